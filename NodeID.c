@@ -1,10 +1,30 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+/**
+ * NodeId Lookup Benchmark
+ * -----------------------
+ * Looks up a value per node by its NodeId, as a publisher does for the fields
+ * of a DataSet in every cycle. The nodes have numeric NodeIds
+ * (``ns=1;i=<n>``) or string NodeIds in the style of ``"the.answer"``
+ * (``ns=1;s=sensor.<n>.value``). A lookup by NodeId hashes and compares the
+ * NodeId in a hash table, see nodeid_intern.h. A lookup by handle indexes
+ * the values with the interned handle. The order of the lookups is random
+ * but the same for all runs. Every run is reported as one JSON object per
+ * line::
+ *
+ *   {"ids":"string","nodes":10000,"lookups":10000000,"nsPerLookup":31.20}
+ */
+
 #include <open62541/plugin/log_stdout.h>
 #include <open62541/server.h>
 #include <open62541/server_config_default.h>
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
-
+#include "nodeid_intern.h"
 
 static void
 variables_nodeids(void) {
@@ -13,14 +33,134 @@ variables_nodeids(void) {
 
     printf("                 %d                  ",id1.identifier.numeric);
 
- 
+
     UA_NodeId_clear(&id1);
 }
 
+static UA_UInt64
+nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UA_UInt64)ts.tv_sec * 1000000000 + (UA_UInt64)ts.tv_nsec;
+}
+
+static void
+report(const char *ids, size_t nodes, size_t lookups, UA_UInt64 ns) {
+    printf("{\"ids\":\"%s\",\"nodes\":%lu,\"lookups\":%lu,\"nsPerLookup\":%.2f}\n",
+           ids, (unsigned long)nodes, (unsigned long)lookups,
+           (UA_Double)ns / (UA_Double)lookups);
+}
 
-int main(void) {
+/* Looks up the values of the nodes in the given order through the table */
+static UA_UInt64
+lookupByNodeId(const NodeIdInternTable *t, const UA_NodeId *ids,
+               const UA_UInt32 *order, size_t lookups, const UA_Int64 *values,
+               UA_Int64 *sum) {
+    UA_UInt64 start = nowNs();
+    for(size_t i = 0; i < lookups; i++) {
+        NodeIdHandle h = NodeIdIntern_find(t, &ids[order[i]]);
+        *sum += values[h];
+    }
+    return nowNs() - start;
+}
 
-    variables_nodeids();
+static UA_UInt64
+lookupByHandle(const NodeIdHandle *handles, const UA_UInt32 *order, size_t lookups,
+               const UA_Int64 *values, UA_Int64 *sum) {
+    UA_UInt64 start = nowNs();
+    for(size_t i = 0; i < lookups; i++)
+        *sum += values[handles[order[i]]];
+    return nowNs() - start;
+}
+
+static int
+bench(size_t nodes, size_t lookups) {
+    UA_NodeId *numericIds = (UA_NodeId*)UA_calloc(nodes, sizeof(UA_NodeId));
+    UA_NodeId *stringIds = (UA_NodeId*)UA_calloc(nodes, sizeof(UA_NodeId));
+    NodeIdHandle *handles = (NodeIdHandle*)UA_calloc(nodes, sizeof(NodeIdHandle));
+    UA_Int64 *values = (UA_Int64*)UA_calloc(nodes, sizeof(UA_Int64));
+    UA_UInt32 *order = (UA_UInt32*)UA_calloc(lookups, sizeof(UA_UInt32));
+    NodeIdInternTable *numericTable = NodeIdIntern_new(nodes);
+    NodeIdInternTable *stringTable = NodeIdIntern_new(nodes);
+    int result = EXIT_FAILURE;
+    if(!numericIds || !stringIds || !handles || !values || !order ||
+       !numericTable || !stringTable)
+        goto cleanup;
+
+    /* The handles of both tables are the same, the nodes are interned in
+     * the same order */
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    for(size_t i = 0; i < nodes && retval == UA_STATUSCODE_GOOD; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "sensor.%lu.value", (unsigned long)i);
+        numericIds[i] = UA_NODEID_NUMERIC(1, (UA_UInt32)(50000 + i));
+        stringIds[i] = UA_NODEID_STRING_ALLOC(1, name);
+        values[i] = (UA_Int64)i;
+        retval = NodeIdIntern_intern(numericTable, &numericIds[i], &handles[i]);
+        retval |= NodeIdIntern_intern(stringTable, &stringIds[i], &handles[i]);
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+        goto cleanup;
+
+    UA_UInt32 x = 2463534242u; /* xorshift32 */
+    for(size_t i = 0; i < lookups; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        order[i] = (UA_UInt32)(x % nodes);
+    }
+
+    /* A warm-up run over the tables, then the measured runs */
+    UA_Int64 sum = 0;
+    lookupByNodeId(stringTable, stringIds, order, lookups < nodes ? lookups : nodes,
+                   values, &sum);
+    report("numeric", nodes, lookups,
+           lookupByNodeId(numericTable, numericIds, order, lookups, values, &sum));
+    report("string", nodes, lookups,
+           lookupByNodeId(stringTable, stringIds, order, lookups, values, &sum));
+    report("interned", nodes, lookups,
+           lookupByHandle(handles, order, lookups, values, &sum));
+    if(sum == 42) /* Keeps the lookups from being optimized out */
+        printf("\n");
+    result = EXIT_SUCCESS;
+
+ cleanup:
+    for(size_t i = 0; stringIds && i < nodes; i++)
+        UA_NodeId_clear(&stringIds[i]);
+    UA_free(numericIds);
+    UA_free(stringIds);
+    UA_free(handles);
+    UA_free(values);
+    UA_free(order);
+    NodeIdIntern_delete(numericTable);
+    NodeIdIntern_delete(stringTable);
+    return result;
+}
+
+static void
+usage(char *progname) {
+    printf("usage: %s [--nodes=10000] [--lookups=10000000] [--print]\n", progname);
+}
 
-    return EXIT_SUCCESS;
+int main(int argc, char **argv) {
+    size_t nodes = 10000;
+    size_t lookups = 10000000;
+    for(int i = 1; i < argc; i++) {
+        if(strncmp(argv[i], "--nodes=", 8) == 0)
+            nodes = strtoul(&argv[i][8], NULL, 10);
+        else if(strncmp(argv[i], "--lookups=", 10) == 0)
+            lookups = strtoul(&argv[i][10], NULL, 10);
+        else if(strcmp(argv[i], "--print") == 0) {
+            variables_nodeids();
+            return EXIT_SUCCESS;
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if(nodes < 1 || nodes > UA_UINT32_MAX - 50000 || lookups < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    return bench(nodes, lookups);
 }
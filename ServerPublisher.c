@@ -23,11 +23,95 @@
 
 #include "open62541.h"
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "SteamEngine.h"
+#include "object_template.h"
 
 UA_NodeId connectionIdent, publishedDataSetIdent, writerGroupIdent;
 
+/* Number of temperature sensors, temp1 to tempN */
+size_t sensorCount = 3;
+
+/**
+ * **Sensor instances**
+ *
+ * The first sensor is added with ``addTemperatureSensorInstance``. All others
+ * are instances of the same type and are added in one pass from an object
+ * template of the type (see ``object_template.h``), so the type hierarchy is
+ * walked once and not once per sensor. As temp1, they have the string NodeIds
+ * ``tempN`` and their children ``tempN.<BrowseName>``.
+ *
+ * The template does not call the lifecycle constructor of the type. Instead,
+ * ``constructTemperatureSensors`` runs once for all sensors of a batch and
+ * numbers them in their node context, from 2 on, so that callbacks can tell
+ * the sensors apart. ``addTemperatureTypeConstructor`` is still registered
+ * after the sensors are added, as before. It runs for sensors that are added
+ * later through the server API, but not for temp1 to tempN. */
+static UA_StatusCode
+constructTemperatureSensors(UA_Server *server, const UA_NodeId *instances,
+                            size_t instancesSize, void *context) {
+    size_t *nextSensor = (size_t*)context;
+    for(size_t i = 0; i < instancesSize; i++) {
+        UA_StatusCode retval =
+            UA_Server_setNodeContext(server, instances[i],
+                                     (void*)(uintptr_t)(*nextSensor)++);
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+addTemperatureSensorInstances(UA_Server *server, UA_UInt16 nsIndex, size_t count) {
+    if(count < 2)
+        return UA_STATUSCODE_GOOD;
+    UA_NodeId typeId;
+    UA_StatusCode retval =
+        ObjectTemplate_getTypeDefinition(server, UA_NODEID_STRING(nsIndex, "temp1"),
+                                         &typeId);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    ObjectTemplate *t = NULL;
+    retval = ObjectTemplate_new(server, typeId, &t);
+    UA_NodeId_deleteMembers(&typeId);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    size_t nextSensor = 2;
+    ObjectTemplate_setConstructor(t, constructTemperatureSensors, &nextSensor);
+
+    size_t n = count - 1;
+    char (*names)[24] = (char (*)[24])UA_malloc(n * sizeof(*names));
+    UA_QualifiedName *browseNames =
+        (UA_QualifiedName*)UA_malloc(n * sizeof(UA_QualifiedName));
+    UA_NodeId *ids = (UA_NodeId*)UA_malloc(n * sizeof(UA_NodeId));
+    if(!names || !browseNames || !ids) {
+        retval = UA_STATUSCODE_BADOUTOFMEMORY;
+        goto cleanup;
+    }
+    for(size_t i = 0; i < n; i++) {
+        snprintf(names[i], sizeof(names[i]), "temp%lu", (unsigned long)(i + 2));
+        browseNames[i] = UA_QUALIFIEDNAME(nsIndex, names[i]);
+        ids[i] = UA_NODEID_STRING(nsIndex, names[i]);
+    }
+    retval = ObjectTemplate_instantiate(t, server,
+                                        UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                        UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                        n, browseNames, ids, NULL);
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                "Added %lu sensors with %lu nodes each: %s",
+                (unsigned long)n, (unsigned long)ObjectTemplate_nodesPerInstance(t),
+                UA_StatusCode_name(retval));
+
+ cleanup:
+    UA_free(names);
+    UA_free(browseNames);
+    UA_free(ids);
+    ObjectTemplate_delete(t);
+    return retval;
+}
+
 static void
 addPubSubConnection(UA_Server *server, UA_String *transportProfile,
                     UA_NetworkAddressUrlDataType *networkAddressUrl){
@@ -192,8 +276,12 @@ static int run(UA_String *transportProfile,
     /*----------------- YOUR CODE HERE --------------------*/
     defineTemperatureSensorType(server);
     addTemperatureSensorInstance(server, 1, "temp1");
-    addTemperatureSensorInstance(server, 1, "temp2");
-    addTemperatureSensorInstance(server, 1, "temp3");
+    retval = addTemperatureSensorInstances(server, 1, sensorCount);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_Server_delete(server);
+        UA_ServerConfig_delete(config);
+        return -1;
+    }
     addTemperatureTypeConstructor(server);
 
     /* Add Value Callback Methods */
@@ -226,7 +314,7 @@ static int run(UA_String *transportProfile,
 
 static void
 usage(char *progname) {
-    printf("usage: %s <uri> [device]\n", progname);
+    printf("usage: %s <uri> [device] [--sensors=<n>]\n", progname);
 }
 
 int main(int argc, char **argv) {
@@ -241,6 +329,21 @@ int main(int argc, char **argv) {
     // IP address with multiple recipients.
     {UA_STRING_NULL , UA_STRING("opc.udp://224.0.0.22:4840/")};
 
+    /* Take out the options, the URI and device are positional */
+    int argn = 1;
+    for(int i = 1; i < argc; i++) {
+        if(strncmp(argv[i], "--sensors=", 10) == 0) {
+            sensorCount = strtoul(&argv[i][10], NULL, 10);
+            if(sensorCount < 1) {
+                printf("Error: at least one sensor is needed\n");
+                return 1;
+            }
+        } else {
+            argv[argn++] = argv[i];
+        }
+    }
+    argc = argn;
+
     if (argc > 1) {
         if (strcmp(argv[1], "-h") == 0) {
             usage(argv[0]);
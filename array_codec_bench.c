@@ -0,0 +1,226 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+/**
+ * Array Codec Benchmark
+ * ---------------------
+ * Encodes and decodes numeric arrays with the array codec of
+ * pubsub_array_codec.h and with the generic binary codec of open62541 (an
+ * array Variant, as a DataSet field). The generic codec only knows the
+ * little-endian order of OPC UA Binary. The big-endian order swaps the
+ * bytes of every element and is measured with every implementation the CPU
+ * supports. Every run is reported as one JSON object per line, with the
+ * array bytes processed per second::
+ *
+ *   {"type":"float","elements":4096,"byteOrder":"big","impl":"avx2",
+ *    "op":"encode","iterations":120000,"GBps":14.210}
+ *
+ * The encoded buffers of the implementations are compared and every decoded
+ * array is checked against the original. */
+
+#include <open62541/types_generated_encoding_binary.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pubsub_array_codec.h"
+
+typedef struct {
+    const char *name;
+    const UA_DataType *type;
+} BenchType;
+
+static size_t elements = 4096;
+static UA_Double duration = 0.2;
+
+static UA_UInt64
+nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UA_UInt64)ts.tv_sec * 1000000000 + (UA_UInt64)ts.tv_nsec;
+}
+
+static void
+report(const BenchType *bt, const char *byteOrder, const char *impl, const char *op,
+       size_t iterations, UA_UInt64 ns) {
+    UA_Double bytes = (UA_Double)elements * bt->type->memSize * (UA_Double)iterations;
+    printf("{\"type\":\"%s\",\"elements\":%lu,\"byteOrder\":\"%s\",\"impl\":\"%s\","
+           "\"op\":\"%s\",\"iterations\":%lu,\"GBps\":%.3f}\n", bt->name,
+           (unsigned long)elements, byteOrder, impl, op, (unsigned long)iterations,
+           bytes / (UA_Double)ns);
+    fflush(stdout);
+}
+
+/* Runs batches of iterations until the duration is over */
+#define BENCH_LOOP(iterations, ns, body) do {                           \
+        UA_UInt64 benchStart = nowNs();                                 \
+        UA_UInt64 benchEnd = benchStart + (UA_UInt64)(duration * 1e9);  \
+        UA_UInt64 benchNow;                                             \
+        iterations = 0;                                                 \
+        do {                                                            \
+            for(size_t batch = 0; batch < 16; batch++) { body; }        \
+            iterations += 16;                                           \
+            benchNow = nowNs();                                         \
+        } while(benchNow < benchEnd);                                   \
+        ns = benchNow - benchStart;                                     \
+    } while(0)
+
+static int
+benchCodec(const BenchType *bt, PubSubArrayCodecByteOrder order, const char *impl,
+           const void *array, UA_ByteString *buf, const UA_ByteString *reference) {
+    const char *byteOrder = order == PUBSUBARRAYCODEC_BIGENDIAN ? "big" : "little";
+    size_t iterations;
+    UA_UInt64 ns;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    UA_Byte *pos;
+    BENCH_LOOP(iterations, ns, {
+        pos = buf->data;
+        retval |= PubSubArrayCodec_encode(array, elements, bt->type, order, &pos,
+                                          &buf->data[buf->length]);
+    });
+    if(retval != UA_STATUSCODE_GOOD ||
+       (reference && memcmp(buf->data, reference->data, reference->length) != 0)) {
+        fprintf(stderr, "Encoding %s with %s failed\n", bt->name, impl);
+        return EXIT_FAILURE;
+    }
+    report(bt, byteOrder, impl, "encode", iterations, ns);
+
+    void *decoded = NULL;
+    size_t decodedSize = 0;
+    BENCH_LOOP(iterations, ns, {
+        size_t offset = 0;
+        UA_Array_delete(decoded, decodedSize, bt->type);
+        retval |= PubSubArrayCodec_decode(buf, &offset, &decoded, &decodedSize,
+                                          bt->type, order);
+    });
+    UA_Boolean equal = decodedSize == elements &&
+        memcmp(decoded, array, elements * bt->type->memSize) == 0;
+    UA_Array_delete(decoded, decodedSize, bt->type);
+    if(retval != UA_STATUSCODE_GOOD || !equal) {
+        fprintf(stderr, "Decoding %s with %s failed\n", bt->name, impl);
+        return EXIT_FAILURE;
+    }
+    report(bt, byteOrder, impl, "decode", iterations, ns);
+    return EXIT_SUCCESS;
+}
+
+static int
+benchGeneric(const BenchType *bt, void *array, UA_ByteString *buf) {
+    UA_Variant value;
+    UA_Variant_setArray(&value, array, elements, bt->type);
+    size_t iterations;
+    UA_UInt64 ns;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    UA_ByteString view = *buf;
+    BENCH_LOOP(iterations, ns, {
+        view.length = buf->length;
+        retval |= UA_encodeBinary(&value, &UA_TYPES[UA_TYPES_VARIANT], &view);
+    });
+    if(retval != UA_STATUSCODE_GOOD) {
+        fprintf(stderr, "Encoding %s with the generic codec failed\n", bt->name);
+        return EXIT_FAILURE;
+    }
+    report(bt, "little", "generic", "encode", iterations, ns);
+
+    UA_Variant decoded;
+    UA_Variant_init(&decoded);
+    BENCH_LOOP(iterations, ns, {
+        size_t offset = 0;
+        UA_Variant_clear(&decoded);
+        retval |= UA_decodeBinary(&view, &offset, &decoded,
+                                  &UA_TYPES[UA_TYPES_VARIANT], NULL);
+    });
+    UA_Variant_clear(&decoded);
+    if(retval != UA_STATUSCODE_GOOD) {
+        fprintf(stderr, "Decoding %s with the generic codec failed\n", bt->name);
+        return EXIT_FAILURE;
+    }
+    report(bt, "little", "generic", "decode", iterations, ns);
+    return EXIT_SUCCESS;
+}
+
+static int
+benchType(const BenchType *bt) {
+    size_t bytes = elements * bt->type->memSize;
+    UA_Byte *array = (UA_Byte*)UA_malloc(bytes);
+    UA_ByteString buf, reference;
+    UA_ByteString_init(&reference);
+    if(!array || UA_ByteString_allocBuffer(&buf, bytes + 64) != UA_STATUSCODE_GOOD) {
+        UA_free(array);
+        return EXIT_FAILURE;
+    }
+    UA_UInt32 x = 2463534242u; /* xorshift32 */
+    for(size_t i = 0; i < bytes; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        array[i] = (UA_Byte)x;
+    }
+
+    int result = benchGeneric(bt, array, &buf);
+    if(result == EXIT_SUCCESS)
+        result = benchCodec(bt, PUBSUBARRAYCODEC_LITTLEENDIAN, "memcpy",
+                            array, &buf, NULL);
+
+    /* The scalar swap is the reference for the vectorized swaps */
+    for(int i = PUBSUBARRAYCODEC_SCALAR;
+        i <= PUBSUBARRAYCODEC_AVX2 && result == EXIT_SUCCESS; i++) {
+        PubSubArrayCodecImpl impl = PubSubArrayCodec_select((PubSubArrayCodecImpl)i);
+        if(impl != (PubSubArrayCodecImpl)i)
+            break; /* Not supported by the CPU */
+        result = benchCodec(bt, PUBSUBARRAYCODEC_BIGENDIAN,
+                            PubSubArrayCodec_implName(impl), array, &buf,
+                            reference.length > 0 ? &reference : NULL);
+        if(result == EXIT_SUCCESS && reference.length == 0) {
+            reference.length = bytes + 4;
+            reference.data = (UA_Byte*)UA_malloc(reference.length);
+            if(!reference.data)
+                result = EXIT_FAILURE;
+            else
+                memcpy(reference.data, buf.data, reference.length);
+        }
+    }
+    PubSubArrayCodec_select(PUBSUBARRAYCODEC_AVX2);
+
+    UA_ByteString_clear(&reference);
+    UA_ByteString_clear(&buf);
+    UA_free(array);
+    return result;
+}
+
+static void
+usage(char *progname) {
+    printf("usage: %s [--elements=4096] [--duration=0.2]\n", progname);
+}
+
+int main(int argc, char **argv) {
+    const BenchType types[] = {
+        {"int16", &UA_TYPES[UA_TYPES_INT16]},
+        {"int32", &UA_TYPES[UA_TYPES_INT32]},
+        {"float", &UA_TYPES[UA_TYPES_FLOAT]},
+        {"double", &UA_TYPES[UA_TYPES_DOUBLE]},
+        {"int64", &UA_TYPES[UA_TYPES_INT64]}
+    };
+
+    for(int i = 1; i < argc; i++) {
+        if(strncmp(argv[i], "--elements=", 11) == 0) {
+            elements = strtoul(&argv[i][11], NULL, 10);
+        } else if(strncmp(argv[i], "--duration=", 11) == 0) {
+            duration = strtod(&argv[i][11], NULL);
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if(elements < 1 || elements > UA_INT32_MAX || duration <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for(size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if(benchType(&types[i]) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
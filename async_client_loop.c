@@ -0,0 +1,352 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "async_client_loop.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define ASYNCCLIENTLOOP_MAXEVENTS 64
+
+typedef enum {
+    ASYNCCLIENT_WAITING,    /* Waiting for the reconnect timer */
+    ASYNCCLIENT_CONNECTING, /* connectAsync was called, session not yet active */
+    ASYNCCLIENT_CONNECTED   /* Session activated */
+} AsyncClientState;
+
+typedef struct {
+    AsyncClientLoop *loop;
+    UA_Client *client;
+    char *endpointUrl;
+    AsyncClientState state;
+    /* The wrapped function */
+    UA_StatusCode (*pollConnection)(UA_Connection *connection, UA_UInt32 timeout,
+                                    const UA_Logger *logger);
+
+    int fd;                 /* -1 if no socket is registered */
+    UA_Boolean awaitWritable;
+
+    UA_DateTime nextIterate;  /* Monotonic */
+    UA_DateTime nextConnect;  /* Monotonic, only in ASYNCCLIENT_WAITING */
+    UA_DateTime connectDeadline;
+    UA_UInt32 backoffMs;
+} AsyncClientEntry;
+
+struct AsyncClientLoop {
+    AsyncClientLoopConfig config;
+    int epfd;
+    AsyncClientEntry **entries;
+    size_t entriesSize;
+    size_t entriesCapacity;
+};
+
+/* The connection is created inside the client. The client whose library
+ * function is currently executed is remembered so that the socket opened by
+ * the wrapped pollConnectionFunc can be attributed to it. The loop is
+ * single-threaded by contract. */
+static AsyncClientEntry *currentEntry = NULL;
+
+static void
+unregisterSocket(AsyncClientEntry *e) {
+    if(e->fd < 0)
+        return;
+    /* Fails with EBADF/ENOENT if the client already closed the socket. The
+     * kernel then removed it from the epoll set already. */
+    epoll_ctl(e->loop->epfd, EPOLL_CTL_DEL, e->fd, NULL);
+    e->fd = -1;
+    e->awaitWritable = false;
+}
+
+static void
+registerSocket(AsyncClientEntry *e, int fd) {
+    AsyncClientLoop *loop = e->loop;
+    if(fd == e->fd)
+        return;
+    unregisterSocket(e);
+    if(fd < 0)
+        return;
+
+    /* The descriptor number may have been recycled from a socket another
+     * client closed in the meantime. That registration is stale. */
+    for(size_t i = 0; i < loop->entriesSize; i++) {
+        if(loop->entries[i] != e && loop->entries[i]->fd == fd) {
+            loop->entries[i]->fd = -1;
+            loop->entries[i]->awaitWritable = false;
+        }
+    }
+
+    /* Wait for writability until the non-blocking connect has completed */
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.ptr = e;
+    if(epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) != 0 &&
+       (errno != EEXIST || epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev) != 0)) {
+        UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_CLIENT,
+                       "%s: Cannot register socket %i with epoll (%s). "
+                       "Falling back to timed iteration",
+                       e->endpointUrl, fd, strerror(errno));
+        return;
+    }
+    e->fd = fd;
+    e->awaitWritable = true;
+}
+
+static void
+stopAwaitWritable(AsyncClientEntry *e) {
+    if(e->fd < 0 || !e->awaitWritable)
+        return;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = e;
+    epoll_ctl(e->loop->epfd, EPOLL_CTL_MOD, e->fd, &ev);
+    e->awaitWritable = false;
+}
+
+/* The socket does not exist after initConnectionFunc yet. It is created and
+ * connected (non-blocking) in the first poll of the connection, so it is
+ * registered from there. The library treats a sockfd of 0 as "no socket". */
+static UA_StatusCode
+pollConnection(UA_Connection *connection, UA_UInt32 timeout,
+               const UA_Logger *logger) {
+    AsyncClientEntry *e = currentEntry;
+    UA_StatusCode retval = (e && e->pollConnection) ?
+        e->pollConnection(connection, timeout, logger) :
+        UA_ClientConnectionTCP_poll(connection, timeout, logger);
+    if(e) {
+        if(connection->state != UA_CONNECTIONSTATE_CLOSED && (int)connection->sockfd > 0)
+            registerSocket(e, (int)connection->sockfd);
+        else
+            unregisterSocket(e);
+    }
+    return retval;
+}
+
+static void
+scheduleReconnect(AsyncClientEntry *e, UA_DateTime now, UA_StatusCode reason) {
+    unregisterSocket(e);
+    currentEntry = e;
+    UA_Client_disconnect(e->client);
+    currentEntry = NULL;
+
+    const AsyncClientLoopConfig *config = &e->loop->config;
+    UA_Double delay = (UA_Double)e->backoffMs;
+    if(config->reconnectJitter > 0.0) {
+        UA_Double r = (UA_Double)UA_UInt32_random() / (UA_Double)UINT32_MAX;
+        delay *= 1.0 + config->reconnectJitter * (2.0 * r - 1.0);
+    }
+
+    UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_CLIENT,
+                   "%s: Not connected (%s). Retrying in %u ms", e->endpointUrl,
+                   UA_StatusCode_name(reason), (unsigned)delay);
+
+    e->state = ASYNCCLIENT_WAITING;
+    e->nextConnect = now + (UA_DateTime)(delay * UA_DATETIME_MSEC);
+    e->backoffMs *= 2;
+    if(e->backoffMs > config->reconnectMaxMs)
+        e->backoffMs = config->reconnectMaxMs;
+}
+
+static void
+startConnect(AsyncClientEntry *e, UA_DateTime now) {
+    e->state = ASYNCCLIENT_CONNECTING;
+    e->nextIterate = now + e->loop->config.iterateIntervalMs * UA_DATETIME_MSEC;
+    e->connectDeadline = now +
+        (UA_DateTime)UA_Client_getConfig(e->client)->timeout * UA_DATETIME_MSEC;
+
+    currentEntry = e;
+    UA_StatusCode retval = UA_Client_connectAsync(e->client, e->endpointUrl);
+    currentEntry = NULL;
+    if(retval != UA_STATUSCODE_GOOD)
+        scheduleReconnect(e, now, retval);
+}
+
+static void
+checkState(AsyncClientEntry *e, UA_DateTime now) {
+    UA_SecureChannelState channelState;
+    UA_SessionState sessionState;
+    UA_StatusCode connectStatus;
+    UA_Client_getState(e->client, &channelState, &sessionState, &connectStatus);
+
+    if(connectStatus != UA_STATUSCODE_GOOD) {
+        scheduleReconnect(e, now, connectStatus);
+        return;
+    }
+
+    if(e->state == ASYNCCLIENT_CONNECTED) {
+        if(channelState != UA_SECURECHANNELSTATE_OPEN)
+            scheduleReconnect(e, now, UA_STATUSCODE_BADCONNECTIONCLOSED);
+        return;
+    }
+
+    /* ASYNCCLIENT_CONNECTING */
+    if(sessionState == UA_SESSIONSTATE_ACTIVATED) {
+        e->state = ASYNCCLIENT_CONNECTED;
+        e->backoffMs = e->loop->config.reconnectInitialMs;
+        stopAwaitWritable(e);
+        return;
+    }
+    if(channelState == UA_SECURECHANNELSTATE_CLOSED || now > e->connectDeadline)
+        scheduleReconnect(e, now, channelState == UA_SECURECHANNELSTATE_CLOSED ?
+                          UA_STATUSCODE_BADCONNECTIONCLOSED : UA_STATUSCODE_BADTIMEOUT);
+}
+
+static void
+iterateEntry(AsyncClientEntry *e, UA_DateTime now) {
+    currentEntry = e;
+    UA_StatusCode retval = UA_Client_run_iterate(e->client, 0);
+    currentEntry = NULL;
+    e->nextIterate = now + e->loop->config.iterateIntervalMs * UA_DATETIME_MSEC;
+    if(retval != UA_STATUSCODE_GOOD) {
+        scheduleReconnect(e, now, retval);
+        return;
+    }
+    checkState(e, now);
+}
+
+AsyncClientLoop *
+AsyncClientLoop_new(const AsyncClientLoopConfig *config) {
+    AsyncClientLoop *loop = (AsyncClientLoop*)UA_calloc(1, sizeof(AsyncClientLoop));
+    if(!loop)
+        return NULL;
+    if(config) {
+        loop->config = *config;
+    } else {
+        AsyncClientLoopConfig defaultConfig = ASYNCCLIENTLOOPCONFIG_DEFAULT;
+        loop->config = defaultConfig;
+    }
+    if(loop->config.iterateIntervalMs == 0)
+        loop->config.iterateIntervalMs = 1;
+    if(loop->config.reconnectInitialMs == 0)
+        loop->config.reconnectInitialMs = 1;
+    if(loop->config.reconnectMaxMs < loop->config.reconnectInitialMs)
+        loop->config.reconnectMaxMs = loop->config.reconnectInitialMs;
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(loop->epfd < 0) {
+        UA_free(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+void
+AsyncClientLoop_delete(AsyncClientLoop *loop) {
+    for(size_t i = 0; i < loop->entriesSize; i++) {
+        AsyncClientEntry *e = loop->entries[i];
+        unregisterSocket(e);
+        UA_Client_delete(e->client); /* Disconnects the client internally */
+        UA_free(e->endpointUrl);
+        UA_free(e);
+    }
+    UA_free(loop->entries);
+    close(loop->epfd);
+    UA_free(loop);
+}
+
+UA_StatusCode
+AsyncClientLoop_addClient(AsyncClientLoop *loop, UA_Client *client,
+                          const char *endpointUrl) {
+    if(!client || !endpointUrl)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+
+    if(loop->entriesSize == loop->entriesCapacity) {
+        size_t newCapacity = loop->entriesCapacity ? 2 * loop->entriesCapacity : 16;
+        AsyncClientEntry **entries = (AsyncClientEntry**)
+            UA_realloc(loop->entries, newCapacity * sizeof(AsyncClientEntry*));
+        if(!entries)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        loop->entries = entries;
+        loop->entriesCapacity = newCapacity;
+    }
+
+    AsyncClientEntry *e = (AsyncClientEntry*)UA_calloc(1, sizeof(AsyncClientEntry));
+    if(!e)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    e->endpointUrl = strdup(endpointUrl);
+    if(!e->endpointUrl) {
+        UA_free(e);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    e->loop = loop;
+    e->client = client;
+    e->fd = -1;
+    e->state = ASYNCCLIENT_WAITING;
+    e->nextConnect = UA_DateTime_nowMonotonic();
+    e->backoffMs = loop->config.reconnectInitialMs;
+
+    /* Hook into the connection setup to learn the socket of the client */
+    UA_ClientConfig *cc = UA_Client_getConfig(client);
+    e->pollConnection = cc->pollConnectionFunc;
+    cc->pollConnectionFunc = pollConnection;
+
+    loop->entries[loop->entriesSize++] = e;
+    return UA_STATUSCODE_GOOD;
+}
+
+size_t
+AsyncClientLoop_getClientCount(const AsyncClientLoop *loop) {
+    return loop->entriesSize;
+}
+
+UA_StatusCode
+AsyncClientLoop_runIterate(AsyncClientLoop *loop, UA_UInt32 timeoutMs) {
+    /* Sleep until the earliest timer of all clients */
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    UA_DateTime wakeup = now + (UA_DateTime)timeoutMs * UA_DATETIME_MSEC;
+    for(size_t i = 0; i < loop->entriesSize; i++) {
+        AsyncClientEntry *e = loop->entries[i];
+        UA_DateTime next = (e->state == ASYNCCLIENT_WAITING) ?
+            e->nextConnect : e->nextIterate;
+        if(next < wakeup)
+            wakeup = next;
+    }
+    int waitMs = 0;
+    if(wakeup > now)
+        waitMs = (int)((wakeup - now + UA_DATETIME_MSEC - 1) / UA_DATETIME_MSEC);
+
+    struct epoll_event events[ASYNCCLIENTLOOP_MAXEVENTS];
+    int n = epoll_wait(loop->epfd, events, ASYNCCLIENTLOOP_MAXEVENTS, waitMs);
+    if(n < 0 && errno != EINTR) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_CLIENT,
+                     "epoll_wait failed (%s)", strerror(errno));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    /* Clients with socket activity */
+    now = UA_DateTime_nowMonotonic();
+    for(int i = 0; i < n; i++) {
+        AsyncClientEntry *e = (AsyncClientEntry*)events[i].data.ptr;
+        if(e->state == ASYNCCLIENT_WAITING)
+            continue; /* Was reset while processing an earlier event */
+        if(events[i].events & EPOLLOUT)
+            stopAwaitWritable(e);
+        iterateEntry(e, now);
+    }
+
+    /* Clients with an expired timer */
+    for(size_t i = 0; i < loop->entriesSize; i++) {
+        AsyncClientEntry *e = loop->entries[i];
+        if(e->state == ASYNCCLIENT_WAITING) {
+            if(now >= e->nextConnect)
+                startConnect(e, now);
+        } else if(now >= e->nextIterate) {
+            iterateEntry(e, now);
+        }
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+AsyncClientLoop_run(AsyncClientLoop *loop, volatile UA_Boolean *running) {
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    while(*running && retval == UA_STATUSCODE_GOOD)
+        retval = AsyncClientLoop_runIterate(loop, 1000);
+    return retval;
+}
@@ -0,0 +1,71 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef ASYNC_CLIENT_LOOP_H_
+#define ASYNC_CLIENT_LOOP_H_
+
+#include <open62541/client_config_default.h>
+
+/**
+ * Async Client Loop
+ * -----------------
+ * Drives many ``UA_Client`` instances from one thread. The sockets of all
+ * clients are multiplexed on a single epoll instance, connections are opened
+ * with ``UA_Client_connectAsync`` and a client that loses its connection is
+ * reconnected after an exponential backoff instead of blocking the loop in
+ * ``UA_sleep_ms``.
+ *
+ * The loop only polls ``UA_Client_getState``. The stateCallback and
+ * clientContext of every client stay available to the application, e.g. to
+ * (re)create subscriptions once a session is activated.
+ *
+ * The loop is not thread-safe. All clients must only be used from the thread
+ * that calls ``AsyncClientLoop_run`` / ``AsyncClientLoop_runIterate``. */
+
+typedef struct {
+    /* Upper bound between two UA_Client_run_iterate calls of a connected
+     * client. Required for the client-internal timers (publish requests,
+     * channel renewal, keep-alive). */
+    UA_UInt32 iterateIntervalMs;
+
+    /* Reconnect backoff. The delay starts at reconnectInitialMs, doubles after
+     * every failed attempt up to reconnectMaxMs and is spread by +/-
+     * reconnectJitter (0..1) so that many clients of a restarted server do
+     * not reconnect in lock-step. */
+    UA_UInt32 reconnectInitialMs;
+    UA_UInt32 reconnectMaxMs;
+    UA_Double reconnectJitter;
+} AsyncClientLoopConfig;
+
+#define ASYNCCLIENTLOOPCONFIG_DEFAULT {50, 500, 30000, 0.2}
+
+typedef struct AsyncClientLoop AsyncClientLoop;
+
+/* Returns NULL if the epoll instance cannot be created. A NULL config selects
+ * ASYNCCLIENTLOOPCONFIG_DEFAULT. */
+AsyncClientLoop *
+AsyncClientLoop_new(const AsyncClientLoopConfig *config);
+
+/* Disconnects and deletes all clients that were added to the loop */
+void
+AsyncClientLoop_delete(AsyncClientLoop *loop);
+
+/* The loop takes ownership of the client. The first connection attempt is
+ * made during the next iteration. */
+UA_StatusCode
+AsyncClientLoop_addClient(AsyncClientLoop *loop, UA_Client *client,
+                          const char *endpointUrl);
+
+size_t
+AsyncClientLoop_getClientCount(const AsyncClientLoop *loop);
+
+/* Waits up to timeoutMs for socket activity or the next timer and processes
+ * all clients that are due */
+UA_StatusCode
+AsyncClientLoop_runIterate(AsyncClientLoop *loop, UA_UInt32 timeoutMs);
+
+/* Iterates until *running is false */
+UA_StatusCode
+AsyncClientLoop_run(AsyncClientLoop *loop, volatile UA_Boolean *running);
+
+#endif /* ASYNC_CLIENT_LOOP_H_ */
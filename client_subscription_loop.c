@@ -5,8 +5,10 @@
  * Client disconnect handling
  * --------------------------
  * This example shows you how to handle a client disconnect, e.g., if the server
- * is shut down while the client is connected. You just need to call connect
- * again and the client will automatically reconnect.
+ * is shut down while the client is connected. The clients are driven by the
+ * AsyncClientLoop (see ``async_client_loop.h``). It connects without blocking
+ * and reconnects with an exponential backoff, so one thread can watch many
+ * servers. Every endpoint URL given on the command line gets its own client.
  *
  * This example is very similar to the tutorial_client_firststeps.c. */
 
@@ -20,6 +22,9 @@
 #include <signal.h>
 #include <stdlib.h>
 
+#include "async_client_loop.h"
+#include "publish_pipeline.h"
+
 UA_Boolean running = true;
 
 
@@ -33,6 +38,7 @@ static void
 handler_currentTimeChanged(UA_Client *client, UA_UInt32 subId, void *subContext,
                            UA_UInt32 monId, void *monContext, UA_DataValue *value) {
     UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND, "currentTime has changed!");
+    PublishPipeline_onNotification((PublishPipeline*)subContext, client, subId, value);
     if(UA_Variant_hasScalarType(&value->value, &UA_TYPES[UA_TYPES_DATETIME])) {
         UA_DateTime raw_date = *(UA_DateTime *) value->value.data;
         UA_DateTimeStruct dts = UA_DateTime_toStruct(raw_date);
@@ -44,6 +50,7 @@ handler_currentTimeChanged(UA_Client *client, UA_UInt32 subId, void *subContext,
 
 static void
 deleteSubscriptionCallback(UA_Client *client, UA_UInt32 subscriptionId, void *subscriptionContext) {
+    PublishPipeline_removeSubscription((PublishPipeline*)subscriptionContext, subscriptionId);
     UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
                 "Subscription Id %u was deleted", subscriptionId);
 }
@@ -53,6 +60,50 @@ subscriptionInactivityCallback (UA_Client *client, UA_UInt32 subId, void *subCon
     UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND, "Inactivity for subscription %u", subId);
 }
 
+static void
+monitoredItemCreated(UA_Client *client, void *userdata, UA_UInt32 requestId,
+                     void *r) {
+    UA_CreateMonitoredItemsResponse *response = (UA_CreateMonitoredItemsResponse*)r;
+    if(response->responseHeader.serviceResult == UA_STATUSCODE_GOOD &&
+       response->resultsSize == 1 &&
+       response->results[0].statusCode == UA_STATUSCODE_GOOD)
+        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                    "Monitoring UA_NS0ID_SERVER_SERVERSTATUS_CURRENTTIME', id %u",
+                    response->results[0].monitoredItemId);
+}
+
+static void
+subscriptionCreated(UA_Client *client, void *userdata, UA_UInt32 requestId,
+                    void *r) {
+    UA_CreateSubscriptionResponse *response = (UA_CreateSubscriptionResponse*)r;
+    if(response->responseHeader.serviceResult == UA_STATUSCODE_GOOD)
+        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                    "Create subscription succeeded, id %u, publishing interval %.1f ms",
+                    response->subscriptionId, response->revisedPublishingInterval);
+    else
+        return;
+    PublishPipeline_addSubscription((PublishPipeline*)userdata, response);
+
+    /* Add a MonitoredItem */
+    UA_NodeId currentTimeNode =
+        UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_SERVERSTATUS_CURRENTTIME);
+    UA_MonitoredItemCreateRequest monRequest =
+        UA_MonitoredItemCreateRequest_default(currentTimeNode);
+    UA_CreateMonitoredItemsRequest request;
+    UA_CreateMonitoredItemsRequest_init(&request);
+    request.subscriptionId = response->subscriptionId;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_BOTH;
+    request.itemsToCreate = &monRequest;
+    request.itemsToCreateSize = 1;
+
+    void *context = NULL;
+    UA_Client_DataChangeNotificationCallback callback = handler_currentTimeChanged;
+    UA_Client_DeleteMonitoredItemCallback deleteCallback = NULL;
+    UA_Client_MonitoredItems_createDataChanges_async(client, request, &context,
+                                                     &callback, &deleteCallback,
+                                                     monitoredItemCreated, NULL, NULL);
+}
+
 static void
 stateCallback(UA_Client *client, UA_SecureChannelState channelState,
               UA_SessionState sessionState, UA_StatusCode recoveryStatus) {
@@ -78,31 +129,14 @@ stateCallback(UA_Client *client, UA_SecureChannelState channelState,
     case UA_SESSIONSTATE_ACTIVATED: {
         UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND, "A session with the server is activated");
         /* A new session was created. We need to create the subscription. */
-        /* Create a subscription */
-        UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
-        UA_CreateSubscriptionResponse response =
-            UA_Client_Subscriptions_create(client, request, NULL, NULL, deleteSubscriptionCallback);
-            if(response.responseHeader.serviceResult == UA_STATUSCODE_GOOD)
-                UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                            "Create subscription succeeded, id %u",
-                            response.subscriptionId);
-            else
-                return;
-
-            /* Add a MonitoredItem */
-            UA_NodeId currentTimeNode =
-                UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_SERVERSTATUS_CURRENTTIME);
-            UA_MonitoredItemCreateRequest monRequest =
-                UA_MonitoredItemCreateRequest_default(currentTimeNode);
-
-            UA_MonitoredItemCreateResult monResponse =
-                UA_Client_MonitoredItems_createDataChange(client, response.subscriptionId,
-                                                          UA_TIMESTAMPSTORETURN_BOTH, monRequest,
-                                                          NULL, handler_currentTimeChanged, NULL);
-            if(monResponse.statusCode == UA_STATUSCODE_GOOD)
-                UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                            "Monitoring UA_NS0ID_SERVER_SERVERSTATUS_CURRENTTIME', id %u",
-                            monResponse.monitoredItemId);
+        /* Create a subscription. The PublishPipeline of the client sets the
+         * subscription parameters and adapts the PublishRequests in flight. */
+        PublishPipeline *pipe = (PublishPipeline*)UA_Client_getContext(client);
+        UA_CreateSubscriptionRequest request = PublishPipeline_createRequest(pipe);
+        /* The clients share one thread. Do not block it for a round-trip. */
+        UA_Client_Subscriptions_create_async(client, request, pipe, NULL,
+                                             deleteSubscriptionCallback,
+                                             subscriptionCreated, pipe, NULL);
         }
         break;
     case UA_SESSIONSTATE_CLOSED:
@@ -114,37 +148,59 @@ stateCallback(UA_Client *client, UA_SecureChannelState channelState,
 }
 
 int
-main(void) {
+main(int argc, char **argv) {
     signal(SIGINT, stopHandler); /* catches ctrl-c */
 
-    UA_Client *client = UA_Client_new();
-    UA_ClientConfig *cc = UA_Client_getConfig(client);
-    UA_ClientConfig_setDefault(cc);
-
-
-    /* Set stateCallback */
-    cc->stateCallback = stateCallback;
-    cc->subscriptionInactivityCallback = subscriptionInactivityCallback;
-
-    /* Endless loop runAsync */
-    while(running) {
-        /* if already connected, this will return GOOD and do nothing */
-        /* if the connection is closed/errored, the connection will be reset and then reconnected */
-        /* Alternatively you can also use UA_Client_getState to get the current state */
-        UA_StatusCode retval = UA_Client_connect(client, "opc.tcp://localhost:4801");
-        if(retval != UA_STATUSCODE_GOOD) {
-            UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                         "Not connected. Retrying to connect in 1 second");
-            /* The connect may timeout after 1 second (see above) or it may fail immediately on network errors */
-            /* E.g. name resolution errors or unreachable network. Thus there should be a small sleep here */
-            UA_sleep_ms(1000);
-            continue;
+    AsyncClientLoop *loop = AsyncClientLoop_new(NULL);
+    if(!loop)
+        return EXIT_FAILURE;
+
+    /* Subscription and pipelining parameters shared by all clients */
+    PublishPipelineConfig pipeConfig = PUBLISHPIPELINECONFIG_DEFAULT;
+    pipeConfig.publishingIntervalMs = 100.0;
+    pipeConfig.maxKeepAliveCount = 10;
+
+    const char *defaultUrl = "opc.tcp://localhost:4801";
+    int urlCount = (argc > 1) ? argc - 1 : 1;
+    PublishPipeline **pipes = (PublishPipeline**)
+        UA_calloc((size_t)urlCount, sizeof(PublishPipeline*));
+    if(!pipes) {
+        AsyncClientLoop_delete(loop);
+        return EXIT_FAILURE;
+    }
+    for(int i = 0; i < urlCount; i++) {
+        const char *url = (argc > 1) ? argv[i + 1] : defaultUrl;
+        pipes[i] = PublishPipeline_new(&pipeConfig);
+        UA_Client *client = UA_Client_new();
+        UA_ClientConfig *cc = UA_Client_getConfig(client);
+        UA_ClientConfig_setDefault(cc);
+        cc->clientContext = pipes[i];
+        cc->outStandingPublishRequests = pipeConfig.minPublishRequests;
+
+        /* Set stateCallback */
+        cc->stateCallback = stateCallback;
+        cc->subscriptionInactivityCallback = subscriptionInactivityCallback;
+
+        /* The loop connects the client and reconnects it after a
+         * connection loss */
+        if(!pipes[i] ||
+           AsyncClientLoop_addClient(loop, client, url) != UA_STATUSCODE_GOOD) {
+            UA_Client_delete(client);
+            urlCount = i + 1;
+            running = false;
+            break;
         }
+    }
 
-        UA_Client_run_iterate(client, 1000);
-    };
+    UA_StatusCode retval = running ?
+        AsyncClientLoop_run(loop, &running) : UA_STATUSCODE_BADOUTOFMEMORY;
 
     /* Clean up */
-    UA_Client_delete(client); /* Disconnects the client internally */
-    return EXIT_SUCCESS;
+    AsyncClientLoop_delete(loop); /* Disconnects the clients internally */
+    for(int i = 0; i < urlCount; i++) {
+        if(pipes[i])
+            PublishPipeline_delete(pipes[i]);
+    }
+    UA_free(pipes);
+    return retval == UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,553 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "concurrent_nodestore.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define ADD(p, n) __atomic_fetch_add(p, n, __ATOMIC_RELAXED)
+#define SUB(p, n) __atomic_fetch_sub(p, n, __ATOMIC_RELAXED)
+
+#define RECLAIMBATCH 64      /* Retired versions before the readers are checked */
+#define FIRSTNUMERICID 50000 /* For nodes inserted with ns=x;i=0 */
+
+typedef struct Entry Entry;
+
+/* A version of a node. The node is followed by the members of its class. */
+typedef struct Version {
+    struct Version *retiredNext;
+    UA_UInt64 retiredEpoch;
+    Entry *removedEntry;  /* Freed with the version */
+    UA_UInt64 serial;     /* Unique, set when the version becomes current */
+    UA_UInt64 origSerial; /* For copies: the serial of the copied version */
+    UA_Node node;
+} Version;
+
+#define VERSION(n) \
+    ((Version*)(uintptr_t)((const UA_Byte*)(n) - offsetof(Version, node)))
+
+struct Entry {
+    Entry *next;      /* Chain of the bucket */
+    UA_UInt32 hash;
+    Version *current; /* NULL once removed */
+};
+
+typedef struct {
+    Entry **buckets;
+    size_t mask;
+    pthread_mutex_t storeLock; /* Insert and remove */
+    pthread_mutex_t writeLocks[CONCURRENTNODESTORE_WRITELOCKS];
+    pthread_mutex_t retireLock;
+    Version *retired;
+    size_t retiredSize;
+    UA_UInt32 nextNumericId;
+    UA_UInt64 serial;
+    ConcurrentNodestoreStats stats;
+} Store;
+
+/**
+ * Epochs
+ * ^^^^^^
+ * Every thread that reads has a record with the global epoch at the start
+ * of its read, 0 outside of reads. Reads nest, only the outermost read sets
+ * the epoch. A version is retired with the current global epoch, which is
+ * then incremented. Readers that start afterwards cannot find the version.
+ * It is freed once no record has an epoch less than or equal to its retire
+ * epoch.
+ *
+ * The records are shared by all nodestores. A record is reused by a new
+ * thread after its thread has ended. Records are never freed. */
+
+typedef struct ThreadRecord {
+    struct ThreadRecord *next;
+    UA_UInt64 epoch;
+    size_t nesting;
+    UA_Boolean used;
+} ThreadRecord;
+
+static UA_UInt64 globalEpoch = 1;
+static ThreadRecord *records = NULL;
+static __thread ThreadRecord *localRecord = NULL;
+static pthread_key_t recordKey;
+static pthread_once_t recordKeyOnce = PTHREAD_ONCE_INIT;
+
+static void
+releaseRecord(void *data) {
+    ThreadRecord *r = (ThreadRecord*)data;
+    STORE(&r->epoch, 0);
+    STORE(&r->used, false);
+}
+
+static void
+createRecordKey(void) {
+    pthread_key_create(&recordKey, releaseRecord);
+}
+
+static ThreadRecord *
+getRecord(void) {
+    if(UA_LIKELY(localRecord != NULL))
+        return localRecord;
+    pthread_once(&recordKeyOnce, createRecordKey);
+    ThreadRecord *r = LOAD(&records);
+    for(; r; r = r->next) {
+        UA_Boolean expected = false;
+        if(!LOAD(&r->used) &&
+           __atomic_compare_exchange_n(&r->used, &expected, true, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+    if(!r) {
+        r = (ThreadRecord*)UA_calloc(1, sizeof(ThreadRecord));
+        if(!r)
+            return NULL;
+        r->used = true;
+        r->next = __atomic_load_n(&records, __ATOMIC_RELAXED);
+        while(!__atomic_compare_exchange_n(&records, &r->next, r, true,
+                                           __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+    }
+    r->nesting = 0;
+    pthread_setspecific(recordKey, r);
+    localRecord = r;
+    return r;
+}
+
+static UA_Boolean
+enterEpoch(void) {
+    ThreadRecord *r = getRecord();
+    if(!r)
+        return false;
+    if(r->nesting++ > 0)
+        return true;
+    /* Publish the epoch, then check that it did not move in between. Else a
+     * reclaim could have missed the record and freed what we read next. */
+    UA_UInt64 e = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+    for(;;) {
+        __atomic_store_n(&r->epoch, e, __ATOMIC_SEQ_CST);
+        UA_UInt64 again = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+        if(again == e)
+            break;
+        e = again;
+    }
+    return true;
+}
+
+static void
+leaveEpoch(void) {
+    ThreadRecord *r = localRecord;
+    if(--r->nesting == 0)
+        STORE(&r->epoch, 0);
+}
+
+static void
+freeVersion(Version *v) {
+    UA_Node_clear(&v->node);
+    UA_free(v->removedEntry);
+    UA_free(v);
+}
+
+/* Called with the retire lock */
+static void
+reclaim(Store *s) {
+    UA_UInt64 min = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+    for(ThreadRecord *r = LOAD(&records); r; r = r->next) {
+        UA_UInt64 e = __atomic_load_n(&r->epoch, __ATOMIC_SEQ_CST);
+        if(e != 0 && e < min)
+            min = e;
+    }
+    Version **pv = &s->retired;
+    while(*pv) {
+        Version *v = *pv;
+        if(v->retiredEpoch >= min) {
+            pv = &v->retiredNext;
+            continue;
+        }
+        *pv = v->retiredNext;
+        freeVersion(v);
+        s->retiredSize--;
+        SUB(&s->stats.retired, 1);
+        ADD(&s->stats.reclaimed, 1);
+    }
+}
+
+/* The version is no longer reachable from the table */
+static void
+retire(Store *s, Version *v) {
+    pthread_mutex_lock(&s->retireLock);
+    v->retiredEpoch = __atomic_fetch_add(&globalEpoch, 1, __ATOMIC_SEQ_CST);
+    v->retiredNext = s->retired;
+    s->retired = v;
+    s->retiredSize++;
+    ADD(&s->stats.retired, 1);
+    if(s->retiredSize >= RECLAIMBATCH)
+        reclaim(s);
+    pthread_mutex_unlock(&s->retireLock);
+}
+
+/**
+ * Table
+ * ^^^^^ */
+
+static size_t
+nodeSize(UA_NodeClass nodeClass) {
+    switch(nodeClass) {
+    case UA_NODECLASS_OBJECT: return sizeof(UA_ObjectNode);
+    case UA_NODECLASS_VARIABLE: return sizeof(UA_VariableNode);
+    case UA_NODECLASS_METHOD: return sizeof(UA_MethodNode);
+    case UA_NODECLASS_OBJECTTYPE: return sizeof(UA_ObjectTypeNode);
+    case UA_NODECLASS_VARIABLETYPE: return sizeof(UA_VariableTypeNode);
+    case UA_NODECLASS_REFERENCETYPE: return sizeof(UA_ReferenceTypeNode);
+    case UA_NODECLASS_DATATYPE: return sizeof(UA_DataTypeNode);
+    case UA_NODECLASS_VIEW: return sizeof(UA_ViewNode);
+    default: return 0;
+    }
+}
+
+static Version *
+newVersion(UA_NodeClass nodeClass) {
+    size_t size = nodeSize(nodeClass);
+    if(size == 0)
+        return NULL;
+    Version *v = (Version*)UA_calloc(1, offsetof(Version, node) + size);
+    if(!v)
+        return NULL;
+    v->node.nodeClass = nodeClass;
+    return v;
+}
+
+static void
+deleteVersion(Version *v) {
+    UA_Node_clear(&v->node);
+    UA_free(v);
+}
+
+static UA_UInt64
+nextSerial(Store *s) {
+    return ADD(&s->serial, 1) + 1;
+}
+
+static pthread_mutex_t *
+writeLock(Store *s, UA_UInt32 hash) {
+    return &s->writeLocks[hash % CONCURRENTNODESTORE_WRITELOCKS];
+}
+
+/* Must be called within an epoch */
+static Entry *
+findEntry(const Store *s, const UA_NodeId *nodeId, UA_UInt32 hash, Version **current) {
+    Entry *e = LOAD(&s->buckets[hash & s->mask]);
+    for(; e; e = LOAD(&e->next)) {
+        if(e->hash != hash)
+            continue;
+        Version *v = LOAD(&e->current);
+        if(v && UA_NodeId_equal(&v->node.nodeId, nodeId)) {
+            if(current)
+                *current = v;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static UA_StatusCode
+copyCurrent(Store *s, const UA_NodeId *nodeId, UA_UInt32 hash, Version **out) {
+    if(!enterEpoch())
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    UA_StatusCode retval = UA_STATUSCODE_BADNODEIDUNKNOWN;
+    Version *cur = NULL;
+    if(findEntry(s, nodeId, hash, &cur)) {
+        Version *v = newVersion(cur->node.nodeClass);
+        retval = UA_STATUSCODE_BADOUTOFMEMORY;
+        if(v) {
+            retval = UA_Node_copy(&cur->node, &v->node);
+            if(retval == UA_STATUSCODE_GOOD) {
+                v->origSerial = cur->serial;
+                *out = v;
+            } else {
+                UA_free(v);
+            }
+        }
+    }
+    leaveEpoch();
+    return retval;
+}
+
+/* Takes ownership of the version */
+static UA_StatusCode
+replaceVersion(Store *s, Version *v, UA_UInt32 hash) {
+    if(!enterEpoch()) {
+        deleteVersion(v);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    pthread_mutex_t *lock = writeLock(s, hash);
+    pthread_mutex_lock(lock);
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    Version *cur = NULL;
+    Entry *e = findEntry(s, &v->node.nodeId, hash, &cur);
+    if(!e) {
+        retval = UA_STATUSCODE_BADNODEIDUNKNOWN;
+    } else if(cur->serial != v->origSerial) {
+        retval = UA_STATUSCODE_BADINTERNALERROR;
+        ADD(&s->stats.conflicts, 1);
+    } else {
+        v->serial = nextSerial(s);
+        STORE(&e->current, v);
+        ADD(&s->stats.replaced, 1);
+    }
+    pthread_mutex_unlock(lock);
+    leaveEpoch();
+    if(retval == UA_STATUSCODE_GOOD)
+        retire(s, cur);
+    else
+        deleteVersion(v);
+    return retval;
+}
+
+/**
+ * Nodestore Interface
+ * ^^^^^^^^^^^^^^^^^^^ */
+
+static UA_Node *
+csNewNode(void *nsCtx, UA_NodeClass nodeClass) {
+    Version *v = newVersion(nodeClass);
+    return v ? &v->node : NULL;
+}
+
+static void
+csDeleteNode(void *nsCtx, UA_Node *node) {
+    deleteVersion(VERSION(node));
+}
+
+static const UA_Node *
+csGetNode(void *nsCtx, const UA_NodeId *nodeId) {
+    if(!enterEpoch())
+        return NULL;
+    Version *v = NULL;
+    if(!findEntry((Store*)nsCtx, nodeId, UA_NodeId_hash(nodeId), &v)) {
+        leaveEpoch();
+        return NULL;
+    }
+    return &v->node;
+}
+
+static void
+csReleaseNode(void *nsCtx, const UA_Node *node) {
+    if(node)
+        leaveEpoch();
+}
+
+static UA_StatusCode
+csGetNodeCopy(void *nsCtx, const UA_NodeId *nodeId, UA_Node **outNode) {
+    Version *v = NULL;
+    UA_StatusCode retval =
+        copyCurrent((Store*)nsCtx, nodeId, UA_NodeId_hash(nodeId), &v);
+    if(retval == UA_STATUSCODE_GOOD)
+        *outNode = &v->node;
+    return retval;
+}
+
+static UA_StatusCode
+csInsertNode(void *nsCtx, UA_Node *node, UA_NodeId *addedNodeId) {
+    Store *s = (Store*)nsCtx;
+    Version *v = VERSION(node);
+    if(!enterEpoch()) {
+        deleteVersion(v);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    pthread_mutex_lock(&s->storeLock);
+
+    /* Find a free numeric identifier for ns=x;i=0 */
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    UA_NodeId *id = &node->nodeId;
+    if(id->identifierType == UA_NODEIDTYPE_NUMERIC && id->identifier.numeric == 0) {
+        do {
+            id->identifier.numeric = s->nextNumericId++;
+            if(s->nextNumericId == 0)
+                s->nextNumericId = FIRSTNUMERICID;
+        } while(findEntry(s, id, UA_NodeId_hash(id), NULL));
+    } else if(findEntry(s, id, UA_NodeId_hash(id), NULL)) {
+        retval = UA_STATUSCODE_BADNODEIDEXISTS;
+    }
+
+    Entry *e = NULL;
+    if(retval == UA_STATUSCODE_GOOD) {
+        e = (Entry*)UA_calloc(1, sizeof(Entry));
+        if(!e)
+            retval = UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    if(retval == UA_STATUSCODE_GOOD && addedNodeId)
+        retval = UA_NodeId_copy(id, addedNodeId);
+    if(retval == UA_STATUSCODE_GOOD) {
+        e->hash = UA_NodeId_hash(id);
+        v->serial = nextSerial(s);
+        e->current = v;
+        Entry **bucket = &s->buckets[e->hash & s->mask];
+        e->next = *bucket;
+        STORE(bucket, e);
+        ADD(&s->stats.nodes, 1);
+    }
+
+    pthread_mutex_unlock(&s->storeLock);
+    leaveEpoch();
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_free(e);
+        deleteVersion(v);
+    }
+    return retval;
+}
+
+static UA_StatusCode
+csReplaceNode(void *nsCtx, UA_Node *node) {
+    return replaceVersion((Store*)nsCtx, VERSION(node), UA_NodeId_hash(&node->nodeId));
+}
+
+static UA_StatusCode
+csRemoveNode(void *nsCtx, const UA_NodeId *nodeId) {
+    Store *s = (Store*)nsCtx;
+    UA_UInt32 hash = UA_NodeId_hash(nodeId);
+    if(!enterEpoch())
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    pthread_mutex_lock(&s->storeLock);
+    pthread_mutex_t *lock = writeLock(s, hash);
+    pthread_mutex_lock(lock);
+
+    /* Readers on the entry can still follow its next pointer */
+    Version *cur = NULL;
+    for(Entry **pe = &s->buckets[hash & s->mask]; *pe; pe = &(*pe)->next) {
+        Entry *e = *pe;
+        Version *v = e->current;
+        if(e->hash != hash || !v || !UA_NodeId_equal(&v->node.nodeId, nodeId))
+            continue;
+        STORE(pe, e->next);
+        STORE(&e->current, NULL);
+        v->removedEntry = e;
+        cur = v;
+        break;
+    }
+
+    pthread_mutex_unlock(lock);
+    pthread_mutex_unlock(&s->storeLock);
+    leaveEpoch();
+    if(!cur)
+        return UA_STATUSCODE_BADNODEIDUNKNOWN;
+    SUB(&s->stats.nodes, 1);
+    retire(s, cur);
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+csIterate(void *nsCtx, UA_NodestoreVisitor visitor, void *visitorCtx) {
+    Store *s = (Store*)nsCtx;
+    if(!enterEpoch())
+        return;
+    for(size_t i = 0; i <= s->mask; i++) {
+        for(Entry *e = LOAD(&s->buckets[i]); e; e = LOAD(&e->next)) {
+            Version *v = LOAD(&e->current);
+            if(v)
+                visitor(visitorCtx, &v->node);
+        }
+    }
+    leaveEpoch();
+}
+
+/* No other thread uses the nodestore anymore */
+static void
+csClear(void *nsCtx) {
+    Store *s = (Store*)nsCtx;
+    if(!s)
+        return;
+    for(size_t i = 0; i <= s->mask; i++) {
+        Entry *e = s->buckets[i];
+        while(e) {
+            Entry *next = e->next;
+            deleteVersion(e->current);
+            UA_free(e);
+            e = next;
+        }
+    }
+    while(s->retired) {
+        Version *v = s->retired;
+        s->retired = v->retiredNext;
+        freeVersion(v);
+    }
+    for(size_t i = 0; i < CONCURRENTNODESTORE_WRITELOCKS; i++)
+        pthread_mutex_destroy(&s->writeLocks[i]);
+    pthread_mutex_destroy(&s->storeLock);
+    pthread_mutex_destroy(&s->retireLock);
+    UA_free(s->buckets);
+    UA_free(s);
+}
+
+UA_StatusCode
+ConcurrentNodestore_init(UA_Nodestore *ns, size_t buckets) {
+    if(buckets == 0)
+        buckets = CONCURRENTNODESTORE_DEFAULTBUCKETS;
+    size_t size = 1;
+    while(size < buckets)
+        size *= 2;
+    Store *s = (Store*)UA_calloc(1, sizeof(Store));
+    if(!s)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    s->buckets = (Entry**)UA_calloc(size, sizeof(Entry*));
+    if(!s->buckets) {
+        UA_free(s);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    s->mask = size - 1;
+    s->nextNumericId = FIRSTNUMERICID;
+    pthread_mutex_init(&s->storeLock, NULL);
+    pthread_mutex_init(&s->retireLock, NULL);
+    for(size_t i = 0; i < CONCURRENTNODESTORE_WRITELOCKS; i++)
+        pthread_mutex_init(&s->writeLocks[i], NULL);
+
+    ns->context = s;
+    ns->clear = csClear;
+    ns->newNode = csNewNode;
+    ns->deleteNode = csDeleteNode;
+    ns->getNode = csGetNode;
+    ns->releaseNode = csReleaseNode;
+    ns->getNodeCopy = csGetNodeCopy;
+    ns->insertNode = csInsertNode;
+    ns->replaceNode = csReplaceNode;
+    ns->removeNode = csRemoveNode;
+    ns->iterate = csIterate;
+    return UA_STATUSCODE_GOOD;
+}
+
+/**
+ * Values
+ * ^^^^^^ */
+
+UA_StatusCode
+ConcurrentNodestore_readValue(const UA_Nodestore *ns, const UA_NodeId *nodeId,
+                              UA_UInt32 hash, UA_DataValue *value) {
+    if(!enterEpoch())
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    Version *v = NULL;
+    UA_StatusCode retval = UA_STATUSCODE_BADNODEIDUNKNOWN;
+    if(findEntry((Store*)ns->context, nodeId, hash, &v)) {
+        const UA_VariableNode *vn = (const UA_VariableNode*)&v->node;
+        if(v->node.nodeClass != UA_NODECLASS_VARIABLE)
+            retval = UA_STATUSCODE_BADNODECLASSINVALID;
+        else if(vn->valueSource != UA_VALUESOURCE_DATA ||
+                vn->value.data.callback.onRead)
+            retval = UA_STATUSCODE_BADNOTSUPPORTED;
+        else
+            retval = UA_DataValue_copy(&vn->value.data.value, value);
+    }
+    leaveEpoch();
+    return retval;
+}
+
+void
+ConcurrentNodestore_getStats(const UA_Nodestore *ns, ConcurrentNodestoreStats *stats) {
+    Store *s = (Store*)ns->context;
+    stats->nodes = __atomic_load_n(&s->stats.nodes, __ATOMIC_RELAXED);
+    stats->replaced = __atomic_load_n(&s->stats.replaced, __ATOMIC_RELAXED);
+    stats->conflicts = __atomic_load_n(&s->stats.conflicts, __ATOMIC_RELAXED);
+    stats->retired = __atomic_load_n(&s->stats.retired, __ATOMIC_RELAXED);
+    stats->reclaimed = __atomic_load_n(&s->stats.reclaimed, __ATOMIC_RELAXED);
+}
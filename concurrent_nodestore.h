@@ -0,0 +1,66 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef CONCURRENT_NODESTORE_H_
+#define CONCURRENT_NODESTORE_H_
+
+#include <open62541/plugin/nodestore.h>
+
+/**
+ * Concurrent Nodestore
+ * --------------------
+ * The default nodestore of open62541 is not thread-safe. Everything that
+ * touches the information model, PubSub sampling, value callbacks and client
+ * sessions, runs under the server lock or on the server thread. This
+ * nodestore can be read from any number of threads without locks:
+ *
+ * - Nodes are never changed in place. ``getNodeCopy`` and ``replaceNode``
+ *   make a new version of the node, which replaces the current version with
+ *   one pointer store. A reader sees either the old or the new version,
+ *   never a mix, so every write is atomic per node.
+ * - Readers announce the epoch in which they started (between ``getNode``
+ *   and ``releaseNode``). A replaced or removed version is freed once every
+ *   reader that could still hold it has left its epoch. Readers never wait
+ *   and never write shared memory besides their own epoch.
+ * - Replacing a node takes one of CONCURRENTNODESTORE_WRITELOCKS locks,
+ *   selected by the hash of the NodeId. Writers of different nodes rarely
+ *   wait for each other. A replace fails with BADINTERNALERROR if the node
+ *   was replaced since the copy was made, as in the default nodestore.
+ *   Inserting and removing nodes take one lock for the store.
+ *
+ * The buckets of the hash table are fixed when the nodestore is created,
+ * their chains grow with the nodes. ``ConcurrentNodestore_readValue`` gives
+ * threads outside the server, such as publish workers, direct access to the
+ * value of a variable. It takes the hash of the NodeId, e.g.
+ * ``NodeIdIntern_hash`` of an interned NodeId (see nodeid_intern.h), so the
+ * NodeId is not hashed again.
+ *
+ * To use the nodestore, replace the nodestore of the server config before
+ * the server is created with ``UA_Server_newWithConfig``. */
+
+#define CONCURRENTNODESTORE_DEFAULTBUCKETS 16384
+#define CONCURRENTNODESTORE_WRITELOCKS 64
+
+typedef struct {
+    UA_UInt64 nodes;
+    UA_UInt64 replaced;  /* Node versions that became current by a replace */
+    UA_UInt64 conflicts; /* Replaces that lost against another write */
+    UA_UInt64 retired;   /* Versions waiting for the readers to leave */
+    UA_UInt64 reclaimed; /* Versions freed */
+} ConcurrentNodestoreStats;
+
+/* buckets is rounded up to a power of two, 0 for the default */
+UA_StatusCode
+ConcurrentNodestore_init(UA_Nodestore *ns, size_t buckets);
+
+/* Copies the value of a variable node. Fails with BADNOTSUPPORTED if the
+ * value comes from a DataSource or has an onRead callback, read it through
+ * the server then. hash is UA_NodeId_hash(nodeId). */
+UA_StatusCode
+ConcurrentNodestore_readValue(const UA_Nodestore *ns, const UA_NodeId *nodeId,
+                              UA_UInt32 hash, UA_DataValue *value);
+
+void
+ConcurrentNodestore_getStats(const UA_Nodestore *ns, ConcurrentNodestoreStats *stats);
+
+#endif /* CONCURRENT_NODESTORE_H_ */
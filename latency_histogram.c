@@ -0,0 +1,103 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "latency_histogram.h"
+
+#include <string.h>
+
+/* Single writer: a relaxed load/store pair is enough, no read-modify-write
+ * instruction is needed. The atomic accesses only prevent torn reads. */
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+
+static size_t
+bucketIndex(UA_UInt64 value) {
+    if(value < LATENCYHISTOGRAM_SUBBUCKETS)
+        return (size_t)value;
+    unsigned msb = 63u - (unsigned)__builtin_clzll(value);
+    if(msb >= LATENCYHISTOGRAM_MAX_BITS)
+        return LATENCYHISTOGRAM_BUCKETS - 1;
+    unsigned shift = msb - LATENCYHISTOGRAM_SUBBUCKET_BITS;
+    return (size_t)(shift + 1) * LATENCYHISTOGRAM_SUBBUCKETS +
+        (size_t)((value >> shift) - LATENCYHISTOGRAM_SUBBUCKETS);
+}
+
+/* Midpoint of the value range covered by a bucket */
+static UA_UInt64
+bucketValue(size_t index) {
+    if(index < LATENCYHISTOGRAM_SUBBUCKETS)
+        return (UA_UInt64)index;
+    unsigned shift = (unsigned)(index / LATENCYHISTOGRAM_SUBBUCKETS) - 1;
+    UA_UInt64 lower = (UA_UInt64)(LATENCYHISTOGRAM_SUBBUCKETS +
+                                  index % LATENCYHISTOGRAM_SUBBUCKETS) << shift;
+    return lower + (((UA_UInt64)1 << shift) >> 1);
+}
+
+void
+LatencyHistogram_init(LatencyHistogram *h) {
+    memset(h, 0, sizeof(LatencyHistogram));
+    h->min = UINT64_MAX;
+}
+
+void
+LatencyHistogram_record(LatencyHistogram *h, UA_UInt64 value) {
+    UA_UInt64 *bucket = &h->buckets[bucketIndex(value)];
+    STORE(bucket, LOAD(bucket) + 1);
+    STORE(&h->sum, LOAD(&h->sum) + value);
+    if(value < LOAD(&h->min))
+        STORE(&h->min, value);
+    if(value > LOAD(&h->max))
+        STORE(&h->max, value);
+    /* Written last. Readers use it as an upper bound only. */
+    STORE(&h->count, LOAD(&h->count) + 1);
+}
+
+UA_UInt64
+LatencyHistogram_percentile(const LatencyHistogram *h, UA_Double p) {
+    UA_UInt64 total = 0;
+    for(size_t i = 0; i < LATENCYHISTOGRAM_BUCKETS; i++)
+        total += LOAD(&h->buckets[i]);
+    if(total == 0)
+        return 0;
+    if(p < 0.0)
+        p = 0.0;
+    if(p > 1.0)
+        p = 1.0;
+
+    UA_UInt64 rank = (UA_UInt64)(p * (UA_Double)total + 0.5);
+    if(rank == 0)
+        rank = 1;
+    UA_UInt64 seen = 0;
+    for(size_t i = 0; i < LATENCYHISTOGRAM_BUCKETS; i++) {
+        seen += LOAD(&h->buckets[i]);
+        if(seen >= rank) {
+            /* The bucket midpoint may lie outside the observed range */
+            UA_UInt64 v = bucketValue(i);
+            UA_UInt64 max = LOAD(&h->max);
+            return (v > max) ? max : v;
+        }
+    }
+    return LOAD(&h->max);
+}
+
+UA_Double
+LatencyHistogram_mean(const LatencyHistogram *h) {
+    UA_UInt64 count = LOAD(&h->count);
+    if(count == 0)
+        return 0.0;
+    return (UA_Double)LOAD(&h->sum) / (UA_Double)count;
+}
+
+void
+LatencyHistogram_merge(LatencyHistogram *dst, const LatencyHistogram *src) {
+    for(size_t i = 0; i < LATENCYHISTOGRAM_BUCKETS; i++)
+        dst->buckets[i] += LOAD(&src->buckets[i]);
+    dst->count += LOAD(&src->count);
+    dst->sum += LOAD(&src->sum);
+    UA_UInt64 min = LOAD(&src->min);
+    UA_UInt64 max = LOAD(&src->max);
+    if(min < dst->min)
+        dst->min = min;
+    if(max > dst->max)
+        dst->max = max;
+}
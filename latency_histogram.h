@@ -0,0 +1,55 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+#include <open62541/types.h>
+
+/**
+ * Latency Histogram
+ * -----------------
+ * Log-linear histogram in the style of HdrHistogram. Every power of two is
+ * split into 32 sub-buckets, so a recorded value is reported with a relative
+ * error below 3%. Values up to 2^48 (in whatever unit the caller uses) are
+ * tracked; larger values are clamped into the last bucket.
+ *
+ * Recording is wait-free and allocation-free. A histogram has a single
+ * writer. Other threads may read it (percentiles, merge) concurrently and then
+ * see a slightly stale but never torn counter. */
+
+#define LATENCYHISTOGRAM_SUBBUCKET_BITS 5
+#define LATENCYHISTOGRAM_SUBBUCKETS (1u << LATENCYHISTOGRAM_SUBBUCKET_BITS)
+#define LATENCYHISTOGRAM_MAX_BITS 48
+#define LATENCYHISTOGRAM_BUCKETS \
+    ((LATENCYHISTOGRAM_MAX_BITS - LATENCYHISTOGRAM_SUBBUCKET_BITS + 1) * \
+     LATENCYHISTOGRAM_SUBBUCKETS)
+
+typedef struct {
+    UA_UInt64 count;
+    UA_UInt64 sum;
+    UA_UInt64 min;
+    UA_UInt64 max;
+    UA_UInt64 buckets[LATENCYHISTOGRAM_BUCKETS];
+} LatencyHistogram;
+
+void
+LatencyHistogram_init(LatencyHistogram *h);
+
+/* Only to be called from the thread owning the histogram */
+void
+LatencyHistogram_record(LatencyHistogram *h, UA_UInt64 value);
+
+/* Returns the value below which the fraction p (0..1) of all recorded values
+ * lie. Returns 0 for an empty histogram. */
+UA_UInt64
+LatencyHistogram_percentile(const LatencyHistogram *h, UA_Double p);
+
+UA_Double
+LatencyHistogram_mean(const LatencyHistogram *h);
+
+/* Adds the counters of src to dst. src may be written concurrently. */
+void
+LatencyHistogram_merge(LatencyHistogram *dst, const LatencyHistogram *src);
+
+#endif /* LATENCY_HISTOGRAM_H_ */
@@ -0,0 +1,625 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "log_ring.h"
+
+#include <open62541/types.h>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOGRING_CALLSITES 256 /* Per thread, power of two */
+#define LOGRING_CALLSITE_PROBES 8
+#define LOGRING_MAX_RECORD 2048
+#define LOGRING_MAX_LINE 4096
+#define LOGRING_PADDING 0xff
+
+/* Records are 8-byte aligned. The arguments follow the header in 8-byte
+ * slots. A string is a slot with its length followed by the characters. */
+typedef struct {
+    UA_UInt32 size; /* Including the header */
+    UA_Byte level;  /* LOGRING_PADDING skips to the start of the ring */
+    UA_Byte category;
+    UA_Byte rawFormat; /* The arguments could not be encoded */
+    UA_Byte reserved;
+    UA_DateTime time;
+    const char *fmt;
+} RecordHeader;
+
+typedef struct {
+    const char *fmt;
+    UA_DateTime windowStart;
+    UA_UInt32 count;
+    UA_UInt32 suppressed;
+} CallSite;
+
+typedef struct ThreadRing {
+    struct ThreadRing *next;
+    pthread_t thread;
+    UA_Byte *data;
+
+    /* Written by the owning thread */
+    UA_UInt64 head __attribute__((aligned(64)));
+    UA_UInt64 written;
+    UA_UInt64 dropped;
+    UA_UInt64 suppressed;
+    CallSite sites[LOGRING_CALLSITES];
+
+    /* Written by the background thread */
+    UA_UInt64 tail __attribute__((aligned(64)));
+} ThreadRing;
+
+typedef struct {
+    LogRingConfig config;
+    UA_UInt64 id;
+    ThreadRing *rings;
+    pthread_t thread;
+    UA_Boolean running;
+    UA_UInt64 reportedDrops;
+    char line[LOGRING_MAX_LINE];
+} LogRingContext;
+
+static const char *logLevelNames[6] =
+    {"trace", "debug", "info", "warn", "error", "fatal"};
+static const char *logCategoryNames[7] =
+    {"network", "channel", "session", "server", "client", "userland", "securitypolicy"};
+
+static const char *suppressedFormat = "%u similar messages suppressed: %s";
+
+/* A freed logger may be followed by a new one at the same address. The id
+ * invalidates the cached ring. */
+static UA_UInt64 nextContextId = 0;
+static __thread UA_UInt64 localContextId = 0;
+static __thread ThreadRing *localRing = NULL;
+
+static ThreadRing *
+getRing(LogRingContext *ctx) {
+    if(UA_LIKELY(localContextId == ctx->id))
+        return localRing;
+    pthread_t self = pthread_self();
+    ThreadRing *r = __atomic_load_n(&ctx->rings, __ATOMIC_ACQUIRE);
+    for(; r; r = r->next) {
+        if(pthread_equal(r->thread, self))
+            break;
+    }
+    if(!r) {
+        r = (ThreadRing*)calloc(1, sizeof(ThreadRing));
+        if(!r)
+            return NULL;
+        r->data = (UA_Byte*)malloc(ctx->config.ringSize);
+        if(!r->data) {
+            free(r);
+            return NULL;
+        }
+        r->thread = self;
+        r->next = __atomic_load_n(&ctx->rings, __ATOMIC_RELAXED);
+        while(!__atomic_compare_exchange_n(&ctx->rings, &r->next, r, true,
+                                           __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+    }
+    localContextId = ctx->id;
+    localRing = r;
+    return r;
+}
+
+/**
+ * Argument Encoding
+ * ^^^^^^^^^^^^^^^^^
+ * The printf format is parsed to take every argument from the va_list with
+ * its correct type. Integers are widened to 64 bit. The formatter parses the
+ * format again and prints every conversion on its own. */
+
+typedef enum {
+    ARG_NONE, ARG_SIGNED, ARG_UNSIGNED, ARG_DOUBLE, ARG_STRING, ARG_POINTER, ARG_INVALID
+} ArgKind;
+
+typedef struct {
+    const char *start; /* The '%' */
+    const char *flags;
+    size_t flagsSize;
+    UA_Boolean widthStar, precisionStar, hasPrecision;
+    int width, precision;
+    char length[3];    /* As written in the format */
+    char conversion;
+    ArgKind kind;
+} ConversionSpec;
+
+/* Parses the conversion starting at p (after the '%'). Returns the position
+ * after the conversion. */
+static const char *
+parseSpec(const char *p, ConversionSpec *spec) {
+    memset(spec, 0, sizeof(ConversionSpec));
+    spec->width = -1;
+    spec->flags = p;
+    while(*p && strchr("-+ #0'", *p))
+        p++;
+    spec->flagsSize = (size_t)(p - spec->flags);
+    if(*p == '*') {
+        spec->widthStar = true;
+        p++;
+    } else if(*p >= '0' && *p <= '9') {
+        spec->width = (int)strtol(p, (char**)(uintptr_t)&p, 10);
+    }
+    if(*p == '.') {
+        p++;
+        spec->hasPrecision = true;
+        if(*p == '*') {
+            spec->precisionStar = true;
+            p++;
+        } else {
+            spec->precision = (int)strtol(p, (char**)(uintptr_t)&p, 10);
+        }
+    }
+    size_t l = 0;
+    while(*p && strchr("hlLqjzt", *p) && l < 2)
+        spec->length[l++] = *p++;
+    spec->conversion = *p;
+    switch(*p) {
+    case 'd': case 'i': case 'c':
+        spec->kind = ARG_SIGNED; break;
+    case 'u': case 'o': case 'x': case 'X':
+        spec->kind = ARG_UNSIGNED; break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        spec->kind = ARG_DOUBLE; break;
+    case 's':
+        spec->kind = ARG_STRING; break;
+    case 'p':
+        spec->kind = ARG_POINTER; break;
+    case '%':
+        spec->kind = ARG_NONE; break;
+    default:
+        spec->kind = ARG_INVALID;
+        return p;
+    }
+    return p + 1;
+}
+
+typedef struct {
+    UA_Byte *pos;
+    const UA_Byte *end;
+} Cursor;
+
+static UA_Boolean
+putSlot(Cursor *c, const void *value) {
+    if(c->pos + 8 > c->end)
+        return false;
+    memcpy(c->pos, value, 8);
+    c->pos += 8;
+    return true;
+}
+
+static UA_Boolean
+putString(Cursor *c, const char *s, int precision) {
+    if(!s)
+        s = "(null)";
+    size_t max = LOGRING_MAX_STRING;
+    if(precision >= 0 && (size_t)precision < max)
+        max = (size_t)precision;
+    UA_UInt64 len = strnlen(s, max);
+    size_t padded = ((size_t)len + 7) & ~(size_t)7;
+    if(!putSlot(c, &len) || c->pos + padded > c->end)
+        return false;
+    memcpy(c->pos, s, (size_t)len);
+    c->pos += padded;
+    return true;
+}
+
+static UA_Boolean
+encodeArgs(Cursor *c, const char *fmt, va_list args) {
+    ConversionSpec spec;
+    for(const char *p = strchr(fmt, '%'); p; p = strchr(p, '%')) {
+        p = parseSpec(p + 1, &spec);
+        if(spec.kind == ARG_INVALID)
+            return false;
+        if(spec.kind == ARG_NONE)
+            continue;
+        if(spec.widthStar) {
+            UA_Int64 w = va_arg(args, int);
+            if(!putSlot(c, &w))
+                return false;
+        }
+        int precision = spec.hasPrecision ? spec.precision : -1;
+        if(spec.precisionStar) {
+            UA_Int64 pr = va_arg(args, int);
+            precision = (int)pr;
+            if(!putSlot(c, &pr))
+                return false;
+        }
+
+        const char *len = spec.length;
+        UA_Boolean ok = true;
+        switch(spec.kind) {
+        case ARG_SIGNED: {
+            UA_Int64 v;
+            if(strcmp(len, "ll") == 0 || strcmp(len, "q") == 0)
+                v = va_arg(args, long long);
+            else if(strcmp(len, "l") == 0)
+                v = va_arg(args, long);
+            else if(strcmp(len, "j") == 0)
+                v = va_arg(args, intmax_t);
+            else if(strcmp(len, "z") == 0 || strcmp(len, "t") == 0)
+                v = va_arg(args, ptrdiff_t);
+            else
+                v = va_arg(args, int);
+            ok = putSlot(c, &v);
+            break;
+        }
+        case ARG_UNSIGNED: {
+            UA_UInt64 v;
+            if(strcmp(len, "ll") == 0 || strcmp(len, "q") == 0)
+                v = va_arg(args, unsigned long long);
+            else if(strcmp(len, "l") == 0)
+                v = va_arg(args, unsigned long);
+            else if(strcmp(len, "j") == 0)
+                v = va_arg(args, uintmax_t);
+            else if(strcmp(len, "z") == 0 || strcmp(len, "t") == 0)
+                v = va_arg(args, size_t);
+            else
+                v = va_arg(args, unsigned int);
+            ok = putSlot(c, &v);
+            break;
+        }
+        case ARG_DOUBLE: {
+            UA_Double v;
+            if(strcmp(len, "L") == 0)
+                v = (UA_Double)va_arg(args, long double);
+            else
+                v = va_arg(args, double);
+            ok = putSlot(c, &v);
+            break;
+        }
+        case ARG_STRING:
+            ok = putString(c, va_arg(args, const char*), precision);
+            break;
+        case ARG_POINTER: {
+            UA_UInt64 v = (UA_UInt64)(uintptr_t)va_arg(args, void*);
+            ok = putSlot(c, &v);
+            break;
+        }
+        default:
+            break;
+        }
+        if(!ok)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Writing Records
+ * ^^^^^^^^^^^^^^^ */
+
+static void
+writeRecord(LogRingContext *ctx, ThreadRing *r, UA_LogLevel level,
+            UA_LogCategory category, UA_DateTime now, const char *fmt, va_list args) {
+    UA_Byte payload[LOGRING_MAX_RECORD];
+    Cursor c = {payload, payload + sizeof(payload)};
+    RecordHeader h;
+    memset(&h, 0, sizeof(RecordHeader));
+    h.level = (UA_Byte)level;
+    h.category = (UA_Byte)category;
+    h.time = now;
+    h.fmt = fmt;
+    if(!encodeArgs(&c, fmt, args)) {
+        /* Print the format string as it is */
+        h.rawFormat = true;
+        c.pos = payload;
+    }
+    size_t payloadSize = (size_t)(c.pos - payload);
+    h.size = (UA_UInt32)(sizeof(RecordHeader) + payloadSize);
+
+    size_t ringSize = ctx->config.ringSize;
+    UA_UInt64 head = r->head;
+    UA_UInt64 tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    size_t offset = (size_t)(head & (ringSize - 1));
+    size_t contiguous = ringSize - offset;
+    size_t needed = h.size + (h.size > contiguous ? contiguous : 0);
+    if(ringSize - (size_t)(head - tail) < needed) {
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    /* Records do not wrap around. The rest of the ring is skipped. */
+    if(h.size > contiguous) {
+        RecordHeader *pad = (RecordHeader*)&r->data[offset];
+        pad->size = (UA_UInt32)contiguous;
+        pad->level = LOGRING_PADDING;
+        head += contiguous;
+        offset = 0;
+    }
+    memcpy(&r->data[offset], &h, sizeof(RecordHeader));
+    memcpy(&r->data[offset + sizeof(RecordHeader)], payload, payloadSize);
+    __atomic_store_n(&r->written, r->written + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->head, head + h.size, __ATOMIC_RELEASE);
+}
+
+static void
+writeRecordf(LogRingContext *ctx, ThreadRing *r, UA_LogLevel level,
+             UA_LogCategory category, UA_DateTime now, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    writeRecord(ctx, r, level, category, now, fmt, args);
+    va_end(args);
+}
+
+/* Returns true if the record is suppressed. Sets *report to the number of
+ * records suppressed in the last window of the call site. */
+static UA_Boolean
+rateLimited(LogRingContext *ctx, ThreadRing *r, const char *fmt,
+            UA_DateTime now, UA_UInt32 *report) {
+    size_t hash = (size_t)(((uintptr_t)fmt >> 3) * 2654435761u);
+    for(size_t i = 0; i < LOGRING_CALLSITE_PROBES; i++) {
+        CallSite *s = &r->sites[(hash + i) & (LOGRING_CALLSITES - 1)];
+        if(!s->fmt) {
+            s->fmt = fmt;
+            s->windowStart = now;
+        } else if(s->fmt != fmt) {
+            continue;
+        }
+        if(now - s->windowStart >= UA_DATETIME_SEC) {
+            *report = s->suppressed;
+            s->windowStart = now;
+            s->count = 0;
+            s->suppressed = 0;
+        }
+        if(s->count >= ctx->config.rateLimit) {
+            s->suppressed++;
+            __atomic_store_n(&r->suppressed, r->suppressed + 1, __ATOMIC_RELAXED);
+            return true;
+        }
+        s->count++;
+        return false;
+    }
+    return false; /* No free entry. The call site is not limited. */
+}
+
+static void
+logRingLog(void *context, UA_LogLevel level, UA_LogCategory category,
+           const char *msg, va_list args) {
+    LogRingContext *ctx = (LogRingContext*)context;
+    if(level < ctx->config.minLevel)
+        return;
+    ThreadRing *r = getRing(ctx);
+    if(!r)
+        return;
+    UA_DateTime now = UA_DateTime_now();
+    UA_UInt32 suppressed = 0;
+    if(ctx->config.rateLimit > 0 && rateLimited(ctx, r, msg, now, &suppressed))
+        return;
+    if(suppressed > 0)
+        writeRecordf(ctx, r, level, category, now, suppressedFormat, suppressed, msg);
+    writeRecord(ctx, r, level, category, now, msg, args);
+}
+
+/**
+ * Formatting
+ * ^^^^^^^^^^
+ * Runs in the background thread only. */
+
+static UA_Int64
+getSlot(const UA_Byte **pos) {
+    UA_Int64 v;
+    memcpy(&v, *pos, 8);
+    *pos += 8;
+    return v;
+}
+
+static size_t
+formatArgs(char *out, size_t cap, const char *fmt, const UA_Byte *args) {
+    size_t n = 0;
+    const char *p = fmt;
+    char specString[64];
+    char string[LOGRING_MAX_STRING + 1];
+    while(*p && n + 1 < cap) {
+        const char *percent = strchr(p, '%');
+        size_t literal = percent ? (size_t)(percent - p) : strlen(p);
+        if(literal > cap - 1 - n)
+            literal = cap - 1 - n;
+        memcpy(&out[n], p, literal);
+        n += literal;
+        if(!percent)
+            break;
+
+        ConversionSpec spec;
+        p = parseSpec(percent + 1, &spec);
+        if(spec.kind == ARG_NONE) {
+            if(n + 1 < cap)
+                out[n++] = '%';
+            continue;
+        }
+
+        /* Rebuild the conversion with the resolved width and precision and
+         * with 64-bit integers */
+        int width = spec.widthStar ? (int)getSlot(&args) : spec.width;
+        int precision = spec.precisionStar ? (int)getSlot(&args) : spec.precision;
+        size_t s = 0;
+        specString[s++] = '%';
+        memcpy(&specString[s], spec.flags, spec.flagsSize);
+        s += spec.flagsSize;
+        if(width >= 0)
+            s += (size_t)snprintf(&specString[s], 16, "%d", width);
+        if(spec.hasPrecision)
+            s += (size_t)snprintf(&specString[s], 16, ".%d", precision);
+        if(spec.kind == ARG_SIGNED || spec.kind == ARG_UNSIGNED) {
+            if(spec.conversion != 'c') {
+                specString[s++] = 'l';
+                specString[s++] = 'l';
+            }
+        }
+        specString[s++] = spec.conversion;
+        specString[s] = 0;
+
+        int written = 0;
+        switch(spec.kind) {
+        case ARG_SIGNED:
+            if(spec.conversion == 'c')
+                written = snprintf(&out[n], cap - n, specString, (int)getSlot(&args));
+            else
+                written = snprintf(&out[n], cap - n, specString,
+                                   (long long)getSlot(&args));
+            break;
+        case ARG_UNSIGNED:
+            written = snprintf(&out[n], cap - n, specString,
+                               (unsigned long long)getSlot(&args));
+            break;
+        case ARG_DOUBLE: {
+            UA_Double v;
+            memcpy(&v, args, 8);
+            args += 8;
+            written = snprintf(&out[n], cap - n, specString, v);
+            break;
+        }
+        case ARG_STRING: {
+            size_t len = (size_t)getSlot(&args);
+            memcpy(string, args, len);
+            string[len] = 0;
+            args += (len + 7) & ~(size_t)7;
+            written = snprintf(&out[n], cap - n, specString, string);
+            break;
+        }
+        case ARG_POINTER:
+            written = snprintf(&out[n], cap - n, specString,
+                               (void*)(uintptr_t)getSlot(&args));
+            break;
+        default:
+            break;
+        }
+        if(written > 0)
+            n += (size_t)written < cap - n ? (size_t)written : cap - 1 - n;
+    }
+    out[n] = 0;
+    return n;
+}
+
+/* The same layout as UA_Log_Stdout, without colors */
+static void
+writeLine(LogRingContext *ctx, UA_DateTime time, UA_Byte level, UA_Byte category,
+          const char *fmt, const UA_Byte *args, UA_Boolean rawFormat) {
+    UA_Int64 tOffset = UA_DateTime_localTimeUtcOffset();
+    UA_DateTimeStruct dts = UA_DateTime_toStruct(time + tOffset);
+    int n = snprintf(ctx->line, LOGRING_MAX_LINE,
+                     "[%04u-%02u-%02u %02u:%02u:%02u.%03u (UTC%+05d)] %s/%s\t",
+                     dts.year, dts.month, dts.day, dts.hour, dts.min, dts.sec,
+                     dts.milliSec, (int)(tOffset / UA_DATETIME_SEC / 36),
+                     logLevelNames[level < 6 ? level : 5],
+                     logCategoryNames[category < 7 ? category : 5]);
+    size_t pos = (n > 0 && n < LOGRING_MAX_LINE) ? (size_t)n : 0;
+    if(rawFormat) {
+        size_t len = strlen(fmt);
+        if(len > LOGRING_MAX_LINE - 2 - pos)
+            len = LOGRING_MAX_LINE - 2 - pos;
+        memcpy(&ctx->line[pos], fmt, len);
+        pos += len;
+    } else {
+        pos += formatArgs(&ctx->line[pos], LOGRING_MAX_LINE - 1 - pos, fmt, args);
+    }
+    ctx->line[pos++] = '\n';
+    fwrite(ctx->line, 1, pos, ctx->config.out);
+}
+
+static size_t
+drainRing(LogRingContext *ctx, ThreadRing *r) {
+    size_t mask = ctx->config.ringSize - 1;
+    UA_UInt64 tail = r->tail;
+    UA_UInt64 head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    size_t records = 0;
+    while(tail < head) {
+        const RecordHeader *h = (const RecordHeader*)&r->data[tail & mask];
+        if(h->level != LOGRING_PADDING) {
+            writeLine(ctx, h->time, h->level, h->category, h->fmt,
+                      (const UA_Byte*)h + sizeof(RecordHeader), h->rawFormat);
+            records++;
+        }
+        tail += h->size;
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    }
+    return records;
+}
+
+static size_t
+drainAll(LogRingContext *ctx) {
+    size_t records = 0;
+    UA_UInt64 dropped = 0;
+    for(ThreadRing *r = __atomic_load_n(&ctx->rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        records += drainRing(ctx, r);
+        dropped += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+    }
+    if(dropped > ctx->reportedDrops) {
+        UA_UInt64 newDrops = dropped - ctx->reportedDrops;
+        writeLine(ctx, UA_DateTime_now(), UA_LOGLEVEL_WARNING, UA_LOGCATEGORY_USERLAND,
+                  "%llu log records dropped, the ring buffer was full",
+                  (const UA_Byte*)&newDrops, false);
+        ctx->reportedDrops = dropped;
+        records++;
+    }
+    if(records > 0)
+        fflush(ctx->config.out);
+    return records;
+}
+
+static void *
+logRingThread(void *data) {
+    LogRingContext *ctx = (LogRingContext*)data;
+    struct timespec idle;
+    idle.tv_sec = ctx->config.flushIntervalMs / 1000;
+    idle.tv_nsec = (long)(ctx->config.flushIntervalMs % 1000) * 1000000;
+    while(__atomic_load_n(&ctx->running, __ATOMIC_ACQUIRE)) {
+        if(drainAll(ctx) == 0)
+            nanosleep(&idle, NULL);
+    }
+    drainAll(ctx);
+    return NULL;
+}
+
+static void
+logRingClear(void *context) {
+    LogRingContext *ctx = (LogRingContext*)context;
+    __atomic_store_n(&ctx->running, false, __ATOMIC_RELEASE);
+    pthread_join(ctx->thread, NULL);
+    ThreadRing *r = ctx->rings;
+    while(r) {
+        ThreadRing *next = r->next;
+        free(r->data);
+        free(r);
+        r = next;
+    }
+    free(ctx);
+}
+
+UA_StatusCode
+LogRing_init(UA_Logger *logger, const LogRingConfig *config) {
+    LogRingContext *ctx = (LogRingContext*)calloc(1, sizeof(LogRingContext));
+    if(!ctx)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    ctx->config = *config;
+    if(!ctx->config.out)
+        ctx->config.out = stdout;
+    size_t ringSize = 4096;
+    while(ringSize < config->ringSize)
+        ringSize <<= 1;
+    ctx->config.ringSize = ringSize;
+    ctx->id = __atomic_add_fetch(&nextContextId, 1, __ATOMIC_RELAXED);
+    ctx->running = true;
+    if(pthread_create(&ctx->thread, NULL, logRingThread, ctx) != 0) {
+        free(ctx);
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    logger->log = logRingLog;
+    logger->context = ctx;
+    logger->clear = logRingClear;
+    return UA_STATUSCODE_GOOD;
+}
+
+void
+LogRing_getStats(const UA_Logger *logger, LogRingStats *stats) {
+    memset(stats, 0, sizeof(LogRingStats));
+    LogRingContext *ctx = (LogRingContext*)logger->context;
+    for(ThreadRing *r = __atomic_load_n(&ctx->rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        stats->written += __atomic_load_n(&r->written, __ATOMIC_RELAXED);
+        stats->dropped += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+        stats->suppressed += __atomic_load_n(&r->suppressed, __ATOMIC_RELAXED);
+    }
+}
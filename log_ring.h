@@ -0,0 +1,60 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef LOG_RING_H_
+#define LOG_RING_H_
+
+#include <open62541/plugin/log.h>
+
+#include <stdio.h>
+
+/**
+ * Asynchronous Ring Logger
+ * ------------------------
+ * A UA_Logger plugin that keeps formatting and I/O off the calling thread.
+ * A log call copies the format pointer, a timestamp and the raw arguments
+ * into a lock-free ring owned by the calling thread. A background thread
+ * drains the rings of all threads, formats the records in the style of
+ * UA_Log_Stdout and writes them out.
+ *
+ * Format strings are stored by pointer and must stay valid until the logger
+ * is cleared. This holds for the string literals used with the UA_LOG_*
+ * macros. String arguments are copied, up to LOGRING_MAX_STRING bytes.
+ *
+ * When the ring of a thread is full, the record is dropped and counted. With
+ * a rate limit, every call site (i.e. format string) logs at most rateLimit
+ * records per second and thread. The number of suppressed records is logged
+ * with the next record of the call site after the second has passed. Drops
+ * are reported by the background thread.
+ *
+ * Records of one thread keep their order. Records of different threads may
+ * be interleaved out of timestamp order. */
+
+#define LOGRING_MAX_STRING 256
+
+typedef struct {
+    UA_LogLevel minLevel;
+    size_t ringSize;            /* Bytes per thread, rounded up to a power of two */
+    UA_UInt32 rateLimit;        /* Records per second and call site, 0 = unlimited */
+    UA_UInt32 flushIntervalMs;  /* Sleep of the background thread when idle */
+    FILE *out;                  /* NULL for stdout */
+} LogRingConfig;
+
+#define LOGRINGCONFIG_DEFAULT {UA_LOGLEVEL_INFO, 65536, 100, 10, NULL}
+
+typedef struct {
+    UA_UInt64 written;
+    UA_UInt64 dropped;
+    UA_UInt64 suppressed;
+} LogRingStats;
+
+/* Starts the background thread. The logger is cleared with
+ * logger->clear(logger->context), which writes out all pending records. */
+UA_StatusCode
+LogRing_init(UA_Logger *logger, const LogRingConfig *config);
+
+/* Sums the counters of all threads */
+void
+LogRing_getStats(const UA_Logger *logger, LogRingStats *stats);
+
+#endif /* LOG_RING_H_ */
@@ -0,0 +1,391 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+/**
+ * MQTT Broker Stand-In
+ * --------------------
+ * A minimal MQTT 3.1.1 broker for testing the MQTT transport of
+ * pubsub_mqtt.h on localhost, without an installed broker. It listens on
+ * 127.0.0.1 and runs a single poll loop:
+ *
+ * - Received publishes are forwarded with QoS 0 to all clients with a
+ *   matching subscription. The filters may use ``+`` and ``#``. QoS 1
+ *   publishes are acknowledged when they are received.
+ * - The packets for a client are collected during one iteration of the loop
+ *   and written at its end. Clients that do not read are disconnected when
+ *   their buffer is full.
+ *
+ * There are no sessions, retained messages, wills, QoS 2 or authentication.
+ *
+ * Run step of the application is as mentioned below:
+ *
+ * ./mqtt_broker_standin --port=1883 */
+
+#define _GNU_SOURCE
+#include <open62541/plugin/log_stdout.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAXCLIENTS 64
+#define MAXSUBSCRIPTIONS 16
+#define MAXFILTERSIZE 128
+#define BUFSIZE (256 * 1024)
+
+typedef struct {
+    int fd;
+    char filters[MAXSUBSCRIPTIONS][MAXFILTERSIZE];
+    size_t filtersSize;
+    size_t inSize;
+    size_t outSize;
+    UA_Byte in[BUFSIZE];
+    UA_Byte out[BUFSIZE];
+} Client;
+
+static Client *clients[MAXCLIENTS];
+
+static struct {
+    UA_UInt64 connections;
+    UA_UInt64 received;
+    UA_UInt64 forwarded;
+    UA_UInt64 dropped; /* Clients disconnected with a full buffer */
+} stats;
+
+UA_Boolean running = true;
+static void stopHandler(int sign) {
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND, "received ctrl-c");
+    running = false;
+}
+
+static void
+closeClient(size_t index) {
+    close(clients[index]->fd);
+    free(clients[index]);
+    clients[index] = NULL;
+}
+
+/* Queues a packet with the body in two parts. Returns false if the buffer
+ * of the client is full. */
+static UA_Boolean
+queuePacket(Client *c, UA_Byte type, const UA_Byte *body1, size_t body1Size,
+            const UA_Byte *body2, size_t body2Size) {
+    size_t length = body1Size + body2Size;
+    if(c->outSize + 5 + length > BUFSIZE)
+        return false;
+    UA_Byte *pos = &c->out[c->outSize];
+    *pos++ = type;
+    do {
+        UA_Byte b = (UA_Byte)(length % 128);
+        length /= 128;
+        *pos++ = length > 0 ? (UA_Byte)(b | 0x80) : b;
+    } while(length > 0);
+    if(body1Size > 0)
+        memcpy(pos, body1, body1Size);
+    if(body2Size > 0)
+        memcpy(pos + body1Size, body2, body2Size);
+    c->outSize = (size_t)(pos - c->out) + body1Size + body2Size;
+    return true;
+}
+
+static UA_Boolean
+topicMatches(const char *filter, const UA_Byte *topic, size_t topicLength) {
+    size_t t = 0;
+    for(; *filter; filter++) {
+        if(*filter == '#')
+            return true;
+        if(*filter == '+') {
+            while(t < topicLength && topic[t] != '/')
+                t++;
+            continue;
+        }
+        if(t >= topicLength || topic[t] != (UA_Byte)*filter)
+            return false;
+        t++;
+    }
+    return t == topicLength;
+}
+
+static void
+forward(const UA_Byte *topic, size_t topicLength, const UA_Byte *payload,
+        size_t payloadSize) {
+    /* Topic with its length, for the body of the forwarded PUBLISH */
+    UA_Byte header[2 + 65535];
+    header[0] = (UA_Byte)(topicLength >> 8);
+    header[1] = (UA_Byte)topicLength;
+    memcpy(&header[2], topic, topicLength);
+    for(size_t i = 0; i < MAXCLIENTS; i++) {
+        Client *c = clients[i];
+        if(!c)
+            continue;
+        for(size_t j = 0; j < c->filtersSize; j++) {
+            if(!topicMatches(c->filters[j], topic, topicLength))
+                continue;
+            if(queuePacket(c, 0x30, header, 2 + topicLength, payload, payloadSize)) {
+                stats.forwarded++;
+            } else {
+                UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                               "Client %lu does not read, disconnecting",
+                               (unsigned long)i);
+                stats.dropped++;
+                closeClient(i);
+            }
+            break; /* Once per client */
+        }
+    }
+}
+
+static void
+handleSubscribe(Client *c, const UA_Byte *body, size_t length, UA_Boolean unsubscribe) {
+    UA_Byte ack[2 + MAXSUBSCRIPTIONS];
+    size_t ackSize = 2;
+    memcpy(ack, body, 2); /* Packet id */
+    size_t pos = 2;
+    while(pos + 2 <= length) {
+        size_t filterLength = (size_t)body[pos] << 8 | body[pos + 1];
+        pos += 2;
+        if(pos + filterLength + (unsubscribe ? 0 : 1) > length)
+            break;
+        char filter[MAXFILTERSIZE];
+        UA_Boolean fits = filterLength < MAXFILTERSIZE;
+        if(fits) {
+            memcpy(filter, &body[pos], filterLength);
+            filter[filterLength] = 0;
+        }
+        pos += filterLength;
+        if(unsubscribe) {
+            for(size_t j = 0; fits && j < c->filtersSize; j++) {
+                if(strcmp(c->filters[j], filter) == 0) {
+                    memcpy(c->filters[j], c->filters[--c->filtersSize], MAXFILTERSIZE);
+                    break;
+                }
+            }
+            continue;
+        }
+        pos++; /* Requested QoS, forwarded with QoS 0 */
+        UA_Byte granted = 0x80;
+        if(fits && c->filtersSize < MAXSUBSCRIPTIONS) {
+            memcpy(c->filters[c->filtersSize++], filter, filterLength + 1);
+            granted = 0;
+        }
+        if(ackSize < sizeof(ack))
+            ack[ackSize++] = granted;
+    }
+    if(unsubscribe)
+        queuePacket(c, 0xB0, ack, 2, NULL, 0);
+    else
+        queuePacket(c, 0x90, ack, ackSize, NULL, 0);
+}
+
+/* Returns false if the client is to be disconnected */
+static UA_Boolean
+handlePacket(Client *c, UA_Byte type, const UA_Byte *body, size_t length) {
+    switch(type & 0xf0) {
+    case 0x10: { /* CONNECT */
+        const UA_Byte connack[2] = {0, 0};
+        queuePacket(c, 0x20, connack, 2, NULL, 0);
+        stats.connections++;
+        return true;
+    }
+    case 0x30: { /* PUBLISH */
+        UA_Byte qos = (UA_Byte)((type >> 1) & 0x03);
+        if(length < 2 || qos > 1)
+            return false;
+        size_t topicLength = (size_t)body[0] << 8 | body[1];
+        size_t offset = 2 + topicLength + (qos > 0 ? 2 : 0);
+        if(offset > length)
+            return false;
+        if(qos > 0)
+            queuePacket(c, 0x40, &body[2 + topicLength], 2, NULL, 0);
+        stats.received++;
+        forward(&body[2], topicLength, &body[offset], length - offset);
+        return true;
+    }
+    case 0x80: /* SUBSCRIBE */
+    case 0xA0: /* UNSUBSCRIBE */
+        if(length < 2)
+            return false;
+        handleSubscribe(c, body, length, (type & 0xf0) == 0xA0);
+        return true;
+    case 0xC0: /* PINGREQ */
+        queuePacket(c, 0xD0, NULL, 0, NULL, 0);
+        return true;
+    case 0xE0: /* DISCONNECT */
+        return false;
+    default:
+        return true; /* PUBACK */
+    }
+}
+
+/* Returns false if the client is to be disconnected */
+static UA_Boolean
+readClient(size_t index) {
+    Client *c = clients[index];
+    ssize_t n = recv(c->fd, &c->in[c->inSize], BUFSIZE - c->inSize, MSG_DONTWAIT);
+    if(n == 0)
+        return false;
+    if(n < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    c->inSize += (size_t)n;
+
+    size_t offset = 0;
+    for(;;) {
+        const UA_Byte *p = &c->in[offset];
+        size_t available = c->inSize - offset;
+        size_t length = 0;
+        size_t headerSize = 1;
+        UA_Boolean complete = false;
+        while(!complete && headerSize < available && headerSize < 5) {
+            length |= (size_t)(p[headerSize] & 0x7f) << (7 * (headerSize - 1));
+            complete = !(p[headerSize] & 0x80);
+            headerSize++;
+        }
+        if(!complete) {
+            if(headerSize == 5)
+                return false;
+            break;
+        }
+        if(headerSize + length > BUFSIZE)
+            return false;
+        if(headerSize + length > available)
+            break;
+        if(!handlePacket(c, p[0], &p[headerSize], length))
+            return false;
+        /* Forwarding may have disconnected this client */
+        if(!clients[index])
+            return true;
+        offset += headerSize + length;
+    }
+    c->inSize -= offset;
+    memmove(c->in, &c->in[offset], c->inSize);
+    return true;
+}
+
+static UA_Boolean
+flushClient(Client *c) {
+    if(c->outSize == 0)
+        return true;
+    ssize_t n = send(c->fd, c->out, c->outSize, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if(n < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    c->outSize -= (size_t)n;
+    memmove(c->out, &c->out[n], c->outSize);
+    return true;
+}
+
+static void
+acceptClient(int listenFd) {
+    int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(fd < 0)
+        return;
+    for(size_t i = 0; i < MAXCLIENTS; i++) {
+        if(clients[i])
+            continue;
+        clients[i] = (Client*)calloc(1, sizeof(Client));
+        if(!clients[i])
+            break;
+        clients[i]->fd = fd;
+        return;
+    }
+    UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                   "No space for another client");
+    close(fd);
+}
+
+static void
+usage(char *progname) {
+    printf("usage: %s [--port=<port>]\n", progname);
+}
+
+int main(int argc, char **argv) {
+    signal(SIGINT, stopHandler);
+    signal(SIGTERM, stopHandler);
+
+    unsigned long port = 1883;
+    for(int i = 1; i < argc; i++) {
+        if(strncmp(argv[i], "--port=", 7) == 0) {
+            port = strtoul(&argv[i][7], NULL, 10);
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if(port == 0 || port > 65535) {
+        printf("Error: --port must be between 1 and 65535\n");
+        return EXIT_FAILURE;
+    }
+
+    int listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(listenFd < 0 ||
+       setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+       bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+       listen(listenFd, MAXCLIENTS) != 0) {
+        printf("Error: cannot listen on 127.0.0.1:%lu: %s\n", port, strerror(errno));
+        if(listenFd >= 0)
+            close(listenFd);
+        return EXIT_FAILURE;
+    }
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                "Listening on 127.0.0.1:%lu", port);
+
+    struct pollfd fds[MAXCLIENTS + 1];
+    time_t nextReport = time(NULL) + 10;
+    while(running) {
+        fds[0].fd = listenFd;
+        fds[0].events = POLLIN;
+        for(size_t i = 0; i < MAXCLIENTS; i++) {
+            fds[i + 1].fd = clients[i] ? clients[i]->fd : -1;
+            fds[i + 1].events = (short)(POLLIN | (clients[i] && clients[i]->outSize > 0 ?
+                                                  POLLOUT : 0));
+            fds[i + 1].revents = 0;
+        }
+        if(poll(fds, MAXCLIENTS + 1, 1000) < 0 && errno != EINTR)
+            break;
+
+        if(fds[0].revents & POLLIN)
+            acceptClient(listenFd);
+        for(size_t i = 0; i < MAXCLIENTS; i++) {
+            /* The slot may have been reused by a client accepted above */
+            if(clients[i] && clients[i]->fd == fds[i + 1].fd &&
+               (fds[i + 1].revents & (POLLIN | POLLERR | POLLHUP)) && !readClient(i) &&
+               clients[i])
+                closeClient(i);
+        }
+
+        /* One write per client for everything queued in this iteration */
+        for(size_t i = 0; i < MAXCLIENTS; i++) {
+            if(clients[i] && !flushClient(clients[i]))
+                closeClient(i);
+        }
+
+        if(time(NULL) >= nextReport) {
+            UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                        "Broker: %lu connections, %lu publishes received, "
+                        "%lu forwarded, %lu clients dropped",
+                        (unsigned long)stats.connections, (unsigned long)stats.received,
+                        (unsigned long)stats.forwarded, (unsigned long)stats.dropped);
+            nextReport += 10;
+        }
+    }
+
+    for(size_t i = 0; i < MAXCLIENTS; i++) {
+        if(clients[i])
+            closeClient(i);
+    }
+    close(listenFd);
+    return EXIT_SUCCESS;
+}
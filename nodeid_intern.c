@@ -0,0 +1,141 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "nodeid_intern.h"
+
+typedef struct {
+    UA_NodeId nodeId;
+    UA_UInt32 hash;
+} InternEntry;
+
+/* The entries are in the order of their handles. The slots are an open
+ * addressing index over them with linear probing, at most half full. A slot
+ * holds the handle + 1, 0 is empty. */
+struct NodeIdInternTable {
+    InternEntry *entries;
+    size_t entriesSize;
+    size_t entriesCapacity;
+    UA_UInt32 *slots;
+    size_t slotsMask;
+};
+
+static UA_StatusCode
+resizeSlots(NodeIdInternTable *t, size_t slotsSize) {
+    UA_UInt32 *slots = (UA_UInt32*)UA_calloc(slotsSize, sizeof(UA_UInt32));
+    if(!slots)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    /* Reinsert with the stored hashes, the NodeIds are not hashed again */
+    size_t mask = slotsSize - 1;
+    for(size_t i = 0; i < t->entriesSize; i++) {
+        size_t s = t->entries[i].hash & mask;
+        while(slots[s])
+            s = (s + 1) & mask;
+        slots[s] = (UA_UInt32)(i + 1);
+    }
+    UA_free(t->slots);
+    t->slots = slots;
+    t->slotsMask = mask;
+    return UA_STATUSCODE_GOOD;
+}
+
+NodeIdInternTable *
+NodeIdIntern_new(size_t capacity) {
+    NodeIdInternTable *t = (NodeIdInternTable*)UA_calloc(1, sizeof(NodeIdInternTable));
+    if(!t)
+        return NULL;
+    if(capacity < 16)
+        capacity = 16;
+    size_t slotsSize = 32;
+    while(slotsSize < 2 * capacity)
+        slotsSize *= 2;
+    t->entries = (InternEntry*)UA_malloc(capacity * sizeof(InternEntry));
+    t->entriesCapacity = capacity;
+    if(!t->entries || resizeSlots(t, slotsSize) != UA_STATUSCODE_GOOD) {
+        NodeIdIntern_delete(t);
+        return NULL;
+    }
+    return t;
+}
+
+void
+NodeIdIntern_delete(NodeIdInternTable *t) {
+    if(!t)
+        return;
+    for(size_t i = 0; i < t->entriesSize; i++)
+        UA_NodeId_clear(&t->entries[i].nodeId);
+    UA_free(t->entries);
+    UA_free(t->slots);
+    UA_free(t);
+}
+
+/* Returns the slot with the NodeId or the empty slot where it belongs */
+static size_t
+findSlot(const NodeIdInternTable *t, const UA_NodeId *nodeId, UA_UInt32 hash) {
+    size_t s = hash & t->slotsMask;
+    for(; t->slots[s]; s = (s + 1) & t->slotsMask) {
+        const InternEntry *e = &t->entries[t->slots[s] - 1];
+        if(e->hash == hash && UA_NodeId_equal(&e->nodeId, nodeId))
+            break;
+    }
+    return s;
+}
+
+UA_StatusCode
+NodeIdIntern_intern(NodeIdInternTable *t, const UA_NodeId *nodeId,
+                    NodeIdHandle *handle) {
+    UA_UInt32 hash = UA_NodeId_hash(nodeId);
+    size_t s = findSlot(t, nodeId, hash);
+    if(t->slots[s]) {
+        *handle = t->slots[s] - 1;
+        return UA_STATUSCODE_GOOD;
+    }
+    if(t->entriesSize >= NODEIDHANDLE_INVALID - 1)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+
+    if(t->entriesSize == t->entriesCapacity) {
+        size_t capacity = t->entriesCapacity * 2;
+        InternEntry *entries = (InternEntry*)
+            UA_realloc(t->entries, capacity * sizeof(InternEntry));
+        if(!entries)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        t->entries = entries;
+        t->entriesCapacity = capacity;
+    }
+    if(2 * (t->entriesSize + 1) > t->slotsMask + 1) {
+        UA_StatusCode retval = resizeSlots(t, 2 * (t->slotsMask + 1));
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+        s = findSlot(t, nodeId, hash);
+    }
+
+    InternEntry *e = &t->entries[t->entriesSize];
+    UA_StatusCode retval = UA_NodeId_copy(nodeId, &e->nodeId);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    e->hash = hash;
+    *handle = (NodeIdHandle)t->entriesSize;
+    t->entriesSize++;
+    t->slots[s] = (UA_UInt32)t->entriesSize;
+    return UA_STATUSCODE_GOOD;
+}
+
+NodeIdHandle
+NodeIdIntern_find(const NodeIdInternTable *t, const UA_NodeId *nodeId) {
+    size_t s = findSlot(t, nodeId, UA_NodeId_hash(nodeId));
+    return t->slots[s] ? t->slots[s] - 1 : NODEIDHANDLE_INVALID;
+}
+
+const UA_NodeId *
+NodeIdIntern_get(const NodeIdInternTable *t, NodeIdHandle handle) {
+    return &t->entries[handle].nodeId;
+}
+
+UA_UInt32
+NodeIdIntern_hash(const NodeIdInternTable *t, NodeIdHandle handle) {
+    return t->entries[handle].hash;
+}
+
+size_t
+NodeIdIntern_size(const NodeIdInternTable *t) {
+    return t->entriesSize;
+}
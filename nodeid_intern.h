@@ -0,0 +1,58 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef NODEID_INTERN_H_
+#define NODEID_INTERN_H_
+
+#include <open62541/types.h>
+
+/**
+ * Interned NodeIds
+ * ----------------
+ * Looking up a string NodeId such as ``"the.answer"`` hashes the string and
+ * compares it byte by byte, on every lookup. The intern table does this once
+ * per NodeId and returns a handle in its place. Handles are dense: the n-th
+ * distinct NodeId gets the handle n-1. Code on the hot path keeps the handle
+ * and indexes its own arrays with it, so a string NodeId costs the same as a
+ * numeric one. The table keeps a copy of every NodeId with its hash, so the
+ * NodeId and its hash can be taken from the handle without hashing again.
+ *
+ * The table is not synchronized. Intern the NodeIds before other threads
+ * read the table; growing it moves the NodeIds. */
+
+typedef UA_UInt32 NodeIdHandle;
+
+#define NODEIDHANDLE_INVALID UA_UINT32_MAX
+
+typedef struct NodeIdInternTable NodeIdInternTable;
+
+/* The table grows beyond capacity as needed */
+NodeIdInternTable *
+NodeIdIntern_new(size_t capacity);
+
+void
+NodeIdIntern_delete(NodeIdInternTable *t);
+
+/* Returns the handle of an equal NodeId if there is one. Otherwise copies
+ * the NodeId into the table and returns a new handle. */
+UA_StatusCode
+NodeIdIntern_intern(NodeIdInternTable *t, const UA_NodeId *nodeId,
+                    NodeIdHandle *handle);
+
+/* NODEIDHANDLE_INVALID if the NodeId was not interned */
+NodeIdHandle
+NodeIdIntern_find(const NodeIdInternTable *t, const UA_NodeId *nodeId);
+
+/* The handle must be valid */
+const UA_NodeId *
+NodeIdIntern_get(const NodeIdInternTable *t, NodeIdHandle handle);
+
+/* Same as UA_NodeId_hash of the NodeId */
+UA_UInt32
+NodeIdIntern_hash(const NodeIdInternTable *t, NodeIdHandle handle);
+
+/* Number of interned NodeIds, all handles are below */
+size_t
+NodeIdIntern_size(const NodeIdInternTable *t);
+
+#endif /* NODEID_INTERN_H_ */
@@ -0,0 +1,261 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+/**
+ * Nodestore Contention Benchmark
+ * ------------------------------
+ * Reads and writes the values of variable nodes from 1 to 32 threads, as
+ * publish workers sampling DataSets and decode workers writing
+ * TargetVariables would. A read gets the node, copies its value and releases
+ * the node. A write copies the node, changes the value and replaces the
+ * node, again if another write came in between. Every thread picks its
+ * nodes at random.
+ *
+ * Two nodestores are compared: the default hash map of open62541 behind one
+ * mutex, as all threads would use it under the server lock, and the
+ * concurrent nodestore of concurrent_nodestore.h without a lock. Every
+ * configuration is reported as one JSON object per line::
+ *
+ *   {"nodestore":"concurrent","threads":8,"nodes":1000,"writeRatio":0.10,
+ *    "durationS":1.000,"reads":41000000,"writes":4500000,"opsPerS":45500000.0,
+ *    "conflicts":1200}
+ */
+
+#include <open62541/plugin/nodestore.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "concurrent_nodestore.h"
+
+#define BENCH_MAX_THREADS 32
+#define BENCH_FIRST_NODEID 1000
+
+typedef struct {
+    const char *name;
+    UA_Boolean locked;
+} BenchNodestore;
+
+typedef struct {
+    pthread_t thread;
+    UA_Nodestore *ns;
+    pthread_mutex_t *lock; /* NULL for no lock */
+    UA_UInt32 seed;
+    UA_UInt64 reads;
+    UA_UInt64 writes;
+    UA_UInt64 conflicts;
+    UA_Byte padding[64]; /* The counters of two threads share no cache line */
+} BenchThread;
+
+static size_t nodes = 1000;
+static UA_Double writeRatio = 0.1;
+static UA_Double duration = 1.0;
+static UA_Boolean running; /* Accessed with relaxed atomics */
+static pthread_barrier_t startBarrier;
+
+static UA_UInt64
+nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UA_UInt64)ts.tv_sec * 1000000000 + (UA_UInt64)ts.tv_nsec;
+}
+
+static UA_UInt32
+nextRandom(UA_UInt32 *x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+static UA_StatusCode
+addNodes(UA_Nodestore *ns) {
+    for(size_t i = 0; i < nodes; i++) {
+        UA_VariableNode *node =
+            (UA_VariableNode*)ns->newNode(ns->context, UA_NODECLASS_VARIABLE);
+        if(!node)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        node->nodeId = UA_NODEID_NUMERIC(1, (UA_UInt32)(BENCH_FIRST_NODEID + i));
+        node->valueSource = UA_VALUESOURCE_DATA;
+        UA_Int64 v = 0;
+        UA_StatusCode retval =
+            UA_Variant_setScalarCopy(&node->value.data.value.value, &v,
+                                     &UA_TYPES[UA_TYPES_INT64]);
+        node->value.data.value.hasValue = true;
+        if(retval != UA_STATUSCODE_GOOD) {
+            ns->deleteNode(ns->context, (UA_Node*)node);
+            return retval;
+        }
+        retval = ns->insertNode(ns->context, (UA_Node*)node, NULL);
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+readNode(BenchThread *t, const UA_NodeId *id) {
+    if(t->lock)
+        pthread_mutex_lock(t->lock);
+    const UA_Node *node = t->ns->getNode(t->ns->context, id);
+    if(node) {
+        UA_DataValue value;
+        UA_DataValue_copy(&((const UA_VariableNode*)node)->value.data.value, &value);
+        t->ns->releaseNode(t->ns->context, node);
+        UA_DataValue_clear(&value);
+    }
+    if(t->lock)
+        pthread_mutex_unlock(t->lock);
+    t->reads++;
+}
+
+static void
+writeNode(BenchThread *t, const UA_NodeId *id) {
+    UA_StatusCode retval;
+    do {
+        if(t->lock)
+            pthread_mutex_lock(t->lock);
+        UA_Node *node = NULL;
+        retval = t->ns->getNodeCopy(t->ns->context, id, &node);
+        if(retval == UA_STATUSCODE_GOOD) {
+            UA_Variant *v = &((UA_VariableNode*)node)->value.data.value.value;
+            (*(UA_Int64*)v->data)++;
+            retval = t->ns->replaceNode(t->ns->context, node);
+        }
+        if(t->lock)
+            pthread_mutex_unlock(t->lock);
+        if(retval == UA_STATUSCODE_BADINTERNALERROR)
+            t->conflicts++;
+    } while(retval == UA_STATUSCODE_BADINTERNALERROR);
+    t->writes++;
+}
+
+static void *
+benchThread(void *data) {
+    BenchThread *t = (BenchThread*)data;
+    UA_UInt32 writeThreshold = (UA_UInt32)(writeRatio * (UA_Double)UA_UINT32_MAX);
+    pthread_barrier_wait(&startBarrier);
+    while(__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+        UA_NodeId id = UA_NODEID_NUMERIC(1, (UA_UInt32)
+            (BENCH_FIRST_NODEID + nextRandom(&t->seed) % nodes));
+        if(nextRandom(&t->seed) < writeThreshold)
+            writeNode(t, &id);
+        else
+            readNode(t, &id);
+    }
+    return NULL;
+}
+
+static int
+runConfiguration(const BenchNodestore *bns, size_t threads) {
+    UA_Nodestore ns;
+    memset(&ns, 0, sizeof(UA_Nodestore));
+    UA_StatusCode retval = bns->locked ?
+        UA_Nodestore_HashMap(&ns) : ConcurrentNodestore_init(&ns, 0);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = addNodes(&ns);
+    if(retval != UA_STATUSCODE_GOOD) {
+        fprintf(stderr, "Could not set up the %s nodestore: %s\n", bns->name,
+                UA_StatusCode_name(retval));
+        if(ns.context)
+            ns.clear(ns.context);
+        return EXIT_FAILURE;
+    }
+
+    pthread_mutex_t lock;
+    pthread_mutex_init(&lock, NULL);
+    BenchThread t[BENCH_MAX_THREADS];
+    memset(t, 0, sizeof(t));
+    pthread_barrier_init(&startBarrier, NULL, (unsigned)threads + 1);
+    __atomic_store_n(&running, true, __ATOMIC_RELAXED);
+    for(size_t i = 0; i < threads; i++) {
+        t[i].ns = &ns;
+        t[i].lock = bns->locked ? &lock : NULL;
+        t[i].seed = 2463534242u + (UA_UInt32)i * 7919;
+        pthread_create(&t[i].thread, NULL, benchThread, &t[i]);
+    }
+    pthread_barrier_wait(&startBarrier);
+    UA_UInt64 start = nowNs();
+    usleep((useconds_t)(duration * 1000000));
+    __atomic_store_n(&running, false, __ATOMIC_RELAXED);
+    for(size_t i = 0; i < threads; i++)
+        pthread_join(t[i].thread, NULL);
+    UA_Double elapsed = (UA_Double)(nowNs() - start) / 1e9;
+    pthread_barrier_destroy(&startBarrier);
+    pthread_mutex_destroy(&lock);
+
+    UA_UInt64 reads = 0, writes = 0, conflicts = 0;
+    for(size_t i = 0; i < threads; i++) {
+        reads += t[i].reads;
+        writes += t[i].writes;
+        conflicts += t[i].conflicts;
+    }
+    printf("{\"nodestore\":\"%s\",\"threads\":%lu,\"nodes\":%lu,\"writeRatio\":%.2f,"
+           "\"durationS\":%.3f,\"reads\":%lu,\"writes\":%lu,\"opsPerS\":%.1f,"
+           "\"conflicts\":%lu}\n", bns->name, (unsigned long)threads,
+           (unsigned long)nodes, writeRatio, elapsed, (unsigned long)reads,
+           (unsigned long)writes, (UA_Double)(reads + writes) / elapsed,
+           (unsigned long)conflicts);
+    fflush(stdout);
+    ns.clear(ns.context);
+    return EXIT_SUCCESS;
+}
+
+static void
+usage(char *progname) {
+    printf("usage: %s [--nodes=1000] [--write-ratio=0.1] [--duration=1]\n"
+           "       [--threads=1,2,4,8,16,32]\n", progname);
+}
+
+int main(int argc, char **argv) {
+    static const BenchNodestore nodestores[] = {
+        {"locked-hashmap", true},
+        {"concurrent", false}
+    };
+    size_t threadCounts[BENCH_MAX_THREADS] = {1, 2, 4, 8, 16, 32};
+    size_t threadCountsSize = 6;
+
+    for(int i = 1; i < argc; i++) {
+        if(strncmp(argv[i], "--nodes=", 8) == 0) {
+            nodes = strtoul(&argv[i][8], NULL, 10);
+        } else if(strncmp(argv[i], "--write-ratio=", 14) == 0) {
+            writeRatio = strtod(&argv[i][14], NULL);
+        } else if(strncmp(argv[i], "--duration=", 11) == 0) {
+            duration = strtod(&argv[i][11], NULL);
+        } else if(strncmp(argv[i], "--threads=", 10) == 0) {
+            char *pos = &argv[i][10];
+            threadCountsSize = 0;
+            while(*pos && threadCountsSize < BENCH_MAX_THREADS) {
+                threadCounts[threadCountsSize++] = strtoul(pos, &pos, 10);
+                if(*pos != ',')
+                    break;
+                pos++;
+            }
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if(nodes < 1 || writeRatio < 0 || writeRatio > 1 || duration <= 0 ||
+       threadCountsSize == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    for(size_t i = 0; i < threadCountsSize; i++) {
+        if(threadCounts[i] < 1 || threadCounts[i] > BENCH_MAX_THREADS) {
+            printf("Error: between 1 and %d threads\n", BENCH_MAX_THREADS);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for(size_t n = 0; n < sizeof(nodestores) / sizeof(nodestores[0]); n++) {
+        for(size_t i = 0; i < threadCountsSize; i++) {
+            if(runConfiguration(&nodestores[n], threadCounts[i]) != EXIT_SUCCESS)
+                return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
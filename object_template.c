@@ -0,0 +1,410 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "object_template.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define NOPARENT SIZE_MAX
+
+/* A node that is created for every instance. The nodes are in pre-order, so
+ * the parent of a node comes before it. */
+typedef struct {
+    size_t parent; /* Index of the parent node or NOPARENT for the instance */
+    UA_NodeClass nodeClass;
+    UA_NodeId referenceTypeId;
+    UA_QualifiedName browseName;
+    UA_NodeId typeDefinition;
+    UA_NodeId methodId; /* Methods are referenced, not copied */
+    UA_ObjectAttributes objectAttr;
+    UA_VariableAttributes variableAttr;
+} TemplateNode;
+
+struct ObjectTemplate {
+    UA_NodeId typeId;
+    TemplateNode *nodes;
+    size_t nodesSize;
+    size_t nodesCapacity;
+    size_t maxNameLength; /* Of the BrowseNames, for the child NodeIds */
+    ObjectTemplateConstructor constructor;
+    void *constructorContext;
+};
+
+/**********/
+/* Browse */
+/**********/
+
+static UA_BrowseResult
+browseReferences(UA_Server *server, const UA_NodeId *nodeId, UA_UInt32 referenceType,
+                 UA_BrowseDirection direction, UA_UInt32 nodeClassMask) {
+    UA_BrowseDescription bd;
+    UA_BrowseDescription_init(&bd);
+    bd.nodeId = *nodeId;
+    bd.browseDirection = direction;
+    bd.referenceTypeId = UA_NODEID_NUMERIC(0, referenceType);
+    bd.includeSubtypes = true;
+    bd.nodeClassMask = nodeClassMask;
+    bd.resultMask = UA_BROWSERESULTMASK_ALL;
+    return UA_Server_browse(server, 0, &bd);
+}
+
+static UA_StatusCode
+getSingleTarget(UA_Server *server, const UA_NodeId *nodeId, UA_UInt32 referenceType,
+                UA_BrowseDirection direction, UA_NodeId *target) {
+    UA_BrowseResult br = browseReferences(server, nodeId, referenceType, direction, 0);
+    UA_StatusCode retval = br.statusCode;
+    if(retval == UA_STATUSCODE_GOOD && br.referencesSize == 0)
+        retval = UA_STATUSCODE_BADNOTFOUND;
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_NodeId_copy(&br.references[0].nodeId.nodeId, target);
+    UA_BrowseResult_deleteMembers(&br);
+    return retval;
+}
+
+UA_StatusCode
+ObjectTemplate_getTypeDefinition(UA_Server *server, const UA_NodeId nodeId,
+                                 UA_NodeId *typeId) {
+    return getSingleTarget(server, &nodeId, UA_NS0ID_HASTYPEDEFINITION,
+                           UA_BROWSEDIRECTION_FORWARD, typeId);
+}
+
+static UA_Boolean
+isMandatory(UA_Server *server, const UA_NodeId *nodeId) {
+    UA_NodeId rule;
+    if(getSingleTarget(server, nodeId, UA_NS0ID_HASMODELLINGRULE,
+                       UA_BROWSEDIRECTION_FORWARD, &rule) != UA_STATUSCODE_GOOD)
+        return false;
+    UA_NodeId mandatory = UA_NODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY);
+    UA_Boolean result = UA_NodeId_equal(&rule, &mandatory);
+    UA_NodeId_deleteMembers(&rule);
+    return result;
+}
+
+/************/
+/* Template */
+/************/
+
+static void
+TemplateNode_clear(TemplateNode *n) {
+    UA_NodeId_deleteMembers(&n->referenceTypeId);
+    UA_QualifiedName_deleteMembers(&n->browseName);
+    UA_NodeId_deleteMembers(&n->typeDefinition);
+    UA_NodeId_deleteMembers(&n->methodId);
+    UA_ObjectAttributes_deleteMembers(&n->objectAttr);
+    UA_VariableAttributes_deleteMembers(&n->variableAttr);
+}
+
+static UA_Boolean
+hasChild(const ObjectTemplate *t, size_t parent, const UA_QualifiedName *browseName) {
+    for(size_t i = 0; i < t->nodesSize; i++) {
+        if(t->nodes[i].parent == parent &&
+           UA_QualifiedName_equal(&t->nodes[i].browseName, browseName))
+            return true;
+    }
+    return false;
+}
+
+/* The attributes are read once here and copied into every instance */
+static UA_StatusCode
+readAttributes(UA_Server *server, const UA_NodeId *nodeId, TemplateNode *n) {
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    if(n->nodeClass == UA_NODECLASS_OBJECT) {
+        UA_ObjectAttributes *attr = &n->objectAttr;
+        *attr = UA_ObjectAttributes_default;
+        retval |= UA_Server_readDisplayName(server, *nodeId, &attr->displayName);
+        retval |= UA_Server_readDescription(server, *nodeId, &attr->description);
+        retval |= UA_Server_readEventNotifier(server, *nodeId, &attr->eventNotifier);
+        return retval;
+    }
+
+    UA_VariableAttributes *attr = &n->variableAttr;
+    *attr = UA_VariableAttributes_default;
+    retval |= UA_Server_readDisplayName(server, *nodeId, &attr->displayName);
+    retval |= UA_Server_readDescription(server, *nodeId, &attr->description);
+    retval |= UA_Server_readDataType(server, *nodeId, &attr->dataType);
+    retval |= UA_Server_readValueRank(server, *nodeId, &attr->valueRank);
+    retval |= UA_Server_readAccessLevel(server, *nodeId, &attr->accessLevel);
+    retval |= UA_Server_readMinimumSamplingInterval(server, *nodeId,
+                                                    &attr->minimumSamplingInterval);
+    retval |= UA_Server_readHistorizing(server, *nodeId, &attr->historizing);
+    retval |= UA_Server_readValue(server, *nodeId, &attr->value);
+
+    UA_Variant dims;
+    UA_Variant_init(&dims);
+    retval |= UA_Server_readArrayDimensions(server, *nodeId, &dims);
+    if(retval == UA_STATUSCODE_GOOD && !UA_Variant_isScalar(&dims) &&
+       dims.type == &UA_TYPES[UA_TYPES_UINT32]) {
+        attr->arrayDimensions = (UA_UInt32*)dims.data;
+        attr->arrayDimensionsSize = dims.arrayLength;
+        dims.data = NULL;
+        dims.arrayLength = 0;
+    }
+    UA_Variant_deleteMembers(&dims);
+    return retval;
+}
+
+static UA_StatusCode
+appendNode(ObjectTemplate *t, UA_Server *server, size_t parent,
+           const UA_ReferenceDescription *rd) {
+    if(t->nodesSize == t->nodesCapacity) {
+        size_t capacity = t->nodesCapacity ? t->nodesCapacity * 2 : 16;
+        TemplateNode *nodes = (TemplateNode*)
+            UA_realloc(t->nodes, capacity * sizeof(TemplateNode));
+        if(!nodes)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        t->nodes = nodes;
+        t->nodesCapacity = capacity;
+    }
+
+    TemplateNode *n = &t->nodes[t->nodesSize];
+    memset(n, 0, sizeof(TemplateNode));
+    n->parent = parent;
+    n->nodeClass = rd->nodeClass;
+    UA_StatusCode retval = UA_NodeId_copy(&rd->referenceTypeId, &n->referenceTypeId);
+    retval |= UA_QualifiedName_copy(&rd->browseName, &n->browseName);
+    if(rd->nodeClass == UA_NODECLASS_METHOD)
+        retval |= UA_NodeId_copy(&rd->nodeId.nodeId, &n->methodId);
+    else
+        retval |= UA_NodeId_copy(&rd->typeDefinition.nodeId, &n->typeDefinition);
+    if(retval == UA_STATUSCODE_GOOD && rd->nodeClass != UA_NODECLASS_METHOD)
+        retval = readAttributes(server, &rd->nodeId.nodeId, n);
+    if(retval != UA_STATUSCODE_GOOD) {
+        TemplateNode_clear(n);
+        return retval;
+    }
+    if(n->browseName.name.length > t->maxNameLength)
+        t->maxNameLength = n->browseName.name.length;
+    t->nodesSize++;
+    return UA_STATUSCODE_GOOD;
+}
+
+/* Appends the mandatory children of source below the template node parent,
+ * and recursively their mandatory children. Children with the BrowseName of
+ * an existing child are skipped, so the subtypes are walked first. */
+static UA_StatusCode
+collectChildren(ObjectTemplate *t, UA_Server *server, const UA_NodeId *source,
+                size_t parent) {
+    UA_BrowseResult br =
+        browseReferences(server, source, UA_NS0ID_AGGREGATES, UA_BROWSEDIRECTION_FORWARD,
+                         UA_NODECLASS_OBJECT | UA_NODECLASS_VARIABLE |
+                         UA_NODECLASS_METHOD);
+    UA_StatusCode retval = br.statusCode;
+    for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < br.referencesSize; i++) {
+        const UA_ReferenceDescription *rd = &br.references[i];
+        if(!isMandatory(server, &rd->nodeId.nodeId) ||
+           hasChild(t, parent, &rd->browseName))
+            continue;
+        size_t index = t->nodesSize;
+        retval = appendNode(t, server, parent, rd);
+        if(retval == UA_STATUSCODE_GOOD && rd->nodeClass != UA_NODECLASS_METHOD)
+            retval = collectChildren(t, server, &rd->nodeId.nodeId, index);
+    }
+    UA_BrowseResult_deleteMembers(&br);
+    return retval;
+}
+
+UA_StatusCode
+ObjectTemplate_new(UA_Server *server, const UA_NodeId typeId, ObjectTemplate **t) {
+    ObjectTemplate *nt = (ObjectTemplate*)UA_calloc(1, sizeof(ObjectTemplate));
+    if(!nt)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    UA_StatusCode retval = UA_NodeId_copy(&typeId, &nt->typeId);
+
+    /* Walk up to BaseObjectType, which has no mandatory children */
+    const UA_NodeId baseObjectType = UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE);
+    UA_NodeId current;
+    retval |= UA_NodeId_copy(&typeId, &current);
+    while(retval == UA_STATUSCODE_GOOD && !UA_NodeId_equal(&current, &baseObjectType)) {
+        retval = collectChildren(nt, server, &current, NOPARENT);
+        UA_NodeId super;
+        UA_NodeId_init(&super);
+        if(retval == UA_STATUSCODE_GOOD)
+            retval = getSingleTarget(server, &current, UA_NS0ID_HASSUBTYPE,
+                                     UA_BROWSEDIRECTION_INVERSE, &super);
+        UA_NodeId_deleteMembers(&current);
+        current = super;
+    }
+    UA_NodeId_deleteMembers(&current);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        ObjectTemplate_delete(nt);
+        return retval;
+    }
+    *t = nt;
+    return UA_STATUSCODE_GOOD;
+}
+
+void
+ObjectTemplate_delete(ObjectTemplate *t) {
+    if(!t)
+        return;
+    for(size_t i = 0; i < t->nodesSize; i++)
+        TemplateNode_clear(&t->nodes[i]);
+    UA_free(t->nodes);
+    UA_NodeId_deleteMembers(&t->typeId);
+    UA_free(t);
+}
+
+void
+ObjectTemplate_setConstructor(ObjectTemplate *t, ObjectTemplateConstructor constructor,
+                              void *context) {
+    t->constructor = constructor;
+    t->constructorContext = context;
+}
+
+size_t
+ObjectTemplate_nodesPerInstance(const ObjectTemplate *t) {
+    size_t count = 1;
+    for(size_t i = 0; i < t->nodesSize; i++) {
+        if(t->nodes[i].nodeClass != UA_NODECLASS_METHOD)
+            count++;
+    }
+    return count;
+}
+
+/*****************/
+/* Instantiation */
+/*****************/
+
+/* <parent>.<name> into buf, which has room for the longest path */
+static UA_NodeId
+childNodeId(const UA_NodeId *parent, const UA_QualifiedName *browseName,
+            UA_Byte *buf) {
+    if(parent->identifierType != UA_NODEIDTYPE_STRING)
+        return UA_NODEID_NULL;
+    const UA_String *p = &parent->identifier.string;
+    memcpy(buf, p->data, p->length);
+    buf[p->length] = '.';
+    memcpy(&buf[p->length + 1], browseName->name.data, browseName->name.length);
+    UA_NodeId id;
+    id.namespaceIndex = parent->namespaceIndex;
+    id.identifierType = UA_NODEIDTYPE_STRING;
+    id.identifier.string.length = p->length + 1 + browseName->name.length;
+    id.identifier.string.data = buf;
+    return id;
+}
+
+/* Depth of a template node, for the length of the child NodeIds */
+static size_t
+depth(const ObjectTemplate *t, size_t index) {
+    size_t d = 1;
+    for(; t->nodes[index].parent != NOPARENT; index = t->nodes[index].parent)
+        d++;
+    return d;
+}
+
+static UA_StatusCode
+addInstance(const ObjectTemplate *t, UA_Server *server, const UA_NodeId *parentId,
+            const UA_NodeId *referenceTypeId, const UA_QualifiedName *browseName,
+            const UA_NodeId *requestedId, UA_NodeId *ids, UA_Byte *buf,
+            UA_NodeId *outId) {
+    UA_ObjectAttributes oAttr = UA_ObjectAttributes_default;
+    oAttr.displayName.text = browseName->name;
+    UA_NodeId instanceId;
+    UA_StatusCode retval =
+        UA_Server_addNode_begin(server, UA_NODECLASS_OBJECT, *requestedId, *parentId,
+                                *referenceTypeId, *browseName, t->typeId, &oAttr,
+                                &UA_TYPES[UA_TYPES_OBJECTATTRIBUTES], NULL, &instanceId);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    /* ids[i] is the NodeId of template node i in this instance. The string
+     * NodeIds of the children are built into the buffer one after the other. */
+    size_t bufPos = 0;
+    for(size_t i = 0; i < t->nodesSize && retval == UA_STATUSCODE_GOOD; i++) {
+        const TemplateNode *n = &t->nodes[i];
+        const UA_NodeId *parent = n->parent == NOPARENT ? &instanceId : &ids[n->parent];
+        UA_NodeId_init(&ids[i]);
+        if(n->nodeClass == UA_NODECLASS_METHOD) {
+            UA_ExpandedNodeId target;
+            UA_ExpandedNodeId_init(&target);
+            target.nodeId = n->methodId;
+            retval = UA_Server_addReference(server, *parent, n->referenceTypeId,
+                                            target, true);
+            continue;
+        }
+        UA_NodeId requested = childNodeId(parent, &n->browseName, &buf[bufPos]);
+        if(requested.identifierType == UA_NODEIDTYPE_STRING)
+            bufPos += requested.identifier.string.length;
+        if(n->nodeClass == UA_NODECLASS_OBJECT)
+            retval = UA_Server_addNode_begin(server, UA_NODECLASS_OBJECT, requested,
+                                             *parent, n->referenceTypeId, n->browseName,
+                                             n->typeDefinition, &n->objectAttr,
+                                             &UA_TYPES[UA_TYPES_OBJECTATTRIBUTES],
+                                             NULL, &ids[i]);
+        else
+            retval = UA_Server_addNode_begin(server, UA_NODECLASS_VARIABLE, requested,
+                                             *parent, n->referenceTypeId, n->browseName,
+                                             n->typeDefinition, &n->variableAttr,
+                                             &UA_TYPES[UA_TYPES_VARIABLEATTRIBUTES],
+                                             NULL, &ids[i]);
+    }
+
+    for(size_t i = 0; i < t->nodesSize; i++)
+        UA_NodeId_deleteMembers(&ids[i]);
+    if(retval == UA_STATUSCODE_GOOD)
+        *outId = instanceId;
+    else
+        UA_NodeId_deleteMembers(&instanceId);
+    return retval;
+}
+
+UA_StatusCode
+ObjectTemplate_instantiate(const ObjectTemplate *t, UA_Server *server,
+                           const UA_NodeId parentId, const UA_NodeId referenceTypeId,
+                           size_t instancesSize, const UA_QualifiedName *browseNames,
+                           const UA_NodeId *requestedIds, UA_NodeId *outIds) {
+    if(instancesSize == 0)
+        return UA_STATUSCODE_GOOD;
+
+    /* The longest instance NodeId gives the size of the NodeId buffer */
+    size_t maxIdLength = 0;
+    for(size_t i = 0; requestedIds && i < instancesSize; i++) {
+        if(requestedIds[i].identifierType == UA_NODEIDTYPE_STRING &&
+           requestedIds[i].identifier.string.length > maxIdLength)
+            maxIdLength = requestedIds[i].identifier.string.length;
+    }
+    size_t bufSize = 1;
+    for(size_t i = 0; maxIdLength > 0 && i < t->nodesSize; i++)
+        bufSize += maxIdLength + depth(t, i) * (t->maxNameLength + 1);
+
+    UA_NodeId *ids = (UA_NodeId*)UA_calloc(t->nodesSize + 1, sizeof(UA_NodeId));
+    UA_NodeId *instances = (UA_NodeId*)UA_calloc(instancesSize, sizeof(UA_NodeId));
+    UA_Byte *buf = (UA_Byte*)UA_malloc(bufSize);
+    if(!ids || !instances || !buf) {
+        UA_free(ids);
+        UA_free(instances);
+        UA_free(buf);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    size_t added = 0;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    for(; added < instancesSize; added++) {
+        const UA_NodeId *requested = requestedIds ? &requestedIds[added] : &UA_NODEID_NULL;
+        retval = addInstance(t, server, &parentId, &referenceTypeId, &browseNames[added],
+                             requested, ids, buf, &instances[added]);
+        if(retval != UA_STATUSCODE_GOOD)
+            break;
+    }
+
+    /* One constructor call for the batch */
+    if(added > 0 && t->constructor) {
+        UA_StatusCode res =
+            t->constructor(server, instances, added, t->constructorContext);
+        if(retval == UA_STATUSCODE_GOOD)
+            retval = res;
+    }
+
+    for(size_t i = 0; i < added; i++) {
+        if(outIds)
+            outIds[i] = instances[i];
+        else
+            UA_NodeId_deleteMembers(&instances[i]);
+    }
+    UA_free(ids);
+    UA_free(instances);
+    UA_free(buf);
+    return retval;
+}
@@ -0,0 +1,77 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef OBJECT_TEMPLATE_H_
+#define OBJECT_TEMPLATE_H_
+
+/* The API level of ServerPublisher.c, the single-header open62541 before 1.0 */
+#include "open62541.h"
+
+/**
+ * Object Templates
+ * ----------------
+ * Every ``UA_Server_addObjectNode`` walks the type hierarchy of the object
+ * type, browses the mandatory children of every supertype, copies them and
+ * calls the constructors node by node. For thousands of identical instances
+ * the walk gives the same result every time.
+ *
+ * An object template walks the hierarchy once. It records the mandatory
+ * children (also those of the supertypes and of the children themselves)
+ * with their attributes, reference types and type definitions. A child of a
+ * subtype replaces the child of a supertype with the same BrowseName, as in
+ * the server. Mandatory methods are referenced, not copied.
+ *
+ * ``ObjectTemplate_instantiate`` then inserts the instances and their
+ * children with ``UA_Server_addNode_begin`` only, which adds the node with
+ * the references to its parent and type definition. ``UA_Server_addNode_finish``
+ * is not called, so its instantiation walk, its type checks and the
+ * lifecycle constructors registered in the server are skipped for the
+ * instances and their children. The children need no checks, since their
+ * attributes are copies of the children of the type, which the server
+ * checked when the type was defined. Instead of the lifecycle constructors,
+ * the constructor of the template is called once for the whole batch. An
+ * application that relies on a type constructor has to do its work in the
+ * template constructor.
+ *
+ * If the NodeId of an instance is a string NodeId, the children get the
+ * string NodeIds ``<parent>.<BrowseName>`` in the same namespace. Otherwise
+ * the server assigns numeric NodeIds.
+ *
+ * Changes to the type after the template was created are not seen. */
+
+typedef struct ObjectTemplate ObjectTemplate;
+
+/* Called once per instantiate call with all new instances */
+typedef UA_StatusCode
+(*ObjectTemplateConstructor)(UA_Server *server, const UA_NodeId *instances,
+                             size_t instancesSize, void *context);
+
+UA_StatusCode
+ObjectTemplate_new(UA_Server *server, const UA_NodeId typeId, ObjectTemplate **t);
+
+void
+ObjectTemplate_delete(ObjectTemplate *t);
+
+void
+ObjectTemplate_setConstructor(ObjectTemplate *t, ObjectTemplateConstructor constructor,
+                              void *context);
+
+/* Number of nodes created per instance, including the instance */
+size_t
+ObjectTemplate_nodesPerInstance(const ObjectTemplate *t);
+
+/* requestedIds and outIds can be NULL. The DisplayName of an instance is
+ * the name of its BrowseName. Stops at the first error, the instances
+ * added so far remain. */
+UA_StatusCode
+ObjectTemplate_instantiate(const ObjectTemplate *t, UA_Server *server,
+                           const UA_NodeId parentId, const UA_NodeId referenceTypeId,
+                           size_t instancesSize, const UA_QualifiedName *browseNames,
+                           const UA_NodeId *requestedIds, UA_NodeId *outIds);
+
+/* The target of the HasTypeDefinition reference of a node */
+UA_StatusCode
+ObjectTemplate_getTypeDefinition(UA_Server *server, const UA_NodeId nodeId,
+                                 UA_NodeId *typeId);
+
+#endif /* OBJECT_TEMPLATE_H_ */
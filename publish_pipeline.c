@@ -0,0 +1,270 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "publish_pipeline.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#include <math.h>
+
+typedef struct {
+    UA_UInt32 subId;
+    UA_Double publishingIntervalMs; /* As revised by the server */
+    UA_UInt64 windowNotifications;
+    UA_UInt64 clockSkewed;          /* Values with a timestamp in the future */
+    LatencyHistogram total;
+} PipelineSubscription;
+
+struct PublishPipeline {
+    PublishPipelineConfig config;
+    UA_UInt16 inFlight;
+    UA_Double rttMs;            /* Smoothed, 0 until the first probe returned */
+    UA_DateTime probeSent;      /* Monotonic, 0 if no probe is in flight */
+    UA_UInt32 probeRequestId;
+    UA_DateTime windowStart;
+    UA_DateTime lastReport;
+    PipelineSubscription **subs;
+    size_t subsSize;
+};
+
+static PipelineSubscription *
+findSubscription(const PublishPipeline *pipe, UA_UInt32 subId) {
+    for(size_t i = 0; i < pipe->subsSize; i++) {
+        if(pipe->subs[i]->subId == subId)
+            return pipe->subs[i];
+    }
+    return NULL;
+}
+
+PublishPipeline *
+PublishPipeline_new(const PublishPipelineConfig *config) {
+    PublishPipeline *pipe = (PublishPipeline*)UA_calloc(1, sizeof(PublishPipeline));
+    if(!pipe)
+        return NULL;
+    if(config) {
+        pipe->config = *config;
+    } else {
+        PublishPipelineConfig defaultConfig = PUBLISHPIPELINECONFIG_DEFAULT;
+        pipe->config = defaultConfig;
+    }
+    if(pipe->config.minPublishRequests == 0)
+        pipe->config.minPublishRequests = 1;
+    if(pipe->config.maxPublishRequests < pipe->config.minPublishRequests)
+        pipe->config.maxPublishRequests = pipe->config.minPublishRequests;
+    if(pipe->config.adaptIntervalMs == 0)
+        pipe->config.adaptIntervalMs = 1000;
+    pipe->inFlight = pipe->config.minPublishRequests;
+    pipe->windowStart = UA_DateTime_nowMonotonic();
+    pipe->lastReport = pipe->windowStart;
+    return pipe;
+}
+
+void
+PublishPipeline_delete(PublishPipeline *pipe) {
+    for(size_t i = 0; i < pipe->subsSize; i++)
+        UA_free(pipe->subs[i]);
+    UA_free(pipe->subs);
+    UA_free(pipe);
+}
+
+UA_CreateSubscriptionRequest
+PublishPipeline_createRequest(const PublishPipeline *pipe) {
+    UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
+    const PublishPipelineConfig *c = &pipe->config;
+    if(c->publishingIntervalMs > 0.0)
+        request.requestedPublishingInterval = c->publishingIntervalMs;
+    if(c->maxKeepAliveCount > 0)
+        request.requestedMaxKeepAliveCount = c->maxKeepAliveCount;
+    if(c->lifetimeCount > 0)
+        request.requestedLifetimeCount = c->lifetimeCount;
+    if(c->maxNotificationsPerPublish > 0)
+        request.maxNotificationsPerPublish = c->maxNotificationsPerPublish;
+    return request;
+}
+
+UA_StatusCode
+PublishPipeline_addSubscription(PublishPipeline *pipe,
+                                const UA_CreateSubscriptionResponse *response) {
+    if(findSubscription(pipe, response->subscriptionId))
+        return UA_STATUSCODE_GOOD;
+    PipelineSubscription **subs = (PipelineSubscription**)
+        UA_realloc(pipe->subs, (pipe->subsSize + 1) * sizeof(PipelineSubscription*));
+    if(!subs)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    pipe->subs = subs;
+    PipelineSubscription *sub = (PipelineSubscription*)
+        UA_calloc(1, sizeof(PipelineSubscription));
+    if(!sub)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    sub->subId = response->subscriptionId;
+    sub->publishingIntervalMs = response->revisedPublishingInterval;
+    LatencyHistogram_init(&sub->total);
+    pipe->subs[pipe->subsSize++] = sub;
+    return UA_STATUSCODE_GOOD;
+}
+
+void
+PublishPipeline_removeSubscription(PublishPipeline *pipe, UA_UInt32 subId) {
+    for(size_t i = 0; i < pipe->subsSize; i++) {
+        if(pipe->subs[i]->subId != subId)
+            continue;
+        UA_free(pipe->subs[i]);
+        pipe->subs[i] = pipe->subs[--pipe->subsSize];
+        return;
+    }
+}
+
+static void
+report(const PublishPipeline *pipe) {
+    for(size_t i = 0; i < pipe->subsSize; i++) {
+        const PipelineSubscription *sub = pipe->subs[i];
+        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_CLIENT,
+                    "Subscription %u: %lu values, delay p50 %lu us, p99 %lu us, "
+                    "p99.9 %lu us, max %lu us, %lu with clock skew, "
+                    "rtt %.2f ms, %u PublishRequests in flight", sub->subId,
+                    (unsigned long)sub->total.count,
+                    (unsigned long)LatencyHistogram_percentile(&sub->total, 0.5),
+                    (unsigned long)LatencyHistogram_percentile(&sub->total, 0.99),
+                    (unsigned long)LatencyHistogram_percentile(&sub->total, 0.999),
+                    (unsigned long)sub->total.max, (unsigned long)sub->clockSkewed,
+                    pipe->rttMs, pipe->inFlight);
+    }
+}
+
+/**
+ * Round-trip Time
+ * ^^^^^^^^^^^^^^^
+ * The client library sends the PublishRequests internally and does not tell
+ * when. A Read of the server's CurrentTime travels the same SecureChannel and
+ * session, but is answered right away instead of being held for the next
+ * publishing interval. Its request->response time on the monotonic clock is
+ * the rtt of the pipeline. One probe is sent per adaptIntervalMs. */
+
+static void
+probeResponse(UA_Client *client, void *userdata, UA_UInt32 requestId,
+              UA_ReadResponse *response) {
+    PublishPipeline *pipe = (PublishPipeline*)userdata;
+    if(pipe->probeSent == 0 || requestId != pipe->probeRequestId)
+        return; /* A probe that was given up on */
+    UA_DateTime sent = pipe->probeSent;
+    pipe->probeSent = 0;
+    if(response->responseHeader.serviceResult != UA_STATUSCODE_GOOD)
+        return;
+    UA_Double rttMs = (UA_Double)(UA_DateTime_nowMonotonic() - sent) / UA_DATETIME_MSEC;
+    /* Smoothed as the TCP round-trip time (RFC 6298) */
+    if(pipe->rttMs > 0.0)
+        pipe->rttMs = 0.875 * pipe->rttMs + 0.125 * rttMs;
+    else
+        pipe->rttMs = rttMs;
+}
+
+static void
+sendProbe(PublishPipeline *pipe, UA_Client *client, UA_DateTime now) {
+    /* Give up on a probe after the request timeout of the client */
+    if(pipe->probeSent != 0 &&
+       now - pipe->probeSent < (UA_DateTime)UA_Client_getConfig(client)->timeout * UA_DATETIME_MSEC)
+        return;
+    UA_ReadValueId rvid;
+    UA_ReadValueId_init(&rvid);
+    rvid.nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_SERVERSTATUS_CURRENTTIME);
+    rvid.attributeId = UA_ATTRIBUTEID_VALUE;
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.nodesToRead = &rvid;
+    request.nodesToReadSize = 1;
+    pipe->probeSent = now;
+    if(UA_Client_sendAsyncReadRequest(client, &request, probeResponse, pipe,
+                                      &pipe->probeRequestId) != UA_STATUSCODE_GOOD)
+        pipe->probeSent = 0;
+}
+
+static void
+adapt(PublishPipeline *pipe, UA_Client *client, UA_DateTime now) {
+    UA_Double windowSec = (UA_Double)(now - pipe->windowStart) / UA_DATETIME_SEC;
+    if(windowSec <= 0.0)
+        return;
+
+    /* Expected publish responses per second over all subscriptions */
+    UA_Double responseRate = 0.0;
+    for(size_t i = 0; i < pipe->subsSize; i++) {
+        PipelineSubscription *sub = pipe->subs[i];
+        UA_Double rate = (UA_Double)sub->windowNotifications / windowSec;
+        if(sub->publishingIntervalMs > 0.0 && rate > 1000.0 / sub->publishingIntervalMs)
+            rate = 1000.0 / sub->publishingIntervalMs;
+        responseRate += rate;
+        sub->windowNotifications = 0;
+    }
+
+    UA_Double rttMs = pipe->rttMs > 0.0 ? pipe->rttMs : pipe->config.defaultRttMs;
+    UA_Double target = ceil(responseRate * rttMs / 1000.0) + 1.0;
+    if(target < pipe->config.minPublishRequests)
+        target = pipe->config.minPublishRequests;
+    if(target > pipe->config.maxPublishRequests)
+        target = pipe->config.maxPublishRequests;
+
+    UA_UInt16 inFlight = (UA_UInt16)target;
+    if(inFlight != pipe->inFlight) {
+        UA_LOG_DEBUG(UA_Log_Stdout, UA_LOGCATEGORY_CLIENT,
+                     "Adapting PublishRequests in flight from %u to %u "
+                     "(%.1f responses/s, rtt %.2f ms)",
+                     pipe->inFlight, inFlight, responseRate, rttMs);
+        pipe->inFlight = inFlight;
+    }
+    /* The client tops up the outstanding requests with every iteration */
+    UA_Client_getConfig(client)->outStandingPublishRequests = pipe->inFlight;
+    pipe->windowStart = now;
+    sendProbe(pipe, client, now);
+}
+
+void
+PublishPipeline_onNotification(PublishPipeline *pipe, UA_Client *client,
+                               UA_UInt32 subId, const UA_DataValue *value) {
+    PipelineSubscription *sub = findSubscription(pipe, subId);
+    if(!sub)
+        return;
+
+    sub->windowNotifications++;
+    UA_DateTime stamp = 0;
+    if(value->hasServerTimestamp)
+        stamp = value->serverTimestamp;
+    else if(value->hasSourceTimestamp)
+        stamp = value->sourceTimestamp;
+    if(stamp != 0) {
+        UA_DateTime delay = UA_DateTime_now() - stamp;
+        if(delay < 0) {
+            sub->clockSkewed++;
+        } else {
+            UA_UInt64 us = (UA_UInt64)(delay / UA_DATETIME_USEC);
+            LatencyHistogram_record(&sub->total, us);
+        }
+    }
+
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    if(now - pipe->windowStart >= (UA_DateTime)pipe->config.adaptIntervalMs * UA_DATETIME_MSEC)
+        adapt(pipe, client, now);
+    if(pipe->config.reportIntervalMs > 0 &&
+       now - pipe->lastReport >= (UA_DateTime)pipe->config.reportIntervalMs * UA_DATETIME_MSEC) {
+        report(pipe);
+        pipe->lastReport = now;
+    }
+}
+
+UA_StatusCode
+PublishPipeline_getLatency(const PublishPipeline *pipe, UA_UInt32 subId,
+                           UA_UInt64 *p50, UA_UInt64 *p99, UA_UInt64 *p999) {
+    const PipelineSubscription *sub = findSubscription(pipe, subId);
+    if(!sub)
+        return UA_STATUSCODE_BADNOTFOUND;
+    if(p50)
+        *p50 = LatencyHistogram_percentile(&sub->total, 0.5);
+    if(p99)
+        *p99 = LatencyHistogram_percentile(&sub->total, 0.99);
+    if(p999)
+        *p999 = LatencyHistogram_percentile(&sub->total, 0.999);
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_UInt16
+PublishPipeline_getInFlight(const PublishPipeline *pipe) {
+    return pipe->inFlight;
+}
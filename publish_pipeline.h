@@ -0,0 +1,90 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBLISH_PIPELINE_H_
+#define PUBLISH_PIPELINE_H_
+
+#include <open62541/client_subscriptions.h>
+
+#include "latency_histogram.h"
+
+/**
+ * Publish Request Pipelining
+ * --------------------------
+ * A server can only send a notification message if the client has a
+ * PublishRequest queued. With too few requests in flight, every batch waits
+ * one round-trip for the next request. The PublishPipeline observes the
+ * notification rate and latency of the subscriptions of one client and
+ * adapts ``UA_ClientConfig.outStandingPublishRequests`` so that
+ *
+ *    inFlight = ceil(responseRate * rtt) + 1
+ *
+ * lies between minPublishRequests and maxPublishRequests. The responseRate
+ * is bounded by one message per publishing interval and subscription. The
+ * rtt is the smoothed request->response time of a small Read that the
+ * pipeline sends on the session once per adaptIntervalMs. Unlike the
+ * PublishRequests, the server answers it without waiting for the publishing
+ * interval. Until the first answer, defaultRttMs is used.
+ *
+ * The per-subscription delay histograms (in microseconds) measure the time
+ * from the server timestamp of a value to its arrival at the client. This
+ * requires roughly synchronized clocks. They are exposed for tuning the
+ * publishing interval and keep-alive settings. */
+
+typedef struct {
+    /* Subscription parameters. Zero keeps the value from
+     * UA_CreateSubscriptionRequest_default(). */
+    UA_Double publishingIntervalMs;
+    UA_UInt32 maxKeepAliveCount;
+    UA_UInt32 lifetimeCount;
+    UA_UInt32 maxNotificationsPerPublish;
+
+    /* Bounds for the number of PublishRequests in flight */
+    UA_UInt16 minPublishRequests;
+    UA_UInt16 maxPublishRequests;
+
+    UA_Double defaultRttMs;
+    UA_UInt32 adaptIntervalMs;  /* Length of the observation window */
+    UA_UInt32 reportIntervalMs; /* Log the percentiles, 0 disables */
+} PublishPipelineConfig;
+
+#define PUBLISHPIPELINECONFIG_DEFAULT {0.0, 0, 0, 0, 1, 16, 10.0, 1000, 10000}
+
+typedef struct PublishPipeline PublishPipeline;
+
+PublishPipeline *
+PublishPipeline_new(const PublishPipelineConfig *config);
+
+void
+PublishPipeline_delete(PublishPipeline *pipe);
+
+/* Returns UA_CreateSubscriptionRequest_default() with the configured
+ * subscription parameters applied */
+UA_CreateSubscriptionRequest
+PublishPipeline_createRequest(const PublishPipeline *pipe);
+
+/* Registers a subscription after the server has revised its parameters */
+UA_StatusCode
+PublishPipeline_addSubscription(PublishPipeline *pipe,
+                                const UA_CreateSubscriptionResponse *response);
+
+void
+PublishPipeline_removeSubscription(PublishPipeline *pipe, UA_UInt32 subId);
+
+/* Called from the data change callbacks. Records the delay of the value and
+ * adapts the pipeline depth of the client once per adaptIntervalMs. The
+ * pipeline must outlive the client, which may still answer a pending probe. */
+void
+PublishPipeline_onNotification(PublishPipeline *pipe, UA_Client *client,
+                               UA_UInt32 subId, const UA_DataValue *value);
+
+/* Delay percentiles in microseconds. Returns BADNOTFOUND for an unknown
+ * subscription. */
+UA_StatusCode
+PublishPipeline_getLatency(const PublishPipeline *pipe, UA_UInt32 subId,
+                           UA_UInt64 *p50, UA_UInt64 *p99, UA_UInt64 *p999);
+
+UA_UInt16
+PublishPipeline_getInFlight(const PublishPipeline *pipe);
+
+#endif /* PUBLISH_PIPELINE_H_ */
@@ -0,0 +1,516 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_aggregator.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AGGREGATOR_X86
+#include <immintrin.h>
+#endif
+
+enum {
+    AGGREGATE_MIN = 0,
+    AGGREGATE_MAX,
+    AGGREGATE_MEAN,
+    AGGREGATE_LAST,
+    AGGREGATE_COUNT,
+    AGGREGATES
+};
+
+static const char *aggregateNames[AGGREGATES] = {"Min", "Max", "Mean", "Last", "Count"};
+
+typedef struct {
+    UA_Double min;
+    UA_Double max;
+    UA_Double sum;
+    UA_Double last;
+    UA_UInt64 count;
+} Pane;
+
+typedef struct {
+    UA_NodeId nodes[AGGREGATES];
+    Pane panes[PUBSUBAGGREGATOR_MAXPANES];
+} AggregatedField;
+
+struct PubSubAggregator {
+    UA_Server *server;
+    UA_UInt64 callbackId;
+    size_t panesSize;
+    size_t currentPane; /* The same for all fields */
+    UA_Double *scratch; /* Arrays of other types, converted to Double */
+    size_t scratchSize;
+    size_t fieldsSize;
+    AggregatedField fields[];
+};
+
+/**
+ * Reductions
+ * ^^^^^^^^^^
+ * Min, max and sum of n > 0 values. Floats are summed as Doubles. */
+
+typedef void (*ReduceDoubles)(const UA_Double *v, size_t n, UA_Double *min,
+                              UA_Double *max, UA_Double *sum);
+typedef void (*ReduceFloats)(const UA_Float *v, size_t n, UA_Double *min,
+                             UA_Double *max, UA_Double *sum);
+
+static void
+reduceDoublesScalar(const UA_Double *v, size_t n, UA_Double *min, UA_Double *max,
+                    UA_Double *sum) {
+    UA_Double mn = v[0], mx = v[0], s = 0.0;
+    for(size_t i = 0; i < n; i++) {
+        mn = v[i] < mn ? v[i] : mn;
+        mx = v[i] > mx ? v[i] : mx;
+        s += v[i];
+    }
+    *min = mn;
+    *max = mx;
+    *sum = s;
+}
+
+static void
+reduceFloatsScalar(const UA_Float *v, size_t n, UA_Double *min, UA_Double *max,
+                   UA_Double *sum) {
+    UA_Double mn = v[0], mx = v[0], s = 0.0;
+    for(size_t i = 0; i < n; i++) {
+        UA_Double x = v[i];
+        mn = x < mn ? x : mn;
+        mx = x > mx ? x : mx;
+        s += x;
+    }
+    *min = mn;
+    *max = mx;
+    *sum = s;
+}
+
+#ifdef AGGREGATOR_X86
+
+__attribute__((target("sse2"))) static void
+finishSse2(__m128d vmin, __m128d vmax, __m128d vsum, const UA_Double *tail,
+           size_t tailSize, UA_Double *min, UA_Double *max, UA_Double *sum) {
+    UA_Double mn[2], mx[2], s[2];
+    _mm_storeu_pd(mn, vmin);
+    _mm_storeu_pd(mx, vmax);
+    _mm_storeu_pd(s, vsum);
+    UA_Double tmin = mn[0], tmax = mx[0], tsum = 0.0;
+    if(tailSize > 0)
+        reduceDoublesScalar(tail, tailSize, &tmin, &tmax, &tsum);
+    *min = fmin(fmin(mn[0], mn[1]), tmin);
+    *max = fmax(fmax(mx[0], mx[1]), tmax);
+    *sum = s[0] + s[1] + tsum;
+}
+
+__attribute__((target("sse2"))) static void
+reduceDoublesSse2(const UA_Double *v, size_t n, UA_Double *min, UA_Double *max,
+                  UA_Double *sum) {
+    if(n < 4) {
+        reduceDoublesScalar(v, n, min, max, sum);
+        return;
+    }
+    __m128d vmin = _mm_loadu_pd(v), vmax = vmin;
+    __m128d vsum0 = _mm_setzero_pd(), vsum1 = _mm_setzero_pd();
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4) {
+        __m128d a = _mm_loadu_pd(&v[i]);
+        __m128d b = _mm_loadu_pd(&v[i + 2]);
+        vmin = _mm_min_pd(vmin, _mm_min_pd(a, b));
+        vmax = _mm_max_pd(vmax, _mm_max_pd(a, b));
+        vsum0 = _mm_add_pd(vsum0, a);
+        vsum1 = _mm_add_pd(vsum1, b);
+    }
+    finishSse2(vmin, vmax, _mm_add_pd(vsum0, vsum1), &v[i], n - i, min, max, sum);
+}
+
+__attribute__((target("sse2"))) static void
+reduceFloatsSse2(const UA_Float *v, size_t n, UA_Double *min, UA_Double *max,
+                 UA_Double *sum) {
+    if(n < 4) {
+        reduceFloatsScalar(v, n, min, max, sum);
+        return;
+    }
+    __m128 f = _mm_loadu_ps(v);
+    __m128d vmin = _mm_cvtps_pd(f), vmax = vmin;
+    __m128d vsum0 = _mm_setzero_pd(), vsum1 = _mm_setzero_pd();
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4) {
+        f = _mm_loadu_ps(&v[i]);
+        __m128d a = _mm_cvtps_pd(f);
+        __m128d b = _mm_cvtps_pd(_mm_movehl_ps(f, f));
+        vmin = _mm_min_pd(vmin, _mm_min_pd(a, b));
+        vmax = _mm_max_pd(vmax, _mm_max_pd(a, b));
+        vsum0 = _mm_add_pd(vsum0, a);
+        vsum1 = _mm_add_pd(vsum1, b);
+    }
+    UA_Double tmin, tmax, tsum = 0.0;
+    finishSse2(vmin, vmax, _mm_add_pd(vsum0, vsum1), NULL, 0, min, max, sum);
+    if(i < n) {
+        reduceFloatsScalar(&v[i], n - i, &tmin, &tmax, &tsum);
+        *min = fmin(*min, tmin);
+        *max = fmax(*max, tmax);
+        *sum += tsum;
+    }
+}
+
+__attribute__((target("avx"))) static void
+finishAvx(__m256d vmin, __m256d vmax, __m256d vsum, UA_Double *min, UA_Double *max,
+          UA_Double *sum) {
+    UA_Double mn[4], mx[4], s[4];
+    _mm256_storeu_pd(mn, vmin);
+    _mm256_storeu_pd(mx, vmax);
+    _mm256_storeu_pd(s, vsum);
+    *min = fmin(fmin(mn[0], mn[1]), fmin(mn[2], mn[3]));
+    *max = fmax(fmax(mx[0], mx[1]), fmax(mx[2], mx[3]));
+    *sum = (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+__attribute__((target("avx"))) static void
+reduceDoublesAvx(const UA_Double *v, size_t n, UA_Double *min, UA_Double *max,
+                 UA_Double *sum) {
+    if(n < 8) {
+        reduceDoublesScalar(v, n, min, max, sum);
+        return;
+    }
+    __m256d vmin = _mm256_loadu_pd(v), vmax = vmin;
+    __m256d vsum0 = _mm256_setzero_pd(), vsum1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256d a = _mm256_loadu_pd(&v[i]);
+        __m256d b = _mm256_loadu_pd(&v[i + 4]);
+        vmin = _mm256_min_pd(vmin, _mm256_min_pd(a, b));
+        vmax = _mm256_max_pd(vmax, _mm256_max_pd(a, b));
+        vsum0 = _mm256_add_pd(vsum0, a);
+        vsum1 = _mm256_add_pd(vsum1, b);
+    }
+    finishAvx(vmin, vmax, _mm256_add_pd(vsum0, vsum1), min, max, sum);
+    if(i < n) {
+        UA_Double tmin, tmax, tsum;
+        reduceDoublesScalar(&v[i], n - i, &tmin, &tmax, &tsum);
+        *min = fmin(*min, tmin);
+        *max = fmax(*max, tmax);
+        *sum += tsum;
+    }
+}
+
+__attribute__((target("avx"))) static void
+reduceFloatsAvx(const UA_Float *v, size_t n, UA_Double *min, UA_Double *max,
+                UA_Double *sum) {
+    if(n < 8) {
+        reduceFloatsScalar(v, n, min, max, sum);
+        return;
+    }
+    __m256d vmin = _mm256_cvtps_pd(_mm_loadu_ps(v)), vmax = vmin;
+    __m256d vsum0 = _mm256_setzero_pd(), vsum1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256d a = _mm256_cvtps_pd(_mm_loadu_ps(&v[i]));
+        __m256d b = _mm256_cvtps_pd(_mm_loadu_ps(&v[i + 4]));
+        vmin = _mm256_min_pd(vmin, _mm256_min_pd(a, b));
+        vmax = _mm256_max_pd(vmax, _mm256_max_pd(a, b));
+        vsum0 = _mm256_add_pd(vsum0, a);
+        vsum1 = _mm256_add_pd(vsum1, b);
+    }
+    finishAvx(vmin, vmax, _mm256_add_pd(vsum0, vsum1), min, max, sum);
+    if(i < n) {
+        UA_Double tmin, tmax, tsum;
+        reduceFloatsScalar(&v[i], n - i, &tmin, &tmax, &tsum);
+        *min = fmin(*min, tmin);
+        *max = fmax(*max, tmax);
+        *sum += tsum;
+    }
+}
+
+#endif /* AGGREGATOR_X86 */
+
+/* Selected in PubSubAggregator_new, used in the server thread only */
+static ReduceDoubles reduceDoubles = reduceDoublesScalar;
+static ReduceFloats reduceFloats = reduceFloatsScalar;
+
+static void
+selectReductions(void) {
+#ifdef AGGREGATOR_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx")) {
+        reduceDoubles = reduceDoublesAvx;
+        reduceFloats = reduceFloatsAvx;
+    } else if(__builtin_cpu_supports("sse2")) {
+        reduceDoubles = reduceDoublesSse2;
+        reduceFloats = reduceFloatsSse2;
+    }
+#endif
+}
+
+/**
+ * Samples
+ * ^^^^^^^ */
+
+static UA_Boolean
+isNumeric(const UA_DataType *type) {
+    switch(type->typeKind) {
+    case UA_DATATYPEKIND_SBYTE:
+    case UA_DATATYPEKIND_BYTE:
+    case UA_DATATYPEKIND_INT16:
+    case UA_DATATYPEKIND_UINT16:
+    case UA_DATATYPEKIND_INT32:
+    case UA_DATATYPEKIND_UINT32:
+    case UA_DATATYPEKIND_INT64:
+    case UA_DATATYPEKIND_UINT64:
+    case UA_DATATYPEKIND_FLOAT:
+    case UA_DATATYPEKIND_DOUBLE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Converts n values of a numeric type */
+static void
+toDoubles(const UA_DataType *type, const void *src, size_t n, UA_Double *dst) {
+    switch(type->typeKind) {
+    case UA_DATATYPEKIND_SBYTE:
+        for(size_t i = 0; i < n; i++)
+            dst[i] = ((const UA_SByte*)src)[i];
+        break;
+    case UA_DATATYPEKIND_BYTE:
+        for(size_t i = 0; i < n; i++)
+            dst[i] = ((const UA_Byte*)src)[i];
+        break;
+    case UA_DATATYPEKIND_INT16:
+        for(size_t i = 0; i < n; i++)
+            dst[i] = ((const UA_Int16*)src)[i];
+        break;
+    case UA_DATATYPEKIND_UINT16:
+        for(size_t i = 0; i < n; i++)
+            dst[i] = ((const UA_UInt16*)src)[i];
+        break;
+    case UA_DATATYPEKIND_INT32:
+        for(size_t i = 0; i < n; i++)
+            dst[i] = ((const UA_Int32*)src)[i];
+        break;
+    case UA_DATATYPEKIND_UINT32:
+        for(size_t i = 0; i < n; i++)
+            dst[i] = ((const UA_UInt32*)src)[i];
+        break;
+    case UA_DATATYPEKIND_INT64:
+        for(size_t i = 0; i < n; i++)
+            dst[i] = (UA_Double)((const UA_Int64*)src)[i];
+        break;
+    case UA_DATATYPEKIND_UINT64:
+        for(size_t i = 0; i < n; i++)
+            dst[i] = (UA_Double)((const UA_UInt64*)src)[i];
+        break;
+    case UA_DATATYPEKIND_FLOAT:
+        for(size_t i = 0; i < n; i++)
+            dst[i] = ((const UA_Float*)src)[i];
+        break;
+    default:
+        memcpy(dst, src, n * sizeof(UA_Double));
+        break;
+    }
+}
+
+static void
+addToPane(Pane *p, UA_Double min, UA_Double max, UA_Double sum, UA_Double last,
+          size_t count) {
+    if(p->count == 0) {
+        p->min = min;
+        p->max = max;
+        p->sum = 0.0;
+    } else {
+        p->min = fmin(p->min, min);
+        p->max = fmax(p->max, max);
+    }
+    p->sum += sum;
+    p->last = last;
+    p->count += count;
+}
+
+void
+PubSubAggregator_addSample(PubSubAggregator *aggregator, size_t field,
+                           const UA_Variant *value) {
+    if(field >= aggregator->fieldsSize || !value->type ||
+       value->data <= UA_EMPTY_ARRAY_SENTINEL || !isNumeric(value->type))
+        return;
+    Pane *p = &aggregator->fields[field].panes[aggregator->currentPane];
+
+    if(UA_Variant_isScalar(value)) {
+        UA_Double x;
+        toDoubles(value->type, value->data, 1, &x);
+        addToPane(p, x, x, x, x, 1);
+        return;
+    }
+
+    size_t n = value->arrayLength;
+    UA_Double min, max, sum, last;
+    if(value->type->typeKind == UA_DATATYPEKIND_DOUBLE) {
+        const UA_Double *v = (const UA_Double*)value->data;
+        reduceDoubles(v, n, &min, &max, &sum);
+        last = v[n - 1];
+    } else if(value->type->typeKind == UA_DATATYPEKIND_FLOAT) {
+        const UA_Float *v = (const UA_Float*)value->data;
+        reduceFloats(v, n, &min, &max, &sum);
+        last = v[n - 1];
+    } else {
+        if(n > aggregator->scratchSize) {
+            UA_Double *scratch = (UA_Double*)
+                UA_realloc(aggregator->scratch, n * sizeof(UA_Double));
+            if(!scratch)
+                return;
+            aggregator->scratch = scratch;
+            aggregator->scratchSize = n;
+        }
+        toDoubles(value->type, value->data, n, aggregator->scratch);
+        reduceDoubles(aggregator->scratch, n, &min, &max, &sum);
+        last = aggregator->scratch[n - 1];
+    }
+    addToPane(p, min, max, sum, last, n);
+}
+
+/**
+ * Windows
+ * ^^^^^^^ */
+
+static void
+writeAggregates(UA_Server *server, const AggregatedField *f, const Pane *window) {
+    UA_Variant v;
+    if(window->count > 0) {
+        UA_Double values[AGGREGATE_COUNT] = {
+            window->min, window->max, window->sum / (UA_Double)window->count,
+            window->last
+        };
+        for(size_t i = 0; i < AGGREGATE_COUNT; i++) {
+            UA_Variant_setScalar(&v, &values[i], &UA_TYPES[UA_TYPES_DOUBLE]);
+            UA_Server_writeValue(server, f->nodes[i], v);
+        }
+    }
+    UA_UInt32 count = window->count > UA_UINT32_MAX ?
+        UA_UINT32_MAX : (UA_UInt32)window->count;
+    UA_Variant_setScalar(&v, &count, &UA_TYPES[UA_TYPES_UINT32]);
+    UA_Server_writeValue(server, f->nodes[AGGREGATE_COUNT], v);
+}
+
+/* Writes the window that ends with the current pane and opens the next
+ * pane. Tumbling windows have one pane. */
+static void
+closePane(UA_Server *server, void *data) {
+    PubSubAggregator *aggregator = (PubSubAggregator*)data;
+    size_t next = (aggregator->currentPane + 1) % aggregator->panesSize;
+    for(size_t i = 0; i < aggregator->fieldsSize; i++) {
+        AggregatedField *f = &aggregator->fields[i];
+        Pane window;
+        memset(&window, 0, sizeof(Pane));
+        /* From the oldest to the current pane, the last value is the one of
+         * the newest pane with values */
+        for(size_t j = 1; j <= aggregator->panesSize; j++) {
+            const Pane *p = &f->panes[(aggregator->currentPane + j) % aggregator->panesSize];
+            if(p->count > 0)
+                addToPane(&window, p->min, p->max, p->sum, p->last, p->count);
+        }
+        writeAggregates(server, f, &window);
+        memset(&f->panes[next], 0, sizeof(Pane));
+    }
+    aggregator->currentPane = next;
+}
+
+static UA_StatusCode
+addAggregateNodes(UA_Server *server, const UA_NodeId parent, const UA_String *name,
+                  AggregatedField *f) {
+    /* <field>Aggregate */
+    UA_String objectName;
+    objectName.length = name->length + 9;
+    objectName.data = (UA_Byte*)UA_malloc(objectName.length + 1);
+    if(!objectName.data)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    memcpy(objectName.data, name->data, name->length);
+    memcpy(&objectName.data[name->length], "Aggregate", 10);
+
+    UA_ObjectAttributes oAttr = UA_ObjectAttributes_default;
+    oAttr.displayName.locale = UA_STRING("en-US");
+    oAttr.displayName.text = objectName;
+    UA_QualifiedName browseName;
+    browseName.namespaceIndex = 1;
+    browseName.name = objectName;
+    UA_NodeId objectId;
+    UA_StatusCode retval =
+        UA_Server_addObjectNode(server, UA_NODEID_NULL, parent,
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT), browseName,
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE), oAttr,
+                                NULL, &objectId);
+    UA_free(objectName.data);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    for(size_t i = 0; i < AGGREGATES && retval == UA_STATUSCODE_GOOD; i++) {
+        UA_VariableAttributes vAttr = UA_VariableAttributes_default;
+        vAttr.displayName = UA_LOCALIZEDTEXT("en-US", (char*)aggregateNames[i]);
+        vAttr.dataType = i == AGGREGATE_COUNT ?
+            UA_TYPES[UA_TYPES_UINT32].typeId : UA_TYPES[UA_TYPES_DOUBLE].typeId;
+        vAttr.valueRank = UA_VALUERANK_SCALAR;
+        retval = UA_Server_addVariableNode(server, UA_NODEID_NULL, objectId,
+                                           UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                           UA_QUALIFIEDNAME(1, (char*)aggregateNames[i]),
+                                           UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                           vAttr, NULL, &f->nodes[i]);
+    }
+    UA_NodeId_clear(&objectId);
+    return retval;
+}
+
+PubSubAggregator *
+PubSubAggregator_new(UA_Server *server, const PubSubAggregatorConfig *config,
+                     const UA_NodeId parent, size_t fieldsSize,
+                     const UA_String *fieldNames) {
+    UA_Double hop = config->hopMs > 0 ? config->hopMs : config->windowMs;
+    UA_Double panes = config->windowMs > 0 ? round(config->windowMs / hop) : 0;
+    if(panes < 1 || panes > PUBSUBAGGREGATOR_MAXPANES ||
+       fabs(panes * hop - config->windowMs) > 1e-6 * config->windowMs) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "The window of %.1f ms is not 1 to %d hops of %.1f ms",
+                     config->windowMs, PUBSUBAGGREGATOR_MAXPANES, hop);
+        return NULL;
+    }
+
+    PubSubAggregator *aggregator = (PubSubAggregator*)
+        UA_calloc(1, sizeof(PubSubAggregator) + fieldsSize * sizeof(AggregatedField));
+    if(!aggregator)
+        return NULL;
+    aggregator->server = server;
+    aggregator->panesSize = (size_t)panes;
+    aggregator->fieldsSize = fieldsSize;
+    selectReductions();
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    for(size_t i = 0; i < fieldsSize && retval == UA_STATUSCODE_GOOD; i++)
+        retval = addAggregateNodes(server, parent, &fieldNames[i], &aggregator->fields[i]);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_addRepeatedCallback(server, closePane, aggregator, hop,
+                                               &aggregator->callbackId);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "Cannot add the aggregates: %s", UA_StatusCode_name(retval));
+        aggregator->callbackId = 0;
+        PubSubAggregator_delete(aggregator);
+        return NULL;
+    }
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                "Aggregating %lu fields in windows of %.1f ms every %.1f ms",
+                (unsigned long)fieldsSize, config->windowMs, hop);
+    return aggregator;
+}
+
+void
+PubSubAggregator_delete(PubSubAggregator *aggregator) {
+    if(!aggregator)
+        return;
+    if(aggregator->callbackId)
+        UA_Server_removeRepeatedCallback(aggregator->server, aggregator->callbackId);
+    for(size_t i = 0; i < aggregator->fieldsSize; i++) {
+        for(size_t j = 0; j < AGGREGATES; j++)
+            UA_NodeId_clear(&aggregator->fields[i].nodes[j]);
+    }
+    UA_free(aggregator->scratch);
+    UA_free(aggregator);
+}
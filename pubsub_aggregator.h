@@ -0,0 +1,64 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_AGGREGATOR_H_
+#define PUBSUB_AGGREGATOR_H_
+
+#include <open62541/server.h>
+
+/**
+ * Windowed Aggregation
+ * --------------------
+ * Most consumers of a subscriber want the minimum, maximum, mean and last
+ * value of every field per window, e.g. per second, and not every sample.
+ * The aggregator reduces the samples of the fields of a DataSetReader and
+ * writes the results to aggregate nodes once per window. A client reads
+ * the aggregates once per window instead of every sample.
+ *
+ * For every field, an object ``<field>Aggregate`` with the variables
+ * ``Min``, ``Max``, ``Mean``, ``Last`` (all Double) and ``Count`` (UInt32,
+ * the number of values in the window) is added below the parent node.
+ *
+ * Time is split into panes of ``hopMs``. A sample goes into the current
+ * pane of its field. A repeated callback closes the pane every ``hopMs`` and
+ * writes the aggregates of the last ``windowMs / hopMs`` panes:
+ *
+ * - Tumbling windows: ``hopMs`` is 0 or equal to ``windowMs``. Every sample
+ *   counts in exactly one window.
+ * - Sliding windows: ``hopMs`` divides ``windowMs``. The result of a window
+ *   is written every ``hopMs``, and windows overlap.
+ *
+ * Numeric scalars and arrays are aggregated, other values are ignored. All
+ * elements of an array are values of the window. Arrays of Double and
+ * Float are reduced with AVX or SSE2, selected at runtime. Other numeric
+ * types are converted first. NaN values make min and max undefined.
+ *
+ * Samples are added from the server thread, e.g. in the onWrite callback
+ * of the TargetVariables. */
+
+#define PUBSUBAGGREGATOR_MAXPANES 64
+
+typedef struct {
+    UA_Double windowMs;
+    UA_Double hopMs; /* 0 for tumbling windows */
+} PubSubAggregatorConfig;
+
+struct PubSubAggregator;
+typedef struct PubSubAggregator PubSubAggregator;
+
+/* Adds the aggregate nodes of the fields below parent and starts the
+ * repeated callback */
+PubSubAggregator *
+PubSubAggregator_new(UA_Server *server, const PubSubAggregatorConfig *config,
+                     const UA_NodeId parent, size_t fieldsSize,
+                     const UA_String *fieldNames);
+
+/* Stops the repeated callback. The aggregate nodes stay. */
+void
+PubSubAggregator_delete(PubSubAggregator *aggregator);
+
+void
+PubSubAggregator_addSample(PubSubAggregator *aggregator, size_t field,
+                           const UA_Variant *value);
+
+#endif /* PUBSUB_AGGREGATOR_H_ */
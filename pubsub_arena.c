@@ -0,0 +1,192 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+
+/* Keeps the size for realloc. 16 bytes, so the blocks stay aligned. */
+typedef struct {
+    size_t size;
+    size_t padding;
+} BlockHeader;
+
+struct PubSubArena {
+    UA_Byte *base;
+    size_t used;
+    size_t demand; /* Requested in this cycle, also what did not fit */
+    PubSubArenaMode mode;
+    UA_UInt32 warmupCycles;
+    PubSubArenaStats stats;
+};
+
+/* The arena that serves the allocations of the thread and the arena whose
+ * memory is recognized by free and realloc */
+static __thread PubSubArena *current = NULL;
+static __thread PubSubArena *bound = NULL;
+
+#ifdef UA_ENABLE_MALLOC_SINGLETON
+static void * (*heapMalloc)(size_t size) = malloc;
+static void (*heapFree)(void *ptr) = free;
+static void * (*heapCalloc)(size_t nelem, size_t elsize) = calloc;
+static void * (*heapRealloc)(void *ptr, size_t size) = realloc;
+
+static UA_Boolean
+inArena(const void *ptr) {
+    return bound && (const UA_Byte*)ptr >= bound->base &&
+        (const UA_Byte*)ptr < bound->base + bound->stats.capacity;
+}
+
+static void *
+allocate(PubSubArena *arena, size_t size, UA_Boolean zero) {
+    size_t need = sizeof(BlockHeader) + ((size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1));
+    arena->demand += need;
+    if(arena->used + need <= arena->stats.capacity) {
+        BlockHeader *h = (BlockHeader*)&arena->base[arena->used];
+        arena->used += need;
+        h->size = size;
+        arena->stats.allocations++;
+        if(zero)
+            memset(&h[1], 0, size);
+        return &h[1];
+    }
+    if(arena->mode == PUBSUBARENA_STRICT && arena->stats.cycles >= arena->warmupCycles) {
+        arena->stats.failed++;
+        return NULL;
+    }
+    arena->stats.heapAllocations++;
+    return zero ? heapCalloc(1, size) : heapMalloc(size);
+}
+
+static void *
+arenaMalloc(size_t size) {
+    if(current)
+        return allocate(current, size, false);
+    return heapMalloc(size);
+}
+
+static void
+arenaFree(void *ptr) {
+    if(!ptr || inArena(ptr))
+        return;
+    heapFree(ptr);
+}
+
+static void *
+arenaCalloc(size_t nelem, size_t elsize) {
+    if(!current)
+        return heapCalloc(nelem, elsize);
+    if(elsize > 0 && nelem > SIZE_MAX / elsize)
+        return NULL;
+    return allocate(current, nelem * elsize, true);
+}
+
+/* Blocks stay where they are: heap blocks are grown on the heap, arena
+ * blocks are copied within the arena while it is entered. */
+static void *
+arenaRealloc(void *ptr, size_t size) {
+    if(!ptr)
+        return arenaMalloc(size);
+    if(!inArena(ptr))
+        return heapRealloc(ptr, size);
+    size_t oldSize = ((BlockHeader*)ptr)[-1].size;
+    void *newPtr = current ? allocate(current, size, false) : heapMalloc(size);
+    if(newPtr)
+        memcpy(newPtr, ptr, oldSize < size ? oldSize : size);
+    return newPtr;
+}
+#endif
+
+UA_StatusCode
+PubSubArena_install(void) {
+#ifdef UA_ENABLE_MALLOC_SINGLETON
+    if(UA_mallocSingleton == arenaMalloc)
+        return UA_STATUSCODE_GOOD;
+    heapMalloc = UA_mallocSingleton;
+    heapFree = UA_freeSingleton;
+    heapCalloc = UA_callocSingleton;
+    heapRealloc = UA_reallocSingleton;
+    UA_mallocSingleton = arenaMalloc;
+    UA_freeSingleton = arenaFree;
+    UA_callocSingleton = arenaCalloc;
+    UA_reallocSingleton = arenaRealloc;
+    return UA_STATUSCODE_GOOD;
+#else
+    return UA_STATUSCODE_BADNOTSUPPORTED;
+#endif
+}
+
+PubSubArena *
+PubSubArena_new(size_t capacity, PubSubArenaMode mode, UA_UInt32 warmupCycles) {
+    PubSubArena *arena = (PubSubArena*)calloc(1, sizeof(PubSubArena));
+    if(!arena)
+        return NULL;
+    if(capacity > 0) {
+        arena->base = (UA_Byte*)malloc(capacity);
+        if(!arena->base) {
+            free(arena);
+            return NULL;
+        }
+    }
+    arena->stats.capacity = capacity;
+    arena->mode = mode;
+    arena->warmupCycles = warmupCycles;
+    return arena;
+}
+
+void
+PubSubArena_delete(PubSubArena *arena) {
+    if(current == arena)
+        current = NULL;
+    if(bound == arena)
+        bound = NULL;
+    free(arena->base);
+    free(arena);
+}
+
+void
+PubSubArena_enter(PubSubArena *arena) {
+    current = arena;
+    bound = arena;
+}
+
+void
+PubSubArena_leave(void) {
+    current = NULL;
+}
+
+void
+PubSubArena_reset(PubSubArena *arena) {
+    if(current == arena)
+        current = NULL;
+    if(bound == arena)
+        bound = NULL;
+    arena->stats.cycles++;
+    if(arena->demand > arena->stats.highWater)
+        arena->stats.highWater = arena->demand;
+
+    /* Grow to the demand during the warm-up. Nothing in the arena is live
+     * after the reset. */
+    if(arena->stats.cycles <= arena->warmupCycles &&
+       arena->demand > arena->stats.capacity) {
+        size_t capacity = 1024;
+        while(capacity < arena->demand)
+            capacity <<= 1;
+        UA_Byte *base = (UA_Byte*)malloc(capacity);
+        if(base) {
+            free(arena->base);
+            arena->base = base;
+            arena->stats.capacity = capacity;
+        }
+    }
+    arena->used = 0;
+    arena->demand = 0;
+}
+
+void
+PubSubArena_getStats(const PubSubArena *arena, PubSubArenaStats *stats) {
+    *stats = arena->stats;
+}
@@ -0,0 +1,82 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_ARENA_H_
+#define PUBSUB_ARENA_H_
+
+#include <open62541/types.h>
+
+/**
+ * Cycle Arenas
+ * ------------
+ * Sampling a DataSet and decoding a NetworkMessage allocate many small
+ * objects (Variant copies, DataValue arrays, strings) that are all freed at
+ * the end of the cycle. A cycle arena serves these allocations from one
+ * block with a bump pointer. Frees inside the cycle are no-ops, and the
+ * whole arena is reset at the end of the cycle.
+ *
+ * The arena hooks into the open62541 allocator through the malloc singleton
+ * and needs ``UA_ENABLE_MALLOC_SINGLETON``. Only the thread that entered an
+ * arena allocates from it. Other threads, and the same thread outside the
+ * arena, use the previous allocator.
+ *
+ * A cycle is::
+ *
+ *   PubSubArena_enter(arena);   allocations come from the arena
+ *   PubSubArena_leave();        allocations come from the heap again
+ *   PubSubArena_reset(arena);   all arena memory is released
+ *
+ * Between leave and reset, the arena memory stays valid and freeing it is
+ * still a no-op. This lets code that keeps long-lived state (e.g. the
+ * per-writer statistics) run between decode and cleanup. Memory from the
+ * arena must not be kept beyond the reset.
+ *
+ * In the first ``warmupCycles`` cycles, allocations that do not fit go to
+ * the heap and the arena grows to the largest demand seen at the next
+ * reset. After the warm-up, the arena no longer grows. In
+ * PUBSUBARENA_FALLBACK mode, allocations that do not fit still go to the
+ * heap and are counted. In PUBSUBARENA_STRICT mode they fail. The steady
+ * state then never touches the heap. */
+
+typedef enum {
+    PUBSUBARENA_FALLBACK,
+    PUBSUBARENA_STRICT
+} PubSubArenaMode;
+
+typedef struct {
+    UA_UInt64 cycles;
+    UA_UInt64 allocations;     /* Served by the arena */
+    UA_UInt64 heapAllocations; /* Did not fit, served by the heap */
+    UA_UInt64 failed;          /* Did not fit, refused in strict mode */
+    size_t capacity;
+    size_t highWater;          /* Largest demand of a cycle in bytes */
+} PubSubArenaStats;
+
+typedef struct PubSubArena PubSubArena;
+
+/* Routes the open62541 allocator through the arenas. Call once at startup,
+ * before other threads are created. Returns BADNOTSUPPORTED without
+ * UA_ENABLE_MALLOC_SINGLETON. */
+UA_StatusCode
+PubSubArena_install(void);
+
+PubSubArena *
+PubSubArena_new(size_t capacity, PubSubArenaMode mode, UA_UInt32 warmupCycles);
+
+void
+PubSubArena_delete(PubSubArena *arena);
+
+void
+PubSubArena_enter(PubSubArena *arena);
+
+void
+PubSubArena_leave(void);
+
+/* Ends the cycle. Must be called on the thread that entered the arena. */
+void
+PubSubArena_reset(PubSubArena *arena);
+
+void
+PubSubArena_getStats(const PubSubArena *arena, PubSubArenaStats *stats);
+
+#endif /* PUBSUB_ARENA_H_ */
@@ -0,0 +1,239 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_array_codec.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ARRAYCODEC_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define ARRAYCODEC_HOST_BIGENDIAN true
+#else
+#define ARRAYCODEC_HOST_BIGENDIAN false
+#endif
+
+/* Swaps the bytes of the elements in bytes (a multiple of elementSize) */
+typedef void (*SwapFunction)(UA_Byte *dst, const UA_Byte *src, size_t bytes,
+                             size_t elementSize);
+
+/* NULL until the first use. Accessed with relaxed atomics. */
+static SwapFunction swapFunction;
+
+static void
+swapScalar(UA_Byte *dst, const UA_Byte *src, size_t bytes, size_t elementSize) {
+    switch(elementSize) {
+    case 2:
+        for(size_t i = 0; i < bytes; i += 2) {
+            uint16_t v;
+            memcpy(&v, &src[i], 2);
+            v = __builtin_bswap16(v);
+            memcpy(&dst[i], &v, 2);
+        }
+        break;
+    case 4:
+        for(size_t i = 0; i < bytes; i += 4) {
+            uint32_t v;
+            memcpy(&v, &src[i], 4);
+            v = __builtin_bswap32(v);
+            memcpy(&dst[i], &v, 4);
+        }
+        break;
+    case 8:
+        for(size_t i = 0; i < bytes; i += 8) {
+            uint64_t v;
+            memcpy(&v, &src[i], 8);
+            v = __builtin_bswap64(v);
+            memcpy(&dst[i], &v, 8);
+        }
+        break;
+    default:
+        memcpy(dst, src, bytes);
+        break;
+    }
+}
+
+#ifdef ARRAYCODEC_X86
+
+/* Shuffle masks that reverse the bytes of every element of 2, 4 and 8
+ * bytes in 16 bytes */
+static const UA_Byte swapMasks[3][16] = {
+    {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+    {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+    {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8}
+};
+
+static const UA_Byte *
+swapMask(size_t elementSize) {
+    return swapMasks[elementSize == 2 ? 0 : (elementSize == 4 ? 1 : 2)];
+}
+
+__attribute__((target("ssse3"))) static void
+swapSsse3(UA_Byte *dst, const UA_Byte *src, size_t bytes, size_t elementSize) {
+    if(elementSize < 2) {
+        memcpy(dst, src, bytes);
+        return;
+    }
+    const __m128i mask = _mm_loadu_si128((const __m128i*)swapMask(elementSize));
+    size_t i = 0;
+    for(; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&src[i]);
+        _mm_storeu_si128((__m128i*)&dst[i], _mm_shuffle_epi8(v, mask));
+    }
+    swapScalar(&dst[i], &src[i], bytes - i, elementSize);
+}
+
+/* The shuffle works within the 16 byte lanes, which never split an
+ * element */
+__attribute__((target("avx2"))) static void
+swapAvx2(UA_Byte *dst, const UA_Byte *src, size_t bytes, size_t elementSize) {
+    if(elementSize < 2) {
+        memcpy(dst, src, bytes);
+        return;
+    }
+    const __m256i mask = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i*)swapMask(elementSize)));
+    size_t i = 0;
+    for(; i + 64 <= bytes; i += 64) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*)&src[i]);
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)&src[i + 32]);
+        _mm256_storeu_si256((__m256i*)&dst[i], _mm256_shuffle_epi8(v0, mask));
+        _mm256_storeu_si256((__m256i*)&dst[i + 32], _mm256_shuffle_epi8(v1, mask));
+    }
+    for(; i + 32 <= bytes; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&src[i]);
+        _mm256_storeu_si256((__m256i*)&dst[i], _mm256_shuffle_epi8(v, mask));
+    }
+    swapScalar(&dst[i], &src[i], bytes - i, elementSize);
+}
+
+#endif /* ARRAYCODEC_X86 */
+
+UA_Boolean
+PubSubArrayCodec_supportsType(const UA_DataType *type) {
+    switch(type->typeKind) {
+    case UA_DATATYPEKIND_SBYTE:
+    case UA_DATATYPEKIND_BYTE:
+    case UA_DATATYPEKIND_INT16:
+    case UA_DATATYPEKIND_UINT16:
+    case UA_DATATYPEKIND_INT32:
+    case UA_DATATYPEKIND_UINT32:
+    case UA_DATATYPEKIND_INT64:
+    case UA_DATATYPEKIND_UINT64:
+    case UA_DATATYPEKIND_FLOAT:
+    case UA_DATATYPEKIND_DOUBLE:
+    case UA_DATATYPEKIND_DATETIME:
+    case UA_DATATYPEKIND_STATUSCODE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+PubSubArrayCodecImpl
+PubSubArrayCodec_select(PubSubArrayCodecImpl max) {
+    PubSubArrayCodecImpl impl = PUBSUBARRAYCODEC_SCALAR;
+    SwapFunction f = swapScalar;
+#ifdef ARRAYCODEC_X86
+    __builtin_cpu_init();
+    if(max >= PUBSUBARRAYCODEC_AVX2 && __builtin_cpu_supports("avx2")) {
+        impl = PUBSUBARRAYCODEC_AVX2;
+        f = swapAvx2;
+    } else if(max >= PUBSUBARRAYCODEC_SSSE3 && __builtin_cpu_supports("ssse3")) {
+        impl = PUBSUBARRAYCODEC_SSSE3;
+        f = swapSsse3;
+    }
+#endif
+    __atomic_store_n(&swapFunction, f, __ATOMIC_RELAXED);
+    return impl;
+}
+
+const char *
+PubSubArrayCodec_implName(PubSubArrayCodecImpl impl) {
+    switch(impl) {
+    case PUBSUBARRAYCODEC_SSSE3:
+        return "ssse3";
+    case PUBSUBARRAYCODEC_AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+void
+PubSubArrayCodec_copy(void *dst, const void *src, size_t length,
+                      size_t elementSize, UA_Boolean swap) {
+    size_t bytes = length * elementSize;
+    if(!swap || elementSize < 2) {
+        memcpy(dst, src, bytes);
+        return;
+    }
+    SwapFunction f = __atomic_load_n(&swapFunction, __ATOMIC_RELAXED);
+    if(!f) {
+        PubSubArrayCodec_select(PUBSUBARRAYCODEC_AVX2);
+        f = __atomic_load_n(&swapFunction, __ATOMIC_RELAXED);
+    }
+    f((UA_Byte*)dst, (const UA_Byte*)src, bytes, elementSize);
+}
+
+UA_StatusCode
+PubSubArrayCodec_encode(const void *array, size_t length, const UA_DataType *type,
+                        PubSubArrayCodecByteOrder order, UA_Byte **bufPos,
+                        const UA_Byte *bufEnd) {
+    if(!PubSubArrayCodec_supportsType(type))
+        return UA_STATUSCODE_BADNOTSUPPORTED;
+    if(!array && length > 0)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    if(length > UA_INT32_MAX)
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+    size_t bytes = length * type->memSize;
+    if((size_t)(bufEnd - *bufPos) < 4 + bytes)
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+
+    UA_Boolean swap = (order == PUBSUBARRAYCODEC_BIGENDIAN) != ARRAYCODEC_HOST_BIGENDIAN;
+    UA_Int32 signedLength = array ? (UA_Int32)length : -1;
+    PubSubArrayCodec_copy(*bufPos, &signedLength, 1, 4, swap);
+    *bufPos += 4;
+    if(bytes > 0)
+        PubSubArrayCodec_copy(*bufPos, array, length, type->memSize, swap);
+    *bufPos += bytes;
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+PubSubArrayCodec_decode(const UA_ByteString *src, size_t *offset, void **array,
+                        size_t *length, const UA_DataType *type,
+                        PubSubArrayCodecByteOrder order) {
+    if(!PubSubArrayCodec_supportsType(type))
+        return UA_STATUSCODE_BADNOTSUPPORTED;
+    if(*offset > src->length || src->length - *offset < 4)
+        return UA_STATUSCODE_BADDECODINGERROR;
+
+    UA_Boolean swap = (order == PUBSUBARRAYCODEC_BIGENDIAN) != ARRAYCODEC_HOST_BIGENDIAN;
+    UA_Int32 signedLength;
+    PubSubArrayCodec_copy(&signedLength, &src->data[*offset], 1, 4, swap);
+    if(signedLength < 0) {
+        *array = NULL;
+        *length = 0;
+        *offset += 4;
+        return UA_STATUSCODE_GOOD;
+    }
+
+    size_t bytes = (size_t)signedLength * type->memSize;
+    if(src->length - *offset - 4 < bytes)
+        return UA_STATUSCODE_BADDECODINGERROR;
+    void *dst = UA_Array_new((size_t)signedLength, type);
+    if(!dst)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    if(bytes > 0)
+        PubSubArrayCodec_copy(dst, &src->data[*offset + 4], (size_t)signedLength,
+                              type->memSize, swap);
+    *array = dst;
+    *length = (size_t)signedLength;
+    *offset += 4 + bytes;
+    return UA_STATUSCODE_GOOD;
+}
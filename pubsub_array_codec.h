@@ -0,0 +1,76 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_ARRAY_CODEC_H_
+#define PUBSUB_ARRAY_CODEC_H_
+
+#include <open62541/types.h>
+
+/**
+ * Array Codec
+ * -----------
+ * Fast paths for the binary encoding of arrays of the fixed-size numeric
+ * built-in types (SByte to Double, DateTime, StatusCode), as sensors publish
+ * them with thousands of elements per field. An array is encoded as in OPC
+ * UA Binary: the Int32 length (-1 for a null array), then the elements.
+ *
+ * The elements are encoded in the little-endian order of OPC UA Binary, or
+ * in big-endian order for peers that send RAW fields in their native order.
+ * If the order differs from the host, the bytes of every element are
+ * swapped. The swap runs with AVX2 or SSSE3 shuffles, 32 or 16 bytes at a
+ * time, or with a scalar loop. The fastest implementation the CPU supports
+ * is selected at the first use. ``PubSubArrayCodec_select`` caps the
+ * selection, e.g. to compare the implementations. Without a swap the
+ * elements are copied with ``memcpy``.
+ *
+ * Boolean arrays are not supported, since every non-zero byte must decode
+ * to true.
+ *
+ * The publish pool (pubsub_publish_pool.h) encodes the numeric array fields
+ * of its DataSets with it. pubsub_subscribe_standalone.c decodes an array
+ * in RAW DataSetMessages with it (``--raw-array=<type>[:be]``). */
+
+typedef enum {
+    PUBSUBARRAYCODEC_SCALAR = 0,
+    PUBSUBARRAYCODEC_SSSE3,
+    PUBSUBARRAYCODEC_AVX2
+} PubSubArrayCodecImpl;
+
+typedef enum {
+    PUBSUBARRAYCODEC_LITTLEENDIAN = 0, /* OPC UA Binary */
+    PUBSUBARRAYCODEC_BIGENDIAN
+} PubSubArrayCodecByteOrder;
+
+UA_Boolean
+PubSubArrayCodec_supportsType(const UA_DataType *type);
+
+/* Selects the fastest implementation that the CPU supports, but at most max.
+ * Returns the selected implementation. */
+PubSubArrayCodecImpl
+PubSubArrayCodec_select(PubSubArrayCodecImpl max);
+
+const char *
+PubSubArrayCodec_implName(PubSubArrayCodecImpl impl);
+
+/* Copies length elements of elementSize (1, 2, 4 or 8) bytes. The bytes of
+ * every element are swapped if swap is set. dst and src must not overlap. */
+void
+PubSubArrayCodec_copy(void *dst, const void *src, size_t length,
+                      size_t elementSize, UA_Boolean swap);
+
+/* Encodes the array at bufPos and advances bufPos. A NULL array is encoded
+ * as a null array. Fails with BADENCODINGLIMITSEXCEEDED if the buffer is too
+ * short. */
+UA_StatusCode
+PubSubArrayCodec_encode(const void *array, size_t length, const UA_DataType *type,
+                        PubSubArrayCodecByteOrder order, UA_Byte **bufPos,
+                        const UA_Byte *bufEnd);
+
+/* Decodes an array at offset into a new array from UA_Array_new and
+ * advances offset. A null array is decoded to NULL. */
+UA_StatusCode
+PubSubArrayCodec_decode(const UA_ByteString *src, size_t *offset, void **array,
+                        size_t *length, const UA_DataType *type,
+                        PubSubArrayCodecByteOrder order);
+
+#endif /* PUBSUB_ARRAY_CODEC_H_ */
@@ -0,0 +1,734 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+/**
+ * PubSub Loopback Benchmark
+ * -------------------------
+ * Measures the publish/subscribe path end to end on one host. For every
+ * configuration of a sweep, one publisher process and a number of reader
+ * processes are forked. They exchange UADP messages over 127.0.0.1 or a
+ * multicast group on the loopback interface.
+ *
+ * The publisher is a server with the same PubSub configuration as
+ * ``tutorial_pubsub_publish.c``. The first field of its DataSet is a
+ * DataSource that returns the CLOCK_MONOTONIC time in nanoseconds when the
+ * field is sampled. The remaining fields carry the payload. The readers
+ * receive and decode like ``pubsub_subscribe_standalone.c`` and record the
+ * sample-to-decoded latency.
+ *
+ * The sweep covers the payload field count, the field type, the field
+ * encoding (Variant or RAW), the publishing interval and the reader count.
+ * Every configuration is reported as one JSON object per line on stdout::
+ *
+ *   {"fields":8,"type":"int32","encoding":"variant","intervalMs":10,
+ *    "readers":2,"durationS":5.000,"published":500,"publishedPerS":100.0,
+ *    "received":1000,"receivedPerS":100.0,"lossRatio":0.000000,
+ *    "latencyNs":{"p50":41000,"p99":88000,"p999":120000,"max":131000,
+ *    "mean":43210.5},"cpuCores":{"publisher":0.0120,"reader":0.0051},
+ *    "allocsPerMsg":{"publisher":31.00,"reader":12.00}}
+ *
+ * ``receivedPerS`` and ``cpuCores.reader`` are averages over the readers.
+ * Allocations are counted through the malloc singleton and are null unless
+ * open62541 is built with UA_ENABLE_MALLOC_SINGLETON.
+ *
+ * Several readers need a multicast address, since only one socket receives
+ * a unicast datagram. Configurations with more than one reader are skipped
+ * for unicast addresses. */
+
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/plugin/pubsub.h>
+#include <open62541/plugin/pubsub_udp.h>
+#include <open62541/server.h>
+#include <open62541/server_config_default.h>
+#include <open62541/types_generated_encoding_binary.h>
+
+#include <open62541/ua_pubsub_networkmessage.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "latency_histogram.h"
+#include "pubsub_transport_wrap.h"
+
+#define BENCH_SERVER_PORT 4850
+#define BENCH_WRITERGROUPID 100
+#define BENCH_DATASETWRITERID 62541
+#define BENCH_FIELD_NAMESPACE 1
+#define BENCH_FIELD_NODEID 60000
+#define BENCH_BUFFER_SIZE 65536
+#define BENCH_RECEIVE_TIMEOUT 100000 /* us */
+#define BENCH_STARTUP_NS 300000000   /* readers join the group */
+#define BENCH_MAX_READERS 64
+#define BENCH_MAX_VALUES 16
+
+typedef struct {
+    const char *name;
+    UA_UInt16 typeIndex;
+} BenchFieldType;
+
+static const BenchFieldType fieldTypes[] = {
+    {"byte", UA_TYPES_BYTE},
+    {"int32", UA_TYPES_INT32},
+    {"double", UA_TYPES_DOUBLE},
+    {"string", UA_TYPES_STRING}
+};
+#define BENCH_FIELDTYPES (sizeof(fieldTypes) / sizeof(BenchFieldType))
+
+/* One configuration of the sweep */
+typedef struct {
+    UA_NetworkAddressUrlDataType address;
+    size_t fields;
+    const BenchFieldType *fieldType;
+    UA_Boolean raw;
+    UA_Double interval;
+    size_t readers;
+    UA_UInt64 measureStart; /* CLOCK_MONOTONIC ns */
+    UA_UInt64 measureEnd;
+} BenchRun;
+
+/* Sent from every child process to the parent through a pipe */
+typedef struct {
+    UA_UInt64 messages;
+    UA_UInt64 allocations;
+    UA_Double cpuSeconds;
+    LatencyHistogram latency; /* Readers only */
+} BenchResult;
+
+static UA_UInt64
+benchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UA_UInt64)ts.tv_sec * 1000000000u + (UA_UInt64)ts.tv_nsec;
+}
+
+static UA_Double
+cpuSeconds(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (UA_Double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+        (UA_Double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * Allocation Counting
+ * ^^^^^^^^^^^^^^^^^^^
+ * The children are single-threaded, so a plain counter suffices. */
+
+static UA_UInt64 allocations = 0;
+
+#ifdef UA_ENABLE_MALLOC_SINGLETON
+static void *
+countingMalloc(size_t size) {
+    allocations++;
+    return malloc(size);
+}
+
+static void *
+countingCalloc(size_t nelem, size_t elsize) {
+    allocations++;
+    return calloc(nelem, elsize);
+}
+
+static void *
+countingRealloc(void *ptr, size_t size) {
+    allocations++;
+    return realloc(ptr, size);
+}
+#endif
+
+static void
+countAllocations(void) {
+#ifdef UA_ENABLE_MALLOC_SINGLETON
+    UA_mallocSingleton = countingMalloc;
+    UA_callocSingleton = countingCalloc;
+    UA_reallocSingleton = countingRealloc;
+#endif
+}
+
+static void
+writeResult(int fd, const BenchResult *result) {
+    const UA_Byte *pos = (const UA_Byte*)result;
+    size_t left = sizeof(BenchResult);
+    while(left > 0) {
+        ssize_t n = write(fd, pos, left);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return;
+        pos += n;
+        left -= (size_t)n;
+    }
+}
+
+static UA_Boolean
+readResult(int fd, BenchResult *result) {
+    UA_Byte *pos = (UA_Byte*)result;
+    size_t left = sizeof(BenchResult);
+    while(left > 0) {
+        ssize_t n = read(fd, pos, left);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        pos += n;
+        left -= (size_t)n;
+    }
+    return true;
+}
+
+/**
+ * Publisher
+ * ^^^^^^^^^ */
+
+static UA_UInt64 sentMessages = 0;
+
+static UA_StatusCode
+countingSend(PubSubChannelWrap *wrap, UA_ExtensionObject *transportSettings,
+             const UA_ByteString *buf) {
+    UA_StatusCode retval = wrap->send(wrap->channel, transportSettings, buf);
+    if(retval == UA_STATUSCODE_GOOD)
+        sentMessages++;
+    return retval;
+}
+
+static const PubSubTransportWrapper countingWrapper = {
+    "bench", NULL, countingSend, NULL, NULL
+};
+
+static UA_StatusCode
+readSendTime(UA_Server *server, const UA_NodeId *sessionId, void *sessionContext,
+             const UA_NodeId *nodeId, void *nodeContext, UA_Boolean sourceTimeStamp,
+             const UA_NumericRange *range, UA_DataValue *value) {
+    UA_UInt64 now = benchNow();
+    UA_StatusCode retval =
+        UA_Variant_setScalarCopy(&value->value, &now, &UA_TYPES[UA_TYPES_UINT64]);
+    value->hasValue = (retval == UA_STATUSCODE_GOOD);
+    return retval;
+}
+
+static void
+setFieldValue(UA_Variant *v, const BenchFieldType *fieldType, size_t i) {
+    const UA_DataType *type = &UA_TYPES[fieldType->typeIndex];
+    UA_Byte b = (UA_Byte)i;
+    UA_Int32 i32 = (UA_Int32)i;
+    UA_Double d = (UA_Double)i * 1.5;
+    char s[32];
+    snprintf(s, sizeof(s), "value-%010lu", (unsigned long)i);
+    UA_String str = UA_STRING(s);
+    switch(fieldType->typeIndex) {
+    case UA_TYPES_BYTE: UA_Variant_setScalarCopy(v, &b, type); break;
+    case UA_TYPES_INT32: UA_Variant_setScalarCopy(v, &i32, type); break;
+    case UA_TYPES_DOUBLE: UA_Variant_setScalarCopy(v, &d, type); break;
+    default: UA_Variant_setScalarCopy(v, &str, type); break;
+    }
+}
+
+static void
+addPublishedField(UA_Server *server, const UA_NodeId pds, const UA_NodeId node,
+                  char *alias) {
+    UA_DataSetFieldConfig fieldConfig;
+    memset(&fieldConfig, 0, sizeof(UA_DataSetFieldConfig));
+    fieldConfig.dataSetFieldType = UA_PUBSUB_DATASETFIELD_VARIABLE;
+    fieldConfig.field.variable.fieldNameAlias = UA_STRING(alias);
+    fieldConfig.field.variable.publishParameters.publishedVariable = node;
+    fieldConfig.field.variable.publishParameters.attributeId = UA_ATTRIBUTEID_VALUE;
+    UA_Server_addDataSetField(server, pds, &fieldConfig, NULL);
+}
+
+static UA_StatusCode
+setupPublisher(UA_Server *server, const BenchRun *run) {
+    UA_PubSubConnectionConfig connectionConfig;
+    memset(&connectionConfig, 0, sizeof(connectionConfig));
+    connectionConfig.name = UA_STRING("Bench Connection");
+    connectionConfig.transportProfileUri =
+        UA_STRING("http://opcfoundation.org/UA-Profile/Transport/pubsub-udp-uadp");
+    connectionConfig.enabled = UA_TRUE;
+    UA_Variant_setScalar(&connectionConfig.address, (void*)(uintptr_t)&run->address,
+                         &UA_TYPES[UA_TYPES_NETWORKADDRESSURLDATATYPE]);
+    connectionConfig.publisherId.numeric = 2234;
+    UA_NodeId connectionId;
+    UA_StatusCode retval =
+        UA_Server_addPubSubConnection(server, &connectionConfig, &connectionId);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    UA_PublishedDataSetConfig pdsConfig;
+    memset(&pdsConfig, 0, sizeof(UA_PublishedDataSetConfig));
+    pdsConfig.publishedDataSetType = UA_PUBSUB_DATASET_PUBLISHEDITEMS;
+    pdsConfig.name = UA_STRING("Bench PDS");
+    UA_NodeId pdsId;
+    retval = UA_Server_addPublishedDataSet(server, &pdsConfig, &pdsId).addResult;
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    /* The send time is always the first field */
+    UA_NodeId parent = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", "SendTime");
+    attr.dataType = UA_TYPES[UA_TYPES_UINT64].typeId;
+    UA_DataSource dataSource;
+    dataSource.read = readSendTime;
+    dataSource.write = NULL;
+    UA_NodeId sendTimeId = UA_NODEID_NUMERIC(BENCH_FIELD_NAMESPACE, BENCH_FIELD_NODEID);
+    retval = UA_Server_addDataSourceVariableNode(server, sendTimeId, parent,
+                 UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                 UA_QUALIFIEDNAME(1, "SendTime"),
+                 UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                 attr, dataSource, NULL, NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    addPublishedField(server, pdsId, sendTimeId, "SendTime");
+
+    for(size_t i = 0; i < run->fields; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "Field%lu", (unsigned long)i);
+        attr = UA_VariableAttributes_default;
+        attr.displayName = UA_LOCALIZEDTEXT("en-US", name);
+        attr.dataType = UA_TYPES[run->fieldType->typeIndex].typeId;
+        setFieldValue(&attr.value, run->fieldType, i);
+        UA_NodeId fieldId = UA_NODEID_NUMERIC(BENCH_FIELD_NAMESPACE,
+                                              BENCH_FIELD_NODEID + 1 + (UA_UInt32)i);
+        retval = UA_Server_addVariableNode(server, fieldId, parent,
+                     UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                     UA_QUALIFIEDNAME(1, name),
+                     UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                     attr, NULL, NULL);
+        UA_Variant_clear(&attr.value);
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+        addPublishedField(server, pdsId, fieldId, name);
+    }
+
+    UA_WriterGroupConfig writerGroupConfig;
+    memset(&writerGroupConfig, 0, sizeof(UA_WriterGroupConfig));
+    writerGroupConfig.name = UA_STRING("Bench WriterGroup");
+    writerGroupConfig.publishingInterval = run->interval;
+    writerGroupConfig.enabled = UA_FALSE;
+    writerGroupConfig.writerGroupId = BENCH_WRITERGROUPID;
+    writerGroupConfig.encodingMimeType = UA_PUBSUB_ENCODING_UADP;
+    writerGroupConfig.messageSettings.encoding = UA_EXTENSIONOBJECT_DECODED;
+    writerGroupConfig.messageSettings.content.decoded.type =
+        &UA_TYPES[UA_TYPES_UADPWRITERGROUPMESSAGEDATATYPE];
+    UA_UadpWriterGroupMessageDataType *writerGroupMessage =
+        UA_UadpWriterGroupMessageDataType_new();
+    writerGroupMessage->networkMessageContentMask =
+        (UA_UadpNetworkMessageContentMask)(UA_UADPNETWORKMESSAGECONTENTMASK_PUBLISHERID |
+        (UA_UadpNetworkMessageContentMask)UA_UADPNETWORKMESSAGECONTENTMASK_GROUPHEADER |
+        (UA_UadpNetworkMessageContentMask)UA_UADPNETWORKMESSAGECONTENTMASK_WRITERGROUPID |
+        (UA_UadpNetworkMessageContentMask)UA_UADPNETWORKMESSAGECONTENTMASK_PAYLOADHEADER);
+    writerGroupConfig.messageSettings.content.decoded.data = writerGroupMessage;
+    UA_NodeId writerGroupId;
+    retval = UA_Server_addWriterGroup(server, connectionId, &writerGroupConfig,
+                                      &writerGroupId);
+    UA_UadpWriterGroupMessageDataType_delete(writerGroupMessage);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    /* Every message is a KeyFrame, so the readers always see the send time */
+    UA_DataSetWriterConfig writerConfig;
+    memset(&writerConfig, 0, sizeof(UA_DataSetWriterConfig));
+    writerConfig.name = UA_STRING("Bench DataSetWriter");
+    writerConfig.dataSetWriterId = BENCH_DATASETWRITERID;
+    writerConfig.keyFrameCount = 1;
+    if(run->raw)
+        writerConfig.dataSetFieldContentMask = UA_DATASETFIELDCONTENTMASK_RAWDATA;
+    retval = UA_Server_addDataSetWriter(server, writerGroupId, pdsId,
+                                        &writerConfig, NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    return UA_Server_setWriterGroupOperational(server, writerGroupId);
+}
+
+static void
+runPublisher(const BenchRun *run, int fd) {
+    BenchResult result;
+    memset(&result, 0, sizeof(BenchResult));
+
+    UA_Server *server = UA_Server_new();
+    UA_ServerConfig *config = UA_Server_getConfig(server);
+    UA_ServerConfig_setMinimal(config, BENCH_SERVER_PORT, NULL);
+    UA_ServerConfig_addPubSubTransportLayer(config,
+        PubSubTransportWrap_layer(UA_PubSubTransportLayerUDPMP(), &countingWrapper, NULL));
+
+    UA_StatusCode retval = setupPublisher(server, run);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_run_startup(server);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "Publisher setup failed with %s", UA_StatusCode_name(retval));
+        UA_Server_delete(server);
+        writeResult(fd, &result);
+        return;
+    }
+
+    UA_Boolean measuring = false;
+    UA_UInt64 startMessages = 0, startAllocations = 0;
+    UA_Double startCpu = 0.0;
+    for(UA_UInt64 now = benchNow(); now < run->measureEnd; now = benchNow()) {
+        if(!measuring && now >= run->measureStart) {
+            measuring = true;
+            startMessages = sentMessages;
+            startAllocations = allocations;
+            startCpu = cpuSeconds();
+        }
+        UA_Server_run_iterate(server, true);
+    }
+    result.messages = sentMessages - startMessages;
+    result.allocations = allocations - startAllocations;
+    result.cpuSeconds = cpuSeconds() - startCpu;
+
+    UA_Server_run_shutdown(server);
+    UA_Server_delete(server);
+    writeResult(fd, &result);
+}
+
+/**
+ * Reader
+ * ^^^^^^ */
+
+static UA_Boolean
+getSendTime(const UA_NetworkMessage *nm, UA_UInt64 *sendTime) {
+    if(nm->networkMessageType != UA_NETWORKMESSAGE_DATASET ||
+       !nm->groupHeaderEnabled || !nm->groupHeader.writerGroupIdEnabled ||
+       nm->groupHeader.writerGroupId != BENCH_WRITERGROUPID ||
+       !nm->payloadHeaderEnabled || nm->payloadHeader.dataSetPayloadHeader.count < 1)
+        return false;
+    const UA_DataSetMessage *dsm = &nm->payload.dataSetPayload.dataSetMessages[0];
+    if(dsm->header.dataSetMessageType != UA_DATASETMESSAGE_DATAKEYFRAME)
+        return false;
+
+    /* The RAW-encoded payload starts with the send time */
+    if(dsm->header.fieldEncoding == UA_FIELDENCODING_RAWDATA) {
+        size_t offset = 0;
+        return UA_UInt64_decodeBinary(&dsm->data.keyFrameData.rawFields,
+                                      &offset, sendTime) == UA_STATUSCODE_GOOD;
+    }
+    if(dsm->data.keyFrameData.fieldCount < 1)
+        return false;
+    const UA_Variant *v = &dsm->data.keyFrameData.dataSetFields[0].value;
+    if(v->type != &UA_TYPES[UA_TYPES_UINT64])
+        return false;
+    *sendTime = *(UA_UInt64*)v->data;
+    return true;
+}
+
+static void
+runReader(const BenchRun *run, int fd) {
+    BenchResult result;
+    memset(&result, 0, sizeof(BenchResult));
+    LatencyHistogram_init(&result.latency);
+
+    UA_PubSubTransportLayer udpLayer = UA_PubSubTransportLayerUDPMP();
+    UA_PubSubConnectionConfig connectionConfig;
+    memset(&connectionConfig, 0, sizeof(connectionConfig));
+    connectionConfig.name = UA_STRING("Bench Reader");
+    connectionConfig.transportProfileUri = udpLayer.transportProfileUri;
+    connectionConfig.enabled = UA_TRUE;
+    UA_Variant_setScalar(&connectionConfig.address, (void*)(uintptr_t)&run->address,
+                         &UA_TYPES[UA_TYPES_NETWORKADDRESSURLDATATYPE]);
+    UA_PubSubChannel *psc = udpLayer.createPubSubChannel(&connectionConfig);
+    UA_ByteString buffer = UA_BYTESTRING_NULL;
+    if(!psc || psc->regist(psc, NULL, NULL) != UA_STATUSCODE_GOOD ||
+       UA_ByteString_allocBuffer(&buffer, BENCH_BUFFER_SIZE) != UA_STATUSCODE_GOOD) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "Reader cannot listen on %.*s", (int)run->address.url.length,
+                     (char*)run->address.url.data);
+        if(psc)
+            psc->close(psc);
+        writeResult(fd, &result);
+        return;
+    }
+
+    /* The buffer is reused. Allocations in the loop come from decoding. */
+    UA_Boolean measuring = false;
+    UA_UInt64 startAllocations = 0;
+    UA_Double startCpu = 0.0;
+    for(UA_UInt64 now = benchNow(); now < run->measureEnd; now = benchNow()) {
+        if(!measuring && now >= run->measureStart) {
+            measuring = true;
+            startAllocations = allocations;
+            startCpu = cpuSeconds();
+        }
+
+        buffer.length = BENCH_BUFFER_SIZE;
+        UA_StatusCode retval = psc->receive(psc, &buffer, NULL, BENCH_RECEIVE_TIMEOUT);
+        if(retval != UA_STATUSCODE_GOOD || buffer.length == 0)
+            continue;
+
+        UA_NetworkMessage networkMessage;
+        memset(&networkMessage, 0, sizeof(UA_NetworkMessage));
+        size_t offset = 0;
+        UA_UInt64 sendTime;
+        retval = UA_NetworkMessage_decodeBinary(&buffer, &offset, &networkMessage);
+        if(retval == UA_STATUSCODE_GOOD && getSendTime(&networkMessage, &sendTime) &&
+           measuring) {
+            UA_UInt64 received = benchNow();
+            result.messages++;
+            if(received >= sendTime)
+                LatencyHistogram_record(&result.latency, received - sendTime);
+        }
+        UA_NetworkMessage_clear(&networkMessage);
+    }
+    result.allocations = allocations - startAllocations;
+    result.cpuSeconds = cpuSeconds() - startCpu;
+
+    buffer.length = BENCH_BUFFER_SIZE;
+    UA_ByteString_clear(&buffer);
+    psc->close(psc);
+    writeResult(fd, &result);
+}
+
+/**
+ * Sweep
+ * ^^^^^ */
+
+/* The children only report through the pipe. Their log output would mix
+ * with the JSON lines on stdout. */
+static pid_t
+forkChild(const BenchRun *run, UA_Boolean publisher, int *readFd) {
+    int fds[2];
+    if(pipe(fds) != 0)
+        return -1;
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if(pid == 0) {
+        close(fds[0]);
+        int devNull = open("/dev/null", O_WRONLY);
+        if(devNull >= 0)
+            dup2(devNull, STDOUT_FILENO);
+        countAllocations();
+        if(publisher)
+            runPublisher(run, fds[1]);
+        else
+            runReader(run, fds[1]);
+        _exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+    *readFd = fds[0];
+    return pid;
+}
+
+static void
+printAllocsPerMsg(const char *key, UA_UInt64 allocs, UA_UInt64 messages) {
+#ifdef UA_ENABLE_MALLOC_SINGLETON
+    if(messages > 0) {
+        printf("\"%s\":%.2f", key, (UA_Double)allocs / (UA_Double)messages);
+        return;
+    }
+#endif
+    printf("\"%s\":null", key);
+}
+
+static void
+runConfiguration(BenchRun *run, UA_Double warmup, UA_Double duration) {
+    int fds[BENCH_MAX_READERS + 1];
+    pid_t pids[BENCH_MAX_READERS + 1];
+    UA_UInt64 now = benchNow();
+    run->measureStart = now + BENCH_STARTUP_NS + (UA_UInt64)(warmup * 1e9);
+    run->measureEnd = run->measureStart + (UA_UInt64)(duration * 1e9);
+
+    /* The readers are started first so that they have joined the group
+     * before the first message. The last child is the publisher. */
+    size_t children = 0;
+    for(; children <= run->readers; children++) {
+        pids[children] = forkChild(run, children == run->readers, &fds[children]);
+        if(pids[children] < 0)
+            break;
+    }
+
+    BenchResult *results = (BenchResult*)UA_calloc(run->readers + 1, sizeof(BenchResult));
+    UA_Boolean complete = (results != NULL && children == run->readers + 1);
+    for(size_t i = 0; i < children; i++) {
+        if(results && !readResult(fds[i], &results[i]))
+            complete = false;
+        close(fds[i]);
+        waitpid(pids[i], NULL, 0);
+    }
+    if(!complete) {
+        fprintf(stderr, "Configuration with %lu fields and %lu readers failed\n",
+                (unsigned long)run->fields, (unsigned long)run->readers);
+        UA_free(results);
+        return;
+    }
+
+    BenchResult *publisher = &results[run->readers];
+    LatencyHistogram *latency = &results[0].latency;
+    UA_UInt64 received = results[0].messages;
+    UA_UInt64 readerAllocs = results[0].allocations;
+    UA_Double readerCpu = results[0].cpuSeconds;
+    for(size_t i = 1; i < run->readers; i++) {
+        LatencyHistogram_merge(latency, &results[i].latency);
+        received += results[i].messages;
+        readerAllocs += results[i].allocations;
+        readerCpu += results[i].cpuSeconds;
+    }
+    UA_Double readers = (UA_Double)run->readers;
+    UA_Double expected = (UA_Double)publisher->messages * readers;
+    UA_Double loss = expected > 0.0 ? 1.0 - (UA_Double)received / expected : 0.0;
+    if(loss < 0.0)
+        loss = 0.0; /* Messages in flight at the start of the window */
+
+    printf("{\"fields\":%lu,\"type\":\"%s\",\"encoding\":\"%s\",\"intervalMs\":%g,"
+           "\"readers\":%lu,\"durationS\":%.3f,",
+           (unsigned long)run->fields, run->fieldType->name,
+           run->raw ? "raw" : "variant", run->interval,
+           (unsigned long)run->readers, duration);
+    printf("\"published\":%lu,\"publishedPerS\":%.1f,"
+           "\"received\":%lu,\"receivedPerS\":%.1f,\"lossRatio\":%.6f,",
+           (unsigned long)publisher->messages,
+           (UA_Double)publisher->messages / duration, (unsigned long)received,
+           (UA_Double)received / readers / duration, loss);
+    printf("\"latencyNs\":{\"p50\":%lu,\"p99\":%lu,\"p999\":%lu,\"max\":%lu,"
+           "\"mean\":%.1f},",
+           (unsigned long)LatencyHistogram_percentile(latency, 0.5),
+           (unsigned long)LatencyHistogram_percentile(latency, 0.99),
+           (unsigned long)LatencyHistogram_percentile(latency, 0.999),
+           (unsigned long)latency->max, LatencyHistogram_mean(latency));
+    printf("\"cpuCores\":{\"publisher\":%.4f,\"reader\":%.4f},\"allocsPerMsg\":{",
+           publisher->cpuSeconds / duration, readerCpu / readers / duration);
+    printAllocsPerMsg("publisher", publisher->allocations, publisher->messages);
+    printf(",");
+    printAllocsPerMsg("reader", readerAllocs, received);
+    printf("}}\n");
+    fflush(stdout);
+    UA_free(results);
+}
+
+/* Parses a comma-separated list of numbers */
+static size_t
+parseNumbers(const char *list, UA_Double *values) {
+    size_t count = 0;
+    while(*list && count < BENCH_MAX_VALUES) {
+        char *end;
+        values[count++] = strtod(list, &end);
+        if(end == list)
+            return 0;
+        list = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+static size_t
+parseFieldTypes(const char *list, const BenchFieldType **types) {
+    size_t count = 0;
+    while(*list && count < BENCH_MAX_VALUES) {
+        size_t len = strcspn(list, ",");
+        size_t t = 0;
+        for(; t < BENCH_FIELDTYPES; t++) {
+            if(strlen(fieldTypes[t].name) == len &&
+               strncmp(fieldTypes[t].name, list, len) == 0)
+                break;
+        }
+        if(t == BENCH_FIELDTYPES)
+            return 0;
+        types[count++] = &fieldTypes[t];
+        list += len;
+        if(*list == ',')
+            list++;
+    }
+    return count;
+}
+
+static UA_Boolean
+isMulticast(const UA_String *url) {
+    /* opc.udp://a.b.c.d:port/ with a in 224..239 */
+    if(url->length < 13)
+        return false;
+    int first = atoi((const char*)&url->data[10]);
+    return first >= 224 && first <= 239;
+}
+
+static void
+usage(char *progname) {
+    printf("usage: %s [--url=opc.udp://224.0.0.22:4850/] [--duration=5] "
+           "[--warmup=1]\n"
+           "          [--fields=1,8,64] [--types=int32,double,string] "
+           "[--encodings=variant,raw]\n"
+           "          [--intervals=100,10,1] [--readers=1,4]\n"
+           "Field types: byte, int32, double, string\n", progname);
+}
+
+int main(int argc, char **argv) {
+    char *url = (char*)(uintptr_t)"opc.udp://224.0.0.22:4850/";
+    UA_Double duration = 5.0, warmup = 1.0;
+    UA_Double fields[BENCH_MAX_VALUES] = {1, 8, 64};
+    UA_Double intervals[BENCH_MAX_VALUES] = {100, 10, 1};
+    UA_Double readers[BENCH_MAX_VALUES] = {1, 4};
+    const BenchFieldType *types[BENCH_MAX_VALUES] =
+        {&fieldTypes[1], &fieldTypes[2], &fieldTypes[3]};
+    UA_Boolean encodings[2] = {false, true};
+    size_t fieldsSize = 3, intervalsSize = 3, readersSize = 2;
+    size_t typesSize = 3, encodingsSize = 2;
+
+    for(int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if(strncmp(arg, "--url=", 6) == 0) {
+            url = &arg[6];
+        } else if(strncmp(arg, "--duration=", 11) == 0) {
+            duration = atof(&arg[11]);
+        } else if(strncmp(arg, "--warmup=", 9) == 0) {
+            warmup = atof(&arg[9]);
+        } else if(strncmp(arg, "--fields=", 9) == 0) {
+            fieldsSize = parseNumbers(&arg[9], fields);
+        } else if(strncmp(arg, "--intervals=", 12) == 0) {
+            intervalsSize = parseNumbers(&arg[12], intervals);
+        } else if(strncmp(arg, "--readers=", 10) == 0) {
+            readersSize = parseNumbers(&arg[10], readers);
+        } else if(strncmp(arg, "--types=", 8) == 0) {
+            typesSize = parseFieldTypes(&arg[8], types);
+        } else if(strncmp(arg, "--encodings=", 12) == 0) {
+            encodingsSize = 0;
+            if(strstr(&arg[12], "variant"))
+                encodings[encodingsSize++] = false;
+            if(strstr(&arg[12], "raw"))
+                encodings[encodingsSize++] = true;
+        } else {
+            usage(argv[0]);
+            return strcmp(arg, "-h") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if(fieldsSize == 0 || intervalsSize == 0 || readersSize == 0 ||
+       typesSize == 0 || encodingsSize == 0 || duration <= 0.0 || warmup < 0.0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    BenchRun run;
+    memset(&run, 0, sizeof(BenchRun));
+    run.address.url = UA_STRING(url);
+    UA_Boolean multicast = isMulticast(&run.address.url);
+    for(size_t f = 0; f < fieldsSize; f++) {
+        for(size_t t = 0; t < typesSize; t++) {
+            for(size_t e = 0; e < encodingsSize; e++) {
+                for(size_t i = 0; i < intervalsSize; i++) {
+                    for(size_t r = 0; r < readersSize; r++) {
+                        run.fields = (size_t)fields[f];
+                        run.fieldType = types[t];
+                        run.raw = encodings[e];
+                        run.interval = intervals[i];
+                        run.readers = (size_t)readers[r];
+                        if(run.readers < 1 || run.readers > BENCH_MAX_READERS ||
+                           (run.readers > 1 && !multicast)) {
+                            fprintf(stderr, "Skipping %lu readers on %s\n",
+                                    (unsigned long)run.readers, url);
+                            continue;
+                        }
+                        runConfiguration(&run, warmup, duration);
+                    }
+                }
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,472 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_capture.h"
+#include "pubsub_net_latency.h"
+#include "pubsub_transport_wrap.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MINSEGMENTSIZE (1u * 1024u * 1024u)
+
+typedef struct {
+    UA_UInt32 number;
+    int fd;
+    UA_Byte *base;          /* NULL if the slot is empty */
+    size_t size;
+    PubSubCaptureHeader *header;
+} Segment;
+
+struct PubSubCapture {
+    char *path;
+    size_t segmentSize;
+    UA_UInt32 maxSegments;
+
+    /* Used by the receive thread only */
+    Segment current;
+    size_t dataEnd;
+    UA_UInt64 records;
+
+    /* Handed over to the background thread */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    Segment prepared;
+    Segment finished;
+    UA_UInt32 nextSegment;
+    UA_Boolean running;
+    UA_Boolean failed;      /* Stop preparing after an error */
+    pthread_t thread;
+
+    PubSubCaptureStats stats;
+};
+
+static void
+countStat(UA_UInt64 *counter, UA_UInt64 n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static void
+segmentPath(const char *path, UA_UInt32 number, char *buf, size_t bufSize) {
+    snprintf(buf, bufSize, "%s.%06u", path, number);
+}
+
+static UA_UInt32 *
+indexEntry(UA_Byte *base, UA_UInt64 indexEnd, UA_UInt64 record) {
+    return (UA_UInt32*)(base + indexEnd - sizeof(UA_UInt32) * (record + 1));
+}
+
+/**
+ * Segments
+ * ^^^^^^^^
+ * Created and finished in the background thread. The blocks of the file are
+ * allocated and the mapping is populated up front, so the first write to a
+ * page in the receive thread does not wait for the file system. */
+
+static UA_StatusCode
+createSegment(const PubSubCapture *capture, UA_UInt32 number, Segment *s) {
+    char path[512];
+    segmentPath(capture->path, number, path, sizeof(path));
+    memset(s, 0, sizeof(Segment));
+    s->number = number;
+    s->size = capture->segmentSize;
+    s->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(s->fd < 0)
+        goto error;
+    if(posix_fallocate(s->fd, 0, (off_t)s->size) != 0 &&
+       ftruncate(s->fd, (off_t)s->size) != 0)
+        goto error;
+    void *base = mmap(NULL, s->size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, s->fd, 0);
+    if(base == MAP_FAILED)
+        goto error;
+    s->base = (UA_Byte*)base;
+    s->header = (PubSubCaptureHeader*)base;
+    s->header->magic = PUBSUBCAPTURE_MAGIC;
+    s->header->version = PUBSUBCAPTURE_VERSION;
+    s->header->segment = number;
+    s->header->dataEnd = sizeof(PubSubCaptureHeader);
+    s->header->indexEnd = s->size;
+    return UA_STATUSCODE_GOOD;
+
+ error:
+    UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                 "Capture: cannot create %s: %s", path, strerror(errno));
+    if(s->fd >= 0)
+        close(s->fd);
+    s->base = NULL;
+    return UA_STATUSCODE_BADINTERNALERROR;
+}
+
+/* Moves the index behind the records and truncates the file */
+static void
+finishSegment(Segment *s) {
+    PubSubCaptureHeader *h = s->header;
+    UA_UInt64 records = h->records;
+    size_t indexSize = sizeof(UA_UInt32) * records;
+    memmove(s->base + h->dataEnd, s->base + h->indexEnd - indexSize, indexSize);
+    h->indexEnd = h->dataEnd + indexSize;
+    __atomic_store_n(&h->complete, 1, __ATOMIC_RELEASE);
+    size_t size = h->indexEnd;
+    munmap(s->base, s->size);
+    if(ftruncate(s->fd, (off_t)size) != 0)
+        UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                       "Capture: cannot truncate segment %u: %s",
+                       s->number, strerror(errno));
+    close(s->fd);
+    s->base = NULL;
+}
+
+/* Removes a segment that was prepared, but not used */
+static void
+discardSegment(const PubSubCapture *capture, Segment *s) {
+    char path[512];
+    segmentPath(capture->path, s->number, path, sizeof(path));
+    munmap(s->base, s->size);
+    close(s->fd);
+    unlink(path);
+    s->base = NULL;
+}
+
+static void *
+captureThread(void *data) {
+    PubSubCapture *capture = (PubSubCapture*)data;
+    pthread_mutex_lock(&capture->lock);
+    for(;;) {
+        if(capture->finished.base) {
+            Segment s = capture->finished;
+            pthread_mutex_unlock(&capture->lock);
+            finishSegment(&s);
+            pthread_mutex_lock(&capture->lock);
+            capture->finished.base = NULL;
+            continue;
+        }
+        if(!capture->running)
+            break;
+        if(!capture->prepared.base && !capture->failed &&
+           (capture->maxSegments == 0 || capture->nextSegment < capture->maxSegments)) {
+            Segment s;
+            UA_UInt32 number = capture->nextSegment;
+            pthread_mutex_unlock(&capture->lock);
+            UA_StatusCode retval = createSegment(capture, number, &s);
+            pthread_mutex_lock(&capture->lock);
+            if(retval == UA_STATUSCODE_GOOD) {
+                capture->prepared = s;
+                capture->nextSegment++;
+            } else {
+                capture->failed = true;
+            }
+            continue;
+        }
+        pthread_cond_wait(&capture->cond, &capture->lock);
+    }
+    pthread_mutex_unlock(&capture->lock);
+    return NULL;
+}
+
+/**
+ * Writing
+ * ^^^^^^^ */
+
+/* Swaps in the prepared segment. Does not wait for the lock. */
+static UA_Boolean
+rollover(PubSubCapture *capture) {
+    if(pthread_mutex_trylock(&capture->lock) != 0)
+        return false;
+    UA_Boolean ready = capture->prepared.base && !capture->finished.base;
+    if(ready) {
+        capture->finished = capture->current;
+        capture->current = capture->prepared;
+        capture->prepared.base = NULL;
+        capture->dataEnd = sizeof(PubSubCaptureHeader);
+        capture->records = 0;
+        countStat(&capture->stats.segments, 1);
+        pthread_cond_signal(&capture->cond);
+    }
+    pthread_mutex_unlock(&capture->lock);
+    return ready;
+}
+
+UA_Boolean
+PubSubCapture_append(PubSubCapture *capture, UA_DateTime receiveTime,
+                     const UA_ByteString *message) {
+    if(message->length > PUBSUBCAPTURE_MAXMESSAGESIZE) {
+        countStat(&capture->stats.dropped, 1);
+        return false;
+    }
+    size_t recordSize = (sizeof(PubSubCaptureRecord) + message->length + 7) & ~(size_t)7;
+    if(capture->dataEnd + recordSize + sizeof(UA_UInt32) * (capture->records + 1) >
+       capture->current.size && !rollover(capture)) {
+        countStat(&capture->stats.dropped, 1);
+        return false;
+    }
+
+    Segment *s = &capture->current;
+    PubSubCaptureRecord *record = (PubSubCaptureRecord*)(s->base + capture->dataEnd);
+    record->receiveTime = receiveTime;
+    record->length = (UA_UInt32)message->length;
+    record->reserved = 0;
+    if(message->length > 0)
+        memcpy(record + 1, message->data, message->length);
+    *indexEntry(s->base, s->size, capture->records) = (UA_UInt32)capture->dataEnd;
+    capture->dataEnd += recordSize;
+    capture->records++;
+
+    PubSubCaptureHeader *h = s->header;
+    if(capture->records == 1)
+        h->firstTime = receiveTime;
+    h->lastTime = receiveTime;
+    h->dataEnd = capture->dataEnd;
+    __atomic_store_n(&h->records, capture->records, __ATOMIC_RELEASE);
+    countStat(&capture->stats.records, 1);
+    countStat(&capture->stats.bytes, message->length);
+    return true;
+}
+
+PubSubCapture *
+PubSubCapture_new(const PubSubCaptureConfig *config) {
+    size_t segmentSize = config->segmentSize > 0 ?
+        config->segmentSize : PUBSUBCAPTURE_SEGMENTSIZE;
+    if(segmentSize < MINSEGMENTSIZE || segmentSize > UINT32_MAX) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "Capture: the segment size must be between 1 MiB and 4 GiB");
+        return NULL;
+    }
+    PubSubCapture *capture = (PubSubCapture*)UA_calloc(1, sizeof(PubSubCapture));
+    if(!capture)
+        return NULL;
+    capture->path = strdup(config->path);
+    capture->segmentSize = segmentSize & ~(size_t)7;
+    capture->maxSegments = config->maxSegments;
+    if(!capture->path ||
+       createSegment(capture, 0, &capture->current) != UA_STATUSCODE_GOOD) {
+        free(capture->path);
+        UA_free(capture);
+        return NULL;
+    }
+    capture->dataEnd = sizeof(PubSubCaptureHeader);
+    capture->nextSegment = 1;
+    capture->stats.segments = 1;
+    capture->running = true;
+    pthread_mutex_init(&capture->lock, NULL);
+    pthread_cond_init(&capture->cond, NULL);
+    if(pthread_create(&capture->thread, NULL, captureThread, capture) != 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "Capture: cannot start the background thread");
+        capture->running = false;
+        PubSubCapture_delete(capture);
+        return NULL;
+    }
+    return capture;
+}
+
+void
+PubSubCapture_delete(PubSubCapture *capture) {
+    if(capture->running) {
+        pthread_mutex_lock(&capture->lock);
+        capture->running = false;
+        pthread_cond_signal(&capture->cond);
+        pthread_mutex_unlock(&capture->lock);
+        pthread_join(capture->thread, NULL);
+    }
+    finishSegment(&capture->current);
+    if(capture->prepared.base)
+        discardSegment(capture, &capture->prepared);
+    pthread_mutex_destroy(&capture->lock);
+    pthread_cond_destroy(&capture->cond);
+    free(capture->path);
+    UA_free(capture);
+}
+
+void
+PubSubCapture_getStats(PubSubCapture *capture, PubSubCaptureStats *stats) {
+    stats->records = __atomic_load_n(&capture->stats.records, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&capture->stats.bytes, __ATOMIC_RELAXED);
+    stats->segments = __atomic_load_n(&capture->stats.segments, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&capture->stats.dropped, __ATOMIC_RELAXED);
+}
+
+/**
+ * Transport Wrapper
+ * ^^^^^^^^^^^^^^^^^ */
+
+static UA_StatusCode
+captureReceive(PubSubChannelWrap *wrap, UA_ByteString *buf,
+               UA_ExtensionObject *transportSettings, UA_UInt32 timeout) {
+    UA_DateTime before = PubSubNetLatency_lastReceiveTime(NULL);
+    UA_StatusCode retval = wrap->receive(wrap->channel, buf, transportSettings, timeout);
+    if(retval != UA_STATUSCODE_GOOD || buf->length == 0)
+        return retval;
+    /* A PubSubNetLatency wrapper below has stamped the message */
+    UA_DateTime receiveTime = PubSubNetLatency_lastReceiveTime(NULL);
+    if(receiveTime == before)
+        receiveTime = UA_DateTime_now();
+    PubSubCapture_append((PubSubCapture*)wrap->wrapperContext, receiveTime, buf);
+    return retval;
+}
+
+static const PubSubTransportWrapper captureWrapper = {
+    "capture", NULL, NULL, captureReceive, NULL
+};
+
+UA_PubSubTransportLayer
+PubSubCapture_wrapTransportLayer(UA_PubSubTransportLayer inner,
+                                 PubSubCapture *capture) {
+    return PubSubTransportWrap_layer(inner, &captureWrapper, capture);
+}
+
+/**
+ * Reading
+ * ^^^^^^^ */
+
+struct PubSubCaptureReader {
+    char *path;
+    UA_UInt32 segment;
+    UA_Byte *base;          /* NULL after the last segment */
+    size_t size;
+    const PubSubCaptureHeader *header;
+    UA_UInt64 record;       /* Next record in the segment */
+    UA_DateTime startTime;
+};
+
+static void
+unmapSegment(PubSubCaptureReader *reader) {
+    if(reader->base)
+        munmap(reader->base, reader->size);
+    reader->base = NULL;
+    reader->header = NULL;
+}
+
+static UA_StatusCode
+mapSegment(PubSubCaptureReader *reader, UA_UInt32 number) {
+    unmapSegment(reader);
+    char path[512];
+    segmentPath(reader->path, number, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return UA_STATUSCODE_BADNOTFOUND;
+    struct stat st;
+    void *base = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(PubSubCaptureHeader))
+        base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    reader->base = (UA_Byte*)base;
+    reader->size = (size_t)st.st_size;
+    reader->header = (const PubSubCaptureHeader*)base;
+    reader->segment = number;
+    reader->record = 0;
+    if(reader->header->magic != PUBSUBCAPTURE_MAGIC ||
+       reader->header->version != PUBSUBCAPTURE_VERSION ||
+       reader->header->indexEnd > reader->size) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "Capture: %s is not a capture segment", path);
+        unmapSegment(reader);
+        return UA_STATUSCODE_BADDECODINGERROR;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+/* Records of the mapped segment. Acquires the records of a segment that is
+ * still written. */
+static UA_UInt64
+segmentRecords(const PubSubCaptureReader *reader) {
+    return __atomic_load_n(&reader->header->records, __ATOMIC_ACQUIRE);
+}
+
+static const PubSubCaptureRecord *
+getRecord(const PubSubCaptureReader *reader, UA_UInt64 record) {
+    const PubSubCaptureHeader *h = reader->header;
+    size_t offset = *indexEntry(reader->base, h->indexEnd, record);
+    if(offset < sizeof(PubSubCaptureHeader) ||
+       offset + sizeof(PubSubCaptureRecord) > reader->size)
+        return NULL;
+    const PubSubCaptureRecord *r = (const PubSubCaptureRecord*)(reader->base + offset);
+    if(r->length > reader->size - offset - sizeof(PubSubCaptureRecord))
+        return NULL;
+    return r;
+}
+
+PubSubCaptureReader *
+PubSubCaptureReader_open(const char *path) {
+    PubSubCaptureReader *reader =
+        (PubSubCaptureReader*)UA_calloc(1, sizeof(PubSubCaptureReader));
+    if(!reader)
+        return NULL;
+    reader->path = strdup(path);
+    if(!reader->path || mapSegment(reader, 0) != UA_STATUSCODE_GOOD) {
+        free(reader->path);
+        UA_free(reader);
+        return NULL;
+    }
+    reader->startTime = reader->header->firstTime;
+    return reader;
+}
+
+void
+PubSubCaptureReader_close(PubSubCaptureReader *reader) {
+    unmapSegment(reader);
+    free(reader->path);
+    UA_free(reader);
+}
+
+UA_Boolean
+PubSubCaptureReader_next(PubSubCaptureReader *reader, UA_DateTime *receiveTime,
+                         UA_ByteString *message) {
+    while(reader->base) {
+        if(reader->record < segmentRecords(reader)) {
+            const PubSubCaptureRecord *r = getRecord(reader, reader->record);
+            if(!r) {
+                UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                             "Capture: record %lu of segment %u is corrupt",
+                             (unsigned long)reader->record, reader->segment);
+                unmapSegment(reader);
+                return false;
+            }
+            reader->record++;
+            *receiveTime = r->receiveTime;
+            message->length = r->length;
+            message->data = (UA_Byte*)(uintptr_t)(r + 1);
+            return true;
+        }
+        mapSegment(reader, reader->segment + 1);
+    }
+    return false;
+}
+
+UA_StatusCode
+PubSubCaptureReader_seek(PubSubCaptureReader *reader, UA_DateTime time) {
+    for(UA_UInt32 number = 0; mapSegment(reader, number) == UA_STATUSCODE_GOOD; number++) {
+        UA_UInt64 records = segmentRecords(reader);
+        if(records == 0 || reader->header->lastTime < time)
+            continue;
+        UA_UInt64 low = 0;
+        UA_UInt64 high = records;
+        while(low < high) {
+            UA_UInt64 mid = low + (high - low) / 2;
+            const PubSubCaptureRecord *r = getRecord(reader, mid);
+            if(r && r->receiveTime < time)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        reader->record = low;
+        return UA_STATUSCODE_GOOD;
+    }
+    return UA_STATUSCODE_BADNOTFOUND;
+}
+
+UA_DateTime
+PubSubCaptureReader_startTime(const PubSubCaptureReader *reader) {
+    return reader->startTime;
+}
@@ -0,0 +1,123 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_CAPTURE_H_
+#define PUBSUB_CAPTURE_H_
+
+#include <open62541/plugin/pubsub.h>
+
+/**
+ * PubSub Capture Files
+ * --------------------
+ * Records the raw NetworkMessages received by a subscriber, with their
+ * receive time, so that production traffic can be replayed with
+ * ``pubsub_replay.c`` and fed to benchmarks of the decoders.
+ *
+ * A capture is a series of segment files ``<path>.000000``,
+ * ``<path>.000001``, ... Each segment is allocated in full and mapped
+ * before it is used. Appending a record is a copy into the mapping and no
+ * system call. A background thread prepares the next segment, and finishes
+ * full segments: it moves their index behind the records, truncates the file
+ * and unmaps it. If the next segment is not ready when the current one is
+ * full, messages are dropped and counted until it is. The receive path never
+ * waits for the disk.
+ *
+ * A segment starts with a PubSubCaptureHeader. The records follow, aligned
+ * to 8 bytes: a PubSubCaptureRecord and the message. The index holds the
+ * offset of every record as a UInt32, in reverse order below
+ * ``indexEnd``. While a segment is written, the index grows down from the
+ * end of the file. The header fields are in host byte order.
+ *
+ * There is a single writer per capture, the thread that receives. */
+
+#define PUBSUBCAPTURE_MAGIC 0x55414350 /* "UACP" */
+#define PUBSUBCAPTURE_VERSION 1
+#define PUBSUBCAPTURE_SEGMENTSIZE (64u * 1024u * 1024u)
+#define PUBSUBCAPTURE_MAXMESSAGESIZE 65536
+
+typedef struct {
+    UA_UInt32 magic;
+    UA_UInt32 version;
+    UA_UInt32 segment;      /* Number of the segment in the capture */
+    UA_UInt32 complete;     /* Set when the segment is finished */
+    UA_UInt64 records;      /* Written last for every record */
+    UA_UInt64 dataEnd;      /* End of the last record */
+    UA_UInt64 indexEnd;
+    UA_DateTime firstTime;  /* Receive time of the first record */
+    UA_DateTime lastTime;
+} __attribute__((aligned(64))) PubSubCaptureHeader;
+
+typedef struct {
+    UA_DateTime receiveTime;
+    UA_UInt32 length;
+    UA_UInt32 reserved;
+} PubSubCaptureRecord;
+
+typedef struct {
+    const char *path;
+    size_t segmentSize;     /* 0 for PUBSUBCAPTURE_SEGMENTSIZE */
+    UA_UInt32 maxSegments;  /* Stop recording after that many, 0 for no limit */
+} PubSubCaptureConfig;
+
+typedef struct {
+    UA_UInt64 records;
+    UA_UInt64 bytes;        /* Of the messages */
+    UA_UInt64 segments;
+    UA_UInt64 dropped;      /* Too large, or no segment ready to take it */
+} PubSubCaptureStats;
+
+typedef struct PubSubCapture PubSubCapture;
+
+/* Creates the first segment and starts the background thread */
+PubSubCapture *
+PubSubCapture_new(const PubSubCaptureConfig *config);
+
+/* Finishes the current segment and waits for the background thread */
+void
+PubSubCapture_delete(PubSubCapture *capture);
+
+/* Returns false if the message was dropped */
+UA_Boolean
+PubSubCapture_append(PubSubCapture *capture, UA_DateTime receiveTime,
+                     const UA_ByteString *message);
+
+void
+PubSubCapture_getStats(PubSubCapture *capture, PubSubCaptureStats *stats);
+
+/* Appends every message received by the channels of the layer. Stacked on
+ * top of PubSubNetLatency_wrapTransportLayer (pubsub_net_latency.h), the
+ * receive time is the timestamp taken there, e.g. by the kernel. Otherwise
+ * it is UA_DateTime_now() after the receive. */
+UA_PubSubTransportLayer
+PubSubCapture_wrapTransportLayer(UA_PubSubTransportLayer inner,
+                                 PubSubCapture *capture);
+
+/**
+ * Reading
+ * ^^^^^^^
+ * The reader maps one segment after the other. The messages point into the
+ * mapping and are valid until the next call. */
+
+typedef struct PubSubCaptureReader PubSubCaptureReader;
+
+PubSubCaptureReader *
+PubSubCaptureReader_open(const char *path);
+
+void
+PubSubCaptureReader_close(PubSubCaptureReader *reader);
+
+/* Returns false after the last record */
+UA_Boolean
+PubSubCaptureReader_next(PubSubCaptureReader *reader, UA_DateTime *receiveTime,
+                         UA_ByteString *message);
+
+/* Continues with the first record received at or after time. A binary
+ * search in the index of the segment that contains it. */
+UA_StatusCode
+PubSubCaptureReader_seek(PubSubCaptureReader *reader, UA_DateTime time);
+
+/* Receive time of the first record of the capture */
+UA_DateTime
+PubSubCaptureReader_startTime(const PubSubCaptureReader *reader);
+
+#endif /* PUBSUB_CAPTURE_H_ */
@@ -0,0 +1,99 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_ethernet_frame.h"
+
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+UA_StatusCode
+PubSubEthernet_parseAddress(const UA_String *url, UA_Byte *mac,
+                            UA_UInt16 *vid, UA_Byte *pcp) {
+    char buf[64];
+    if(url->length < 10 || url->length >= sizeof(buf) ||
+       strncmp((const char*)url->data, "opc.eth://", 10) != 0)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    memcpy(buf, url->data, url->length);
+    buf[url->length] = 0;
+
+    unsigned int m[ETH_ALEN];
+    int n = 0;
+    if(sscanf(&buf[10], "%2x-%2x-%2x-%2x-%2x-%2x%n",
+              &m[0], &m[1], &m[2], &m[3], &m[4], &m[5], &n) != ETH_ALEN)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    for(size_t i = 0; i < ETH_ALEN; i++)
+        mac[i] = (UA_Byte)m[i];
+
+    *vid = 0;
+    *pcp = 0;
+    const char *rest = &buf[10 + n];
+    if(*rest == ':') {
+        unsigned int v = 0, p = 0;
+        if(sscanf(rest + 1, "%u.%u", &v, &p) < 1 || v > 4094 || p > 7)
+            return UA_STATUSCODE_BADINTERNALERROR;
+        *vid = (UA_UInt16)v;
+        *pcp = (UA_Byte)p;
+    } else if(*rest != 0 && strcmp(rest, "/") != 0) {
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+PubSubEthernet_interfaceAddress(const char *ifName, UA_Byte *mac) {
+    struct ifreq ifreq;
+    memset(&ifreq, 0, sizeof(ifreq));
+    if(strlen(ifName) >= sizeof(ifreq.ifr_name))
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    strcpy(ifreq.ifr_name, ifName);
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(fd < 0)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    int res = ioctl(fd, SIOCGIFHWADDR, &ifreq);
+    close(fd);
+    if(res < 0)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    memcpy(mac, ifreq.ifr_hwaddr.sa_data, ETH_ALEN);
+    return UA_STATUSCODE_GOOD;
+}
+
+size_t
+PubSubEthernet_writeHeader(UA_Byte *frame, const UA_Byte *dst, const UA_Byte *src,
+                           UA_UInt16 vid, UA_Byte pcp) {
+    memcpy(frame, dst, ETH_ALEN);
+    memcpy(&frame[ETH_ALEN], src, ETH_ALEN);
+    UA_Byte *pos = &frame[2 * ETH_ALEN];
+    if(vid) {
+        UA_UInt16 tpid = htons(PUBSUBETHERNET_ETHERTYPE_VLAN);
+        UA_UInt16 tci = htons((UA_UInt16)((pcp << 13) | vid));
+        memcpy(pos, &tpid, 2);
+        memcpy(pos + 2, &tci, 2);
+        pos += 4;
+    }
+    UA_UInt16 etherType = htons(PUBSUBETHERNET_ETHERTYPE_UADP);
+    memcpy(pos, &etherType, 2);
+    return (size_t)(pos + 2 - frame);
+}
+
+size_t
+PubSubEthernet_payloadOffset(const UA_Byte *frame, size_t length) {
+    size_t offset = 2 * ETH_ALEN;
+    if(length < offset + 2)
+        return 0;
+    UA_UInt16 etherType = (UA_UInt16)(frame[offset] << 8 | frame[offset + 1]);
+    if(etherType == PUBSUBETHERNET_ETHERTYPE_VLAN) {
+        offset += 4;
+        if(length < offset + 2)
+            return 0;
+        etherType = (UA_UInt16)(frame[offset] << 8 | frame[offset + 1]);
+    }
+    if(etherType != PUBSUBETHERNET_ETHERTYPE_UADP)
+        return 0;
+    return offset + 2;
+}
@@ -0,0 +1,39 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_ETHERNET_FRAME_H_
+#define PUBSUB_ETHERNET_FRAME_H_
+
+#include <open62541/types.h>
+
+/**
+ * Ethernet Frames
+ * ---------------
+ * Helpers shared by the transports and wrappers that build UADP Ethernet
+ * frames themselves. Addresses have the syntax of the Ethernet layer of
+ * open62541, ``opc.eth://<MAC>[:<VID>[.<PCP>]]``. */
+
+#define PUBSUBETHERNET_ETHERTYPE_UADP 0xb62c
+#define PUBSUBETHERNET_ETHERTYPE_VLAN 0x8100
+#define PUBSUBETHERNET_MAXHEADERSIZE 18 /* With a VLAN tag */
+
+UA_StatusCode
+PubSubEthernet_parseAddress(const UA_String *url, UA_Byte *mac,
+                            UA_UInt16 *vid, UA_Byte *pcp);
+
+/* The MAC address of the interface */
+UA_StatusCode
+PubSubEthernet_interfaceAddress(const char *ifName, UA_Byte *mac);
+
+/* Writes the header up to and including the UADP ethertype. Returns the
+ * header size, 14 or 18 bytes with a VLAN tag (vid != 0). */
+size_t
+PubSubEthernet_writeHeader(UA_Byte *frame, const UA_Byte *dst, const UA_Byte *src,
+                           UA_UInt16 vid, UA_Byte pcp);
+
+/* Returns the offset of the UADP payload in a received frame, also behind a
+ * VLAN tag, or 0 if the frame has another ethertype */
+size_t
+PubSubEthernet_payloadOffset(const UA_Byte *frame, size_t length);
+
+#endif /* PUBSUB_ETHERNET_FRAME_H_ */
@@ -0,0 +1,378 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_ethernet_mmap.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#include "pubsub_ethernet_frame.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CHANNELDATAMMAP_MAGIC 0x4d4d4150 /* "MMAP" */
+
+/* Offset of the frame in a TX slot, see tpacket_fill_skb in the kernel */
+#define TX_DATA_OFFSET TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+
+typedef struct {
+    UA_UInt32 magic;
+    int ifindex;
+    UA_UInt16 vid;
+    UA_Byte prio;
+    UA_Byte ifAddress[ETH_ALEN];
+    UA_Byte targetAddress[ETH_ALEN];
+
+    UA_Byte *map;
+    size_t mapSize;
+    struct tpacket_req3 rxReq;
+    struct tpacket_req3 txReq;
+    UA_Byte *rxRing;
+    UA_Byte *txRing;
+
+    /* RX position. A block is returned to the kernel when all its packets
+     * have been read. */
+    UA_UInt32 rxBlock;
+    UA_Boolean rxBlockActive;
+    UA_UInt32 rxPacketsLeft;
+    struct tpacket3_hdr *rxPacket;
+    struct timespec lastRx;
+
+    UA_UInt32 txFrame;
+    PubSubEthernetMmapStats stats;
+} ChannelDataMmap;
+
+/* opc.eth://<MAC>[:<VID>[.<PCP>]] with the MAC as xx-xx-xx-xx-xx-xx */
+static ChannelDataMmap *
+getChannelData(UA_PubSubChannel *channel) {
+    ChannelDataMmap *cd = (ChannelDataMmap*)channel->handle;
+    if(!cd || cd->magic != CHANNELDATAMMAP_MAGIC)
+        return NULL;
+    return cd;
+}
+
+static UA_StatusCode
+mmapRegist(UA_PubSubChannel *channel, UA_ExtensionObject *transportSettings,
+           void (*callback)(UA_ByteString *encodedBuffer, UA_ByteString *topic)) {
+    ChannelDataMmap *cd = (ChannelDataMmap*)channel->handle;
+    if(!(cd->targetAddress[0] & 1))
+        return UA_STATUSCODE_GOOD; /* Unicast */
+    struct packet_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = cd->ifindex;
+    mreq.mr_type = PACKET_MR_MULTICAST;
+    mreq.mr_alen = ETH_ALEN;
+    memcpy(mreq.mr_address, cd->targetAddress, ETH_ALEN);
+    if(setsockopt(channel->sockfd, SOL_PACKET, PACKET_ADD_MEMBERSHIP,
+                  &mreq, sizeof(mreq)) < 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection regist failed. %s", strerror(errno));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+mmapUnregist(UA_PubSubChannel *channel, UA_ExtensionObject *transportSettings) {
+    ChannelDataMmap *cd = (ChannelDataMmap*)channel->handle;
+    if(!(cd->targetAddress[0] & 1))
+        return UA_STATUSCODE_GOOD;
+    struct packet_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = cd->ifindex;
+    mreq.mr_type = PACKET_MR_MULTICAST;
+    mreq.mr_alen = ETH_ALEN;
+    memcpy(mreq.mr_address, cd->targetAddress, ETH_ALEN);
+    if(setsockopt(channel->sockfd, SOL_PACKET, PACKET_DROP_MEMBERSHIP,
+                  &mreq, sizeof(mreq)) < 0)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+mmapSend(UA_PubSubChannel *channel, UA_ExtensionObject *transportSettings,
+         const UA_ByteString *buf) {
+    ChannelDataMmap *cd = (ChannelDataMmap*)channel->handle;
+    struct tpacket3_hdr *hdr = (struct tpacket3_hdr*)
+        &cd->txRing[(size_t)cd->txFrame * cd->txReq.tp_frame_size];
+    if(__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+        /* Let the kernel drain the ring, then try once more */
+        send(channel->sockfd, NULL, 0, 0);
+        if(__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+            cd->stats.txBusy++;
+            return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+        }
+    }
+
+    UA_Byte *frame = (UA_Byte*)hdr + TX_DATA_OFFSET;
+    size_t headerSize = PubSubEthernet_writeHeader(frame, cd->targetAddress,
+                                                   cd->ifAddress, cd->vid, cd->prio);
+    if(TX_DATA_OFFSET + headerSize + buf->length > cd->txReq.tp_frame_size)
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED; /* The frame stays available */
+    memcpy(&frame[headerSize], buf->data, buf->length);
+
+    hdr->tp_len = (UA_UInt32)(headerSize + buf->length);
+    hdr->tp_next_offset = 0;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    cd->txFrame = (cd->txFrame + 1) % cd->txReq.tp_frame_nr;
+
+    if(send(channel->sockfd, NULL, 0, MSG_DONTWAIT) < 0 &&
+       errno != EAGAIN && errno != ENOBUFS) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection sending failed. %s", strerror(errno));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    cd->stats.txFrames++;
+    return UA_STATUSCODE_GOOD;
+}
+
+/* Returns the next packet of the RX ring or NULL if the kernel has not
+ * filled the next block yet */
+static struct tpacket3_hdr *
+nextPacket(ChannelDataMmap *cd) {
+    for(;;) {
+        struct tpacket_block_desc *block = (struct tpacket_block_desc*)
+            &cd->rxRing[(size_t)cd->rxBlock * cd->rxReq.tp_block_size];
+        if(!cd->rxBlockActive) {
+            if(!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+                 TP_STATUS_USER))
+                return NULL;
+            cd->rxBlockActive = true;
+            cd->rxPacketsLeft = block->hdr.bh1.num_pkts;
+            cd->rxPacket = (struct tpacket3_hdr*)
+                ((UA_Byte*)block + block->hdr.bh1.offset_to_first_pkt);
+        }
+        if(cd->rxPacketsLeft == 0) {
+            __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                             __ATOMIC_RELEASE);
+            cd->rxBlockActive = false;
+            cd->rxBlock = (cd->rxBlock + 1) % cd->rxReq.tp_block_nr;
+            continue;
+        }
+        struct tpacket3_hdr *pkt = cd->rxPacket;
+        cd->rxPacketsLeft--;
+        cd->rxPacket = (struct tpacket3_hdr*)((UA_Byte*)pkt + pkt->tp_next_offset);
+        return pkt;
+    }
+}
+
+static UA_StatusCode
+mmapReceive(UA_PubSubChannel *channel, UA_ByteString *message,
+            UA_ExtensionObject *transportSettings, UA_UInt32 timeout) {
+    ChannelDataMmap *cd = (ChannelDataMmap*)channel->handle;
+    size_t capacity = message->length;
+    message->length = 0;
+    UA_Boolean waited = false;
+    for(;;) {
+        struct tpacket3_hdr *pkt = nextPacket(cd);
+        if(!pkt) {
+            if(waited || timeout == 0)
+                return UA_STATUSCODE_GOOD;
+            /* The timeout is in microseconds */
+            struct pollfd pfd = {channel->sockfd, POLLIN | POLLERR, 0};
+            cd->stats.rxWakeups++;
+            if(poll(&pfd, 1, (int)((timeout + 999) / 1000)) <= 0)
+                return UA_STATUSCODE_GOOD;
+            waited = true;
+            continue;
+        }
+
+        /* Skip our own frames, the packet socket sees outgoing traffic */
+        const struct sockaddr_ll *sll = (const struct sockaddr_ll*)
+            ((UA_Byte*)pkt + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        if(sll->sll_pkttype == PACKET_OUTGOING)
+            continue;
+
+        const UA_Byte *frame = (const UA_Byte*)pkt + pkt->tp_mac;
+        size_t length = pkt->tp_snaplen;
+        size_t offset = PubSubEthernet_payloadOffset(frame, length);
+        if(offset == 0 || length - offset > capacity)
+            continue;
+
+        memcpy(message->data, &frame[offset], length - offset);
+        message->length = length - offset;
+        cd->lastRx.tv_sec = pkt->tp_sec;
+        cd->lastRx.tv_nsec = pkt->tp_nsec;
+        cd->stats.rxFrames++;
+        return UA_STATUSCODE_GOOD;
+    }
+}
+
+static UA_StatusCode
+mmapClose(UA_PubSubChannel *channel) {
+    ChannelDataMmap *cd = (ChannelDataMmap*)channel->handle;
+    if(cd) {
+        if(cd->map)
+            munmap(cd->map, cd->mapSize);
+        UA_free(cd);
+    }
+    if(channel->sockfd >= 0)
+        close(channel->sockfd);
+    UA_free(channel);
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+setupRings(int fd, ChannelDataMmap *cd) {
+    int version = TPACKET_V3;
+    if(setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+        return UA_STATUSCODE_BADNOTSUPPORTED;
+
+    struct tpacket_req3 *rx = &cd->rxReq;
+    rx->tp_block_size = PUBSUBETHERNETMMAP_BLOCK_SIZE;
+    rx->tp_block_nr = PUBSUBETHERNETMMAP_RX_BLOCKS;
+    rx->tp_frame_size = PUBSUBETHERNETMMAP_FRAME_SIZE;
+    rx->tp_frame_nr = (rx->tp_block_size / rx->tp_frame_size) * rx->tp_block_nr;
+    rx->tp_retire_blk_tov = PUBSUBETHERNETMMAP_BLOCK_TIMEOUT;
+    if(setsockopt(fd, SOL_PACKET, PACKET_RX_RING, rx, sizeof(*rx)) < 0)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+
+    /* The TX ring of TPACKET_V3 is frame-based, the block fields only
+     * define its size */
+    struct tpacket_req3 *tx = &cd->txReq;
+    tx->tp_block_size = PUBSUBETHERNETMMAP_BLOCK_SIZE;
+    tx->tp_block_nr = PUBSUBETHERNETMMAP_TX_BLOCKS;
+    tx->tp_frame_size = PUBSUBETHERNETMMAP_FRAME_SIZE;
+    tx->tp_frame_nr = (tx->tp_block_size / tx->tp_frame_size) * tx->tp_block_nr;
+    if(setsockopt(fd, SOL_PACKET, PACKET_TX_RING, tx, sizeof(*tx)) < 0)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+
+    size_t rxSize = (size_t)rx->tp_block_size * rx->tp_block_nr;
+    size_t txSize = (size_t)tx->tp_block_size * tx->tp_block_nr;
+    void *map = mmap(NULL, rxSize + txSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, 0);
+    if(map == MAP_FAILED)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+    cd->map = (UA_Byte*)map;
+    cd->mapSize = rxSize + txSize;
+    cd->rxRing = cd->map;
+    cd->txRing = cd->map + rxSize;
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_PubSubChannel *
+createChannel(UA_PubSubConnectionConfig *connectionConfig) {
+    if(!UA_Variant_hasScalarType(&connectionConfig->address,
+                                 &UA_TYPES[UA_TYPES_NETWORKADDRESSURLDATATYPE])) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Invalid Address.");
+        return NULL;
+    }
+    const UA_NetworkAddressUrlDataType *address =
+        (const UA_NetworkAddressUrlDataType*)connectionConfig->address.data;
+
+    ChannelDataMmap *cd = (ChannelDataMmap*)UA_calloc(1, sizeof(ChannelDataMmap));
+    UA_PubSubChannel *channel = (UA_PubSubChannel*)UA_calloc(1, sizeof(UA_PubSubChannel));
+    if(!cd || !channel) {
+        UA_free(cd);
+        UA_free(channel);
+        return NULL;
+    }
+    cd->magic = CHANNELDATAMMAP_MAGIC;
+    channel->handle = cd;
+    channel->sockfd = -1;
+    channel->connectionConfig = connectionConfig;
+
+    char ifName[IF_NAMESIZE];
+    if(PubSubEthernet_parseAddress(&address->url, cd->targetAddress, &cd->vid, &cd->prio) !=
+       UA_STATUSCODE_GOOD || address->networkInterface.length >= IF_NAMESIZE) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Invalid Address.");
+        goto error;
+    }
+    memcpy(ifName, address->networkInterface.data, address->networkInterface.length);
+    ifName[address->networkInterface.length] = 0;
+    cd->ifindex = (int)if_nametoindex(ifName);
+    if(cd->ifindex == 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Unknown interface %s.", ifName);
+        goto error;
+    }
+
+    /* Protocol 0 receives nothing until the socket is bound */
+    channel->sockfd = socket(PF_PACKET, SOCK_RAW, 0);
+    if(channel->sockfd < 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Cannot create socket. %s",
+                     strerror(errno));
+        goto error;
+    }
+
+    if(PubSubEthernet_interfaceAddress(ifName, cd->ifAddress) != UA_STATUSCODE_GOOD) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Cannot get the MAC address.");
+        goto error;
+    }
+
+    UA_StatusCode retval = setupRings(channel->sockfd, cd);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Cannot set up the "
+                     "PACKET_MMAP rings. %s", strerror(errno));
+        goto error;
+    }
+
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(PUBSUBETHERNET_ETHERTYPE_UADP);
+    sll.sll_ifindex = cd->ifindex;
+    if(bind(channel->sockfd, (struct sockaddr*)&sll, sizeof(sll)) < 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Cannot bind. %s",
+                     strerror(errno));
+        goto error;
+    }
+
+    channel->state = UA_PUBSUB_CHANNEL_RDY;
+    channel->send = mmapSend;
+    channel->regist = mmapRegist;
+    channel->unregist = mmapUnregist;
+    channel->receive = mmapReceive;
+    channel->close = mmapClose;
+    return channel;
+
+ error:
+    mmapClose(channel);
+    return NULL;
+}
+
+UA_PubSubTransportLayer
+PubSubEthernetMmap_transportLayer(void) {
+    UA_PubSubTransportLayer layer;
+    layer.transportProfileUri =
+        UA_STRING("http://opcfoundation.org/UA-Profile/Transport/pubsub-eth-uadp");
+    layer.createPubSubChannel = createChannel;
+    return layer;
+}
+
+UA_StatusCode
+PubSubEthernetMmap_getStats(UA_PubSubChannel *channel, PubSubEthernetMmapStats *stats) {
+    ChannelDataMmap *cd = getChannelData(channel);
+    if(!cd)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    /* The kernel resets its counters on every read */
+    struct tpacket_stats_v3 kstats;
+    socklen_t len = sizeof(kstats);
+    if(getsockopt(channel->sockfd, SOL_PACKET, PACKET_STATISTICS, &kstats, &len) == 0)
+        cd->stats.rxDropped += kstats.tp_drops;
+    *stats = cd->stats;
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+PubSubEthernetMmap_lastRxTimestamp(UA_PubSubChannel *channel, struct timespec *ts) {
+    ChannelDataMmap *cd = getChannelData(channel);
+    if(!cd)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    *ts = cd->lastRx;
+    return UA_STATUSCODE_GOOD;
+}
@@ -0,0 +1,65 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_ETHERNET_MMAP_H_
+#define PUBSUB_ETHERNET_MMAP_H_
+
+#include <open62541/plugin/pubsub.h>
+
+#include <time.h>
+
+/**
+ * Memory-Mapped Ethernet Transport
+ * --------------------------------
+ * A drop-in replacement for ``UA_PubSubTransportLayerEthernet()``. It uses
+ * the same transport profile and the same ``opc.eth://`` addresses
+ * (``opc.eth://<MAC>[:<VID>[.<PCP>]]`` plus the interface name). Only one of
+ * the two layers can be registered with a server.
+ *
+ * Frames are exchanged through PACKET_MMAP rings (TPACKET_V3) shared with
+ * the kernel. The kernel fills the RX blocks and hands over a whole block
+ * at once. The wakeup is batched for up to PUBSUBETHERNETMMAP_BLOCK_TIMEOUT
+ * ms at low rates. A receive call takes the next frame out of the current
+ * block and needs no syscall until the block is used up. A send writes the
+ * frame into the TX ring and kicks the kernel with an empty send.
+ *
+ * The channel interface hands buffers owned by the caller in and out.
+ * Payloads are therefore copied once between the ring and that buffer in
+ * userspace; there is no per-frame copy in the kernel.
+ *
+ * On a veth pair (requires CAP_NET_RAW)::
+ *
+ *   ip link add veth0 type veth peer name veth1
+ *   ip link set veth0 up && ip link set veth1 up
+ *   ./tutorial_pubsub_subscribe opc.eth://01-00-5E-7F-00-01 veth1 --eth-mmap
+ *   ./tutorial_pubsub_publish opc.eth://01-00-5E-7F-00-01 veth0 --eth-mmap
+ *
+ * Leave out ``--eth-mmap`` on either side to compare with the Ethernet layer
+ * of open62541. */
+
+#define PUBSUBETHERNETMMAP_BLOCK_SIZE (1u << 16)
+#define PUBSUBETHERNETMMAP_FRAME_SIZE 2048u
+#define PUBSUBETHERNETMMAP_RX_BLOCKS 16u
+#define PUBSUBETHERNETMMAP_TX_BLOCKS 2u
+#define PUBSUBETHERNETMMAP_BLOCK_TIMEOUT 1 /* ms */
+
+typedef struct {
+    UA_UInt64 rxFrames;   /* Returned from receive */
+    UA_UInt64 rxDropped;  /* Lost because the RX ring was full */
+    UA_UInt64 rxWakeups;  /* Waits on the socket */
+    UA_UInt64 txFrames;
+    UA_UInt64 txBusy;     /* Sends rejected because the TX ring was full */
+} PubSubEthernetMmapStats;
+
+UA_PubSubTransportLayer
+PubSubEthernetMmap_transportLayer(void);
+
+/* Returns BADINVALIDARGUMENT for channels of other transport layers */
+UA_StatusCode
+PubSubEthernetMmap_getStats(UA_PubSubChannel *channel, PubSubEthernetMmapStats *stats);
+
+/* Kernel receive timestamp of the frame returned by the last receive */
+UA_StatusCode
+PubSubEthernetMmap_lastRxTimestamp(UA_PubSubChannel *channel, struct timespec *ts);
+
+#endif /* PUBSUB_ETHERNET_MMAP_H_ */
@@ -0,0 +1,589 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_ethernet_xdp.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#include "pubsub_ethernet_frame.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_packet.h>
+#include <linux/if_xdp.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define CHANNELDATAXDP_MAGIC 0x58445053 /* "XDPS" */
+#define XDP_ACTION_PASS 2
+#define BPF_FUNC_REDIRECT_MAP 51
+
+typedef struct {
+    UA_UInt32 *producer;
+    UA_UInt32 *consumer;
+    UA_UInt32 *flags;
+    void *desc;
+    void *map;
+    size_t mapSize;
+} XdpRing;
+
+typedef struct {
+    UA_UInt32 magic;
+    int ifindex;
+    UA_UInt32 queue;
+    UA_UInt16 vid;
+    UA_Byte prio;
+    UA_Byte ifAddress[ETH_ALEN];
+    UA_Byte targetAddress[ETH_ALEN];
+
+    UA_Byte *umem;
+    XdpRing rx;
+    XdpRing tx;
+    XdpRing fill;
+    XdpRing completion;
+
+    /* Free TX frames (UMEM offsets) */
+    UA_UInt64 txFree[PUBSUBETHERNETXDP_FRAMES / 2];
+    size_t txFreeSize;
+
+    int mapFd;
+    int progFd;
+    int linkFd;
+    int memberFd; /* AF_PACKET socket that holds the multicast membership */
+    PubSubEthernetXdpStats stats;
+} ChannelDataXdp;
+
+static int
+bpf(int cmd, union bpf_attr *attr) {
+    return (int)syscall(SYS_bpf, cmd, attr, sizeof(union bpf_attr));
+}
+
+/**
+ * XDP Program
+ * ^^^^^^^^^^^
+ * Equivalent to::
+ *
+ *   if(ethertype == UADP || (ethertype == VLAN && inner ethertype == UADP))
+ *       return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+ *   return XDP_PASS;
+ *
+ * Since Linux 5.3 the flags of bpf_redirect_map are the action for queues
+ * without a socket in the map. */
+
+#define INSN(CODE, DST, SRC, OFF, IMM) \
+    ((struct bpf_insn){(CODE), (DST), (SRC), (OFF), (IMM)})
+
+static int
+loadProgram(int mapFd) {
+    UA_Int32 uadp = htons(PUBSUBETHERNET_ETHERTYPE_UADP);
+    UA_Int32 vlan = htons(PUBSUBETHERNET_ETHERTYPE_VLAN);
+    struct bpf_insn insns[] = {
+        /* 0 */ INSN(BPF_LDX | BPF_MEM | BPF_W, 2, 1, 0, 0),   /* r2 = ctx->data */
+        /* 1 */ INSN(BPF_LDX | BPF_MEM | BPF_W, 3, 1, 4, 0),   /* r3 = ctx->data_end */
+        /* 2 */ INSN(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0),
+        /* 3 */ INSN(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, 14),
+        /* 4 */ INSN(BPF_JMP | BPF_JGT | BPF_X, 4, 3, 14, 0),   /* goto pass */
+        /* 5 */ INSN(BPF_LDX | BPF_MEM | BPF_H, 5, 2, 12, 0),  /* r5 = ethertype */
+        /* 6 */ INSN(BPF_JMP | BPF_JEQ | BPF_K, 5, 0, 6, uadp), /* goto redirect */
+        /* 7 */ INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, 11, vlan), /* goto pass */
+        /* 8 */ INSN(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0),
+        /* 9 */ INSN(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, 18),
+        /* 10 */ INSN(BPF_JMP | BPF_JGT | BPF_X, 4, 3, 8, 0),  /* goto pass */
+        /* 11 */ INSN(BPF_LDX | BPF_MEM | BPF_H, 5, 2, 16, 0),
+        /* 12 */ INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, 6, uadp), /* goto pass */
+        /* 13 redirect */
+        INSN(BPF_LDX | BPF_MEM | BPF_W, 2, 1, 16, 0),          /* r2 = rx_queue_index */
+        /* 14 */ INSN(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, mapFd),
+        /* 15 */ INSN(0, 0, 0, 0, 0),
+        /* 16 */ INSN(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_ACTION_PASS),
+        /* 17 */ INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_REDIRECT_MAP),
+        /* 18 */ INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+        /* 19 pass */
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_ACTION_PASS),
+        /* 20 */ INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+    };
+
+    static char log[4096];
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (UA_UInt64)(uintptr_t)insns;
+    attr.insn_cnt = sizeof(insns) / sizeof(struct bpf_insn);
+    attr.license = (UA_UInt64)(uintptr_t)"Dual BSD/GPL";
+    attr.log_buf = (UA_UInt64)(uintptr_t)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+    log[0] = 0;
+    int fd = bpf(BPF_PROG_LOAD, &attr);
+    if(fd < 0)
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub AF_XDP: Cannot load the XDP program. %s %s",
+                     strerror(errno), log);
+    return fd;
+}
+
+static UA_StatusCode
+attachProgram(UA_PubSubChannel *channel, ChannelDataXdp *cd) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(UA_UInt32);
+    attr.value_size = sizeof(UA_UInt32);
+    attr.max_entries = cd->queue + 1;
+    cd->mapFd = bpf(BPF_MAP_CREATE, &attr);
+    if(cd->mapFd < 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub AF_XDP: Cannot create the XSKMAP. %s", strerror(errno));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    UA_UInt32 key = cd->queue;
+    UA_UInt32 value = (UA_UInt32)channel->sockfd;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = (UA_UInt32)cd->mapFd;
+    attr.key = (UA_UInt64)(uintptr_t)&key;
+    attr.value = (UA_UInt64)(uintptr_t)&value;
+    if(bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub AF_XDP: Cannot add the socket to the XSKMAP. %s",
+                     strerror(errno));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    cd->progFd = loadProgram(cd->mapFd);
+    if(cd->progFd < 0)
+        return UA_STATUSCODE_BADINTERNALERROR;
+
+    /* The link detaches the program when its fd is closed */
+    UA_UInt32 modes[2] = {XDP_FLAGS_DRV_MODE, XDP_FLAGS_SKB_MODE};
+    for(size_t i = 0; i < 2 && cd->linkFd < 0; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.link_create.prog_fd = (UA_UInt32)cd->progFd;
+        attr.link_create.target_ifindex = (UA_UInt32)cd->ifindex;
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = modes[i];
+        cd->linkFd = bpf(BPF_LINK_CREATE, &attr);
+        cd->stats.nativeMode = (i == 0);
+    }
+    if(cd->linkFd < 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub AF_XDP: Cannot attach the XDP program. %s",
+                     strerror(errno));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+detachProgram(ChannelDataXdp *cd) {
+    if(cd->linkFd >= 0)
+        close(cd->linkFd);
+    if(cd->progFd >= 0)
+        close(cd->progFd);
+    if(cd->mapFd >= 0)
+        close(cd->mapFd);
+    cd->linkFd = cd->progFd = cd->mapFd = -1;
+}
+
+/**
+ * Rings
+ * ^^^^^ */
+
+static UA_StatusCode
+mapRing(int fd, XdpRing *ring, const struct xdp_ring_offset *off,
+        size_t descSize, off_t pgoff) {
+    ring->mapSize = off->desc + PUBSUBETHERNETXDP_RING_SIZE * descSize;
+    ring->map = mmap(NULL, ring->mapSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if(ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+    }
+    ring->producer = (UA_UInt32*)((UA_Byte*)ring->map + off->producer);
+    ring->consumer = (UA_UInt32*)((UA_Byte*)ring->map + off->consumer);
+    ring->flags = (UA_UInt32*)((UA_Byte*)ring->map + off->flags);
+    ring->desc = (UA_Byte*)ring->map + off->desc;
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+unmapRing(XdpRing *ring) {
+    if(ring->map)
+        munmap(ring->map, ring->mapSize);
+    ring->map = NULL;
+}
+
+#define RING_MASK (PUBSUBETHERNETXDP_RING_SIZE - 1)
+
+static void
+fillFrame(ChannelDataXdp *cd, UA_UInt64 addr) {
+    UA_UInt32 prod = *cd->fill.producer;
+    ((UA_UInt64*)cd->fill.desc)[prod & RING_MASK] = addr;
+    __atomic_store_n(cd->fill.producer, prod + 1, __ATOMIC_RELEASE);
+}
+
+static void
+reclaimTxFrames(ChannelDataXdp *cd) {
+    UA_UInt32 cons = *cd->completion.consumer;
+    UA_UInt32 prod = __atomic_load_n(cd->completion.producer, __ATOMIC_ACQUIRE);
+    for(; cons != prod; cons++)
+        cd->txFree[cd->txFreeSize++] = ((UA_UInt64*)cd->completion.desc)[cons & RING_MASK];
+    __atomic_store_n(cd->completion.consumer, cons, __ATOMIC_RELEASE);
+}
+
+static void
+kickTx(UA_PubSubChannel *channel, ChannelDataXdp *cd) {
+    if(!(__atomic_load_n(cd->tx.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP))
+        return;
+    if(sendto(channel->sockfd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+       errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != ENETDOWN)
+        UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                       "PubSub AF_XDP: TX wakeup failed. %s", strerror(errno));
+}
+
+/**
+ * Channel Operations
+ * ^^^^^^^^^^^^^^^^^^ */
+
+/* The AF_XDP socket cannot join a multicast group. The NIC filter is opened
+ * through a packet socket that receives no protocol, as long as it stays
+ * open. */
+static UA_StatusCode
+joinMulticast(ChannelDataXdp *cd) {
+    if(!(cd->targetAddress[0] & 1) || cd->memberFd >= 0)
+        return UA_STATUSCODE_GOOD; /* Unicast */
+    cd->memberFd = socket(AF_PACKET, SOCK_RAW, 0);
+    if(cd->memberFd < 0)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    struct packet_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = cd->ifindex;
+    mreq.mr_type = PACKET_MR_MULTICAST;
+    mreq.mr_alen = ETH_ALEN;
+    memcpy(mreq.mr_address, cd->targetAddress, ETH_ALEN);
+    if(setsockopt(cd->memberFd, SOL_PACKET, PACKET_ADD_MEMBERSHIP,
+                  &mreq, sizeof(mreq)) < 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection regist failed. %s", strerror(errno));
+        close(cd->memberFd);
+        cd->memberFd = -1;
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+leaveMulticast(ChannelDataXdp *cd) {
+    if(cd->memberFd >= 0)
+        close(cd->memberFd);
+    cd->memberFd = -1;
+}
+
+static UA_StatusCode
+xdpRegist(UA_PubSubChannel *channel, UA_ExtensionObject *transportSettings,
+          void (*callback)(UA_ByteString *encodedBuffer, UA_ByteString *topic)) {
+    ChannelDataXdp *cd = (ChannelDataXdp*)channel->handle;
+    if(cd->linkFd >= 0)
+        return UA_STATUSCODE_GOOD;
+    UA_StatusCode retval = joinMulticast(cd);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    retval = attachProgram(channel, cd);
+    if(retval != UA_STATUSCODE_GOOD) {
+        detachProgram(cd);
+        leaveMulticast(cd);
+        return retval;
+    }
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                "PubSub AF_XDP: Receiving on queue %u in %s mode, %s",
+                cd->queue, cd->stats.nativeMode ? "native" : "generic",
+                cd->stats.zeroCopy ? "zero-copy" : "copy");
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+xdpUnregist(UA_PubSubChannel *channel, UA_ExtensionObject *transportSettings) {
+    ChannelDataXdp *cd = (ChannelDataXdp*)channel->handle;
+    detachProgram(cd);
+    leaveMulticast(cd);
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+xdpSend(UA_PubSubChannel *channel, UA_ExtensionObject *transportSettings,
+        const UA_ByteString *buf) {
+    ChannelDataXdp *cd = (ChannelDataXdp*)channel->handle;
+    reclaimTxFrames(cd);
+    if(cd->txFreeSize == 0) {
+        kickTx(channel, cd);
+        reclaimTxFrames(cd);
+        if(cd->txFreeSize == 0) {
+            cd->stats.txBusy++;
+            return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+        }
+    }
+    UA_UInt64 addr = cd->txFree[--cd->txFreeSize];
+
+    UA_Byte *frame = &cd->umem[addr];
+    size_t headerSize = PubSubEthernet_writeHeader(frame, cd->targetAddress,
+                                                   cd->ifAddress, cd->vid, cd->prio);
+    if(headerSize + buf->length > PUBSUBETHERNETXDP_FRAME_SIZE) {
+        cd->txFree[cd->txFreeSize++] = addr;
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+    }
+    memcpy(&frame[headerSize], buf->data, buf->length);
+
+    UA_UInt32 prod = *cd->tx.producer;
+    struct xdp_desc *desc = &((struct xdp_desc*)cd->tx.desc)[prod & RING_MASK];
+    desc->addr = addr;
+    desc->len = (UA_UInt32)(headerSize + buf->length);
+    desc->options = 0;
+    __atomic_store_n(cd->tx.producer, prod + 1, __ATOMIC_RELEASE);
+    kickTx(channel, cd);
+    cd->stats.txFrames++;
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+xdpReceive(UA_PubSubChannel *channel, UA_ByteString *message,
+           UA_ExtensionObject *transportSettings, UA_UInt32 timeout) {
+    ChannelDataXdp *cd = (ChannelDataXdp*)channel->handle;
+    size_t capacity = message->length;
+    message->length = 0;
+    UA_Boolean waited = false;
+    for(;;) {
+        UA_UInt32 cons = *cd->rx.consumer;
+        UA_UInt32 prod = __atomic_load_n(cd->rx.producer, __ATOMIC_ACQUIRE);
+        if(cons == prod) {
+            if(waited || timeout == 0)
+                return UA_STATUSCODE_GOOD;
+            /* The timeout is in microseconds */
+            struct pollfd pfd = {channel->sockfd, POLLIN, 0};
+            cd->stats.rxWakeups++;
+            if(poll(&pfd, 1, (int)((timeout + 999) / 1000)) <= 0)
+                return UA_STATUSCODE_GOOD;
+            waited = true;
+            continue;
+        }
+
+        const struct xdp_desc *desc = &((struct xdp_desc*)cd->rx.desc)[cons & RING_MASK];
+        const UA_Byte *frame = &cd->umem[desc->addr];
+        size_t length = desc->len;
+        size_t offset = PubSubEthernet_payloadOffset(frame, length);
+        UA_Boolean accept = (offset > 0 && length - offset <= capacity);
+        if(accept) {
+            memcpy(message->data, &frame[offset], length - offset);
+            message->length = length - offset;
+        }
+
+        /* Hand the frame back to the kernel */
+        fillFrame(cd, desc->addr - (desc->addr % PUBSUBETHERNETXDP_FRAME_SIZE));
+        __atomic_store_n(cd->rx.consumer, cons + 1, __ATOMIC_RELEASE);
+        if(accept) {
+            cd->stats.rxFrames++;
+            return UA_STATUSCODE_GOOD;
+        }
+    }
+}
+
+static UA_StatusCode
+xdpClose(UA_PubSubChannel *channel) {
+    ChannelDataXdp *cd = (ChannelDataXdp*)channel->handle;
+    if(cd) {
+        detachProgram(cd);
+        leaveMulticast(cd);
+        unmapRing(&cd->rx);
+        unmapRing(&cd->tx);
+        unmapRing(&cd->fill);
+        unmapRing(&cd->completion);
+    }
+    if(channel->sockfd >= 0)
+        close(channel->sockfd);
+    if(cd) {
+        if(cd->umem)
+            munmap(cd->umem, (size_t)PUBSUBETHERNETXDP_FRAMES * PUBSUBETHERNETXDP_FRAME_SIZE);
+        UA_free(cd);
+    }
+    UA_free(channel);
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+setupSocket(int fd, ChannelDataXdp *cd) {
+    size_t umemSize = (size_t)PUBSUBETHERNETXDP_FRAMES * PUBSUBETHERNETXDP_FRAME_SIZE;
+    void *umem = mmap(NULL, umemSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(umem == MAP_FAILED)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    cd->umem = (UA_Byte*)umem;
+
+    struct xdp_umem_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = (UA_UInt64)(uintptr_t)umem;
+    reg.len = umemSize;
+    reg.chunk_size = PUBSUBETHERNETXDP_FRAME_SIZE;
+    if(setsockopt(fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+
+    int ringSize = PUBSUBETHERNETXDP_RING_SIZE;
+    if(setsockopt(fd, SOL_XDP, XDP_UMEM_FILL_RING, &ringSize, sizeof(ringSize)) < 0 ||
+       setsockopt(fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ringSize, sizeof(ringSize)) < 0 ||
+       setsockopt(fd, SOL_XDP, XDP_RX_RING, &ringSize, sizeof(ringSize)) < 0 ||
+       setsockopt(fd, SOL_XDP, XDP_TX_RING, &ringSize, sizeof(ringSize)) < 0)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+
+    struct xdp_mmap_offsets off;
+    socklen_t optlen = sizeof(off);
+    if(getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+    if(mapRing(fd, &cd->rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) ||
+       mapRing(fd, &cd->tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) ||
+       mapRing(fd, &cd->fill, &off.fr, sizeof(UA_UInt64),
+               (off_t)XDP_UMEM_PGOFF_FILL_RING) ||
+       mapRing(fd, &cd->completion, &off.cr, sizeof(UA_UInt64),
+               (off_t)XDP_UMEM_PGOFF_COMPLETION_RING))
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+
+    /* The first half of the frames receives, the second half sends */
+    UA_UInt32 rxFrames = PUBSUBETHERNETXDP_FRAMES / 2;
+    for(UA_UInt32 i = 0; i < rxFrames && i < PUBSUBETHERNETXDP_RING_SIZE; i++)
+        fillFrame(cd, (UA_UInt64)i * PUBSUBETHERNETXDP_FRAME_SIZE);
+    for(UA_UInt32 i = rxFrames; i < PUBSUBETHERNETXDP_FRAMES; i++)
+        cd->txFree[cd->txFreeSize++] = (UA_UInt64)i * PUBSUBETHERNETXDP_FRAME_SIZE;
+
+    /* Zero-copy if the driver supports it, copy mode otherwise */
+    struct sockaddr_xdp sxdp;
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = (UA_UInt32)cd->ifindex;
+    sxdp.sxdp_queue_id = cd->queue;
+    sxdp.sxdp_flags = XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP;
+    if(bind(fd, (struct sockaddr*)&sxdp, sizeof(sxdp)) < 0) {
+        sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+        if(bind(fd, (struct sockaddr*)&sxdp, sizeof(sxdp)) < 0)
+            return UA_STATUSCODE_BADCOMMUNICATIONERROR;
+    }
+    struct xdp_options options;
+    optlen = sizeof(options);
+    if(getsockopt(fd, SOL_XDP, XDP_OPTIONS, &options, &optlen) == 0)
+        cd->stats.zeroCopy = (options.flags & XDP_OPTIONS_ZEROCOPY) != 0;
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_PubSubChannel *
+createChannel(UA_PubSubConnectionConfig *connectionConfig) {
+    if(!UA_Variant_hasScalarType(&connectionConfig->address,
+                                 &UA_TYPES[UA_TYPES_NETWORKADDRESSURLDATATYPE])) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Invalid Address.");
+        return NULL;
+    }
+    const UA_NetworkAddressUrlDataType *address =
+        (const UA_NetworkAddressUrlDataType*)connectionConfig->address.data;
+
+    ChannelDataXdp *cd = (ChannelDataXdp*)UA_calloc(1, sizeof(ChannelDataXdp));
+    UA_PubSubChannel *channel = (UA_PubSubChannel*)UA_calloc(1, sizeof(UA_PubSubChannel));
+    if(!cd || !channel) {
+        UA_free(cd);
+        UA_free(channel);
+        return NULL;
+    }
+    cd->magic = CHANNELDATAXDP_MAGIC;
+    cd->mapFd = cd->progFd = cd->linkFd = cd->memberFd = -1;
+    channel->handle = cd;
+    channel->sockfd = -1;
+    channel->connectionConfig = connectionConfig;
+
+    /* <interface>[:<queue>] */
+    char ifName[IF_NAMESIZE + 12];
+    if(PubSubEthernet_parseAddress(&address->url, cd->targetAddress, &cd->vid, &cd->prio) !=
+       UA_STATUSCODE_GOOD || address->networkInterface.length >= sizeof(ifName)) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Invalid Address.");
+        goto error;
+    }
+    memcpy(ifName, address->networkInterface.data, address->networkInterface.length);
+    ifName[address->networkInterface.length] = 0;
+    char *queue = strchr(ifName, ':');
+    if(queue) {
+        *queue = 0;
+        cd->queue = (UA_UInt32)strtoul(queue + 1, NULL, 10);
+    }
+    cd->ifindex = (int)if_nametoindex(ifName);
+    if(cd->ifindex == 0 || strlen(ifName) >= IF_NAMESIZE) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Unknown interface %s.", ifName);
+        goto error;
+    }
+
+    channel->sockfd = socket(AF_XDP, SOCK_RAW, 0);
+    if(channel->sockfd < 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Cannot create the AF_XDP "
+                     "socket. %s", strerror(errno));
+        goto error;
+    }
+
+    if(PubSubEthernet_interfaceAddress(ifName, cd->ifAddress) != UA_STATUSCODE_GOOD) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Cannot get the MAC address.");
+        goto error;
+    }
+
+    if(setupSocket(channel->sockfd, cd) != UA_STATUSCODE_GOOD) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Cannot set up the AF_XDP "
+                     "socket on %s queue %u. %s", ifName, cd->queue, strerror(errno));
+        goto error;
+    }
+
+    channel->state = UA_PUBSUB_CHANNEL_RDY;
+    channel->send = xdpSend;
+    channel->regist = xdpRegist;
+    channel->unregist = xdpUnregist;
+    channel->receive = xdpReceive;
+    channel->close = xdpClose;
+    return channel;
+
+ error:
+    xdpClose(channel);
+    return NULL;
+}
+
+UA_PubSubTransportLayer
+PubSubEthernetXdp_transportLayer(void) {
+    UA_PubSubTransportLayer layer;
+    layer.transportProfileUri = UA_STRING(PUBSUBETHERNETXDP_PROFILE);
+    layer.createPubSubChannel = createChannel;
+    return layer;
+}
+
+UA_StatusCode
+PubSubEthernetXdp_getStats(UA_PubSubChannel *channel, PubSubEthernetXdpStats *stats) {
+    ChannelDataXdp *cd = (ChannelDataXdp*)channel->handle;
+    if(!cd || cd->magic != CHANNELDATAXDP_MAGIC)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    struct xdp_statistics xstats;
+    socklen_t len = sizeof(xstats);
+    if(getsockopt(channel->sockfd, SOL_XDP, XDP_STATISTICS, &xstats, &len) == 0)
+        cd->stats.rxDropped = xstats.rx_dropped + xstats.rx_ring_full +
+            xstats.rx_fill_ring_empty_descs;
+    *stats = cd->stats;
+    return UA_STATUSCODE_GOOD;
+}
@@ -0,0 +1,64 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_ETHERNET_XDP_H_
+#define PUBSUB_ETHERNET_XDP_H_
+
+#include <open62541/plugin/pubsub.h>
+
+/**
+ * AF_XDP Ethernet Transport
+ * -------------------------
+ * UADP over Ethernet through an AF_XDP socket. The frames live in a UMEM
+ * area shared with the kernel and are passed through the RX, TX, fill and
+ * completion rings without syscalls. A syscall is only made to wake up the
+ * kernel when it asks for it (XDP_USE_NEED_WAKEUP).
+ *
+ * The layer has its own transport profile PUBSUBETHERNETXDP_PROFILE and
+ * takes the addresses of the Ethernet layer, ``opc.eth://<MAC>[:<VID>[.<PCP>]]``.
+ * The network interface may be given as ``<name>:<queue>`` to bind to a
+ * queue other than 0.
+ *
+ * When the channel is registered for receiving, a small XDP program is
+ * attached to the interface. It redirects frames with the UADP ethertype
+ * (also VLAN-tagged) to the socket and passes all other traffic to the
+ * network stack. Native (driver) mode is tried first, then generic (SKB)
+ * mode. The socket is bound in zero-copy mode if the driver supports it and
+ * in copy mode otherwise, so it also works on veth pairs. Attaching uses
+ * BPF links and needs Linux 5.9 and CAP_NET_ADMIN/CAP_BPF. For a multicast
+ * address, the interface joins the group through a packet socket that is
+ * kept open while the channel is registered.
+ *
+ * Like every PubSub channel, receive and send copy between the UMEM frames
+ * and the buffers owned by the caller.
+ *
+ * On a veth pair (generic or native mode, always copy mode)::
+ *
+ *   ./pubsub_subscribe_standalone opc.eth://01-00-5E-7F-00-01 veth1 --xdp
+ *   ./tutorial_pubsub_publish opc.eth://01-00-5E-7F-00-01 veth0 --xdp */
+
+#define PUBSUBETHERNETXDP_PROFILE \
+    "http://opcfoundation.org/UA-Profile/Transport/pubsub-eth-uadp-xdp"
+
+#define PUBSUBETHERNETXDP_FRAME_SIZE 2048u
+#define PUBSUBETHERNETXDP_FRAMES 4096u    /* Half for RX, half for TX */
+#define PUBSUBETHERNETXDP_RING_SIZE 2048u
+
+typedef struct {
+    UA_Boolean zeroCopy;
+    UA_Boolean nativeMode; /* XDP program attached in driver mode */
+    UA_UInt64 rxFrames;
+    UA_UInt64 rxDropped;   /* Kernel drops, e.g. fill ring empty */
+    UA_UInt64 rxWakeups;
+    UA_UInt64 txFrames;
+    UA_UInt64 txBusy;      /* Sends rejected because no TX frame was free */
+} PubSubEthernetXdpStats;
+
+UA_PubSubTransportLayer
+PubSubEthernetXdp_transportLayer(void);
+
+/* Returns BADINVALIDARGUMENT for channels of other transport layers */
+UA_StatusCode
+PubSubEthernetXdp_getStats(UA_PubSubChannel *channel, PubSubEthernetXdpStats *stats);
+
+#endif /* PUBSUB_ETHERNET_XDP_H_ */
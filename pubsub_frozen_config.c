@@ -0,0 +1,957 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_frozen_config.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ALIGN8(x) (((x) + 7) & ~(size_t)7)
+
+/* Growing array of records, only used by the builder */
+typedef struct {
+    UA_Byte *data;
+    size_t size;
+    size_t capacity;
+    size_t recordSize;
+} Table;
+
+struct PubSubFrozenConfigBuilder {
+    Table connections;
+    Table publishedDataSets;
+    Table publishedFields;
+    Table writerGroups;
+    Table dataSetWriters;
+    Table readerGroups;
+    Table dataSetReaders;
+    Table readerFields;
+    UA_Byte *strings;
+    size_t stringsSize;
+    size_t stringsCapacity;
+};
+
+struct PubSubFrozenConfig {
+    PubSubFrozenHeader *header;
+    size_t mappedSize;
+};
+
+/***********/
+/* Builder */
+/***********/
+
+static UA_StatusCode
+appendRecord(Table *t, const void *record, UA_UInt32 *index) {
+    if(t->size >= UA_UINT32_MAX)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+    if(t->size == t->capacity) {
+        size_t capacity = t->capacity ? t->capacity * 2 : 16;
+        UA_Byte *data = (UA_Byte*)UA_realloc(t->data, capacity * t->recordSize);
+        if(!data)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        t->data = data;
+        t->capacity = capacity;
+    }
+    memcpy(&t->data[t->size * t->recordSize], record, t->recordSize);
+    if(index)
+        *index = (UA_UInt32)t->size;
+    t->size++;
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+addString(PubSubFrozenConfigBuilder *b, const UA_String *s, PubSubFrozenString *out) {
+    out->offset = 0;
+    out->length = 0;
+    if(!s || s->length == 0)
+        return UA_STATUSCODE_GOOD;
+    if(s->length > UA_UINT32_MAX - b->stringsSize)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+    if(b->stringsSize + s->length > b->stringsCapacity) {
+        size_t capacity = b->stringsCapacity ? b->stringsCapacity : 1024;
+        while(capacity < b->stringsSize + s->length)
+            capacity *= 2;
+        UA_Byte *strings = (UA_Byte*)UA_realloc(b->strings, capacity);
+        if(!strings)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        b->strings = strings;
+        b->stringsCapacity = capacity;
+    }
+    memcpy(&b->strings[b->stringsSize], s->data, s->length);
+    out->offset = (UA_UInt32)b->stringsSize;
+    out->length = (UA_UInt32)s->length;
+    b->stringsSize += s->length;
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+addNodeId(PubSubFrozenConfigBuilder *b, const UA_NodeId *id, PubSubFrozenNodeId *out) {
+    memset(out, 0, sizeof(PubSubFrozenNodeId));
+    if(!id)
+        return UA_STATUSCODE_GOOD;
+    out->namespaceIndex = id->namespaceIndex;
+    out->identifierType = (UA_UInt16)id->identifierType;
+    if(id->identifierType == UA_NODEIDTYPE_NUMERIC) {
+        out->numeric = id->identifier.numeric;
+        return UA_STATUSCODE_GOOD;
+    }
+    if(id->identifierType == UA_NODEIDTYPE_STRING)
+        return addString(b, &id->identifier.string, &out->string);
+    return UA_STATUSCODE_BADNOTSUPPORTED;
+}
+
+PubSubFrozenConfigBuilder *
+PubSubFrozenConfigBuilder_new(void) {
+    PubSubFrozenConfigBuilder *b = (PubSubFrozenConfigBuilder*)
+        UA_calloc(1, sizeof(PubSubFrozenConfigBuilder));
+    if(!b)
+        return NULL;
+    b->connections.recordSize = sizeof(PubSubFrozenConnection);
+    b->publishedDataSets.recordSize = sizeof(PubSubFrozenPublishedDataSet);
+    b->publishedFields.recordSize = sizeof(PubSubFrozenPublishedField);
+    b->writerGroups.recordSize = sizeof(PubSubFrozenWriterGroup);
+    b->dataSetWriters.recordSize = sizeof(PubSubFrozenDataSetWriter);
+    b->readerGroups.recordSize = sizeof(PubSubFrozenReaderGroup);
+    b->dataSetReaders.recordSize = sizeof(PubSubFrozenDataSetReader);
+    b->readerFields.recordSize = sizeof(PubSubFrozenReaderField);
+    return b;
+}
+
+void
+PubSubFrozenConfigBuilder_delete(PubSubFrozenConfigBuilder *b) {
+    UA_free(b->connections.data);
+    UA_free(b->publishedDataSets.data);
+    UA_free(b->publishedFields.data);
+    UA_free(b->writerGroups.data);
+    UA_free(b->dataSetWriters.data);
+    UA_free(b->readerGroups.data);
+    UA_free(b->dataSetReaders.data);
+    UA_free(b->readerFields.data);
+    UA_free(b->strings);
+    UA_free(b);
+}
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addConnection(PubSubFrozenConfigBuilder *b,
+                                        const UA_String *name,
+                                        const UA_String *transportProfileUri,
+                                        const UA_NetworkAddressUrlDataType *address,
+                                        UA_UInt32 publisherId, UA_UInt32 *connection) {
+    PubSubFrozenConnection c;
+    memset(&c, 0, sizeof(c));
+    c.publisherId = publisherId;
+    UA_StatusCode retval = addString(b, name, &c.name);
+    retval |= addString(b, transportProfileUri, &c.transportProfileUri);
+    retval |= addString(b, &address->url, &c.url);
+    retval |= addString(b, &address->networkInterface, &c.networkInterface);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    return appendRecord(&b->connections, &c, connection);
+}
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addPublishedDataSet(PubSubFrozenConfigBuilder *b,
+                                              const UA_String *name,
+                                              UA_UInt32 *publishedDataSet) {
+    PubSubFrozenPublishedDataSet pds;
+    memset(&pds, 0, sizeof(pds));
+    UA_StatusCode retval = addString(b, name, &pds.name);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    return appendRecord(&b->publishedDataSets, &pds, publishedDataSet);
+}
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addPublishedField(PubSubFrozenConfigBuilder *b,
+                                            UA_UInt32 publishedDataSet,
+                                            const UA_String *name,
+                                            const UA_NodeId *publishedVariable) {
+    if(publishedDataSet >= b->publishedDataSets.size)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    PubSubFrozenPublishedField f;
+    memset(&f, 0, sizeof(f));
+    f.publishedDataSet = publishedDataSet;
+    UA_StatusCode retval = addString(b, name, &f.name);
+    retval |= addNodeId(b, publishedVariable, &f.publishedVariable);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    return appendRecord(&b->publishedFields, &f, NULL);
+}
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addWriterGroup(PubSubFrozenConfigBuilder *b,
+                                         UA_UInt32 connection, const UA_String *name,
+                                         UA_UInt16 writerGroupId,
+                                         UA_Double publishingInterval,
+                                         UA_UInt32 networkMessageContentMask,
+                                         UA_UInt32 *writerGroup) {
+    if(connection >= b->connections.size)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    PubSubFrozenWriterGroup wg;
+    memset(&wg, 0, sizeof(wg));
+    wg.connection = connection;
+    wg.writerGroupId = writerGroupId;
+    wg.networkMessageContentMask = networkMessageContentMask;
+    wg.publishingInterval = publishingInterval;
+    UA_StatusCode retval = addString(b, name, &wg.name);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    return appendRecord(&b->writerGroups, &wg, writerGroup);
+}
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addDataSetWriter(PubSubFrozenConfigBuilder *b,
+                                           UA_UInt32 writerGroup,
+                                           UA_UInt32 publishedDataSet,
+                                           const UA_String *name,
+                                           UA_UInt16 dataSetWriterId,
+                                           UA_UInt32 keyFrameCount,
+                                           UA_UInt32 dataSetMessageContentMask) {
+    if(writerGroup >= b->writerGroups.size ||
+       publishedDataSet >= b->publishedDataSets.size)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    PubSubFrozenDataSetWriter w;
+    memset(&w, 0, sizeof(w));
+    w.writerGroup = writerGroup;
+    w.publishedDataSet = publishedDataSet;
+    w.dataSetWriterId = dataSetWriterId;
+    w.keyFrameCount = keyFrameCount;
+    w.dataSetMessageContentMask = dataSetMessageContentMask;
+    UA_StatusCode retval = addString(b, name, &w.name);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    return appendRecord(&b->dataSetWriters, &w, NULL);
+}
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addReaderGroup(PubSubFrozenConfigBuilder *b,
+                                         UA_UInt32 connection, const UA_String *name,
+                                         UA_UInt32 *readerGroup) {
+    if(connection >= b->connections.size)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    PubSubFrozenReaderGroup rg;
+    memset(&rg, 0, sizeof(rg));
+    rg.connection = connection;
+    UA_StatusCode retval = addString(b, name, &rg.name);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    return appendRecord(&b->readerGroups, &rg, readerGroup);
+}
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addDataSetReader(PubSubFrozenConfigBuilder *b,
+                                           UA_UInt32 readerGroup, const UA_String *name,
+                                           UA_UInt32 publisherId, UA_UInt16 writerGroupId,
+                                           UA_UInt16 dataSetWriterId,
+                                           UA_Double messageReceiveTimeout,
+                                           const UA_String *dataSetName,
+                                           UA_UInt32 *dataSetReader) {
+    if(readerGroup >= b->readerGroups.size)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    PubSubFrozenDataSetReader r;
+    memset(&r, 0, sizeof(r));
+    r.readerGroup = readerGroup;
+    r.publisherId = publisherId;
+    r.writerGroupId = writerGroupId;
+    r.dataSetWriterId = dataSetWriterId;
+    r.messageReceiveTimeout = messageReceiveTimeout;
+    UA_StatusCode retval = addString(b, name, &r.name);
+    retval |= addString(b, dataSetName, &r.dataSetName);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    return appendRecord(&b->dataSetReaders, &r, dataSetReader);
+}
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addReaderField(PubSubFrozenConfigBuilder *b,
+                                         UA_UInt32 dataSetReader, const UA_String *name,
+                                         const UA_NodeId *dataType,
+                                         const UA_NodeId *targetVariable) {
+    if(dataSetReader >= b->dataSetReaders.size ||
+       dataType->namespaceIndex != 0 || dataType->identifierType != UA_NODEIDTYPE_NUMERIC)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    PubSubFrozenReaderField f;
+    memset(&f, 0, sizeof(f));
+    f.dataSetReader = dataSetReader;
+    f.dataType = dataType->identifier.numeric;
+    UA_StatusCode retval = addString(b, name, &f.name);
+    retval |= addNodeId(b, targetVariable, &f.targetVariable);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    return appendRecord(&b->readerFields, &f, NULL);
+}
+
+size_t
+PubSubFrozenConfigBuilder_footprint(const PubSubFrozenConfigBuilder *b) {
+    const Table *tables[] = {&b->connections, &b->publishedDataSets, &b->publishedFields,
+                             &b->writerGroups, &b->dataSetWriters, &b->readerGroups,
+                             &b->dataSetReaders, &b->readerFields};
+    size_t size = ALIGN8(sizeof(PubSubFrozenHeader));
+    for(size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); i++)
+        size += ALIGN8(tables[i]->size * tables[i]->recordSize);
+    return size + b->stringsSize;
+}
+
+/**********/
+/* Freeze */
+/**********/
+
+static PubSubFrozenTable
+layoutTable(size_t *pos, size_t size, size_t recordSize) {
+    PubSubFrozenTable t;
+    t.offset = (UA_UInt32)*pos;
+    t.size = (UA_UInt32)size;
+    *pos += ALIGN8(size * recordSize);
+    return t;
+}
+
+/* Copies the children into the block, grouped by the parent in the order of
+ * the builder (a stable counting sort). parentMap maps the parent indices of
+ * the builder to the block if the parents were reordered themselves. The
+ * range of the children is written to the parent records at rangeOffset.
+ * childMap receives the new index of every child if not NULL. */
+static UA_StatusCode
+placeChildren(const Table *children, UA_Byte *dst, const UA_UInt32 *parentMap,
+              UA_Byte *parents, size_t parentsSize, size_t parentRecordSize,
+              size_t rangeOffset, UA_UInt32 *childMap) {
+    UA_UInt32 *begin = (UA_UInt32*)UA_calloc(parentsSize + 1, sizeof(UA_UInt32));
+    if(!begin)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    const size_t rs = children->recordSize;
+    for(size_t i = 0; i < children->size; i++) {
+        UA_UInt32 p = *(const UA_UInt32*)&children->data[i * rs];
+        if(parentMap)
+            p = parentMap[p];
+        begin[p + 1]++;
+    }
+    for(size_t i = 0; i < parentsSize; i++) {
+        begin[i + 1] += begin[i];
+        UA_UInt32 *range = (UA_UInt32*)&parents[i * parentRecordSize + rangeOffset];
+        range[0] = begin[i];
+        range[1] = begin[i + 1];
+    }
+    for(size_t i = 0; i < children->size; i++) {
+        UA_UInt32 p = *(const UA_UInt32*)&children->data[i * rs];
+        if(parentMap)
+            p = parentMap[p];
+        UA_UInt32 pos = begin[p]++;
+        memcpy(&dst[pos * rs], &children->data[i * rs], rs);
+        *(UA_UInt32*)&dst[pos * rs] = p;
+        if(childMap)
+            childMap[i] = pos;
+    }
+    UA_free(begin);
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+PubSubFrozenConfig_freeze(const PubSubFrozenConfigBuilder *b, size_t maxSize,
+                          PubSubFrozenConfig **frozen) {
+    size_t footprint = PubSubFrozenConfigBuilder_footprint(b);
+    if(footprint > UA_UINT32_MAX || (maxSize > 0 && footprint > maxSize))
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+
+    PubSubFrozenConfig *fc = (PubSubFrozenConfig*)UA_calloc(1, sizeof(PubSubFrozenConfig));
+    if(!fc)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    fc->mappedSize = (footprint + page - 1) & ~(page - 1);
+    void *block = mmap(NULL, fc->mappedSize, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(block == MAP_FAILED) {
+        UA_free(fc);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    fc->header = (PubSubFrozenHeader*)block;
+    UA_Byte *base = (UA_Byte*)block;
+
+    PubSubFrozenHeader *h = fc->header;
+    h->magic = PUBSUBFROZEN_MAGIC;
+    h->version = PUBSUBFROZEN_VERSION;
+    h->size = footprint;
+    size_t pos = ALIGN8(sizeof(PubSubFrozenHeader));
+    h->connections = layoutTable(&pos, b->connections.size, b->connections.recordSize);
+    h->publishedDataSets = layoutTable(&pos, b->publishedDataSets.size,
+                                       b->publishedDataSets.recordSize);
+    h->publishedFields = layoutTable(&pos, b->publishedFields.size,
+                                     b->publishedFields.recordSize);
+    h->writerGroups = layoutTable(&pos, b->writerGroups.size, b->writerGroups.recordSize);
+    h->dataSetWriters = layoutTable(&pos, b->dataSetWriters.size,
+                                    b->dataSetWriters.recordSize);
+    h->readerGroups = layoutTable(&pos, b->readerGroups.size, b->readerGroups.recordSize);
+    h->dataSetReaders = layoutTable(&pos, b->dataSetReaders.size,
+                                    b->dataSetReaders.recordSize);
+    h->readerFields = layoutTable(&pos, b->readerFields.size, b->readerFields.recordSize);
+    h->strings.offset = (UA_UInt32)pos;
+    h->strings.size = (UA_UInt32)b->stringsSize;
+
+    /* The top-level entities keep their order. Groups and readers are
+     * reordered by their parent, so their children are mapped. */
+    size_t mapSize = b->writerGroups.size + b->readerGroups.size + b->dataSetReaders.size;
+    UA_UInt32 *maps = (UA_UInt32*)UA_malloc((mapSize + 1) * sizeof(UA_UInt32));
+    if(!maps) {
+        PubSubFrozenConfig_delete(fc);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    UA_UInt32 *wgMap = maps;
+    UA_UInt32 *rgMap = &wgMap[b->writerGroups.size];
+    UA_UInt32 *readerMap = &rgMap[b->readerGroups.size];
+
+    UA_Byte *connections = &base[h->connections.offset];
+    UA_Byte *pds = &base[h->publishedDataSets.offset];
+    UA_Byte *wgs = &base[h->writerGroups.offset];
+    UA_Byte *rgs = &base[h->readerGroups.offset];
+    UA_Byte *readers = &base[h->dataSetReaders.offset];
+    if(b->connections.size > 0)
+        memcpy(connections, b->connections.data,
+               b->connections.size * b->connections.recordSize);
+    if(b->publishedDataSets.size > 0)
+        memcpy(pds, b->publishedDataSets.data,
+               b->publishedDataSets.size * b->publishedDataSets.recordSize);
+    UA_StatusCode retval =
+        placeChildren(&b->publishedFields, &base[h->publishedFields.offset], NULL,
+                      pds, b->publishedDataSets.size, sizeof(PubSubFrozenPublishedDataSet),
+                      offsetof(PubSubFrozenPublishedDataSet, fieldsBegin), NULL);
+    retval |= placeChildren(&b->writerGroups, wgs, NULL, connections, b->connections.size,
+                            sizeof(PubSubFrozenConnection),
+                            offsetof(PubSubFrozenConnection, writerGroupsBegin), wgMap);
+    retval |= placeChildren(&b->dataSetWriters, &base[h->dataSetWriters.offset], wgMap,
+                            wgs, b->writerGroups.size, sizeof(PubSubFrozenWriterGroup),
+                            offsetof(PubSubFrozenWriterGroup, writersBegin), NULL);
+    retval |= placeChildren(&b->readerGroups, rgs, NULL, connections, b->connections.size,
+                            sizeof(PubSubFrozenConnection),
+                            offsetof(PubSubFrozenConnection, readerGroupsBegin), rgMap);
+    retval |= placeChildren(&b->dataSetReaders, readers, rgMap,
+                            rgs, b->readerGroups.size, sizeof(PubSubFrozenReaderGroup),
+                            offsetof(PubSubFrozenReaderGroup, readersBegin), readerMap);
+    retval |= placeChildren(&b->readerFields, &base[h->readerFields.offset], readerMap,
+                            readers, b->dataSetReaders.size,
+                            sizeof(PubSubFrozenDataSetReader),
+                            offsetof(PubSubFrozenDataSetReader, fieldsBegin), NULL);
+    UA_free(maps);
+    if(b->stringsSize > 0)
+        memcpy(&base[h->strings.offset], b->strings, b->stringsSize);
+    if(retval != UA_STATUSCODE_GOOD) {
+        PubSubFrozenConfig_delete(fc);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    /* Writes to the configuration fault from now on */
+    mprotect(block, fc->mappedSize, PROT_READ);
+    *frozen = fc;
+    return UA_STATUSCODE_GOOD;
+}
+
+void
+PubSubFrozenConfig_delete(PubSubFrozenConfig *frozen) {
+    munmap(frozen->header, frozen->mappedSize);
+    UA_free(frozen);
+}
+
+/*************/
+/* Snapshots */
+/*************/
+
+UA_StatusCode
+PubSubFrozenConfig_save(const PubSubFrozenConfig *frozen, const char *path) {
+    char tmpPath[4096];
+    if(snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path) >= (int)sizeof(tmpPath))
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "Cannot create %s: %s", tmpPath, strerror(errno));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    const UA_Byte *pos = (const UA_Byte*)frozen->header;
+    size_t left = (size_t)frozen->header->size;
+    while(left > 0) {
+        ssize_t n = write(fd, pos, left);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            break;
+        pos += n;
+        left -= (size_t)n;
+    }
+    if(left > 0 || fsync(fd) != 0 || close(fd) != 0 || rename(tmpPath, path) != 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "Cannot write %s: %s", path, strerror(errno));
+        if(left > 0)
+            close(fd);
+        unlink(tmpPath);
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_Boolean
+checkTable(const PubSubFrozenHeader *h, PubSubFrozenTable t, size_t recordSize) {
+    return t.offset % 8 == 0 && t.offset >= sizeof(PubSubFrozenHeader) &&
+        (UA_UInt64)t.offset + (UA_UInt64)t.size * recordSize <= h->strings.offset;
+}
+
+static UA_Boolean
+checkString(const PubSubFrozenHeader *h, PubSubFrozenString s) {
+    return (UA_UInt64)s.offset + s.length <= h->strings.size;
+}
+
+static UA_Boolean
+checkNodeId(const PubSubFrozenHeader *h, const PubSubFrozenNodeId *n) {
+    if(n->identifierType == UA_NODEIDTYPE_NUMERIC)
+        return true;
+    return n->identifierType == UA_NODEIDTYPE_STRING && checkString(h, n->string);
+}
+
+static UA_Boolean
+checkRange(UA_UInt32 begin, UA_UInt32 end, size_t size) {
+    return begin <= end && end <= size;
+}
+
+/* Apply follows the ranges and indices without further checks */
+static UA_Boolean
+checkBlock(const PubSubFrozenHeader *h, size_t fileSize) {
+    if(fileSize < sizeof(PubSubFrozenHeader) || h->magic != PUBSUBFROZEN_MAGIC ||
+       h->version != PUBSUBFROZEN_VERSION || h->size != fileSize ||
+       (UA_UInt64)h->strings.offset + h->strings.size > h->size)
+        return false;
+    if(!checkTable(h, h->connections, sizeof(PubSubFrozenConnection)) ||
+       !checkTable(h, h->publishedDataSets, sizeof(PubSubFrozenPublishedDataSet)) ||
+       !checkTable(h, h->publishedFields, sizeof(PubSubFrozenPublishedField)) ||
+       !checkTable(h, h->writerGroups, sizeof(PubSubFrozenWriterGroup)) ||
+       !checkTable(h, h->dataSetWriters, sizeof(PubSubFrozenDataSetWriter)) ||
+       !checkTable(h, h->readerGroups, sizeof(PubSubFrozenReaderGroup)) ||
+       !checkTable(h, h->dataSetReaders, sizeof(PubSubFrozenDataSetReader)) ||
+       !checkTable(h, h->readerFields, sizeof(PubSubFrozenReaderField)))
+        return false;
+
+    PubSubFrozenView v;
+    PubSubFrozenConfig frozen = {(PubSubFrozenHeader*)(uintptr_t)h, fileSize};
+    PubSubFrozenConfig_getView(&frozen, &v);
+    for(size_t i = 0; i < v.connectionsSize; i++) {
+        const PubSubFrozenConnection *c = &v.connections[i];
+        if(!checkString(h, c->name) || !checkString(h, c->transportProfileUri) ||
+           !checkString(h, c->url) || !checkString(h, c->networkInterface) ||
+           !checkRange(c->writerGroupsBegin, c->writerGroupsEnd, v.writerGroupsSize) ||
+           !checkRange(c->readerGroupsBegin, c->readerGroupsEnd, v.readerGroupsSize))
+            return false;
+    }
+    for(size_t i = 0; i < v.publishedDataSetsSize; i++) {
+        const PubSubFrozenPublishedDataSet *pds = &v.publishedDataSets[i];
+        if(!checkString(h, pds->name) ||
+           !checkRange(pds->fieldsBegin, pds->fieldsEnd, v.publishedFieldsSize))
+            return false;
+    }
+    for(size_t i = 0; i < v.publishedFieldsSize; i++) {
+        const PubSubFrozenPublishedField *f = &v.publishedFields[i];
+        if(f->publishedDataSet >= v.publishedDataSetsSize || !checkString(h, f->name) ||
+           !checkNodeId(h, &f->publishedVariable))
+            return false;
+    }
+    for(size_t i = 0; i < v.writerGroupsSize; i++) {
+        const PubSubFrozenWriterGroup *wg = &v.writerGroups[i];
+        if(wg->connection >= v.connectionsSize || !checkString(h, wg->name) ||
+           !checkRange(wg->writersBegin, wg->writersEnd, v.dataSetWritersSize))
+            return false;
+    }
+    for(size_t i = 0; i < v.dataSetWritersSize; i++) {
+        const PubSubFrozenDataSetWriter *w = &v.dataSetWriters[i];
+        if(w->writerGroup >= v.writerGroupsSize ||
+           w->publishedDataSet >= v.publishedDataSetsSize || !checkString(h, w->name))
+            return false;
+    }
+    for(size_t i = 0; i < v.readerGroupsSize; i++) {
+        const PubSubFrozenReaderGroup *rg = &v.readerGroups[i];
+        if(rg->connection >= v.connectionsSize || !checkString(h, rg->name) ||
+           !checkRange(rg->readersBegin, rg->readersEnd, v.dataSetReadersSize))
+            return false;
+    }
+    for(size_t i = 0; i < v.dataSetReadersSize; i++) {
+        const PubSubFrozenDataSetReader *r = &v.dataSetReaders[i];
+        if(r->readerGroup >= v.readerGroupsSize || !checkString(h, r->name) ||
+           !checkString(h, r->dataSetName) ||
+           !checkRange(r->fieldsBegin, r->fieldsEnd, v.readerFieldsSize))
+            return false;
+    }
+    for(size_t i = 0; i < v.readerFieldsSize; i++) {
+        const PubSubFrozenReaderField *f = &v.readerFields[i];
+        if(f->dataSetReader >= v.dataSetReadersSize || !checkString(h, f->name) ||
+           !checkNodeId(h, &f->targetVariable))
+            return false;
+    }
+    return true;
+}
+
+UA_StatusCode
+PubSubFrozenConfig_load(const char *path, PubSubFrozenConfig **frozen) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "Cannot open %s: %s", path, strerror(errno));
+        return UA_STATUSCODE_BADNOTFOUND;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PubSubFrozenHeader) ||
+       (UA_UInt64)st.st_size > UA_UINT32_MAX) {
+        close(fd);
+        return UA_STATUSCODE_BADDECODINGERROR;
+    }
+    size_t size = (size_t)st.st_size;
+    void *block = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(block == MAP_FAILED)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    if(!checkBlock((const PubSubFrozenHeader*)block, size)) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "%s is not a frozen PubSub configuration of version %u",
+                     path, (unsigned)PUBSUBFROZEN_VERSION);
+        munmap(block, size);
+        return UA_STATUSCODE_BADDECODINGERROR;
+    }
+    PubSubFrozenConfig *fc = (PubSubFrozenConfig*)UA_calloc(1, sizeof(PubSubFrozenConfig));
+    if(!fc) {
+        munmap(block, size);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    fc->header = (PubSubFrozenHeader*)block;
+    fc->mappedSize = size;
+    *frozen = fc;
+    return UA_STATUSCODE_GOOD;
+}
+
+/**********/
+/* Access */
+/**********/
+
+const PubSubFrozenHeader *
+PubSubFrozenConfig_getHeader(const PubSubFrozenConfig *frozen) {
+    return frozen->header;
+}
+
+void
+PubSubFrozenConfig_getView(const PubSubFrozenConfig *frozen, PubSubFrozenView *view) {
+    const PubSubFrozenHeader *h = frozen->header;
+    const UA_Byte *base = (const UA_Byte*)h;
+    view->connections = (const PubSubFrozenConnection*)&base[h->connections.offset];
+    view->connectionsSize = h->connections.size;
+    view->publishedDataSets =
+        (const PubSubFrozenPublishedDataSet*)&base[h->publishedDataSets.offset];
+    view->publishedDataSetsSize = h->publishedDataSets.size;
+    view->publishedFields =
+        (const PubSubFrozenPublishedField*)&base[h->publishedFields.offset];
+    view->publishedFieldsSize = h->publishedFields.size;
+    view->writerGroups = (const PubSubFrozenWriterGroup*)&base[h->writerGroups.offset];
+    view->writerGroupsSize = h->writerGroups.size;
+    view->dataSetWriters =
+        (const PubSubFrozenDataSetWriter*)&base[h->dataSetWriters.offset];
+    view->dataSetWritersSize = h->dataSetWriters.size;
+    view->readerGroups = (const PubSubFrozenReaderGroup*)&base[h->readerGroups.offset];
+    view->readerGroupsSize = h->readerGroups.size;
+    view->dataSetReaders =
+        (const PubSubFrozenDataSetReader*)&base[h->dataSetReaders.offset];
+    view->dataSetReadersSize = h->dataSetReaders.size;
+    view->readerFields = (const PubSubFrozenReaderField*)&base[h->readerFields.offset];
+    view->readerFieldsSize = h->readerFields.size;
+}
+
+UA_String
+PubSubFrozenConfig_getString(const PubSubFrozenConfig *frozen, PubSubFrozenString s) {
+    UA_String out = UA_STRING_NULL;
+    if(s.length == 0)
+        return out;
+    out.length = s.length;
+    out.data = &((UA_Byte*)frozen->header)[frozen->header->strings.offset + s.offset];
+    return out;
+}
+
+UA_NodeId
+PubSubFrozenConfig_getNodeId(const PubSubFrozenConfig *frozen,
+                             const PubSubFrozenNodeId *nodeId) {
+    UA_NodeId out = UA_NODEID_NULL;
+    out.namespaceIndex = nodeId->namespaceIndex;
+    if(nodeId->identifierType == UA_NODEIDTYPE_STRING) {
+        out.identifierType = UA_NODEIDTYPE_STRING;
+        out.identifier.string = PubSubFrozenConfig_getString(frozen, nodeId->string);
+    } else {
+        out.identifier.numeric = nodeId->numeric;
+    }
+    return out;
+}
+
+/*********/
+/* Apply */
+/*********/
+
+static UA_StatusCode
+applyPublishedDataSets(const PubSubFrozenConfig *frozen, const PubSubFrozenView *v,
+                       UA_Server *server, UA_NodeId *pdsIds) {
+    for(size_t i = 0; i < v->publishedDataSetsSize; i++) {
+        const PubSubFrozenPublishedDataSet *pds = &v->publishedDataSets[i];
+        UA_PublishedDataSetConfig pdsConfig;
+        memset(&pdsConfig, 0, sizeof(UA_PublishedDataSetConfig));
+        pdsConfig.publishedDataSetType = UA_PUBSUB_DATASET_PUBLISHEDITEMS;
+        pdsConfig.name = PubSubFrozenConfig_getString(frozen, pds->name);
+        UA_AddPublishedDataSetResult res =
+            UA_Server_addPublishedDataSet(server, &pdsConfig, &pdsIds[i]);
+        if(res.addResult != UA_STATUSCODE_GOOD)
+            return res.addResult;
+
+        for(size_t j = pds->fieldsBegin; j < pds->fieldsEnd; j++) {
+            const PubSubFrozenPublishedField *f = &v->publishedFields[j];
+            UA_DataSetFieldConfig fieldConfig;
+            memset(&fieldConfig, 0, sizeof(UA_DataSetFieldConfig));
+            fieldConfig.dataSetFieldType = UA_PUBSUB_DATASETFIELD_VARIABLE;
+            fieldConfig.field.variable.fieldNameAlias =
+                PubSubFrozenConfig_getString(frozen, f->name);
+            fieldConfig.field.variable.publishParameters.publishedVariable =
+                PubSubFrozenConfig_getNodeId(frozen, &f->publishedVariable);
+            fieldConfig.field.variable.publishParameters.attributeId = UA_ATTRIBUTEID_VALUE;
+            UA_NodeId fieldId;
+            UA_DataSetFieldResult fieldRes =
+                UA_Server_addDataSetField(server, pdsIds[i], &fieldConfig, &fieldId);
+            if(fieldRes.result != UA_STATUSCODE_GOOD)
+                return fieldRes.result;
+            UA_NodeId_clear(&fieldId);
+        }
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+applyWriterGroup(const PubSubFrozenConfig *frozen, const PubSubFrozenView *v,
+                 UA_Server *server, UA_NodeId connectionId,
+                 const PubSubFrozenWriterGroup *wg, const UA_NodeId *pdsIds) {
+    UA_UadpWriterGroupMessageDataType groupMessage;
+    memset(&groupMessage, 0, sizeof(groupMessage));
+    groupMessage.networkMessageContentMask =
+        (UA_UadpNetworkMessageContentMask)wg->networkMessageContentMask;
+    UA_WriterGroupConfig groupConfig;
+    memset(&groupConfig, 0, sizeof(UA_WriterGroupConfig));
+    groupConfig.name = PubSubFrozenConfig_getString(frozen, wg->name);
+    groupConfig.publishingInterval = wg->publishingInterval;
+    groupConfig.writerGroupId = wg->writerGroupId;
+    groupConfig.encodingMimeType = UA_PUBSUB_ENCODING_UADP;
+    groupConfig.messageSettings.encoding = UA_EXTENSIONOBJECT_DECODED;
+    groupConfig.messageSettings.content.decoded.type =
+        &UA_TYPES[UA_TYPES_UADPWRITERGROUPMESSAGEDATATYPE];
+    groupConfig.messageSettings.content.decoded.data = &groupMessage;
+    UA_NodeId groupId;
+    UA_StatusCode retval = UA_Server_addWriterGroup(server, connectionId, &groupConfig,
+                                                    &groupId);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    for(size_t i = wg->writersBegin; i < wg->writersEnd && retval == UA_STATUSCODE_GOOD; i++) {
+        const PubSubFrozenDataSetWriter *w = &v->dataSetWriters[i];
+        UA_UadpDataSetWriterMessageDataType writerMessage;
+        memset(&writerMessage, 0, sizeof(writerMessage));
+        writerMessage.dataSetMessageContentMask =
+            (UA_UadpDataSetMessageContentMask)w->dataSetMessageContentMask;
+        UA_DataSetWriterConfig writerConfig;
+        memset(&writerConfig, 0, sizeof(UA_DataSetWriterConfig));
+        writerConfig.name = PubSubFrozenConfig_getString(frozen, w->name);
+        writerConfig.dataSetWriterId = w->dataSetWriterId;
+        writerConfig.keyFrameCount = w->keyFrameCount;
+        writerConfig.messageSettings.encoding = UA_EXTENSIONOBJECT_DECODED;
+        writerConfig.messageSettings.content.decoded.type =
+            &UA_TYPES[UA_TYPES_UADPDATASETWRITERMESSAGEDATATYPE];
+        writerConfig.messageSettings.content.decoded.data = &writerMessage;
+        UA_NodeId writerId;
+        retval = UA_Server_addDataSetWriter(server, groupId, pdsIds[w->publishedDataSet],
+                                            &writerConfig, &writerId);
+        if(retval == UA_STATUSCODE_GOOD)
+            UA_NodeId_clear(&writerId);
+    }
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_freezeWriterGroupConfiguration(server, groupId);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_setWriterGroupOperational(server, groupId);
+    UA_NodeId_clear(&groupId);
+    return retval;
+}
+
+/* The folder and the TargetVariables of a reader */
+static UA_StatusCode
+applyTargetVariables(const PubSubFrozenConfig *frozen, const PubSubFrozenView *v,
+                     UA_Server *server, UA_NodeId readerId,
+                     const PubSubFrozenDataSetReader *r) {
+    UA_ObjectAttributes oAttr = UA_ObjectAttributes_default;
+    oAttr.displayName.text = PubSubFrozenConfig_getString(frozen, r->dataSetName);
+    UA_QualifiedName folderName = {1, oAttr.displayName.text};
+    UA_NodeId folderId;
+    UA_StatusCode retval =
+        UA_Server_addObjectNode(server, UA_NODEID_NULL,
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES), folderName,
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                                oAttr, NULL, &folderId);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    size_t fieldsSize = r->fieldsEnd - r->fieldsBegin;
+    UA_FieldTargetVariable *targetVars = (UA_FieldTargetVariable*)
+        UA_calloc(fieldsSize, sizeof(UA_FieldTargetVariable));
+    if(!targetVars) {
+        UA_NodeId_clear(&folderId);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    for(size_t i = 0; i < fieldsSize && retval == UA_STATUSCODE_GOOD; i++) {
+        const PubSubFrozenReaderField *f = &v->readerFields[r->fieldsBegin + i];
+        UA_VariableAttributes vAttr = UA_VariableAttributes_default;
+        vAttr.displayName.text = PubSubFrozenConfig_getString(frozen, f->name);
+        vAttr.dataType = UA_NODEID_NUMERIC(0, f->dataType);
+        UA_QualifiedName name = {1, vAttr.displayName.text};
+        UA_FieldTargetDataType_init(&targetVars[i].targetVariable);
+        targetVars[i].targetVariable.attributeId = UA_ATTRIBUTEID_VALUE;
+        retval = UA_Server_addVariableNode(server,
+                     PubSubFrozenConfig_getNodeId(frozen, &f->targetVariable), folderId,
+                     UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT), name,
+                     UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE), vAttr,
+                     (void*)(uintptr_t)i, &targetVars[i].targetVariable.targetNodeId);
+    }
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_DataSetReader_createTargetVariables(server, readerId,
+                                                               fieldsSize, targetVars);
+    for(size_t i = 0; i < fieldsSize; i++)
+        UA_FieldTargetDataType_clear(&targetVars[i].targetVariable);
+    UA_free(targetVars);
+    UA_NodeId_clear(&folderId);
+    return retval;
+}
+
+static UA_StatusCode
+applyDataSetReader(const PubSubFrozenConfig *frozen, const PubSubFrozenView *v,
+                   UA_Server *server, UA_NodeId groupId,
+                   const PubSubFrozenDataSetReader *r) {
+    UA_DataSetReaderConfig readerConfig;
+    memset(&readerConfig, 0, sizeof(UA_DataSetReaderConfig));
+    readerConfig.name = PubSubFrozenConfig_getString(frozen, r->name);
+
+    /* Small PublisherIds are sent as UInt16 */
+    UA_UInt16 publisherId16 = (UA_UInt16)r->publisherId;
+    UA_UInt32 publisherId32 = r->publisherId;
+    if(r->publisherId <= UA_UINT16_MAX)
+        UA_Variant_setScalar(&readerConfig.publisherId, &publisherId16,
+                             &UA_TYPES[UA_TYPES_UINT16]);
+    else
+        UA_Variant_setScalar(&readerConfig.publisherId, &publisherId32,
+                             &UA_TYPES[UA_TYPES_UINT32]);
+    readerConfig.writerGroupId = r->writerGroupId;
+    readerConfig.dataSetWriterId = r->dataSetWriterId;
+    readerConfig.messageReceiveTimeout = r->messageReceiveTimeout;
+
+    UA_DataSetMetaDataType *metaData = &readerConfig.dataSetMetaData;
+    UA_DataSetMetaDataType_init(metaData);
+    metaData->name = PubSubFrozenConfig_getString(frozen, r->dataSetName);
+    metaData->fieldsSize = r->fieldsEnd - r->fieldsBegin;
+    metaData->fields = (UA_FieldMetaData*)
+        UA_calloc(metaData->fieldsSize, sizeof(UA_FieldMetaData));
+    if(metaData->fieldsSize > 0 && !metaData->fields)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    for(size_t i = 0; i < metaData->fieldsSize; i++) {
+        const PubSubFrozenReaderField *f = &v->readerFields[r->fieldsBegin + i];
+        UA_FieldMetaData_init(&metaData->fields[i]);
+        metaData->fields[i].name = PubSubFrozenConfig_getString(frozen, f->name);
+        metaData->fields[i].dataType = UA_NODEID_NUMERIC(0, f->dataType);
+        /* The builtin types have the NodeIds 1 to 25 */
+        metaData->fields[i].builtInType = (UA_Byte)(f->dataType <= 25 ? f->dataType : 0);
+        metaData->fields[i].valueRank = -1; /* scalar */
+    }
+
+    UA_NodeId readerId;
+    UA_StatusCode retval = UA_Server_addDataSetReader(server, groupId, &readerConfig,
+                                                      &readerId);
+    UA_free(metaData->fields);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    retval = applyTargetVariables(frozen, v, server, readerId, r);
+    UA_NodeId_clear(&readerId);
+    return retval;
+}
+
+static UA_StatusCode
+applyReaderGroup(const PubSubFrozenConfig *frozen, const PubSubFrozenView *v,
+                 UA_Server *server, UA_NodeId connectionId,
+                 const PubSubFrozenReaderGroup *rg) {
+    UA_ReaderGroupConfig groupConfig;
+    memset(&groupConfig, 0, sizeof(UA_ReaderGroupConfig));
+    groupConfig.name = PubSubFrozenConfig_getString(frozen, rg->name);
+    UA_NodeId groupId;
+    UA_StatusCode retval = UA_Server_addReaderGroup(server, connectionId, &groupConfig,
+                                                    &groupId);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    for(size_t i = rg->readersBegin; i < rg->readersEnd && retval == UA_STATUSCODE_GOOD; i++)
+        retval = applyDataSetReader(frozen, v, server, groupId, &v->dataSetReaders[i]);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_freezeReaderGroupConfiguration(server, groupId);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_setReaderGroupOperational(server, groupId);
+    UA_NodeId_clear(&groupId);
+    return retval;
+}
+
+UA_StatusCode
+PubSubFrozenConfig_apply(const PubSubFrozenConfig *frozen, UA_Server *server) {
+    PubSubFrozenView v;
+    PubSubFrozenConfig_getView(frozen, &v);
+
+    UA_NodeId *pdsIds = (UA_NodeId*)UA_calloc(v.publishedDataSetsSize + 1, sizeof(UA_NodeId));
+    if(!pdsIds)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    UA_StatusCode retval = applyPublishedDataSets(frozen, &v, server, pdsIds);
+
+    for(size_t i = 0; i < v.connectionsSize && retval == UA_STATUSCODE_GOOD; i++) {
+        const PubSubFrozenConnection *c = &v.connections[i];
+        UA_NetworkAddressUrlDataType address;
+        address.networkInterface = PubSubFrozenConfig_getString(frozen, c->networkInterface);
+        address.url = PubSubFrozenConfig_getString(frozen, c->url);
+        UA_PubSubConnectionConfig connectionConfig;
+        memset(&connectionConfig, 0, sizeof(connectionConfig));
+        connectionConfig.name = PubSubFrozenConfig_getString(frozen, c->name);
+        connectionConfig.transportProfileUri =
+            PubSubFrozenConfig_getString(frozen, c->transportProfileUri);
+        connectionConfig.enabled = UA_TRUE;
+        UA_Variant_setScalar(&connectionConfig.address, &address,
+                             &UA_TYPES[UA_TYPES_NETWORKADDRESSURLDATATYPE]);
+        connectionConfig.publisherId.numeric = c->publisherId;
+        UA_NodeId connectionId;
+        retval = UA_Server_addPubSubConnection(server, &connectionConfig, &connectionId);
+        if(retval != UA_STATUSCODE_GOOD)
+            break;
+        for(size_t j = c->writerGroupsBegin;
+            j < c->writerGroupsEnd && retval == UA_STATUSCODE_GOOD; j++)
+            retval = applyWriterGroup(frozen, &v, server, connectionId,
+                                      &v.writerGroups[j], pdsIds);
+        for(size_t j = c->readerGroupsBegin;
+            j < c->readerGroupsEnd && retval == UA_STATUSCODE_GOOD; j++)
+            retval = applyReaderGroup(frozen, &v, server, connectionId, &v.readerGroups[j]);
+        UA_NodeId_clear(&connectionId);
+    }
+
+    for(size_t i = 0; i < v.publishedDataSetsSize; i++)
+        UA_NodeId_clear(&pdsIds[i]);
+    UA_free(pdsIds);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "Cannot apply the frozen PubSub configuration: %s",
+                     UA_StatusCode_name(retval));
+        return retval;
+    }
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                "Frozen PubSub configuration: %lu connections, %lu WriterGroups, "
+                "%lu DataSetWriters, %lu ReaderGroups, %lu DataSetReaders in %lu bytes",
+                (unsigned long)v.connectionsSize, (unsigned long)v.writerGroupsSize,
+                (unsigned long)v.dataSetWritersSize, (unsigned long)v.readerGroupsSize,
+                (unsigned long)v.dataSetReadersSize,
+                (unsigned long)frozen->header->size);
+    return UA_STATUSCODE_GOOD;
+}
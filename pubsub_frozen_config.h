@@ -0,0 +1,286 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_FROZEN_CONFIG_H_
+#define PUBSUB_FROZEN_CONFIG_H_
+
+#include <open62541/server.h>
+#include <open62541/server_pubsub.h>
+
+/**
+ * Frozen PubSub Configuration
+ * ---------------------------
+ * Fixed deployments build their PubSub configuration once at startup and
+ * never change it. The frozen configuration describes connections,
+ * PublishedDataSets, WriterGroups, DataSetWriters, ReaderGroups and
+ * DataSetReaders with their TargetVariables in one contiguous block:
+ *
+ * - A builder collects the entities in any order.
+ * - ``PubSubFrozenConfig_freeze`` lays them out in one block. The footprint
+ *   is known before (``PubSubFrozenConfigBuilder_footprint``) and can be
+ *   bounded. The block is read-only afterwards.
+ * - ``PubSubFrozenConfig_apply`` creates the entities in the server, and
+ *   the folder and variable nodes of the TargetVariables. The WriterGroups
+ *   and ReaderGroups are frozen with
+ *   ``UA_Server_freezeWriterGroupConfiguration`` and
+ *   ``UA_Server_freezeReaderGroupConfiguration``, so the server rejects
+ *   adding or removing writers, readers and fields of the frozen
+ *   PublishedDataSets at runtime.
+ *
+ * Every entity type has its own table of fixed-size records. The children of
+ * an entity are stored next to each other, so the records of a group and of
+ * its writers or readers share cache lines. The parent keeps the range
+ * ``[begin, end)`` of its children. Strings are stored in a string table at
+ * the end of the block. All references are offsets or indices into the
+ * block, never pointers, so the block can be copied or mapped anywhere.
+ *
+ * NodeIds are numeric or string NodeIds. PublisherIds are numeric.
+ *
+ * Snapshots
+ * ~~~~~~~~~
+ * ``PubSubFrozenConfig_save`` writes the block to a file as it is.
+ * ``PubSubFrozenConfig_load`` maps the file read-only and checks the
+ * bounds of all tables, ranges, indices and strings. There is no decoding
+ * and no copying, so loading costs the same for ten or ten thousand
+ * readers. One ``PubSubFrozenConfig_apply`` then creates the PubSub
+ * entities and the TargetVariable nodes. The file is in host byte order. A
+ * file from a host with a different byte order fails the magic check. */
+
+#define PUBSUBFROZEN_MAGIC 0x5a465350 /* "PSFZ" */
+#define PUBSUBFROZEN_VERSION 1
+
+typedef struct {
+    UA_UInt32 offset; /* Into the string table */
+    UA_UInt32 length;
+} PubSubFrozenString;
+
+typedef struct {
+    UA_UInt16 namespaceIndex;
+    UA_UInt16 identifierType; /* UA_NODEIDTYPE_NUMERIC or _STRING */
+    UA_UInt32 numeric;
+    PubSubFrozenString string;
+} PubSubFrozenNodeId;
+
+typedef struct {
+    UA_UInt32 offset; /* From the start of the block */
+    UA_UInt32 size;   /* Number of records or bytes of the string table */
+} PubSubFrozenTable;
+
+/* The first member of a child record is the index of the parent */
+
+typedef struct {
+    PubSubFrozenString name;
+    PubSubFrozenString transportProfileUri;
+    PubSubFrozenString url;
+    PubSubFrozenString networkInterface;
+    UA_UInt32 publisherId;
+    UA_UInt32 writerGroupsBegin, writerGroupsEnd;
+    UA_UInt32 readerGroupsBegin, readerGroupsEnd;
+} PubSubFrozenConnection;
+
+typedef struct {
+    PubSubFrozenString name;
+    UA_UInt32 fieldsBegin, fieldsEnd;
+} PubSubFrozenPublishedDataSet;
+
+typedef struct {
+    UA_UInt32 publishedDataSet;
+    PubSubFrozenString name;
+    PubSubFrozenNodeId publishedVariable;
+} PubSubFrozenPublishedField;
+
+typedef struct {
+    UA_UInt32 connection;
+    PubSubFrozenString name;
+    UA_UInt16 writerGroupId;
+    UA_UInt32 networkMessageContentMask; /* UadpNetworkMessageContentMask */
+    UA_Double publishingInterval;
+    UA_UInt32 writersBegin, writersEnd;
+} PubSubFrozenWriterGroup;
+
+typedef struct {
+    UA_UInt32 writerGroup;
+    UA_UInt32 publishedDataSet;
+    PubSubFrozenString name;
+    UA_UInt16 dataSetWriterId;
+    UA_UInt32 keyFrameCount;
+    UA_UInt32 dataSetMessageContentMask; /* UadpDataSetMessageContentMask */
+} PubSubFrozenDataSetWriter;
+
+typedef struct {
+    UA_UInt32 connection;
+    PubSubFrozenString name;
+    UA_UInt32 readersBegin, readersEnd;
+} PubSubFrozenReaderGroup;
+
+typedef struct {
+    UA_UInt32 readerGroup;
+    PubSubFrozenString name;
+    UA_UInt32 publisherId;
+    UA_UInt16 writerGroupId;
+    UA_UInt16 dataSetWriterId;
+    UA_Double messageReceiveTimeout;
+    PubSubFrozenString dataSetName; /* Also the name of the folder */
+    UA_UInt32 fieldsBegin, fieldsEnd;
+} PubSubFrozenDataSetReader;
+
+typedef struct {
+    UA_UInt32 dataSetReader;
+    PubSubFrozenString name;
+    UA_UInt32 dataType;     /* Numeric NodeId in namespace 0 */
+    PubSubFrozenNodeId targetVariable;
+} PubSubFrozenReaderField;
+
+typedef struct {
+    UA_UInt32 magic;
+    UA_UInt32 version;
+    UA_UInt64 size; /* Of the block */
+    PubSubFrozenTable connections;
+    PubSubFrozenTable publishedDataSets;
+    PubSubFrozenTable publishedFields;
+    PubSubFrozenTable writerGroups;
+    PubSubFrozenTable dataSetWriters;
+    PubSubFrozenTable readerGroups;
+    PubSubFrozenTable dataSetReaders;
+    PubSubFrozenTable readerFields;
+    PubSubFrozenTable strings;
+} PubSubFrozenHeader;
+
+/* Typed pointers into the block */
+typedef struct {
+    const PubSubFrozenConnection *connections;
+    size_t connectionsSize;
+    const PubSubFrozenPublishedDataSet *publishedDataSets;
+    size_t publishedDataSetsSize;
+    const PubSubFrozenPublishedField *publishedFields;
+    size_t publishedFieldsSize;
+    const PubSubFrozenWriterGroup *writerGroups;
+    size_t writerGroupsSize;
+    const PubSubFrozenDataSetWriter *dataSetWriters;
+    size_t dataSetWritersSize;
+    const PubSubFrozenReaderGroup *readerGroups;
+    size_t readerGroupsSize;
+    const PubSubFrozenDataSetReader *dataSetReaders;
+    size_t dataSetReadersSize;
+    const PubSubFrozenReaderField *readerFields;
+    size_t readerFieldsSize;
+} PubSubFrozenView;
+
+typedef struct PubSubFrozenConfigBuilder PubSubFrozenConfigBuilder;
+typedef struct PubSubFrozenConfig PubSubFrozenConfig;
+
+/* Builder */
+
+PubSubFrozenConfigBuilder *
+PubSubFrozenConfigBuilder_new(void);
+
+void
+PubSubFrozenConfigBuilder_delete(PubSubFrozenConfigBuilder *builder);
+
+/* The add functions copy their arguments and return the index of the new
+ * entity, which is the parent argument of its children */
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addConnection(PubSubFrozenConfigBuilder *builder,
+                                        const UA_String *name,
+                                        const UA_String *transportProfileUri,
+                                        const UA_NetworkAddressUrlDataType *address,
+                                        UA_UInt32 publisherId, UA_UInt32 *connection);
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addPublishedDataSet(PubSubFrozenConfigBuilder *builder,
+                                              const UA_String *name,
+                                              UA_UInt32 *publishedDataSet);
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addPublishedField(PubSubFrozenConfigBuilder *builder,
+                                            UA_UInt32 publishedDataSet,
+                                            const UA_String *name,
+                                            const UA_NodeId *publishedVariable);
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addWriterGroup(PubSubFrozenConfigBuilder *builder,
+                                         UA_UInt32 connection, const UA_String *name,
+                                         UA_UInt16 writerGroupId,
+                                         UA_Double publishingInterval,
+                                         UA_UInt32 networkMessageContentMask,
+                                         UA_UInt32 *writerGroup);
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addDataSetWriter(PubSubFrozenConfigBuilder *builder,
+                                           UA_UInt32 writerGroup,
+                                           UA_UInt32 publishedDataSet,
+                                           const UA_String *name,
+                                           UA_UInt16 dataSetWriterId,
+                                           UA_UInt32 keyFrameCount,
+                                           UA_UInt32 dataSetMessageContentMask);
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addReaderGroup(PubSubFrozenConfigBuilder *builder,
+                                         UA_UInt32 connection, const UA_String *name,
+                                         UA_UInt32 *readerGroup);
+
+UA_StatusCode
+PubSubFrozenConfigBuilder_addDataSetReader(PubSubFrozenConfigBuilder *builder,
+                                           UA_UInt32 readerGroup, const UA_String *name,
+                                           UA_UInt32 publisherId, UA_UInt16 writerGroupId,
+                                           UA_UInt16 dataSetWriterId,
+                                           UA_Double messageReceiveTimeout,
+                                           const UA_String *dataSetName,
+                                           UA_UInt32 *dataSetReader);
+
+/* The TargetVariable is created below the folder of the reader. With a null
+ * NodeId, the server assigns one. */
+UA_StatusCode
+PubSubFrozenConfigBuilder_addReaderField(PubSubFrozenConfigBuilder *builder,
+                                         UA_UInt32 dataSetReader, const UA_String *name,
+                                         const UA_NodeId *dataType,
+                                         const UA_NodeId *targetVariable);
+
+/* Size of the block that freeze allocates in bytes */
+size_t
+PubSubFrozenConfigBuilder_footprint(const PubSubFrozenConfigBuilder *builder);
+
+/* Frozen configuration */
+
+/* Lays out the entities of the builder in one read-only block. Fails with
+ * BADRESOURCEUNAVAILABLE if the block would be larger than maxSize (0 for no
+ * limit). The builder is not changed and can be deleted afterwards. */
+UA_StatusCode
+PubSubFrozenConfig_freeze(const PubSubFrozenConfigBuilder *builder, size_t maxSize,
+                          PubSubFrozenConfig **frozen);
+
+void
+PubSubFrozenConfig_delete(PubSubFrozenConfig *frozen);
+
+/* Creates the entities in the server and freezes the groups. Call before
+ * the server is started. The server copies what it needs, the block is not
+ * referenced afterwards. The TargetVariables get the index of their field
+ * within the reader as node context. */
+UA_StatusCode
+PubSubFrozenConfig_apply(const PubSubFrozenConfig *frozen, UA_Server *server);
+
+/* Writes to path.tmp and renames it to path */
+UA_StatusCode
+PubSubFrozenConfig_save(const PubSubFrozenConfig *frozen, const char *path);
+
+/* Returns BADDECODINGERROR if the file is not a valid frozen configuration
+ * of this version */
+UA_StatusCode
+PubSubFrozenConfig_load(const char *path, PubSubFrozenConfig **frozen);
+
+const PubSubFrozenHeader *
+PubSubFrozenConfig_getHeader(const PubSubFrozenConfig *frozen);
+
+void
+PubSubFrozenConfig_getView(const PubSubFrozenConfig *frozen, PubSubFrozenView *view);
+
+/* The returned strings and NodeIds point into the block */
+UA_String
+PubSubFrozenConfig_getString(const PubSubFrozenConfig *frozen, PubSubFrozenString s);
+
+UA_NodeId
+PubSubFrozenConfig_getNodeId(const PubSubFrozenConfig *frozen,
+                             const PubSubFrozenNodeId *nodeId);
+
+#endif /* PUBSUB_FROZEN_CONFIG_H_ */
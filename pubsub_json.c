@@ -0,0 +1,480 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_json.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TICKSPERSECOND 10000000LL
+#define TICKSPERDAY (86400LL * TICKSPERSECOND)
+#define DAYS1601TO1970 134774
+
+static const char digitPairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const UA_Double powersOf10[7] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6};
+
+struct PubSubJsonFields {
+    UA_Boolean reversible;
+    size_t fieldsSize;
+    UA_String *keys; /* ,"<name>": and without the comma for the first field */
+};
+
+static UA_Boolean
+fits(UA_Byte *pos, const UA_Byte *end, size_t n) {
+    return (size_t)(end - pos) >= n;
+}
+
+static void
+appendLiteral(UA_Byte **pos, const char *s) {
+    size_t n = strlen(s);
+    memcpy(*pos, s, n);
+    *pos += n;
+}
+
+/**
+ * Numbers
+ * ^^^^^^^ */
+
+/* Writes the digits of v backwards to end. Returns the first digit. */
+static char *
+formatDigits(UA_UInt64 v, char *end) {
+    while(v >= 100) {
+        size_t i = (size_t)(v % 100) * 2;
+        v /= 100;
+        end -= 2;
+        memcpy(end, &digitPairs[i], 2);
+    }
+    if(v >= 10) {
+        end -= 2;
+        memcpy(end, &digitPairs[v * 2], 2);
+    } else {
+        *--end = (char)('0' + v);
+    }
+    return end;
+}
+
+size_t
+PubSubJson_formatUInt64(UA_UInt64 v, char *buf) {
+    char tmp[20];
+    char *start = formatDigits(v, &tmp[20]);
+    size_t n = (size_t)(&tmp[20] - start);
+    memcpy(buf, start, n);
+    return n;
+}
+
+size_t
+PubSubJson_formatInt64(UA_Int64 v, char *buf) {
+    if(v >= 0)
+        return PubSubJson_formatUInt64((UA_UInt64)v, buf);
+    buf[0] = '-';
+    return 1 + PubSubJson_formatUInt64((UA_UInt64)0 - (UA_UInt64)v, &buf[1]);
+}
+
+/* Formats m / 10^decimals */
+static size_t
+formatDecimal(UA_Int64 m, size_t decimals, char *buf) {
+    char tmp[24];
+    char *end = &tmp[24];
+    UA_UInt64 u = m < 0 ? (UA_UInt64)0 - (UA_UInt64)m : (UA_UInt64)m;
+    char *start = formatDigits(u, end);
+    while((size_t)(end - start) <= decimals)
+        *--start = '0';
+    size_t n = 0;
+    if(m < 0)
+        buf[n++] = '-';
+    size_t intDigits = (size_t)(end - start) - decimals;
+    memcpy(&buf[n], start, intDigits);
+    n += intDigits;
+    if(decimals > 0) {
+        buf[n++] = '.';
+        memcpy(&buf[n], &start[intDigits], decimals);
+        n += decimals;
+    }
+    return n;
+}
+
+/* NaN and the infinities are strings. Returns 0 for finite values. */
+static size_t
+formatNonFinite(UA_Double v, char *buf) {
+    const char *s;
+    if(isnan(v))
+        s = "\"NaN\"";
+    else if(isinf(v))
+        s = v > 0 ? "\"Infinity\"" : "\"-Infinity\"";
+    else
+        return 0;
+    size_t n = strlen(s);
+    memcpy(buf, s, n);
+    return n;
+}
+
+size_t
+PubSubJson_formatDouble(UA_Double v, char *buf) {
+    size_t n = formatNonFinite(v, buf);
+    if(n > 0)
+        return n;
+    /* The fewest decimals that read back exactly. m and 10^d are exact and
+     * the division is correctly rounded, as is the parsing of the digits. */
+    if(fabs(v) < 1e15) {
+        for(size_t d = 0; d < 7; d++) {
+            UA_Double scaled = v * powersOf10[d];
+            if(fabs(scaled) >= 9e15)
+                break;
+            UA_Int64 m = (UA_Int64)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+            if((UA_Double)m / powersOf10[d] == v)
+                return formatDecimal(m, d, buf);
+        }
+    }
+    return (size_t)snprintf(buf, PUBSUBJSON_MAXNUMBERSIZE, "%.17g", v);
+}
+
+size_t
+PubSubJson_formatFloat(UA_Float v, char *buf) {
+    size_t n = formatNonFinite(v, buf);
+    if(n > 0)
+        return n;
+    if(fabsf(v) < 1e15f) {
+        for(size_t d = 0; d < 7; d++) {
+            UA_Double scaled = (UA_Double)v * powersOf10[d];
+            if(fabs(scaled) >= 9e15)
+                break;
+            UA_Int64 m = (UA_Int64)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+            if((UA_Float)((UA_Double)m / powersOf10[d]) == v)
+                return formatDecimal(m, d, buf);
+        }
+    }
+    return (size_t)snprintf(buf, PUBSUBJSON_MAXNUMBERSIZE, "%.9g", (UA_Double)v);
+}
+
+/**
+ * DateTime
+ * ^^^^^^^^
+ * ISO 8601 in UTC with up to seven decimals of the seconds. Times outside
+ * the years 1 to 9999 are clamped, as in Part 6. */
+
+static void
+appendTwoDigits(char **p, UA_UInt32 v) {
+    memcpy(*p, &digitPairs[v * 2], 2);
+    *p += 2;
+}
+
+size_t
+PubSubJson_formatDateTime(UA_DateTime t, char *buf) {
+    UA_Int64 days = t / TICKSPERDAY;
+    UA_Int64 rem = t % TICKSPERDAY;
+    if(rem < 0) {
+        days--;
+        rem += TICKSPERDAY;
+    }
+
+    /* Civil date from the days since 1970-01-01 (H. Hinnant) */
+    UA_Int64 z = days - DAYS1601TO1970 + 719468;
+    UA_Int64 era = (z >= 0 ? z : z - 146096) / 146097;
+    UA_Int64 doe = z - era * 146097;
+    UA_Int64 yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    UA_Int64 doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    UA_Int64 mp = (5 * doy + 2) / 153;
+    UA_UInt32 day = (UA_UInt32)(doy - (153 * mp + 2) / 5 + 1);
+    UA_UInt32 month = (UA_UInt32)(mp < 10 ? mp + 3 : mp - 9);
+    UA_Int64 year = yoe + era * 400 + (month <= 2);
+
+    const char *clamped = NULL;
+    if(year < 1)
+        clamped = "\"0001-01-01T00:00:00Z\"";
+    else if(year > 9999)
+        clamped = "\"9999-12-31T23:59:59Z\"";
+    if(clamped) {
+        memcpy(buf, clamped, 22);
+        return 22;
+    }
+
+    UA_UInt32 seconds = (UA_UInt32)(rem / TICKSPERSECOND);
+    UA_UInt32 fraction = (UA_UInt32)(rem % TICKSPERSECOND);
+    char *p = buf;
+    *p++ = '"';
+    appendTwoDigits(&p, (UA_UInt32)(year / 100));
+    appendTwoDigits(&p, (UA_UInt32)(year % 100));
+    *p++ = '-';
+    appendTwoDigits(&p, month);
+    *p++ = '-';
+    appendTwoDigits(&p, day);
+    *p++ = 'T';
+    appendTwoDigits(&p, seconds / 3600);
+    *p++ = ':';
+    appendTwoDigits(&p, seconds / 60 % 60);
+    *p++ = ':';
+    appendTwoDigits(&p, seconds % 60);
+    if(fraction > 0) {
+        size_t decimals = 7;
+        while(fraction % 10 == 0) {
+            fraction /= 10;
+            decimals--;
+        }
+        *p++ = '.';
+        for(size_t i = decimals; i > 0; i--) {
+            p[i - 1] = (char)('0' + fraction % 10);
+            fraction /= 10;
+        }
+        p += decimals;
+    }
+    *p++ = 'Z';
+    *p++ = '"';
+    return (size_t)(p - buf);
+}
+
+/**
+ * Values
+ * ^^^^^^ */
+
+static UA_StatusCode
+encodeString(const UA_String *s, UA_Byte **bufPos, const UA_Byte *bufEnd) {
+    static const char hex[] = "0123456789abcdef";
+    UA_Byte *pos = *bufPos;
+    if(!fits(pos, bufEnd, s->length + 2))
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+    *pos++ = '"';
+    for(size_t i = 0; i < s->length; i++) {
+        UA_Byte c = s->data[i];
+        if(c >= 0x20 && c != '"' && c != '\\') {
+            if(pos >= bufEnd)
+                return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+            *pos++ = c;
+            continue;
+        }
+        if(!fits(pos, bufEnd, 6))
+            return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+        *pos++ = '\\';
+        switch(c) {
+        case '"': *pos++ = '"'; break;
+        case '\\': *pos++ = '\\'; break;
+        case '\n': *pos++ = 'n'; break;
+        case '\r': *pos++ = 'r'; break;
+        case '\t': *pos++ = 't'; break;
+        default:
+            *pos++ = 'u';
+            *pos++ = '0';
+            *pos++ = '0';
+            *pos++ = (UA_Byte)hex[c >> 4];
+            *pos++ = (UA_Byte)hex[c & 0x0f];
+            break;
+        }
+    }
+    if(pos >= bufEnd)
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+    *pos++ = '"';
+    *bufPos = pos;
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+encodeScalar(const UA_DataType *type, const void *p, UA_Byte **bufPos,
+             const UA_Byte *bufEnd) {
+    if(type->typeKind == UA_DATATYPEKIND_STRING)
+        return encodeString((const UA_String*)p, bufPos, bufEnd);
+    if(!fits(*bufPos, bufEnd, PUBSUBJSON_MAXNUMBERSIZE))
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+    char *buf = (char*)*bufPos;
+    size_t n;
+    switch(type->typeKind) {
+    case UA_DATATYPEKIND_BOOLEAN:
+        n = *(const UA_Boolean*)p ? 4 : 5;
+        memcpy(buf, *(const UA_Boolean*)p ? "true" : "false", n);
+        break;
+    case UA_DATATYPEKIND_SBYTE:
+        n = PubSubJson_formatInt64(*(const UA_SByte*)p, buf);
+        break;
+    case UA_DATATYPEKIND_BYTE:
+        n = PubSubJson_formatUInt64(*(const UA_Byte*)p, buf);
+        break;
+    case UA_DATATYPEKIND_INT16:
+        n = PubSubJson_formatInt64(*(const UA_Int16*)p, buf);
+        break;
+    case UA_DATATYPEKIND_UINT16:
+        n = PubSubJson_formatUInt64(*(const UA_UInt16*)p, buf);
+        break;
+    case UA_DATATYPEKIND_INT32:
+        n = PubSubJson_formatInt64(*(const UA_Int32*)p, buf);
+        break;
+    case UA_DATATYPEKIND_UINT32:
+    case UA_DATATYPEKIND_STATUSCODE:
+        n = PubSubJson_formatUInt64(*(const UA_UInt32*)p, buf);
+        break;
+    case UA_DATATYPEKIND_INT64:
+        buf[0] = '"';
+        n = 1 + PubSubJson_formatInt64(*(const UA_Int64*)p, &buf[1]);
+        buf[n++] = '"';
+        break;
+    case UA_DATATYPEKIND_UINT64:
+        buf[0] = '"';
+        n = 1 + PubSubJson_formatUInt64(*(const UA_UInt64*)p, &buf[1]);
+        buf[n++] = '"';
+        break;
+    case UA_DATATYPEKIND_FLOAT:
+        n = PubSubJson_formatFloat(*(const UA_Float*)p, buf);
+        break;
+    case UA_DATATYPEKIND_DOUBLE:
+        n = PubSubJson_formatDouble(*(const UA_Double*)p, buf);
+        break;
+    case UA_DATATYPEKIND_DATETIME:
+        n = PubSubJson_formatDateTime(*(const UA_DateTime*)p, buf);
+        break;
+    default:
+        return UA_STATUSCODE_BADNOTSUPPORTED;
+    }
+    *bufPos += n;
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+encodeValue(const UA_Variant *value, UA_Byte **bufPos, const UA_Byte *bufEnd) {
+    if(UA_Variant_isScalar(value))
+        return encodeScalar(value->type, value->data, bufPos, bufEnd);
+    if(value->arrayDimensionsSize > 1)
+        return UA_STATUSCODE_BADNOTSUPPORTED;
+    if(!fits(*bufPos, bufEnd, 2))
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+    *(*bufPos)++ = '[';
+    const UA_Byte *element = (const UA_Byte*)value->data;
+    for(size_t i = 0; i < value->arrayLength; i++) {
+        if(i > 0) {
+            if(!fits(*bufPos, bufEnd, 1))
+                return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+            *(*bufPos)++ = ',';
+        }
+        UA_StatusCode retval = encodeScalar(value->type, element, bufPos, bufEnd);
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+        element += value->type->memSize;
+    }
+    if(!fits(*bufPos, bufEnd, 1))
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+    *(*bufPos)++ = ']';
+    return UA_STATUSCODE_GOOD;
+}
+
+/**
+ * Fields
+ * ^^^^^^ */
+
+PubSubJsonFields *
+PubSubJsonFields_new(size_t fieldsSize, const UA_String *names,
+                     UA_Boolean reversible) {
+    PubSubJsonFields *fields = (PubSubJsonFields*)UA_calloc(1, sizeof(PubSubJsonFields));
+    if(!fields)
+        return NULL;
+    fields->reversible = reversible;
+    fields->keys = (UA_String*)UA_calloc(fieldsSize, sizeof(UA_String));
+    if(!fields->keys) {
+        UA_free(fields);
+        return NULL;
+    }
+    fields->fieldsSize = fieldsSize;
+    for(size_t i = 0; i < fieldsSize; i++) {
+        /* Escaped name in quotes, comma and colon */
+        size_t maxSize = names[i].length * 6 + 4;
+        UA_Byte *key = (UA_Byte*)UA_malloc(maxSize);
+        if(!key) {
+            PubSubJsonFields_delete(fields);
+            return NULL;
+        }
+        UA_Byte *pos = key;
+        if(i > 0)
+            *pos++ = ',';
+        encodeString(&names[i], &pos, &key[maxSize]);
+        *pos++ = ':';
+        fields->keys[i].data = key;
+        fields->keys[i].length = (size_t)(pos - key);
+    }
+    return fields;
+}
+
+void
+PubSubJsonFields_delete(PubSubJsonFields *fields) {
+    for(size_t i = 0; i < fields->fieldsSize; i++)
+        UA_free(fields->keys[i].data);
+    UA_free(fields->keys);
+    UA_free(fields);
+}
+
+UA_StatusCode
+PubSubJsonFields_encode(const PubSubJsonFields *fields, size_t field,
+                        const UA_Variant *value, UA_Byte **bufPos,
+                        const UA_Byte *bufEnd) {
+    if(field >= fields->fieldsSize)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    const UA_String *key = &fields->keys[field];
+    UA_Byte *pos = *bufPos;
+    /* Key, {"Type":<id>,"Body":  and  } */
+    if(!fits(pos, bufEnd, key->length + 32))
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+    memcpy(pos, key->data, key->length);
+    pos += key->length;
+
+    if(!value->type || !value->data) {
+        appendLiteral(&pos, "null");
+        *bufPos = pos;
+        return UA_STATUSCODE_GOOD;
+    }
+    if(fields->reversible) {
+        appendLiteral(&pos, "{\"Type\":");
+        pos += PubSubJson_formatUInt64(value->type->typeId.identifier.numeric, (char*)pos);
+        appendLiteral(&pos, ",\"Body\":");
+    }
+    UA_StatusCode retval = encodeValue(value, &pos, bufEnd);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    if(fields->reversible) {
+        if(!fits(pos, bufEnd, 1))
+            return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+        *pos++ = '}';
+    }
+    *bufPos = pos;
+    return UA_STATUSCODE_GOOD;
+}
+
+/**
+ * Messages
+ * ^^^^^^^^ */
+
+UA_StatusCode
+PubSubJson_encodeHeader(UA_UInt32 publisherId, UA_UInt16 dataSetWriterId,
+                        UA_Byte **bufPos, const UA_Byte *bufEnd) {
+    UA_Byte *pos = *bufPos;
+    if(!fits(pos, bufEnd, PUBSUBJSON_MAXHEADERSIZE))
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+    appendLiteral(&pos, "{\"MessageType\":\"ua-data\",\"PublisherId\":\"");
+    pos += PubSubJson_formatUInt64(publisherId, (char*)pos);
+    appendLiteral(&pos, "\",\"Messages\":[{\"DataSetWriterId\":");
+    pos += PubSubJson_formatUInt64(dataSetWriterId, (char*)pos);
+    appendLiteral(&pos, ",\"Payload\":{");
+    *bufPos = pos;
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+PubSubJson_encodeTrailer(UA_UInt32 publisherId, UA_UInt16 writerGroupId,
+                         UA_UInt16 sequenceNumber, UA_DateTime timestamp,
+                         UA_Byte **bufPos, const UA_Byte *bufEnd) {
+    UA_Byte *pos = *bufPos;
+    if(!fits(pos, bufEnd, PUBSUBJSON_MAXTRAILERSIZE))
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+    appendLiteral(&pos, "},\"SequenceNumber\":");
+    pos += PubSubJson_formatUInt64(sequenceNumber, (char*)pos);
+    appendLiteral(&pos, ",\"Timestamp\":");
+    pos += PubSubJson_formatDateTime(timestamp, (char*)pos);
+    /* The MessageId is unique per WriterGroup and timestamp */
+    appendLiteral(&pos, "}],\"MessageId\":\"");
+    pos += PubSubJson_formatUInt64(publisherId, (char*)pos);
+    *pos++ = '-';
+    pos += PubSubJson_formatUInt64(writerGroupId, (char*)pos);
+    *pos++ = '-';
+    pos += PubSubJson_formatInt64(timestamp, (char*)pos);
+    appendLiteral(&pos, "\"}");
+    *bufPos = pos;
+    return UA_STATUSCODE_GOOD;
+}
@@ -0,0 +1,100 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_JSON_H_
+#define PUBSUB_JSON_H_
+
+#include <open62541/types.h>
+
+/**
+ * JSON NetworkMessages
+ * --------------------
+ * IT-side consumers take PubSub messages in the JSON encoding of OPC UA
+ * Part 14. The generic JSON encoder of open62541 builds the message from
+ * copies of the DataSet values and computes its size before it encodes.
+ * This encoder writes a message of one DataSetMessage with the static parts
+ * prepared once per DataSetWriter:
+ *
+ * - The header, from the start of the message to the first field, is
+ *   encoded once per DataSetWriter with ``PubSubJson_encodeHeader``.
+ * - The keys of the fields (``"<name>":`` or, reversible,
+ *   ``"<name>":{"Type":<id>,"Body":``) are escaped once in
+ *   ``PubSubJsonFields_new``.
+ * - Per message, only the values and the trailer (sequence number,
+ *   timestamp and MessageId) are formatted into the caller's buffer.
+ *
+ * Integers are formatted two digits at a time. Float and Double values
+ * with at most six decimals are formatted as integers with a decimal
+ * point, if the result reads back to the same value. Other values fall
+ * back to ``%.9g`` and ``%.17g``. A message looks like::
+ *
+ *   {"MessageType":"ua-data","PublisherId":"2234","Messages":[
+ *    {"DataSetWriterId":62541,"Payload":{"DateTime":{"Type":13,
+ *    "Body":"2020-05-31T14:40:00.25Z"},"Int32":{"Type":6,"Body":42}},
+ *    "SequenceNumber":7,"Timestamp":"2020-05-31T14:40:00.25Z"}],
+ *    "MessageId":"2234-100-132354096002500000"}
+ *
+ * The static keys come before the varying ones. The order of the keys of a
+ * JSON object is not significant.
+ *
+ * The encoder is used by the groups of the publish pool
+ * (pubsub_publish_pool.h). The WriterGroups of the server are encoded by
+ * open62541 itself, which has no hook for another encoder. Their JSON
+ * messages still come from the generic encoder (``encodingMimeType``
+ * ``UA_PUBSUB_ENCODING_JSON``).
+ *
+ * Supported values are scalars and one-dimensional arrays of Boolean, the
+ * integer types, Float, Double, String, DateTime and StatusCode. As in Part
+ * 6, Int64 and UInt64 are encoded as strings, and NaN and the infinities as
+ * the strings "NaN", "Infinity" and "-Infinity". An empty Variant is
+ * encoded as null. */
+
+#define PUBSUBJSON_MAXHEADERSIZE 128
+#define PUBSUBJSON_MAXTRAILERSIZE 128
+#define PUBSUBJSON_MAXNUMBERSIZE 32   /* Formatted number, with quotes */
+#define PUBSUBJSON_MAXDATETIMESIZE 32 /* Formatted DateTime, with quotes */
+
+typedef struct PubSubJsonFields PubSubJsonFields;
+
+PubSubJsonFields *
+PubSubJsonFields_new(size_t fieldsSize, const UA_String *names,
+                     UA_Boolean reversible);
+
+void
+PubSubJsonFields_delete(PubSubJsonFields *fields);
+
+/* Encodes the key and the value of a field. Fields after the first one
+ * start with a comma. The fields of a message are encoded in order. */
+UA_StatusCode
+PubSubJsonFields_encode(const PubSubJsonFields *fields, size_t field,
+                        const UA_Variant *value, UA_Byte **bufPos,
+                        const UA_Byte *bufEnd);
+
+/* Encodes the message up to the first field */
+UA_StatusCode
+PubSubJson_encodeHeader(UA_UInt32 publisherId, UA_UInt16 dataSetWriterId,
+                        UA_Byte **bufPos, const UA_Byte *bufEnd);
+
+/* Encodes the message after the last field */
+UA_StatusCode
+PubSubJson_encodeTrailer(UA_UInt32 publisherId, UA_UInt16 writerGroupId,
+                         UA_UInt16 sequenceNumber, UA_DateTime timestamp,
+                         UA_Byte **bufPos, const UA_Byte *bufEnd);
+
+/* The formatters write a JSON value and return its length */
+size_t
+PubSubJson_formatInt64(UA_Int64 v, char *buf);
+
+size_t
+PubSubJson_formatUInt64(UA_UInt64 v, char *buf);
+
+size_t
+PubSubJson_formatDouble(UA_Double v, char *buf);
+
+size_t
+PubSubJson_formatFloat(UA_Float v, char *buf);
+
+size_t
+PubSubJson_formatDateTime(UA_DateTime t, char *buf);
+
+#endif /* PUBSUB_JSON_H_ */
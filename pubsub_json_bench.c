@@ -0,0 +1,387 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+/**
+ * JSON Encoding Benchmark
+ * -----------------------
+ * Encodes the NetworkMessages of a DataSetWriter over and over, with a new
+ * sequence number and timestamp each time:
+ *
+ * - ``uadp-generic``: ``UA_NetworkMessage_encodeBinary`` into a buffer of
+ *   the size from ``UA_NetworkMessage_calcSizeBinary``, allocated per
+ *   message, as the WriterGroups of open62541 publish.
+ * - ``json-generic``: the same with ``UA_NetworkMessage_encodeJson``. Only
+ *   built if open62541 has UA_ENABLE_JSON_ENCODING.
+ * - ``json-fast``: the encoder of pubsub_json.h into a reused buffer, with
+ *   the header and the keys prepared once.
+ *
+ * The DataSets are the one of ``tutorial_pubsub_publish.c`` (a DateTime and
+ * an Int32), ``--fields`` Doubles with three decimals as from a sensor, and
+ * ``--fields`` Doubles with all digits, which take the slow path of the
+ * number formatter. Every run is reported as one JSON object per line::
+ *
+ *   {"dataSet":"sensor","fields":32,"impl":"json-fast","reversible":true,
+ *    "messages":114288,"nsPerMsg":2625.1,"bytesPerMsg":1422,"MBps":542.0}
+ *
+ * With ``--print``, the first message of every JSON run is written to
+ * stderr. */
+
+#include <open62541/types_generated_encoding_binary.h>
+
+#include <open62541/ua_pubsub_networkmessage.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pubsub_json.h"
+
+#define PUBLISHERID 2234
+#define WRITERGROUPID 100
+#define DATASETWRITERID 62541
+
+typedef struct {
+    const char *name;
+    size_t fieldsSize;
+    UA_String *names;
+    UA_Variant *values;
+} BenchDataSet;
+
+static size_t fieldsSize = 32;
+static UA_Double duration = 0.5;
+static UA_Boolean print = false;
+
+static UA_UInt64
+nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UA_UInt64)ts.tv_sec * 1000000000 + (UA_UInt64)ts.tv_nsec;
+}
+
+static void
+report(const BenchDataSet *ds, const char *impl, UA_Boolean reversible,
+       size_t messages, UA_UInt64 ns, size_t bytes) {
+    printf("{\"dataSet\":\"%s\",\"fields\":%lu,\"impl\":\"%s\",\"reversible\":%s,"
+           "\"messages\":%lu,\"nsPerMsg\":%.1f,\"bytesPerMsg\":%lu,\"MBps\":%.1f}\n",
+           ds->name, (unsigned long)ds->fieldsSize, impl,
+           reversible ? "true" : "false", (unsigned long)messages,
+           (UA_Double)ns / (UA_Double)messages, (unsigned long)(bytes / messages),
+           (UA_Double)bytes * 1000.0 / (UA_Double)ns);
+    fflush(stdout);
+}
+
+static void
+printMessage(const char *impl, const UA_Byte *data, size_t length) {
+    if(print)
+        fprintf(stderr, "%s: %.*s\n", impl, (int)length, (const char*)data);
+}
+
+/* Runs batches of messages until the duration is over */
+#define BENCH_LOOP(messages, ns, body) do {                             \
+        UA_UInt64 benchStart = nowNs();                                 \
+        UA_UInt64 benchEnd = benchStart + (UA_UInt64)(duration * 1e9);  \
+        UA_UInt64 benchNow;                                             \
+        messages = 0;                                                   \
+        do {                                                            \
+            for(size_t batch = 0; batch < 16; batch++) { body; }        \
+            messages += 16;                                             \
+            benchNow = nowNs();                                         \
+        } while(benchNow < benchEnd);                                   \
+        ns = benchNow - benchStart;                                     \
+    } while(0)
+
+/***********/
+/* Generic */
+/***********/
+
+typedef struct {
+    UA_NetworkMessage nm;
+    UA_DataSetMessage dsm;
+    UA_UInt16 dataSetWriterId;
+    UA_DataValue *fields;
+    char messageId[64];
+} GenericMessage;
+
+/* The message layout of tutorial_pubsub_publish.c */
+static UA_StatusCode
+initGenericMessage(GenericMessage *m, const BenchDataSet *ds) {
+    memset(m, 0, sizeof(GenericMessage));
+    m->fields = (UA_DataValue*)UA_calloc(ds->fieldsSize, sizeof(UA_DataValue));
+    if(!m->fields)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    for(size_t i = 0; i < ds->fieldsSize; i++) {
+        m->fields[i].value = ds->values[i]; /* Shallow copy */
+        m->fields[i].hasValue = true;
+    }
+    m->dsm.header.dataSetMessageValid = true;
+    m->dsm.header.fieldEncoding = UA_FIELDENCODING_VARIANT;
+    m->dsm.header.dataSetMessageSequenceNrEnabled = true;
+    m->dsm.header.timestampEnabled = true;
+    m->dsm.header.dataSetMessageType = UA_DATASETMESSAGE_DATAKEYFRAME;
+    m->dsm.data.keyFrameData.fieldCount = (UA_UInt16)ds->fieldsSize;
+    m->dsm.data.keyFrameData.dataSetFields = m->fields;
+#ifdef UA_ENABLE_JSON_ENCODING
+    m->dsm.data.keyFrameData.fieldNames = ds->names;
+#endif
+
+    m->dataSetWriterId = DATASETWRITERID;
+    m->nm.version = 1;
+    m->nm.networkMessageType = UA_NETWORKMESSAGE_DATASET;
+    m->nm.publisherIdEnabled = true;
+    m->nm.publisherIdType = UA_PUBLISHERDATATYPE_UINT16;
+    m->nm.publisherId.publisherIdUInt16 = PUBLISHERID;
+    m->nm.groupHeaderEnabled = true;
+    m->nm.groupHeader.writerGroupIdEnabled = true;
+    m->nm.groupHeader.writerGroupId = WRITERGROUPID;
+    m->nm.payloadHeaderEnabled = true;
+    m->nm.payloadHeader.dataSetPayloadHeader.count = 1;
+    m->nm.payloadHeader.dataSetPayloadHeader.dataSetWriterIds = &m->dataSetWriterId;
+    m->nm.payload.dataSetPayload.dataSetMessages = &m->dsm;
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+nextGenericMessage(GenericMessage *m, UA_DateTime timestamp) {
+    m->dsm.header.dataSetMessageSequenceNr++;
+    m->dsm.header.timestamp = timestamp;
+}
+
+static int
+benchUadpGeneric(const BenchDataSet *ds) {
+    GenericMessage m;
+    if(initGenericMessage(&m, ds) != UA_STATUSCODE_GOOD)
+        return EXIT_FAILURE;
+    UA_DateTime timestamp = UA_DateTime_now();
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    size_t messages, bytes = 0;
+    UA_UInt64 ns;
+    BENCH_LOOP(messages, ns, {
+        nextGenericMessage(&m, timestamp);
+        timestamp += 10000;
+        UA_ByteString buf;
+        size_t size = UA_NetworkMessage_calcSizeBinary(&m.nm, NULL);
+        retval |= UA_ByteString_allocBuffer(&buf, size);
+        if(retval == UA_STATUSCODE_GOOD) {
+            UA_Byte *pos = buf.data;
+            retval |= UA_NetworkMessage_encodeBinary(&m.nm, &pos, &buf.data[buf.length]);
+            bytes += (size_t)(pos - buf.data);
+        }
+        UA_ByteString_clear(&buf);
+    });
+    UA_free(m.fields);
+    if(retval != UA_STATUSCODE_GOOD) {
+        fprintf(stderr, "Encoding %s with uadp-generic failed\n", ds->name);
+        return EXIT_FAILURE;
+    }
+    report(ds, "uadp-generic", false, messages, ns, bytes);
+    return EXIT_SUCCESS;
+}
+
+#ifdef UA_ENABLE_JSON_ENCODING
+static int
+benchJsonGeneric(const BenchDataSet *ds, UA_Boolean reversible) {
+    GenericMessage m;
+    if(initGenericMessage(&m, ds) != UA_STATUSCODE_GOOD)
+        return EXIT_FAILURE;
+    m.nm.messageIdEnabled = true;
+    UA_DateTime timestamp = UA_DateTime_now();
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    size_t messages, bytes = 0;
+    UA_UInt64 ns;
+    UA_Boolean printed = false;
+    BENCH_LOOP(messages, ns, {
+        nextGenericMessage(&m, timestamp);
+        m.nm.messageId.length = (size_t)
+            snprintf(m.messageId, sizeof(m.messageId), "%u-%u-%lld", PUBLISHERID,
+                     WRITERGROUPID, (long long)timestamp);
+        m.nm.messageId.data = (UA_Byte*)m.messageId;
+        timestamp += 10000;
+        UA_ByteString buf;
+        size_t size = UA_NetworkMessage_calcSizeJson(&m.nm, NULL, 0, NULL, 0,
+                                                     reversible);
+        retval |= UA_ByteString_allocBuffer(&buf, size);
+        if(retval == UA_STATUSCODE_GOOD) {
+            UA_Byte *pos = buf.data;
+            const UA_Byte *end = &buf.data[buf.length];
+            retval |= UA_NetworkMessage_encodeJson(&m.nm, &pos, &end, NULL, 0,
+                                                   NULL, 0, reversible);
+            bytes += (size_t)(pos - buf.data);
+            if(!printed) {
+                printMessage("json-generic", buf.data, (size_t)(pos - buf.data));
+                printed = true;
+            }
+        }
+        UA_ByteString_clear(&buf);
+    });
+    UA_free(m.fields);
+    if(retval != UA_STATUSCODE_GOOD) {
+        fprintf(stderr, "Encoding %s with json-generic failed\n", ds->name);
+        return EXIT_FAILURE;
+    }
+    report(ds, "json-generic", reversible, messages, ns, bytes);
+    return EXIT_SUCCESS;
+}
+#endif
+
+/********/
+/* Fast */
+/********/
+
+static int
+benchJsonFast(const BenchDataSet *ds, UA_Boolean reversible) {
+    PubSubJsonFields *fields = PubSubJsonFields_new(ds->fieldsSize, ds->names,
+                                                    reversible);
+    UA_ByteString buf;
+    if(!fields || UA_ByteString_allocBuffer(&buf, 65536) != UA_STATUSCODE_GOOD) {
+        if(fields)
+            PubSubJsonFields_delete(fields);
+        return EXIT_FAILURE;
+    }
+    const UA_Byte *end = &buf.data[buf.length];
+
+    /* Prepared once per DataSetWriter */
+    UA_Byte header[PUBSUBJSON_MAXHEADERSIZE];
+    UA_Byte *pos = header;
+    PubSubJson_encodeHeader(PUBLISHERID, DATASETWRITERID, &pos,
+                            &header[PUBSUBJSON_MAXHEADERSIZE]);
+    size_t headerSize = (size_t)(pos - header);
+
+    UA_DateTime timestamp = UA_DateTime_now();
+    UA_UInt16 sequenceNumber = 0;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    size_t messages, bytes = 0;
+    UA_UInt64 ns;
+    UA_Boolean printed = false;
+    BENCH_LOOP(messages, ns, {
+        pos = buf.data;
+        memcpy(pos, header, headerSize);
+        pos += headerSize;
+        for(size_t i = 0; i < ds->fieldsSize; i++)
+            retval |= PubSubJsonFields_encode(fields, i, &ds->values[i], &pos, end);
+        retval |= PubSubJson_encodeTrailer(PUBLISHERID, WRITERGROUPID,
+                                           sequenceNumber++, timestamp, &pos, end);
+        timestamp += 10000;
+        bytes += (size_t)(pos - buf.data);
+        if(!printed) {
+            printMessage("json-fast", buf.data, (size_t)(pos - buf.data));
+            printed = true;
+        }
+    });
+    UA_ByteString_clear(&buf);
+    PubSubJsonFields_delete(fields);
+    if(retval != UA_STATUSCODE_GOOD) {
+        fprintf(stderr, "Encoding %s with json-fast failed\n", ds->name);
+        return EXIT_FAILURE;
+    }
+    report(ds, "json-fast", reversible, messages, ns, bytes);
+    return EXIT_SUCCESS;
+}
+
+/************/
+/* DataSets */
+/************/
+
+static UA_DateTime currentTime;
+static UA_Int32 answer = 42;
+static UA_String tutorialNames[2] = {UA_STRING_STATIC("CurrentTime"),
+                                     UA_STRING_STATIC("the.answer")};
+
+static UA_StatusCode
+initDoubles(BenchDataSet *ds, const char *name, UA_Boolean sensor) {
+    ds->name = name;
+    ds->fieldsSize = fieldsSize;
+    ds->names = (UA_String*)UA_calloc(fieldsSize, sizeof(UA_String));
+    ds->values = (UA_Variant*)UA_calloc(fieldsSize, sizeof(UA_Variant));
+    UA_Double *doubles = (UA_Double*)UA_calloc(fieldsSize, sizeof(UA_Double));
+    char **names = (char**)UA_calloc(fieldsSize, sizeof(char*));
+    if(!ds->names || !ds->values || !doubles || !names) {
+        UA_free(ds->names);
+        UA_free(ds->values);
+        UA_free(doubles);
+        UA_free(names);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    UA_UInt32 x = 2463534242u; /* xorshift32 */
+    for(size_t i = 0; i < fieldsSize; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        doubles[i] = sensor ? (UA_Double)((UA_Int32)(x % 2000000) - 1000000) / 1000.0 :
+            (UA_Double)x / 3.0e7;
+        names[i] = (char*)UA_malloc(32);
+        if(names[i])
+            snprintf(names[i], 32, "Sensor%lu", (unsigned long)i);
+        ds->names[i] = UA_STRING(names[i] ? names[i] : (char*)"");
+        UA_Variant_setScalar(&ds->values[i], &doubles[i], &UA_TYPES[UA_TYPES_DOUBLE]);
+    }
+    UA_free(names);
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+clearDoubles(BenchDataSet *ds) {
+    if(ds->fieldsSize > 0)
+        UA_free(ds->values[0].data); /* The doubles are one array */
+    for(size_t i = 0; i < ds->fieldsSize; i++) {
+        if(ds->names[i].length > 0)
+            UA_free(ds->names[i].data);
+    }
+    UA_free(ds->names);
+    UA_free(ds->values);
+}
+
+static int
+benchDataSet(const BenchDataSet *ds) {
+    int result = benchUadpGeneric(ds);
+    for(int reversible = 1; reversible >= 0 && result == EXIT_SUCCESS; reversible--) {
+#ifdef UA_ENABLE_JSON_ENCODING
+        result = benchJsonGeneric(ds, (UA_Boolean)reversible);
+        if(result != EXIT_SUCCESS)
+            break;
+#endif
+        result = benchJsonFast(ds, (UA_Boolean)reversible);
+    }
+    return result;
+}
+
+static void
+usage(char *progname) {
+    printf("usage: %s [--fields=32] [--duration=0.5] [--print]\n", progname);
+}
+
+int main(int argc, char **argv) {
+    for(int i = 1; i < argc; i++) {
+        if(strncmp(argv[i], "--fields=", 9) == 0) {
+            fieldsSize = strtoul(&argv[i][9], NULL, 10);
+        } else if(strncmp(argv[i], "--duration=", 11) == 0) {
+            duration = strtod(&argv[i][11], NULL);
+        } else if(strcmp(argv[i], "--print") == 0) {
+            print = true;
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if(fieldsSize < 1 || fieldsSize > 1000 || duration <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    BenchDataSet tutorial = {"tutorial", 2, tutorialNames, NULL};
+    UA_Variant tutorialValues[2];
+    currentTime = UA_DateTime_now();
+    UA_Variant_setScalar(&tutorialValues[0], &currentTime, &UA_TYPES[UA_TYPES_DATETIME]);
+    UA_Variant_setScalar(&tutorialValues[1], &answer, &UA_TYPES[UA_TYPES_INT32]);
+    tutorial.values = tutorialValues;
+    int result = benchDataSet(&tutorial);
+
+    BenchDataSet sensor, digits;
+    for(int i = 0; i < 2 && result == EXIT_SUCCESS; i++) {
+        BenchDataSet *ds = i == 0 ? &sensor : &digits;
+        if(initDoubles(ds, i == 0 ? "sensor" : "digits", i == 0) != UA_STATUSCODE_GOOD)
+            return EXIT_FAILURE;
+        result = benchDataSet(ds);
+        clearDoubles(ds);
+    }
+    return result;
+}
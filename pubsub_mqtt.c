@@ -0,0 +1,755 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_mqtt.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CHANNELDATAMQTT_MAGIC 0x4D515454 /* "MQTT" */
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_SUBSCRIBE 0x82
+#define MQTT_SUBACK 0x90
+#define MQTT_UNSUBSCRIBE 0xA2
+#define MQTT_PINGREQ 0xC0
+#define MQTT_DISCONNECT 0xE0
+
+typedef struct ChannelDataMqtt {
+    UA_UInt32 magic;
+    pthread_mutex_t lock;
+    struct ChannelDataMqtt *next; /* In the list of all channels */
+    UA_PubSubChannel *channel;
+    UA_String clientId;
+    UA_String topic;        /* Without transport settings */
+    UA_Byte qos;
+    UA_String subscription; /* Topic of regist */
+    void (*callback)(UA_ByteString *encodedBuffer, UA_ByteString *topic);
+    UA_UInt16 packetId;
+    UA_UInt64 lastSent;     /* ns, for the keep-alive */
+    PubSubMqttStats stats;
+    size_t sendSize;
+    size_t recvSize;
+    UA_Byte sendBuf[PUBSUBMQTT_SENDBUFSIZE];
+    UA_Byte recvBuf[PUBSUBMQTT_RECVBUFSIZE];
+} ChannelDataMqtt;
+
+/* All channels, for PubSubMqtt_yieldAll */
+static pthread_mutex_t channelsLock = PTHREAD_MUTEX_INITIALIZER;
+static ChannelDataMqtt *channels = NULL;
+static struct pollfd *pollFds = NULL;
+static size_t channelsSize = 0;
+
+static UA_UInt64
+monotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UA_UInt64)ts.tv_sec * 1000000000ull + (UA_UInt64)ts.tv_nsec;
+}
+
+static void
+writeUInt16(UA_Byte **pos, UA_UInt16 v) {
+    (*pos)[0] = (UA_Byte)(v >> 8);
+    (*pos)[1] = (UA_Byte)v;
+    *pos += 2;
+}
+
+static void
+writeString(UA_Byte **pos, const UA_String *s) {
+    writeUInt16(pos, (UA_UInt16)s->length);
+    if(s->length > 0)
+        memcpy(*pos, s->data, s->length);
+    *pos += s->length;
+}
+
+static UA_UInt16
+nextPacketId(ChannelDataMqtt *cd) {
+    if(++cd->packetId == 0)
+        cd->packetId = 1;
+    return cd->packetId;
+}
+
+/* Appends the fixed header of a packet to the send buffer. Returns where
+ * the bodySize bytes of the packet go, NULL if the buffer is full. */
+static UA_Byte *
+reservePacket(ChannelDataMqtt *cd, UA_Byte type, size_t bodySize) {
+    if(bodySize > 268435455 || 5 + bodySize > PUBSUBMQTT_SENDBUFSIZE - cd->sendSize)
+        return NULL;
+    UA_Byte *pos = &cd->sendBuf[cd->sendSize];
+    *pos++ = type;
+    size_t length = bodySize;
+    do {
+        UA_Byte b = (UA_Byte)(length % 128);
+        length /= 128;
+        *pos++ = length > 0 ? (UA_Byte)(b | 0x80) : b;
+    } while(length > 0);
+    cd->sendSize = (size_t)(pos - cd->sendBuf) + bodySize;
+    return pos;
+}
+
+static void
+connectionLost(UA_PubSubChannel *channel, const char *reason) {
+    if(channel->state == UA_PUBSUB_CHANNEL_ERROR)
+        return;
+    UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                 "PubSub MQTT: Connection lost. %s", reason);
+    channel->state = UA_PUBSUB_CHANNEL_ERROR;
+}
+
+static void
+flushSend(UA_PubSubChannel *channel, ChannelDataMqtt *cd) {
+    if(cd->sendSize == 0 || channel->state == UA_PUBSUB_CHANNEL_ERROR)
+        return;
+    ssize_t n = send(channel->sockfd, cd->sendBuf, cd->sendSize,
+                     MSG_DONTWAIT | MSG_NOSIGNAL);
+    if(n < 0) {
+        if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            connectionLost(channel, strerror(errno));
+        return;
+    }
+    cd->stats.writes++;
+    cd->lastSent = monotonicNs();
+    cd->sendSize -= (size_t)n;
+    if(cd->sendSize > 0)
+        memmove(cd->sendBuf, &cd->sendBuf[n], cd->sendSize);
+}
+
+static void
+readInput(UA_PubSubChannel *channel, ChannelDataMqtt *cd) {
+    while(cd->recvSize < PUBSUBMQTT_RECVBUFSIZE &&
+          channel->state != UA_PUBSUB_CHANNEL_ERROR) {
+        ssize_t n = recv(channel->sockfd, &cd->recvBuf[cd->recvSize],
+                         PUBSUBMQTT_RECVBUFSIZE - cd->recvSize, MSG_DONTWAIT);
+        if(n > 0) {
+            cd->recvSize += (size_t)n;
+            continue;
+        }
+        if(n == 0)
+            connectionLost(channel, "Closed by the broker.");
+        else if(errno == EINTR)
+            continue;
+        else if(errno != EAGAIN && errno != EWOULDBLOCK)
+            connectionLost(channel, strerror(errno));
+        return;
+    }
+}
+
+/**
+ * Received Packets
+ * ^^^^^^^^^^^^^^^^
+ * A PUBLISH goes to the callback of regist or into the message of receive.
+ * Without either, it stays in the buffer until receive is called. */
+
+static UA_Boolean
+handlePublish(UA_PubSubChannel *channel, ChannelDataMqtt *cd, UA_Byte flags,
+              UA_Byte *body, size_t length, UA_ByteString *message,
+              size_t capacity) {
+    UA_Byte qos = (UA_Byte)((flags >> 1) & 0x03);
+    size_t topicLength = length >= 2 ? ((size_t)body[0] << 8 | body[1]) : 0;
+    size_t offset = 2 + topicLength + (qos > 0 ? 2 : 0);
+    if(length < 2 || offset > length) {
+        connectionLost(channel, "Malformed PUBLISH.");
+        return false;
+    }
+    if(qos > 0) {
+        UA_Byte *pos = reservePacket(cd, MQTT_PUBACK, 2);
+        if(pos)
+            memcpy(pos, &body[2 + topicLength], 2);
+    }
+
+    cd->stats.received++;
+    UA_ByteString topic = {topicLength, &body[2]};
+    UA_ByteString payload = {length - offset, &body[offset]};
+    if(cd->callback) {
+        cd->callback(&payload, &topic);
+        return false;
+    }
+    if(payload.length > capacity) {
+        cd->stats.receivedDropped++;
+        return false;
+    }
+    memcpy(message->data, payload.data, payload.length);
+    message->length = payload.length;
+    return true;
+}
+
+/* Returns whether a message was written to the message of receive */
+static UA_Boolean
+processInput(UA_PubSubChannel *channel, ChannelDataMqtt *cd,
+             UA_ByteString *message, size_t capacity) {
+    size_t offset = 0;
+    UA_Boolean delivered = false;
+    while(!delivered && channel->state != UA_PUBSUB_CHANNEL_ERROR) {
+        UA_Byte *p = &cd->recvBuf[offset];
+        size_t available = cd->recvSize - offset;
+
+        /* Fixed header with up to four bytes of remaining length */
+        size_t length = 0;
+        size_t headerSize = 1;
+        UA_Boolean complete = false;
+        while(!complete && headerSize < available && headerSize < 5) {
+            UA_Byte b = p[headerSize];
+            length |= (size_t)(b & 0x7f) << (7 * (headerSize - 1));
+            headerSize++;
+            complete = !(b & 0x80);
+        }
+        if(!complete) {
+            if(headerSize == 5)
+                connectionLost(channel, "Malformed packet.");
+            break;
+        }
+        if(headerSize + length > PUBSUBMQTT_RECVBUFSIZE) {
+            connectionLost(channel, "Received packet too large.");
+            break;
+        }
+        if(headerSize + length > available)
+            break;
+
+        /* Keep a PUBLISH for receive, but drop what was processed before */
+        if((p[0] & 0xf0) == MQTT_PUBLISH && !cd->callback && !message)
+            break;
+
+        UA_Byte *body = &p[headerSize];
+        switch(p[0] & 0xf0) {
+        case MQTT_PUBLISH:
+            delivered = handlePublish(channel, cd, p[0], body, length,
+                                      message, capacity);
+            break;
+        case MQTT_PUBACK:
+            if(cd->stats.inflight > 0)
+                cd->stats.inflight--;
+            cd->stats.acked++;
+            break;
+        case MQTT_SUBACK:
+            if(length >= 3 && body[2] == 0x80)
+                UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                               "PubSub MQTT: The broker rejected the subscription "
+                               "to %.*s", (int)cd->subscription.length,
+                               (char*)cd->subscription.data);
+            break;
+        default:
+            break; /* PINGRESP, UNSUBACK */
+        }
+        offset += headerSize + length;
+    }
+    if(offset > 0) {
+        cd->recvSize -= offset;
+        memmove(cd->recvBuf, &cd->recvBuf[offset], cd->recvSize);
+    }
+    return delivered;
+}
+
+/**
+ * Event Loop
+ * ^^^^^^^^^^ */
+
+static UA_StatusCode
+runLoop(UA_PubSubChannel *channel, ChannelDataMqtt *cd, UA_ByteString *message,
+        size_t capacity, UA_UInt32 timeout) {
+    if(channel->state == UA_PUBSUB_CHANNEL_ERROR) {
+        /* Do not spin in the receive loop of the caller */
+        if(timeout > 0)
+            poll(NULL, 0, (int)((timeout + 999) / 1000));
+        return UA_STATUSCODE_BADCONNECTIONCLOSED;
+    }
+    flushSend(channel, cd);
+    UA_Boolean waited = false;
+    for(;;) {
+        readInput(channel, cd);
+        if(processInput(channel, cd, message, capacity) || waited || timeout == 0 ||
+           channel->state == UA_PUBSUB_CHANNEL_ERROR)
+            break;
+        struct pollfd pfd = {channel->sockfd, POLLIN, 0};
+        poll(&pfd, 1, (int)((timeout + 999) / 1000));
+        waited = true;
+    }
+
+    /* Acks, and a ping if nothing was sent for half the keep-alive */
+    if(cd->sendSize == 0 &&
+       monotonicNs() - cd->lastSent > PUBSUBMQTT_KEEPALIVE * 500000000ull)
+        reservePacket(cd, MQTT_PINGREQ, 0);
+    flushSend(channel, cd);
+    return channel->state == UA_PUBSUB_CHANNEL_ERROR ?
+        UA_STATUSCODE_BADCONNECTIONCLOSED : UA_STATUSCODE_GOOD;
+}
+
+void
+PubSubMqtt_yieldAll(UA_UInt32 timeout) {
+    pthread_mutex_lock(&channelsLock);
+    size_t n = 0;
+    for(ChannelDataMqtt *cd = channels; cd; cd = cd->next, n++) {
+        pthread_mutex_lock(&cd->lock);
+        flushSend(cd->channel, cd);
+        pollFds[n].fd = cd->channel->state == UA_PUBSUB_CHANNEL_ERROR ?
+            -1 : cd->channel->sockfd;
+        pollFds[n].events = POLLIN;
+        pollFds[n].revents = 0;
+        pthread_mutex_unlock(&cd->lock);
+    }
+    if(timeout > 0 && n > 0)
+        poll(pollFds, (nfds_t)n, (int)((timeout + 999) / 1000));
+    for(ChannelDataMqtt *cd = channels; cd; cd = cd->next) {
+        pthread_mutex_lock(&cd->lock);
+        runLoop(cd->channel, cd, NULL, 0, 0);
+        pthread_mutex_unlock(&cd->lock);
+    }
+    pthread_mutex_unlock(&channelsLock);
+}
+
+/**
+ * Channel Operations
+ * ^^^^^^^^^^^^^^^^^^ */
+
+static UA_Byte
+qualityOfService(UA_UInt32 deliveryGuarantee, UA_Byte qos) {
+    switch(deliveryGuarantee) {
+    case UA_BROKERTRANSPORTQUALITYOFSERVICE_BESTEFFORT:
+    case UA_BROKERTRANSPORTQUALITYOFSERVICE_ATMOSTONCE:
+        return 0;
+    case UA_BROKERTRANSPORTQUALITYOFSERVICE_ATLEASTONCE:
+    case UA_BROKERTRANSPORTQUALITYOFSERVICE_EXACTLYONCE:
+        return 1;
+    default:
+        return qos;
+    }
+}
+
+static const void *
+decodedSettings(const UA_ExtensionObject *settings, const UA_DataType *type) {
+    if(!settings || settings->encoding != UA_EXTENSIONOBJECT_DECODED ||
+       settings->content.decoded.type != type)
+        return NULL;
+    return settings->content.decoded.data;
+}
+
+static UA_StatusCode
+mqttSend(UA_PubSubChannel *channel, UA_ExtensionObject *transportSettings,
+         const UA_ByteString *buf) {
+    ChannelDataMqtt *cd = (ChannelDataMqtt*)channel->handle;
+    UA_String topic = cd->topic;
+    UA_Byte qos = cd->qos;
+    const UA_BrokerWriterGroupTransportDataType *broker =
+        (const UA_BrokerWriterGroupTransportDataType*)
+        decodedSettings(transportSettings,
+                        &UA_TYPES[UA_TYPES_BROKERWRITERGROUPTRANSPORTDATATYPE]);
+    if(broker) {
+        if(broker->queueName.length > 0)
+            topic = broker->queueName;
+        qos = qualityOfService((UA_UInt32)broker->requestedDeliveryGuarantee, qos);
+    }
+
+    pthread_mutex_lock(&cd->lock);
+    if(channel->state == UA_PUBSUB_CHANNEL_ERROR) {
+        pthread_mutex_unlock(&cd->lock);
+        return UA_STATUSCODE_BADCONNECTIONCLOSED;
+    }
+    size_t bodySize = 2 + topic.length + (qos > 0 ? 2 : 0) + buf->length;
+    UA_Byte *pos = NULL;
+    if(qos == 0 || cd->stats.inflight < PUBSUBMQTT_MAXINFLIGHT) {
+        pos = reservePacket(cd, (UA_Byte)(MQTT_PUBLISH | (qos << 1)), bodySize);
+        if(!pos) {
+            flushSend(channel, cd);
+            pos = reservePacket(cd, (UA_Byte)(MQTT_PUBLISH | (qos << 1)), bodySize);
+        }
+    }
+    if(!pos) {
+        cd->stats.dropped++;
+        pthread_mutex_unlock(&cd->lock);
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+    }
+    writeString(&pos, &topic);
+    if(qos > 0) {
+        writeUInt16(&pos, nextPacketId(cd));
+        cd->stats.inflight++;
+    }
+    memcpy(pos, buf->data, buf->length);
+    cd->stats.published++;
+    cd->stats.publishedBytes += buf->length;
+    if(cd->sendSize >= PUBSUBMQTT_BATCHSIZE)
+        flushSend(channel, cd);
+    pthread_mutex_unlock(&cd->lock);
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+mqttRegist(UA_PubSubChannel *channel, UA_ExtensionObject *transportSettings,
+           void (*callback)(UA_ByteString *encodedBuffer, UA_ByteString *topic)) {
+    ChannelDataMqtt *cd = (ChannelDataMqtt*)channel->handle;
+    UA_String topic = cd->topic;
+    UA_Byte qos = cd->qos;
+    const UA_BrokerDataSetReaderTransportDataType *broker =
+        (const UA_BrokerDataSetReaderTransportDataType*)
+        decodedSettings(transportSettings,
+                        &UA_TYPES[UA_TYPES_BROKERDATASETREADERTRANSPORTDATATYPE]);
+    if(broker) {
+        if(broker->queueName.length > 0)
+            topic = broker->queueName;
+        qos = qualityOfService((UA_UInt32)broker->requestedDeliveryGuarantee, qos);
+    }
+
+    pthread_mutex_lock(&cd->lock);
+    UA_String_clear(&cd->subscription);
+    UA_StatusCode retval = UA_String_copy(&topic, &cd->subscription);
+    UA_Byte *pos = NULL;
+    if(retval == UA_STATUSCODE_GOOD)
+        pos = reservePacket(cd, MQTT_SUBSCRIBE, 2 + 2 + topic.length + 1);
+    if(pos) {
+        writeUInt16(&pos, nextPacketId(cd));
+        writeString(&pos, &topic);
+        *pos = qos;
+        cd->callback = callback;
+        flushSend(channel, cd);
+    } else if(retval == UA_STATUSCODE_GOOD) {
+        retval = UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+    }
+    if(channel->state == UA_PUBSUB_CHANNEL_ERROR)
+        retval = UA_STATUSCODE_BADCONNECTIONCLOSED;
+    pthread_mutex_unlock(&cd->lock);
+    if(retval == UA_STATUSCODE_GOOD)
+        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                    "PubSub MQTT: Subscribing to %.*s with QoS %u",
+                    (int)topic.length, (char*)topic.data, qos);
+    return retval;
+}
+
+static UA_StatusCode
+mqttUnregist(UA_PubSubChannel *channel, UA_ExtensionObject *transportSettings) {
+    ChannelDataMqtt *cd = (ChannelDataMqtt*)channel->handle;
+    pthread_mutex_lock(&cd->lock);
+    cd->callback = NULL;
+    if(cd->subscription.length > 0) {
+        UA_Byte *pos = reservePacket(cd, MQTT_UNSUBSCRIBE,
+                                     2 + 2 + cd->subscription.length);
+        if(pos) {
+            writeUInt16(&pos, nextPacketId(cd));
+            writeString(&pos, &cd->subscription);
+            flushSend(channel, cd);
+        }
+    }
+    UA_String_clear(&cd->subscription);
+    pthread_mutex_unlock(&cd->lock);
+    return UA_STATUSCODE_GOOD;
+}
+
+/* The timeout is in microseconds */
+static UA_StatusCode
+mqttReceive(UA_PubSubChannel *channel, UA_ByteString *message,
+            UA_ExtensionObject *transportSettings, UA_UInt32 timeout) {
+    ChannelDataMqtt *cd = (ChannelDataMqtt*)channel->handle;
+    size_t capacity = message->length;
+    message->length = 0;
+    pthread_mutex_lock(&cd->lock);
+    UA_StatusCode retval = runLoop(channel, cd, message, capacity, timeout);
+    pthread_mutex_unlock(&cd->lock);
+    return retval;
+}
+
+/* The timeout is in milliseconds */
+static UA_StatusCode
+mqttYield(UA_PubSubChannel *channel, UA_UInt16 timeout) {
+    ChannelDataMqtt *cd = (ChannelDataMqtt*)channel->handle;
+    pthread_mutex_lock(&cd->lock);
+    UA_StatusCode retval = runLoop(channel, cd, NULL, 0, (UA_UInt32)timeout * 1000);
+    pthread_mutex_unlock(&cd->lock);
+    return retval;
+}
+
+static UA_StatusCode
+mqttClose(UA_PubSubChannel *channel) {
+    ChannelDataMqtt *cd = (ChannelDataMqtt*)channel->handle;
+    if(cd) {
+        pthread_mutex_lock(&channelsLock);
+        for(ChannelDataMqtt **c = &channels; *c; c = &(*c)->next) {
+            if(*c == cd) {
+                *c = cd->next;
+                channelsSize--;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&channelsLock);
+        if(channel->state == UA_PUBSUB_CHANNEL_PUB_SUB &&
+           reservePacket(cd, MQTT_DISCONNECT, 0))
+            flushSend(channel, cd);
+        pthread_mutex_destroy(&cd->lock);
+        UA_String_clear(&cd->clientId);
+        UA_String_clear(&cd->topic);
+        UA_String_clear(&cd->subscription);
+        UA_free(cd);
+    }
+    if(channel->sockfd >= 0)
+        close(channel->sockfd);
+    UA_free(channel);
+    return UA_STATUSCODE_GOOD;
+}
+
+/**
+ * Connect
+ * ^^^^^^^ */
+
+static UA_Boolean
+waitFor(int fd, short events, UA_UInt64 deadline) {
+    UA_UInt64 now = monotonicNs();
+    if(now >= deadline)
+        return false;
+    struct pollfd pfd = {fd, events, 0};
+    return poll(&pfd, 1, (int)((deadline - now) / 1000000 + 1)) > 0;
+}
+
+static int
+connectSocket(const char *host, const char *port, UA_UInt64 deadline) {
+    struct addrinfo hints, *info = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(host, port, &hints, &info) != 0)
+        return -1;
+    int fd = -1;
+    for(struct addrinfo *ai = info; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    ai->ai_protocol);
+        if(fd < 0)
+            continue;
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if(connect(fd, ai->ai_addr, ai->ai_addrlen) != 0 &&
+           (errno != EINPROGRESS || !waitFor(fd, POLLOUT, deadline) ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(info);
+    if(fd >= 0) {
+        /* The messages of a tick are batched already */
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+/* CONNECT and wait for the CONNACK */
+static UA_StatusCode
+handshake(UA_PubSubChannel *channel, ChannelDataMqtt *cd, UA_UInt64 deadline) {
+    UA_Byte *pos = reservePacket(cd, MQTT_CONNECT, 10 + 2 + cd->clientId.length);
+    if(!pos)
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+    UA_String protocol = UA_STRING("MQTT");
+    writeString(&pos, &protocol);
+    *pos++ = 4;    /* 3.1.1 */
+    *pos++ = 0x02; /* Clean session */
+    writeUInt16(&pos, PUBSUBMQTT_KEEPALIVE);
+    writeString(&pos, &cd->clientId);
+    while(cd->sendSize > 0 && channel->state != UA_PUBSUB_CHANNEL_ERROR) {
+        flushSend(channel, cd);
+        if(cd->sendSize > 0 && !waitFor(channel->sockfd, POLLOUT, deadline))
+            return UA_STATUSCODE_BADTIMEOUT;
+    }
+    while(cd->recvSize < 4 && channel->state != UA_PUBSUB_CHANNEL_ERROR) {
+        if(!waitFor(channel->sockfd, POLLIN, deadline))
+            return UA_STATUSCODE_BADTIMEOUT;
+        readInput(channel, cd);
+    }
+    if(channel->state == UA_PUBSUB_CHANNEL_ERROR)
+        return UA_STATUSCODE_BADCONNECTIONCLOSED;
+    if(cd->recvBuf[0] != MQTT_CONNACK || cd->recvBuf[1] != 2 || cd->recvBuf[3] != 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub MQTT: The broker refused the connection (%u)",
+                     cd->recvBuf[3]);
+        return UA_STATUSCODE_BADCONNECTIONREJECTED;
+    }
+    cd->recvSize -= 4;
+    memmove(cd->recvBuf, &cd->recvBuf[4], cd->recvSize);
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+readProperties(const UA_PubSubConnectionConfig *connectionConfig,
+               ChannelDataMqtt *cd) {
+    for(size_t i = 0; i < connectionConfig->connectionPropertiesSize; i++) {
+        const UA_KeyValuePair *kv = &connectionConfig->connectionProperties[i];
+        UA_String clientId = UA_STRING("mqttClientId");
+        UA_String topic = UA_STRING("mqttTopic");
+        UA_String qos = UA_STRING("mqttQos");
+        if(UA_String_equal(&kv->key.name, &clientId) &&
+           UA_Variant_hasScalarType(&kv->value, &UA_TYPES[UA_TYPES_STRING])) {
+            UA_String_clear(&cd->clientId);
+            UA_String_copy((const UA_String*)kv->value.data, &cd->clientId);
+        } else if(UA_String_equal(&kv->key.name, &topic) &&
+                  UA_Variant_hasScalarType(&kv->value, &UA_TYPES[UA_TYPES_STRING])) {
+            UA_String_clear(&cd->topic);
+            UA_String_copy((const UA_String*)kv->value.data, &cd->topic);
+        } else if(UA_String_equal(&kv->key.name, &qos) &&
+                  UA_Variant_hasScalarType(&kv->value, &UA_TYPES[UA_TYPES_BYTE])) {
+            cd->qos = *(const UA_Byte*)kv->value.data > 0 ? 1 : 0;
+        }
+    }
+}
+
+static UA_PubSubChannel *
+createChannel(UA_PubSubConnectionConfig *connectionConfig) {
+    if(!UA_Variant_hasScalarType(&connectionConfig->address,
+                                 &UA_TYPES[UA_TYPES_NETWORKADDRESSURLDATATYPE])) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Invalid Address.");
+        return NULL;
+    }
+    const UA_NetworkAddressUrlDataType *address =
+        (const UA_NetworkAddressUrlDataType*)connectionConfig->address.data;
+
+    /* opc.mqtt://<host>[:<port>][/] */
+    char host[256];
+    char port[8] = "1883";
+    const UA_String *url = &address->url;
+    size_t start = 11;
+    size_t end = url->length;
+    if(url->length <= start || strncmp((const char*)url->data, "opc.mqtt://", start) != 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Invalid Address.");
+        return NULL;
+    }
+    if(url->data[end - 1] == '/')
+        end--;
+    for(size_t i = end; i > start; i--) {
+        if(url->data[i - 1] == ':' && end - i < sizeof(port) && end > i) {
+            memcpy(port, &url->data[i], end - i);
+            port[end - i] = 0;
+            end = i - 1;
+            break;
+        }
+        if(url->data[i - 1] == ']')
+            break;
+    }
+    if(end <= start || end - start >= sizeof(host)) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Invalid Address.");
+        return NULL;
+    }
+    /* [IPv6] */
+    if(url->data[start] == '[' && url->data[end - 1] == ']') {
+        start++;
+        end--;
+    }
+    memcpy(host, &url->data[start], end - start);
+    host[end - start] = 0;
+
+    ChannelDataMqtt *cd = (ChannelDataMqtt*)UA_calloc(1, sizeof(ChannelDataMqtt));
+    UA_PubSubChannel *channel = (UA_PubSubChannel*)UA_calloc(1, sizeof(UA_PubSubChannel));
+    if(!cd || !channel) {
+        UA_free(cd);
+        UA_free(channel);
+        return NULL;
+    }
+    cd->magic = CHANNELDATAMQTT_MAGIC;
+    cd->channel = channel;
+    pthread_mutex_init(&cd->lock, NULL);
+    channel->handle = cd;
+    channel->sockfd = -1;
+    channel->connectionConfig = connectionConfig;
+
+    static UA_UInt32 clientCounter = 0;
+    char clientId[48];
+    snprintf(clientId, sizeof(clientId), "open62541-%ld-%u", (long)getpid(),
+             __atomic_fetch_add(&clientCounter, 1, __ATOMIC_RELAXED));
+    UA_String defaultClientId = UA_STRING(clientId);
+    UA_String defaultTopic = UA_STRING(PUBSUBMQTT_DEFAULTTOPIC);
+    UA_String_copy(&defaultClientId, &cd->clientId);
+    UA_String_copy(&defaultTopic, &cd->topic);
+    readProperties(connectionConfig, cd);
+
+    UA_UInt64 deadline = monotonicNs() + PUBSUBMQTT_CONNECTTIMEOUT * 1000000ull;
+    channel->sockfd = connectSocket(host, port, deadline);
+    if(channel->sockfd < 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. Cannot connect to %s:%s.",
+                     host, port);
+        mqttClose(channel);
+        return NULL;
+    }
+    UA_StatusCode retval = handshake(channel, cd, deadline);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub Connection creation failed. No MQTT session with "
+                     "%s:%s. %s", host, port, UA_StatusCode_name(retval));
+        mqttClose(channel);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&channelsLock);
+    struct pollfd *fds = (struct pollfd*)
+        UA_realloc(pollFds, (channelsSize + 1) * sizeof(struct pollfd));
+    if(fds) {
+        pollFds = fds;
+        cd->next = channels;
+        channels = cd;
+        channelsSize++;
+    }
+    pthread_mutex_unlock(&channelsLock);
+    if(!fds) {
+        mqttClose(channel);
+        return NULL;
+    }
+
+    channel->state = UA_PUBSUB_CHANNEL_PUB_SUB;
+    channel->send = mqttSend;
+    channel->regist = mqttRegist;
+    channel->unregist = mqttUnregist;
+    channel->receive = mqttReceive;
+    channel->yield = mqttYield;
+    channel->close = mqttClose;
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                "PubSub MQTT: Connected to %s:%s as %.*s", host, port,
+                (int)cd->clientId.length, (char*)cd->clientId.data);
+    return channel;
+}
+
+UA_PubSubTransportLayer
+PubSubMqtt_transportLayer(void) {
+    UA_PubSubTransportLayer layer;
+    layer.transportProfileUri = UA_STRING(PUBSUBMQTT_PROFILE);
+    layer.createPubSubChannel = createChannel;
+    return layer;
+}
+
+UA_StatusCode
+PubSubMqtt_getStats(UA_PubSubChannel *channel, PubSubMqttStats *stats) {
+    if(!channel) {
+        memset(stats, 0, sizeof(PubSubMqttStats));
+        pthread_mutex_lock(&channelsLock);
+        for(ChannelDataMqtt *cd = channels; cd; cd = cd->next) {
+            pthread_mutex_lock(&cd->lock);
+            stats->published += cd->stats.published;
+            stats->publishedBytes += cd->stats.publishedBytes;
+            stats->writes += cd->stats.writes;
+            stats->acked += cd->stats.acked;
+            stats->inflight += cd->stats.inflight;
+            stats->dropped += cd->stats.dropped;
+            stats->received += cd->stats.received;
+            stats->receivedDropped += cd->stats.receivedDropped;
+            pthread_mutex_unlock(&cd->lock);
+        }
+        pthread_mutex_unlock(&channelsLock);
+        return UA_STATUSCODE_GOOD;
+    }
+    ChannelDataMqtt *cd = (ChannelDataMqtt*)channel->handle;
+    if(!cd || cd->magic != CHANNELDATAMQTT_MAGIC)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    pthread_mutex_lock(&cd->lock);
+    *stats = cd->stats;
+    pthread_mutex_unlock(&cd->lock);
+    return UA_STATUSCODE_GOOD;
+}
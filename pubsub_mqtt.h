@@ -0,0 +1,90 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_MQTT_H_
+#define PUBSUB_MQTT_H_
+
+#include <open62541/plugin/pubsub.h>
+
+/**
+ * MQTT Transport
+ * --------------
+ * PubSub over an MQTT 3.1.1 broker, for uplinks that cannot take UDP
+ * multicast. The layer is registered like ``UA_PubSubTransportLayerUDPMP()``
+ * (in place of the MQTT layer of open62541, which has the same profile) and
+ * takes addresses ``opc.mqtt://<host>:<port>``.
+ *
+ * A channel is one TCP connection with a clean session. Only the connect
+ * waits for the broker. Afterwards the socket is non-blocking:
+ *
+ * - ``send`` appends a PUBLISH packet to the send buffer of the channel
+ *   and returns. QoS 1 publishes are pipelined: a window of
+ *   PUBSUBMQTT_MAXINFLIGHT packets may wait for their PUBACK.
+ * - The send buffer is written to the socket by the event loop
+ *   (``yield``, ``receive`` or ``PubSubMqtt_yieldAll``), or right away
+ *   once it holds PUBSUBMQTT_BATCHSIZE bytes. The messages of all
+ *   WriterGroups of a tick go out in one TCP write.
+ * - ``regist`` subscribes. Received PUBLISH packets go to the callback of
+ *   ``regist`` from within the event loop or, without a callback, are
+ *   returned one by one by ``receive``. Acks and keep-alive pings are
+ *   handled in the loop, too.
+ *
+ * The topic and QoS come from the BrokerWriterGroupTransportDataType (send)
+ * and BrokerDataSetReaderTransportDataType (regist) in the transport
+ * settings. BestEffort and AtMostOnce are QoS 0, AtLeastOnce and
+ * ExactlyOnce are QoS 1. Without transport settings, the connection
+ * properties ``mqttTopic`` (String) and ``mqttQos`` (Byte) are used, then
+ * PUBSUBMQTT_DEFAULTTOPIC and QoS 0. ``mqttClientId`` (String) sets the
+ * client id.
+ *
+ * ``PubSubMqtt_yieldAll`` runs the loop for all channels of the process with
+ * one poll, e.g. from a repeated callback after the WriterGroups of the
+ * same interval. The channels are locked, so the loop may run in another
+ * thread than the users of a channel. Callbacks must not use their own
+ * channel.
+ *
+ * A lost connection puts the channel in the error state. QoS 1 messages
+ * that were not acknowledged are not sent again.
+ *
+ * ``mqtt_broker_standin.c`` is a broker for tests on localhost::
+ *
+ *   ./mqtt_broker_standin --port=1883
+ *   ./pubsub_subscribe_standalone opc.mqtt://127.0.0.1:1883
+ *   ./tutorial_pubsub_publish opc.mqtt://127.0.0.1:1883 */
+
+#define PUBSUBMQTT_PROFILE \
+    "http://opcfoundation.org/UA-Profile/Transport/pubsub-mqtt-uadp"
+
+#define PUBSUBMQTT_DEFAULTTOPIC "opcua/pubsub"
+#define PUBSUBMQTT_SENDBUFSIZE (256u * 1024u)
+#define PUBSUBMQTT_BATCHSIZE (64u * 1024u)   /* Written without waiting for the loop */
+#define PUBSUBMQTT_RECVBUFSIZE (64u * 1024u) /* Largest received packet */
+#define PUBSUBMQTT_MAXINFLIGHT 256
+#define PUBSUBMQTT_KEEPALIVE 60              /* s */
+#define PUBSUBMQTT_CONNECTTIMEOUT 3000       /* ms */
+
+typedef struct {
+    UA_UInt64 published;
+    UA_UInt64 publishedBytes; /* Payload */
+    UA_UInt64 writes;         /* TCP writes of the send buffer */
+    UA_UInt64 acked;          /* PUBACKs for QoS 1 publishes */
+    UA_UInt64 inflight;
+    UA_UInt64 dropped;        /* Publishes rejected, send buffer or window full */
+    UA_UInt64 received;
+    UA_UInt64 receivedDropped; /* Larger than the buffer of receive */
+} PubSubMqttStats;
+
+UA_PubSubTransportLayer
+PubSubMqtt_transportLayer(void);
+
+/* Runs the event loop of all MQTT channels. Waits up to timeout (in
+ * microseconds) for received packets. */
+void
+PubSubMqtt_yieldAll(UA_UInt32 timeout);
+
+/* Sums the stats of all channels if channel is NULL. Returns
+ * BADINVALIDARGUMENT for channels of other transport layers. */
+UA_StatusCode
+PubSubMqtt_getStats(UA_PubSubChannel *channel, PubSubMqttStats *stats);
+
+#endif /* PUBSUB_MQTT_H_ */
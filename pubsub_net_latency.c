@@ -0,0 +1,280 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_net_latency.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#include "pubsub_ethernet_frame.h"
+#include "pubsub_ethernet_mmap.h"
+#include "pubsub_transport_wrap.h"
+
+#include <errno.h>
+#include <linux/if_packet.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+typedef enum {
+    RXMODE_SOCKET_UDP,
+    RXMODE_SOCKET_ETHERNET,
+    RXMODE_MMAP,
+    RXMODE_USERSPACE
+} RxMode;
+
+typedef struct {
+    RxMode mode;
+    UA_Byte targetAddress[6]; /* Ethernet only */
+} RxChannel;
+
+static __thread UA_DateTime localReceiveTime = 0;
+static __thread PubSubNetLatencySource localSource = PUBSUBNETLATENCY_SOURCE_NONE;
+
+static UA_DateTime
+toDateTime(const struct timespec *ts) {
+    return (UA_DateTime)ts->tv_sec * UA_DATETIME_SEC +
+        (UA_DateTime)ts->tv_nsec / 100 + UA_DATETIME_UNIX_EPOCH;
+}
+
+static void
+setUserspaceTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    localReceiveTime = toDateTime(&ts);
+    localSource = PUBSUBNETLATENCY_SOURCE_USERSPACE;
+}
+
+/**
+ * Receive
+ * ^^^^^^^ */
+
+static UA_StatusCode
+rxInit(PubSubChannelWrap *wrap, UA_PubSubConnectionConfig *connectionConfig) {
+    RxChannel *rc = (RxChannel*)UA_calloc(1, sizeof(RxChannel));
+    if(!rc)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    wrap->context = rc;
+
+    /* Ring based layers keep no timestamp in the socket */
+    PubSubEthernetMmapStats mmapStats;
+    if(PubSubEthernetMmap_getStats(wrap->channel, &mmapStats) == UA_STATUSCODE_GOOD) {
+        rc->mode = RXMODE_MMAP;
+        return UA_STATUSCODE_GOOD;
+    }
+
+    /* Read the socket only in place of the layer itself. Below another
+     * wrapper, the message comes from its receive. */
+    rc->mode = RXMODE_USERSPACE;
+    if(!PubSubTransportWrap_isInnermost(wrap))
+        return UA_STATUSCODE_GOOD;
+    if(!UA_Variant_hasScalarType(&connectionConfig->address,
+                                 &UA_TYPES[UA_TYPES_NETWORKADDRESSURLDATATYPE]))
+        return UA_STATUSCODE_GOOD;
+    const UA_NetworkAddressUrlDataType *address =
+        (const UA_NetworkAddressUrlDataType*)connectionConfig->address.data;
+    UA_UInt16 vid;
+    UA_Byte pcp;
+    int domain = 0;
+    socklen_t len = sizeof(domain);
+    getsockopt(wrap->channel->sockfd, SOL_SOCKET, SO_DOMAIN, &domain, &len);
+    if((domain == AF_INET || domain == AF_INET6) && address->url.length > 10 &&
+       strncmp((const char*)address->url.data, "opc.udp://", 10) == 0)
+        rc->mode = RXMODE_SOCKET_UDP;
+    else if(domain == AF_PACKET &&
+            PubSubEthernet_parseAddress(&address->url, rc->targetAddress,
+                                        &vid, &pcp) == UA_STATUSCODE_GOOD)
+        rc->mode = RXMODE_SOCKET_ETHERNET;
+    else
+        return UA_STATUSCODE_GOOD; /* E.g. AF_XDP */
+
+    int on = 1;
+    if(setsockopt(wrap->channel->sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0)
+        rc->mode = RXMODE_USERSPACE;
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+rxClear(PubSubChannelWrap *wrap) {
+    UA_free(wrap->context);
+    wrap->context = NULL;
+}
+
+/* Same semantics as the receive of the UDP and Ethernet layers of open62541:
+ * wait up to timeout (in us), then read at most one message */
+static UA_StatusCode
+receiveSocket(PubSubChannelWrap *wrap, RxChannel *rc, UA_ByteString *message,
+              UA_UInt32 timeout) {
+    int sockfd = wrap->channel->sockfd;
+    size_t capacity = message->length;
+    message->length = 0;
+    if(timeout > 0) {
+        struct pollfd pfd = {sockfd, POLLIN, 0};
+        if(poll(&pfd, 1, (int)((timeout + 999) / 1000)) <= 0)
+            return UA_STATUSCODE_GOOD;
+    }
+
+    union {
+        UA_Byte buf[CMSG_SPACE(sizeof(struct timespec))];
+        struct cmsghdr align;
+    } control;
+    struct sockaddr_ll from;
+    struct iovec iov = {message->data, capacity};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &from;
+    msg.msg_namelen = sizeof(from);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t n = recvmsg(sockfd, &msg, MSG_DONTWAIT);
+    if(n <= 0) {
+        if(n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            return UA_STATUSCODE_BADINTERNALERROR;
+        return UA_STATUSCODE_GOOD;
+    }
+
+    size_t length = (size_t)n;
+    if(rc->mode == RXMODE_SOCKET_ETHERNET) {
+        /* The packet socket also sees outgoing frames and foreign traffic */
+        if(from.sll_pkttype == PACKET_OUTGOING ||
+           memcmp(message->data, rc->targetAddress, 6) != 0)
+            return UA_STATUSCODE_GOOD;
+        size_t offset = PubSubEthernet_payloadOffset(message->data, length);
+        if(offset == 0)
+            return UA_STATUSCODE_GOOD;
+        length -= offset;
+        memmove(message->data, &message->data[offset], length);
+    }
+    message->length = length;
+
+    for(struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if(cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+            localReceiveTime = toDateTime(&ts);
+            localSource = PUBSUBNETLATENCY_SOURCE_KERNEL;
+            return UA_STATUSCODE_GOOD;
+        }
+    }
+    setUserspaceTime();
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+rxReceive(PubSubChannelWrap *wrap, UA_ByteString *message,
+          UA_ExtensionObject *transportSettings, UA_UInt32 timeout) {
+    RxChannel *rc = (RxChannel*)wrap->context;
+    if(rc->mode == RXMODE_SOCKET_UDP || rc->mode == RXMODE_SOCKET_ETHERNET)
+        return receiveSocket(wrap, rc, message, timeout);
+
+    /* Through the inner wrappers, or a layer without socket timestamps */
+    UA_StatusCode retval = wrap->receive(wrap->channel, message, transportSettings, timeout);
+    if(retval != UA_STATUSCODE_GOOD || message->length == 0)
+        return retval;
+    struct timespec ts;
+    if(rc->mode == RXMODE_MMAP &&
+       PubSubEthernetMmap_lastRxTimestamp(wrap->channel, &ts) == UA_STATUSCODE_GOOD) {
+        localReceiveTime = toDateTime(&ts);
+        localSource = PUBSUBNETLATENCY_SOURCE_KERNEL;
+    } else {
+        setUserspaceTime();
+    }
+    return retval;
+}
+
+static const PubSubTransportWrapper rxWrapper = {
+    "netlatency", rxInit, NULL, rxReceive, rxClear
+};
+
+UA_PubSubTransportLayer
+PubSubNetLatency_wrapTransportLayer(UA_PubSubTransportLayer inner) {
+    return PubSubTransportWrap_layer(inner, &rxWrapper, NULL);
+}
+
+UA_DateTime
+PubSubNetLatency_lastReceiveTime(PubSubNetLatencySource *source) {
+    if(source)
+        *source = localSource;
+    return localReceiveTime;
+}
+
+/**
+ * Statistics
+ * ^^^^^^^^^^ */
+
+typedef struct {
+    PubSubWriterKey key;
+    UA_DateTime lastSent;
+    UA_DateTime lastReceived;
+    UA_UInt64 negative;
+    LatencyHistogram latency;
+    LatencyHistogram jitter;
+} WriterStats;
+
+static WriterStats *writers[PUBSUBNETLATENCY_MAXWRITERS];
+static size_t writersSize = 0;
+
+static WriterStats *
+findWriter(const PubSubWriterKey *key) {
+    for(size_t i = 0; i < writersSize; i++) {
+        WriterStats *w = writers[i];
+        if(w->key.publisherId == key->publisherId &&
+           w->key.writerGroupId == key->writerGroupId &&
+           w->key.dataSetWriterId == key->dataSetWriterId)
+            return w;
+    }
+    if(writersSize == PUBSUBNETLATENCY_MAXWRITERS)
+        return NULL;
+    WriterStats *w = (WriterStats*)UA_calloc(1, sizeof(WriterStats));
+    if(!w)
+        return NULL;
+    w->key = *key;
+    LatencyHistogram_init(&w->latency);
+    LatencyHistogram_init(&w->jitter);
+    __atomic_store_n(&writers[writersSize], w, __ATOMIC_RELEASE);
+    __atomic_store_n(&writersSize, writersSize + 1, __ATOMIC_RELEASE);
+    return w;
+}
+
+void
+PubSubNetLatency_record(const PubSubWriterKey *key, UA_DateTime sent,
+                        UA_DateTime received) {
+    WriterStats *w = findWriter(key);
+    if(!w)
+        return;
+    UA_DateTime transit = received - sent;
+    if(transit >= 0)
+        LatencyHistogram_record(&w->latency, (UA_UInt64)transit * 100);
+    else
+        __atomic_store_n(&w->negative, w->negative + 1, __ATOMIC_RELAXED);
+
+    if(w->lastReceived != 0) {
+        UA_DateTime d = transit - (w->lastReceived - w->lastSent);
+        LatencyHistogram_record(&w->jitter, (UA_UInt64)(d < 0 ? -d : d) * 100);
+    }
+    w->lastSent = sent;
+    w->lastReceived = received;
+}
+
+void
+PubSubNetLatency_dump(const UA_Logger *logger) {
+    size_t size = __atomic_load_n(&writersSize, __ATOMIC_ACQUIRE);
+    for(size_t i = 0; i < size; i++) {
+        const WriterStats *w = __atomic_load_n(&writers[i], __ATOMIC_ACQUIRE);
+        UA_LOG_INFO(logger, UA_LOGCATEGORY_USERLAND,
+                    "Writer %lu/%u/%u latency count %lu p50 %lu ns p99 %lu ns "
+                    "max %lu ns (%lu negative), jitter p50 %lu ns p99 %lu ns max %lu ns",
+                    (unsigned long)w->key.publisherId, (unsigned)w->key.writerGroupId,
+                    (unsigned)w->key.dataSetWriterId,
+                    (unsigned long)w->latency.count,
+                    (unsigned long)LatencyHistogram_percentile(&w->latency, 0.5),
+                    (unsigned long)LatencyHistogram_percentile(&w->latency, 0.99),
+                    (unsigned long)w->latency.max,
+                    (unsigned long)__atomic_load_n(&w->negative, __ATOMIC_RELAXED),
+                    (unsigned long)LatencyHistogram_percentile(&w->jitter, 0.5),
+                    (unsigned long)LatencyHistogram_percentile(&w->jitter, 0.99),
+                    (unsigned long)w->jitter.max);
+    }
+}
@@ -0,0 +1,79 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_NET_LATENCY_H_
+#define PUBSUB_NET_LATENCY_H_
+
+#include <open62541/plugin/log.h>
+#include <open62541/plugin/pubsub.h>
+
+#include "latency_histogram.h"
+
+/**
+ * Network Latency
+ * ---------------
+ * One-way latency and inter-arrival jitter per DataSetWriter, from the
+ * publisher timestamp in the DataSetMessage header to the receive timestamp
+ * of the kernel.
+ *
+ * ``PubSubNetLatency_wrapTransportLayer`` takes the receive timestamp with
+ * the message. No syscall is added per packet:
+ *
+ * - UDP and the Ethernet layer of open62541: SO_TIMESTAMPNS on the channel
+ *   socket. The wrapper receives with recvmsg in place of the layer and
+ *   reads the timestamp from the control message. This needs the wrapper
+ *   directly around the layer. Stacked around other wrappers, it receives
+ *   through them and takes the time in userspace.
+ * - pubsub_ethernet_mmap.h: the timestamp from the ring frame header.
+ * - Other layers (e.g. pubsub_ethernet_xdp.h): the time in userspace right
+ *   after the receive.
+ *
+ * All timestamps are CLOCK_REALTIME. The latency is only meaningful if the
+ * clocks of publisher and subscriber are synchronized (PTP), or both run on
+ * the same host. It includes encoding and sending on the publisher side,
+ * since open62541 takes the DataSetMessage timestamp before encoding.
+ *
+ * The jitter is the change of the transit time between two consecutive
+ * messages of a writer, ``|(r_i - r_i-1) - (s_i - s_i-1)|`` as in RFC 3550.
+ * Unlike the latency it does not depend on the clock offset.
+ *
+ * The statistics have a single writer. Record from the receive thread only;
+ * the dump may run in any thread. */
+
+#define PUBSUBNETLATENCY_MAXWRITERS 32
+
+typedef struct {
+    UA_UInt64 publisherId;   /* Numeric PublisherIds only */
+    UA_UInt16 writerGroupId;
+    UA_UInt16 dataSetWriterId;
+} PubSubWriterKey;
+
+typedef enum {
+    PUBSUBNETLATENCY_SOURCE_NONE = 0,
+    PUBSUBNETLATENCY_SOURCE_KERNEL,
+    PUBSUBNETLATENCY_SOURCE_USERSPACE
+} PubSubNetLatencySource;
+
+/* Receive timestamps for all channels of the layer */
+UA_PubSubTransportLayer
+PubSubNetLatency_wrapTransportLayer(UA_PubSubTransportLayer inner);
+
+/* The receive time of the last message that the calling thread received
+ * through a wrapped channel. 0 if there was none. Wrappers stacked around
+ * this one (e.g. pubsub_capture.h) take the timestamp of the message from
+ * here. */
+UA_DateTime
+PubSubNetLatency_lastReceiveTime(PubSubNetLatencySource *source);
+
+/* Records latency and jitter (in ns) of a DataSetMessage. Latencies below
+ * zero (unsynchronized clocks) are counted, but not recorded. Messages of
+ * more than PUBSUBNETLATENCY_MAXWRITERS writers are ignored. */
+void
+PubSubNetLatency_record(const PubSubWriterKey *key, UA_DateTime sent,
+                        UA_DateTime received);
+
+/* Logs one line per writer */
+void
+PubSubNetLatency_dump(const UA_Logger *logger);
+
+#endif /* PUBSUB_NET_LATENCY_H_ */
@@ -0,0 +1,295 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_probe.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#include <poll.h>
+
+#include "pubsub_transport_wrap.h"
+
+const char *PubSubProbe_stageNames[PUBSUBPROBE_STAGES] = {
+    "Sample", "Encode", "Send", "Receive", "Decode", "Dispatch", "TargetWrite"
+};
+
+UA_Boolean pubsubProbeEnabled = false;
+
+/* Nanoseconds per timestamp tick. Exactly 1 for CLOCK_MONOTONIC. */
+static UA_Double nsPerTick = 1.0;
+
+typedef struct ProbeThread {
+    struct ProbeThread *next;
+    LatencyHistogram stages[PUBSUBPROBE_STAGES];
+} ProbeThread;
+
+/* Threads register once and are never removed. Their samples stay part of
+ * the statistics after the thread has ended. */
+static ProbeThread *probeThreads = NULL;
+static __thread ProbeThread *localThread = NULL;
+static __thread PubSubProbeTime localMark = 0;
+static __thread PubSubProbeTime localSplit = 0;
+static __thread UA_Boolean localReceived = false; /* The last receive had a message */
+
+static ProbeThread *
+getLocalThread(void) {
+    if(UA_LIKELY(localThread != NULL))
+        return localThread;
+    ProbeThread *t = (ProbeThread*)UA_malloc(sizeof(ProbeThread));
+    if(!t)
+        return NULL;
+    for(size_t i = 0; i < PUBSUBPROBE_STAGES; i++)
+        LatencyHistogram_init(&t->stages[i]);
+    t->next = __atomic_load_n(&probeThreads, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&probeThreads, &t->next, t, true,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+    localThread = t;
+    return t;
+}
+
+#ifdef PUBSUBPROBE_USE_TSC
+static void
+calibrateTsc(void) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    PubSubProbeTime tscStart = PubSubProbe_now();
+    struct timespec wait = {0, 20 * 1000 * 1000};
+    nanosleep(&wait, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    PubSubProbeTime tscEnd = PubSubProbe_now();
+    UA_Double ns = (UA_Double)(end.tv_sec - start.tv_sec) * 1e9 +
+        (UA_Double)(end.tv_nsec - start.tv_nsec);
+    if(tscEnd > tscStart)
+        nsPerTick = ns / (UA_Double)(tscEnd - tscStart);
+}
+#endif
+
+void
+PubSubProbe_setEnabled(UA_Boolean enabled) {
+#ifdef PUBSUBPROBE_USE_TSC
+    if(enabled && !pubsubProbeEnabled)
+        calibrateTsc();
+#endif
+    pubsubProbeEnabled = enabled;
+}
+
+void
+PubSubProbe_record(PubSubProbeStage stage, PubSubProbeTime start) {
+    PubSubProbeTime now = PubSubProbe_now();
+    ProbeThread *t = getLocalThread();
+    if(!t || now < start)
+        return;
+    UA_UInt64 ns = (UA_UInt64)((UA_Double)(now - start) * nsPerTick);
+    LatencyHistogram_record(&t->stages[stage], ns);
+}
+
+void
+PubSubProbe_setMark(void) {
+    if(UA_UNLIKELY(pubsubProbeEnabled))
+        localMark = localSplit = PubSubProbe_now();
+}
+
+void
+PubSubProbe_recordSplit(PubSubProbeStage stage) {
+    if(UA_UNLIKELY(localMark != 0)) {
+        PubSubProbeTime start = localSplit;
+        localSplit = PubSubProbe_now();
+        PubSubProbe_record(stage, start);
+    }
+}
+
+void
+PubSubProbe_recordSinceMark(PubSubProbeStage stage) {
+    if(UA_UNLIKELY(localMark != 0)) {
+        PubSubProbe_record(stage, localMark);
+        localMark = 0;
+    }
+}
+
+UA_StatusCode
+PubSubProbe_receive(UA_PubSubChannel *channel, PubSubProbeReceive receive,
+                    UA_ByteString *buf, UA_ExtensionObject *transportSettings,
+                    UA_UInt32 timeout) {
+    if(UA_LIKELY(!pubsubProbeEnabled) || (int)channel->sockfd < 0)
+        return receive(channel, buf, transportSettings, timeout);
+
+    /* Wait for the socket before the timed call. After a message, the layer
+     * may hold more in user space (MQTT, packet rings), so it is asked again
+     * right away. The timed call gets 1us, as some layers block on 0. */
+    struct pollfd pfd = {(int)channel->sockfd, POLLIN, 0};
+    int ready = poll(&pfd, 1, localReceived ? 0 : (int)((timeout + 999) / 1000));
+    PubSubProbeTime t = ready > 0 ? PubSubProbe_now() : 0;
+    UA_StatusCode retval = receive(channel, buf, transportSettings, 1);
+    localReceived = (retval == UA_STATUSCODE_GOOD && buf->length > 0);
+    if(localReceived) {
+        if(t != 0)
+            PubSubProbe_record(PUBSUBPROBE_RECEIVE, t);
+        PubSubProbe_setMark();
+    }
+    return retval;
+}
+
+void
+PubSubProbe_collect(PubSubProbeStage stage, LatencyHistogram *out) {
+    LatencyHistogram_init(out);
+    for(ProbeThread *t = __atomic_load_n(&probeThreads, __ATOMIC_ACQUIRE);
+        t; t = t->next)
+        LatencyHistogram_merge(out, &t->stages[stage]);
+}
+
+void
+PubSubProbe_dump(const UA_Logger *logger) {
+    LatencyHistogram *h = (LatencyHistogram*)UA_malloc(sizeof(LatencyHistogram));
+    if(!h)
+        return;
+    for(size_t i = 0; i < PUBSUBPROBE_STAGES; i++) {
+        PubSubProbe_collect((PubSubProbeStage)i, h);
+        if(h->count == 0)
+            continue;
+        UA_LOG_INFO(logger, UA_LOGCATEGORY_USERLAND,
+                    "Probe %-11s count %10lu  p50 %8lu ns  p99 %8lu ns  "
+                    "p99.9 %8lu ns  max %8lu ns", PubSubProbe_stageNames[i],
+                    (unsigned long)h->count,
+                    (unsigned long)LatencyHistogram_percentile(h, 0.5),
+                    (unsigned long)LatencyHistogram_percentile(h, 0.99),
+                    (unsigned long)LatencyHistogram_percentile(h, 0.999),
+                    (unsigned long)h->max);
+    }
+    UA_free(h);
+}
+
+static void
+periodicDump(UA_Server *server, void *data) {
+    PubSubProbe_dump(UA_Log_Stdout);
+}
+
+UA_StatusCode
+PubSubProbe_addPeriodicDump(UA_Server *server, UA_Double intervalMs,
+                            UA_UInt64 *callbackId) {
+    return UA_Server_addRepeatedCallback(server, periodicDump, NULL,
+                                         intervalMs, callbackId);
+}
+
+/**
+ * Diagnostics Nodes
+ * ^^^^^^^^^^^^^^^^^
+ * The values are computed on every read. The node context encodes the stage
+ * and the metric. */
+
+typedef enum {
+    PROBEMETRIC_COUNT = 0,
+    PROBEMETRIC_P50,
+    PROBEMETRIC_P99,
+    PROBEMETRIC_P999,
+    PROBEMETRIC_MAX
+} ProbeMetric;
+
+static const char *probeMetricNames[] = {"Count", "P50Ns", "P99Ns", "P999Ns", "MaxNs"};
+#define PROBEMETRICS 5
+
+static UA_StatusCode
+readProbeMetric(UA_Server *server, const UA_NodeId *sessionId,
+                void *sessionContext, const UA_NodeId *nodeId, void *nodeContext,
+                UA_Boolean sourceTimeStamp, const UA_NumericRange *range,
+                UA_DataValue *value) {
+    uintptr_t ctx = (uintptr_t)nodeContext;
+    PubSubProbeStage stage = (PubSubProbeStage)(ctx / PROBEMETRICS);
+    ProbeMetric metric = (ProbeMetric)(ctx % PROBEMETRICS);
+    LatencyHistogram *h = (LatencyHistogram*)UA_malloc(sizeof(LatencyHistogram));
+    if(!h)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    PubSubProbe_collect(stage, h);
+
+    UA_UInt64 v = 0;
+    switch(metric) {
+    case PROBEMETRIC_COUNT: v = h->count; break;
+    case PROBEMETRIC_P50: v = LatencyHistogram_percentile(h, 0.5); break;
+    case PROBEMETRIC_P99: v = LatencyHistogram_percentile(h, 0.99); break;
+    case PROBEMETRIC_P999: v = LatencyHistogram_percentile(h, 0.999); break;
+    case PROBEMETRIC_MAX: v = h->max; break;
+    default: break;
+    }
+    UA_free(h);
+
+    UA_StatusCode retval =
+        UA_Variant_setScalarCopy(&value->value, &v, &UA_TYPES[UA_TYPES_UINT64]);
+    value->hasValue = (retval == UA_STATUSCODE_GOOD);
+    if(sourceTimeStamp) {
+        value->sourceTimestamp = UA_DateTime_now();
+        value->hasSourceTimestamp = true;
+    }
+    return retval;
+}
+
+UA_StatusCode
+PubSubProbe_addDiagnosticsNodes(UA_Server *server, const UA_NodeId parent) {
+    UA_NodeId folderId;
+    UA_ObjectAttributes oAttr = UA_ObjectAttributes_default;
+    oAttr.displayName = UA_LOCALIZEDTEXT("en-US", "PubSubLatency");
+    UA_StatusCode retval =
+        UA_Server_addObjectNode(server, UA_NODEID_NULL, parent,
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                UA_QUALIFIEDNAME(1, "PubSubLatency"),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                                oAttr, NULL, &folderId);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    UA_DataSource dataSource;
+    dataSource.read = readProbeMetric;
+    dataSource.write = NULL;
+    for(size_t s = 0; s < PUBSUBPROBE_STAGES; s++) {
+        char *stageName = (char*)(uintptr_t)PubSubProbe_stageNames[s];
+        UA_NodeId stageId;
+        oAttr.displayName = UA_LOCALIZEDTEXT("en-US", stageName);
+        retval |= UA_Server_addObjectNode(server, UA_NODEID_NULL, folderId,
+                                          UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                          UA_QUALIFIEDNAME(1, stageName),
+                                          UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                                          oAttr, NULL, &stageId);
+        for(size_t m = 0; m < PROBEMETRICS; m++) {
+            char *metricName = (char*)(uintptr_t)probeMetricNames[m];
+            UA_VariableAttributes vAttr = UA_VariableAttributes_default;
+            vAttr.displayName = UA_LOCALIZEDTEXT("en-US", metricName);
+            vAttr.dataType = UA_TYPES[UA_TYPES_UINT64].typeId;
+            vAttr.accessLevel = UA_ACCESSLEVELMASK_READ;
+            retval |= UA_Server_addDataSourceVariableNode(
+                server, UA_NODEID_NULL, stageId,
+                UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                UA_QUALIFIEDNAME(1, metricName),
+                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE), vAttr,
+                dataSource, (void*)(uintptr_t)(s * PROBEMETRICS + m), NULL);
+        }
+    }
+    return retval;
+}
+
+/**
+ * Transport Probes
+ * ^^^^^^^^^^^^^^^^ */
+
+static UA_StatusCode
+probeSend(PubSubChannelWrap *wrap, UA_ExtensionObject *transportSettings,
+          const UA_ByteString *buf) {
+    PubSubProbe_recordSinceMark(PUBSUBPROBE_ENCODE);
+    PubSubProbeTime t = PUBSUBPROBE_START();
+    UA_StatusCode retval = wrap->send(wrap->channel, transportSettings, buf);
+    PUBSUBPROBE_STOP(PUBSUBPROBE_SEND, t);
+    return retval;
+}
+
+static UA_StatusCode
+probeReceive(PubSubChannelWrap *wrap, UA_ByteString *buf,
+             UA_ExtensionObject *transportSettings, UA_UInt32 timeout) {
+    return PubSubProbe_receive(wrap->channel, wrap->receive, buf,
+                               transportSettings, timeout);
+}
+
+static const PubSubTransportWrapper probeWrapper = {
+    "probe", NULL, probeSend, probeReceive, NULL
+};
+
+UA_PubSubTransportLayer
+PubSubProbe_wrapTransportLayer(UA_PubSubTransportLayer inner) {
+    return PubSubTransportWrap_layer(inner, &probeWrapper, NULL);
+}
@@ -0,0 +1,141 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_PROBE_H_
+#define PUBSUB_PROBE_H_
+
+#include <open62541/plugin/pubsub.h>
+#include <open62541/server.h>
+
+#include <time.h>
+#ifdef PUBSUBPROBE_USE_TSC
+#include <x86intrin.h>
+#endif
+
+#include "latency_histogram.h"
+
+/**
+ * PubSub Latency Probes
+ * ---------------------
+ * Low-overhead timing of the stages of the publish and subscribe path. Every
+ * thread records into its own set of histograms (in nanoseconds), so
+ * recording takes no lock and shares no cache line. Readers merge the
+ * histograms of all threads.
+ *
+ * While the probes are disabled, a probe point costs one predictable branch
+ * on a global flag. Timestamps come from CLOCK_MONOTONIC, or from the TSC
+ * when compiled with PUBSUBPROBE_USE_TSC.
+ *
+ * Stages that open62541 runs internally are timed at the boundaries that are
+ * visible from the outside. ``PubSubProbe_wrapTransportLayer`` times every
+ * send and receive of a channel. RECEIVE starts once the socket is readable,
+ * so it does not include the wait for the message. A received message sets a
+ * per-thread mark. Recording TARGETWRITE with ``PubSubProbe_recordSinceMark``
+ * then measures receive-to-TargetVariable, i.e. decode, dispatch and write
+ * together. A mark is recorded once and then cleared. In between,
+ * ``PubSubProbe_recordSplit`` cuts the span into consecutive stages. The
+ * server subscriber records DECODE up to the write of the first field and
+ * DISPATCH from there to the write of the last field.
+ *
+ * On the publisher, the publish pool (pubsub_publish_pool.h) samples and
+ * encodes the DataSets itself and records SAMPLE and ENCODE. For the
+ * WriterGroups of the server, the timer wheel of
+ * ``UA_ENABLE_PUBSUB_CUSTOM_PUBLISH_HANDLING`` sets the mark when a publish
+ * callback starts. ENCODE then measures sampling and encoding together up to
+ * the send. Without the timer wheel, these stages have no samples. */
+
+typedef enum {
+    PUBSUBPROBE_SAMPLE = 0,
+    PUBSUBPROBE_ENCODE,
+    PUBSUBPROBE_SEND,
+    PUBSUBPROBE_RECEIVE,
+    PUBSUBPROBE_DECODE,
+    PUBSUBPROBE_DISPATCH,
+    PUBSUBPROBE_TARGETWRITE
+} PubSubProbeStage;
+
+#define PUBSUBPROBE_STAGES 7
+
+extern const char *PubSubProbe_stageNames[PUBSUBPROBE_STAGES];
+
+extern UA_Boolean pubsubProbeEnabled;
+
+typedef UA_UInt64 PubSubProbeTime;
+
+static UA_INLINE PubSubProbeTime
+PubSubProbe_now(void) {
+#ifdef PUBSUBPROBE_USE_TSC
+    return (PubSubProbeTime)__rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (PubSubProbeTime)ts.tv_sec * 1000000000u + (PubSubProbeTime)ts.tv_nsec;
+#endif
+}
+
+/* Usage:
+ *
+ *   PubSubProbeTime t = PUBSUBPROBE_START();
+ *   ... work ...
+ *   PUBSUBPROBE_STOP(PUBSUBPROBE_DECODE, t); */
+#define PUBSUBPROBE_START() (UA_UNLIKELY(pubsubProbeEnabled) ? PubSubProbe_now() : 0)
+#define PUBSUBPROBE_STOP(STAGE, START) do {                 \
+        if(UA_UNLIKELY((START) != 0))                       \
+            PubSubProbe_record(STAGE, START);               \
+    } while(0)
+
+/* Calibrates the TSC (if used) and enables or disables all probes */
+void
+PubSubProbe_setEnabled(UA_Boolean enabled);
+
+void
+PubSubProbe_record(PubSubProbeStage stage, PubSubProbeTime start);
+
+/* Per-thread mark for stages that span a component boundary */
+void
+PubSubProbe_setMark(void);
+
+/* Records the time since the mark, if there is one, and clears it */
+void
+PubSubProbe_recordSinceMark(PubSubProbeStage stage);
+
+/* Records the time since the last split (or the mark) and starts the next
+ * split. The mark is kept. Does nothing without a mark. */
+void
+PubSubProbe_recordSplit(PubSubProbeStage stage);
+
+typedef UA_StatusCode
+(*PubSubProbeReceive)(UA_PubSubChannel *channel, UA_ByteString *buf,
+                      UA_ExtensionObject *transportSettings, UA_UInt32 timeout);
+
+/* Calls receive (the timeout is in us). With the probes enabled, it first
+ * waits for the socket of the channel, then times the call as RECEIVE and
+ * sets the mark if a message was received. */
+UA_StatusCode
+PubSubProbe_receive(UA_PubSubChannel *channel, PubSubProbeReceive receive,
+                    UA_ByteString *buf, UA_ExtensionObject *transportSettings,
+                    UA_UInt32 timeout);
+
+/* Merges the histograms of all threads for one stage */
+void
+PubSubProbe_collect(PubSubProbeStage stage, LatencyHistogram *out);
+
+/* Logs count and percentiles of all stages that have samples */
+void
+PubSubProbe_dump(const UA_Logger *logger);
+
+/* Dumps the probes every intervalMs from the server loop */
+UA_StatusCode
+PubSubProbe_addPeriodicDump(UA_Server *server, UA_Double intervalMs,
+                            UA_UInt64 *callbackId);
+
+/* Adds a "PubSubLatency" object below parent with one object per stage and
+ * the variables Count, P50Ns, P99Ns, P999Ns and MaxNs */
+UA_StatusCode
+PubSubProbe_addDiagnosticsNodes(UA_Server *server, const UA_NodeId parent);
+
+/* Times send and receive of all channels of the layer */
+UA_PubSubTransportLayer
+PubSubProbe_wrapTransportLayer(UA_PubSubTransportLayer inner);
+
+#endif /* PUBSUB_PROBE_H_ */
@@ -0,0 +1,677 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#define _GNU_SOURCE
+#include "pubsub_publish_pool.h"
+#include "concurrent_nodestore.h"
+#include "nodeid_intern.h"
+#include "pubsub_array_codec.h"
+#include "pubsub_json.h"
+#include "pubsub_probe.h"
+#include "pubsub_timer_wheel.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef CLOCK_TAI
+#define CLOCK_TAI 11
+#endif
+
+#define MAXHEADERSIZE 16    /* NetworkMessage up to the DataSetMessage */
+#define DSMHEADERSIZE 12    /* Flags, sequence number, timestamp */
+#define MESSAGESIZE (PUBSUBJSON_MAXHEADERSIZE + PUBSUBJSON_MAXTRAILERSIZE + \
+                     PUBSUBPUBLISHPOOL_MAXPAYLOAD)
+#define MAXSLEEP 100000000u /* ns, to notice the end of the pool */
+#define ARENAWARMUP 100     /* Samples until the arena size is fixed */
+
+/* Encoded fields of the last sample. Written by the sampling worker only. */
+typedef struct {
+    UA_UInt32 seq; /* Odd while the snapshot is written */
+    UA_UInt16 size;
+    UA_Byte data[PUBSUBPUBLISHPOOL_MAXPAYLOAD];
+} Snapshot;
+
+typedef struct {
+    UA_Server *server;
+    const NodeIdInternTable *nodeIds; /* Of the pool */
+    NodeIdHandle *fields;
+    const UA_Nodestore *nodestore; /* NULL to read through the server */
+    UA_Variant *reads;      /* Of the current sample, from the heap */
+    UA_Variant *values;     /* Copies of the reads in the arena */
+    size_t fieldsSize;
+    PubSubArena *arena;
+    PubSubJsonFields *json; /* NULL for UADP */
+    UA_Byte scratch[PUBSUBPUBLISHPOOL_MAXPAYLOAD];
+    Snapshot snapshot __attribute__((aligned(64)));
+} DataSet;
+
+typedef struct {
+    UA_Byte header[PUBSUBJSON_MAXHEADERSIZE];
+    size_t headerSize;
+    DataSet *dataSet;
+    UA_UInt16 writerGroupId;
+    UA_UInt16 sequenceNumber;
+} Group;
+
+/* The DataSets sampled and the groups published by a worker with the same
+ * interval. The samples are taken first. */
+typedef struct {
+    UA_UInt64 interval; /* ns */
+    UA_UInt64 next;     /* ns on CLOCK_TAI */
+    DataSet **dataSets;
+    size_t dataSetsSize;
+    Group *groups;
+    size_t groupsSize;
+} Cycle;
+
+typedef struct {
+    PubSubPublishPool *pool;
+    size_t index;
+    pthread_t thread;
+    UA_Boolean threadStarted;
+    UA_PubSubConnectionConfig connectionConfig;
+    UA_PubSubChannel *channel;
+    Cycle *cycles;
+    size_t cyclesSize;
+    UA_Double rate; /* Messages per second */
+    PubSubPublishPoolStats stats;
+    UA_Byte buffer[MESSAGESIZE];
+} Worker;
+
+struct PubSubPublishPool {
+    PubSubPublishPoolConfig config;
+    UA_NetworkAddressUrlDataType address;
+    UA_UInt16 *cpus;
+    NodeIdInternTable *nodeIds; /* The fields of all DataSets */
+    DataSet **dataSets;
+    size_t dataSetsSize;
+    Worker *workers;
+    UA_Boolean running;
+    UA_Boolean started;
+};
+
+static UA_UInt64
+taiNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_TAI, &ts);
+    return (UA_UInt64)ts.tv_sec * 1000000000ull + (UA_UInt64)ts.tv_nsec;
+}
+
+static void
+countStat(UA_UInt64 *counter, UA_UInt64 n) {
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+static void
+writeUInt16(UA_Byte **pos, UA_UInt16 v) {
+    (*pos)[0] = (UA_Byte)v;
+    (*pos)[1] = (UA_Byte)(v >> 8);
+    *pos += 2;
+}
+
+static void
+writeUInt64(UA_Byte **pos, UA_UInt64 v) {
+    for(size_t i = 0; i < 8; i++)
+        (*pos)[i] = (UA_Byte)(v >> (8 * i));
+    *pos += 8;
+}
+
+/************/
+/* Sampling */
+/************/
+
+static void
+writeSnapshot(Snapshot *s, const UA_Byte *data, UA_UInt16 size) {
+    UA_UInt32 seq = s->seq;
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(s->data, data, size);
+    s->size = size;
+    __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Returns the size of the copied snapshot, 0 before the first sample */
+static size_t
+readSnapshot(const Snapshot *s, UA_Byte *dst, UA_UInt64 *retries) {
+    for(;;) {
+        UA_UInt32 seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if(seq == 0)
+            return 0;
+        if(!(seq & 1)) {
+            size_t size = s->size;
+            if(size > PUBSUBPUBLISHPOOL_MAXPAYLOAD)
+                size = PUBSUBPUBLISHPOOL_MAXPAYLOAD;
+            memcpy(dst, s->data, size);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if(__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq)
+                return size;
+        }
+        (*retries)++;
+        sched_yield();
+    }
+}
+
+/* Same encoding as UA_encodeBinary of the Variant. One-dimensional numeric
+ * arrays are copied with the fast path of pubsub_array_codec.h. */
+static UA_StatusCode
+encodeVariant(const UA_Variant *value, UA_Byte **pos, const UA_Byte *end) {
+    if(value->type && value->arrayLength > 0 && value->arrayDimensionsSize == 0 &&
+       !UA_Variant_isScalar(value) && PubSubArrayCodec_supportsType(value->type)) {
+        if(*pos >= end)
+            return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+        UA_Byte *start = *pos;
+        *(*pos)++ = (UA_Byte)(value->type->typeId.identifier.numeric | 0x80); /* Array */
+        UA_StatusCode retval =
+            PubSubArrayCodec_encode(value->data, value->arrayLength, value->type,
+                                    PUBSUBARRAYCODEC_LITTLEENDIAN, pos, end);
+        if(retval != UA_STATUSCODE_GOOD)
+            *pos = start;
+        return retval;
+    }
+    size_t size = UA_calcSizeBinary(value, &UA_TYPES[UA_TYPES_VARIANT]);
+    if(size > (size_t)(end - *pos))
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+    UA_ByteString view = {size, *pos};
+    UA_StatusCode retval = UA_encodeBinary(value, &UA_TYPES[UA_TYPES_VARIANT], &view);
+    *pos += size;
+    return retval;
+}
+
+/* Runs on the worker of the DataSet. Reads all fields first and encodes them
+ * afterwards, so that the probes time the two stages apart.
+ *
+ * The arena is only entered to copy the values and encode them. The reads
+ * run outside of it: value callbacks store values in the nodestore, and the
+ * server, the probes and the nodestore epochs keep per-thread state that
+ * must outlive the cycle. */
+static void
+sampleDataSet(DataSet *ds, UA_Boolean lockServer) {
+    /* A field that cannot be read is sent as an empty Variant. The
+     * concurrent nodestore is read without the server lock. DataSources and
+     * value callbacks are left to the server, read with the server lock of
+     * the timer wheel. */
+    PubSubProbeTime probeTime = PUBSUBPROBE_START();
+    UA_Boolean locked = false;
+    for(size_t i = 0; i < ds->fieldsSize; i++) {
+        UA_Variant_init(&ds->reads[i]);
+        const UA_NodeId *field = NodeIdIntern_get(ds->nodeIds, ds->fields[i]);
+        if(ds->nodestore) {
+            UA_DataValue dv;
+            UA_DataValue_init(&dv);
+            if(ConcurrentNodestore_readValue(ds->nodestore, field,
+                                             NodeIdIntern_hash(ds->nodeIds, ds->fields[i]),
+                                             &dv) == UA_STATUSCODE_GOOD) {
+                ds->reads[i] = dv.value;
+                UA_Variant_init(&dv.value);
+                UA_DataValue_clear(&dv);
+                continue;
+            }
+        }
+        if(lockServer && !locked) {
+            PubSubTimerWheel_lockServer();
+            locked = true;
+        }
+        UA_Server_readValue(ds->server, *field, &ds->reads[i]);
+    }
+    if(locked)
+        PubSubTimerWheel_unlockServer();
+    PUBSUBPROBE_STOP(PUBSUBPROBE_SAMPLE, probeTime);
+
+    probeTime = PUBSUBPROBE_START();
+    if(ds->arena) {
+        /* The copies and whatever the encoders allocate */
+        PubSubArena_enter(ds->arena);
+        for(size_t i = 0; i < ds->fieldsSize; i++) {
+            UA_Variant_init(&ds->values[i]);
+            UA_Variant_copy(&ds->reads[i], &ds->values[i]);
+        }
+    }
+    const UA_Variant *values = ds->arena ? ds->values : ds->reads;
+    UA_Byte *pos = ds->scratch;
+    const UA_Byte *end = &ds->scratch[PUBSUBPUBLISHPOOL_MAXPAYLOAD];
+    if(!ds->json)
+        writeUInt16(&pos, (UA_UInt16)ds->fieldsSize);
+    size_t i = 0;
+    for(; i < ds->fieldsSize; i++) {
+        const UA_Variant *value = &values[i];
+        UA_StatusCode retval = ds->json ?
+            PubSubJsonFields_encode(ds->json, i, value, &pos, end) :
+            encodeVariant(value, &pos, end);
+        if(retval != UA_STATUSCODE_GOOD)
+            break;
+    }
+    if(ds->arena)
+        PubSubArena_leave();
+    PUBSUBPROBE_STOP(PUBSUBPROBE_ENCODE, probeTime);
+    if(i < ds->fieldsSize)
+        UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                       "Publish pool: cannot encode field %lu of the DataSet",
+                       (unsigned long)i);
+
+    for(size_t j = 0; j < ds->fieldsSize; j++)
+        UA_Variant_clear(&ds->reads[j]);
+    if(ds->arena)
+        PubSubArena_reset(ds->arena); /* Releases the copies */
+
+    /* Keep the last snapshot if a field could not be encoded */
+    if(i == ds->fieldsSize)
+        writeSnapshot(&ds->snapshot, ds->scratch, (UA_UInt16)(pos - ds->scratch));
+}
+
+/**************/
+/* Publishing */
+/**************/
+
+static void
+publishGroup(Worker *w, Group *g) {
+    UA_Byte *pos = w->buffer;
+    memcpy(pos, g->header, g->headerSize);
+    pos += g->headerSize;
+    UA_DateTime now = UA_DateTime_now();
+    if(!g->dataSet->json) {
+        *pos++ = 0x01 | 0x08 | 0x80; /* Valid, Variant fields, SequenceNumber, Flags2 */
+        *pos++ = 0x10;               /* KeyFrame with Timestamp */
+        writeUInt16(&pos, g->sequenceNumber);
+        writeUInt64(&pos, (UA_UInt64)now);
+    }
+
+    UA_UInt64 retries = 0;
+    size_t size = readSnapshot(&g->dataSet->snapshot, pos, &retries);
+    if(retries > 0)
+        countStat(&w->stats.snapshotRetries, retries);
+    if(size == 0)
+        return;
+    pos += size;
+
+    /* The JSON DataSetMessage ends with the sequence number and timestamp */
+    if(g->dataSet->json)
+        PubSubJson_encodeTrailer(w->pool->config.publisherId, g->writerGroupId,
+                                 g->sequenceNumber, now, &pos,
+                                 &w->buffer[MESSAGESIZE]);
+    g->sequenceNumber++;
+
+    UA_ByteString msg = {(size_t)(pos - w->buffer), w->buffer};
+    if(w->channel->send(w->channel, NULL, &msg) != UA_STATUSCODE_GOOD) {
+        countStat(&w->stats.sendErrors, 1);
+        return;
+    }
+    countStat(&w->stats.messages, 1);
+    countStat(&w->stats.bytes, msg.length);
+}
+
+static void *
+workerThread(void *data) {
+    Worker *w = (Worker*)data;
+    while(__atomic_load_n(&w->pool->running, __ATOMIC_ACQUIRE)) {
+        UA_UInt64 now = taiNow();
+        UA_UInt64 next = now + MAXSLEEP;
+        for(size_t i = 0; i < w->cyclesSize; i++) {
+            if(w->cycles[i].next < next)
+                next = w->cycles[i].next;
+        }
+        if(next > now) {
+            struct timespec ts;
+            ts.tv_sec = (time_t)(next / 1000000000ull);
+            ts.tv_nsec = (long)(next % 1000000000ull);
+            clock_nanosleep(CLOCK_TAI, TIMER_ABSTIME, &ts, NULL);
+            now = taiNow();
+        }
+
+        for(size_t i = 0; i < w->cyclesSize; i++) {
+            Cycle *c = &w->cycles[i];
+            if(c->next > now)
+                continue;
+            for(size_t j = 0; j < c->dataSetsSize; j++)
+                sampleDataSet(c->dataSets[j], true);
+            for(size_t j = 0; j < c->groupsSize; j++)
+                publishGroup(w, &c->groups[j]);
+            UA_UInt64 nextCycle = now / c->interval + 1;
+            if(nextCycle > c->next / c->interval + 1)
+                countStat(&w->stats.skipped, nextCycle - c->next / c->interval - 1);
+            c->next = nextCycle * c->interval;
+        }
+
+        /* Layers that buffer the sent messages, e.g. pubsub_mqtt.h, write
+         * the messages of all groups of the tick at once */
+        if(w->channel->yield)
+            w->channel->yield(w->channel, 0);
+        __atomic_store_n(&w->stats.cpu, (UA_UInt16)sched_getcpu(), __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/*********/
+/* Setup */
+/*********/
+
+PubSubPublishPool *
+PubSubPublishPool_new(const PubSubPublishPoolConfig *config) {
+    if(config->workers == 0 || config->workers > PUBSUBPUBLISHPOOL_MAXWORKERS)
+        return NULL;
+    PubSubPublishPool *pool = (PubSubPublishPool*)UA_calloc(1, sizeof(PubSubPublishPool));
+    if(!pool)
+        return NULL;
+    pool->config = *config;
+    pool->workers = (Worker*)UA_calloc(config->workers, sizeof(Worker));
+    if(config->cpusSize > 0)
+        pool->cpus = (UA_UInt16*)UA_calloc(config->cpusSize, sizeof(UA_UInt16));
+    pool->nodeIds = NodeIdIntern_new(16);
+    if(!pool->workers || (config->cpusSize > 0 && !pool->cpus) || !pool->nodeIds ||
+       UA_NetworkAddressUrlDataType_copy(&config->address, &pool->address) !=
+       UA_STATUSCODE_GOOD) {
+        if(pool->nodeIds)
+            NodeIdIntern_delete(pool->nodeIds);
+        UA_free(pool->workers);
+        UA_free(pool->cpus);
+        UA_free(pool);
+        return NULL;
+    }
+    if(config->cpusSize > 0)
+        memcpy(pool->cpus, config->cpus, config->cpusSize * sizeof(UA_UInt16));
+    pool->config.cpus = pool->cpus;
+    for(size_t i = 0; i < config->workers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+    }
+    return pool;
+}
+
+void
+PubSubPublishPool_delete(PubSubPublishPool *pool) {
+    __atomic_store_n(&pool->running, false, __ATOMIC_RELEASE);
+    for(size_t i = 0; i < pool->config.workers; i++) {
+        Worker *w = &pool->workers[i];
+        if(w->threadStarted)
+            pthread_join(w->thread, NULL);
+        if(w->channel)
+            w->channel->close(w->channel);
+        for(size_t j = 0; j < w->cyclesSize; j++) {
+            UA_free(w->cycles[j].dataSets);
+            UA_free(w->cycles[j].groups);
+        }
+        UA_free(w->cycles);
+    }
+    for(size_t i = 0; i < pool->dataSetsSize; i++) {
+        DataSet *ds = pool->dataSets[i];
+        UA_free(ds->fields);
+        UA_free(ds->reads);
+        UA_free(ds->values);
+        if(ds->arena)
+            PubSubArena_delete(ds->arena);
+        if(ds->json)
+            PubSubJsonFields_delete(ds->json);
+        UA_free(ds);
+    }
+    UA_free(pool->dataSets);
+    NodeIdIntern_delete(pool->nodeIds);
+    UA_NetworkAddressUrlDataType_clear(&pool->address);
+    UA_free(pool->cpus);
+    UA_free(pool->workers);
+    UA_free(pool);
+}
+
+/* The keys of the fields are the BrowseNames of the nodes */
+static PubSubJsonFields *
+newJsonFields(UA_Server *server, const UA_NodeId *fields, size_t fieldsSize,
+              UA_Boolean reversible) {
+    UA_QualifiedName *names = (UA_QualifiedName*)
+        UA_Array_new(fieldsSize, &UA_TYPES[UA_TYPES_QUALIFIEDNAME]);
+    UA_String *keys = (UA_String*)UA_calloc(fieldsSize, sizeof(UA_String));
+    PubSubJsonFields *json = NULL;
+    if(names && keys) {
+        for(size_t i = 0; i < fieldsSize; i++) {
+            UA_Server_readBrowseName(server, fields[i], &names[i]);
+            keys[i] = names[i].name;
+        }
+        json = PubSubJsonFields_new(fieldsSize, keys, reversible);
+    }
+    UA_free(keys);
+    UA_Array_delete(names, fieldsSize, &UA_TYPES[UA_TYPES_QUALIFIEDNAME]);
+    return json;
+}
+
+/* The worker with the lowest message and sample rate */
+static Worker *
+leastLoadedWorker(PubSubPublishPool *pool) {
+    Worker *w = &pool->workers[0];
+    for(size_t i = 1; i < pool->config.workers; i++) {
+        if(pool->workers[i].rate < w->rate)
+            w = &pool->workers[i];
+    }
+    return w;
+}
+
+static Cycle *
+getCycle(Worker *w, UA_Double interval_ms) {
+    UA_UInt64 interval = (UA_UInt64)(interval_ms * 1000000.0);
+    for(size_t i = 0; i < w->cyclesSize; i++) {
+        if(w->cycles[i].interval == interval)
+            return &w->cycles[i];
+    }
+    Cycle *cycles = (Cycle*)UA_realloc(w->cycles, (w->cyclesSize + 1) * sizeof(Cycle));
+    if(!cycles)
+        return NULL;
+    w->cycles = cycles;
+    Cycle *c = &w->cycles[w->cyclesSize++];
+    memset(c, 0, sizeof(Cycle));
+    c->interval = interval;
+    return c;
+}
+
+UA_StatusCode
+PubSubPublishPool_addDataSet(PubSubPublishPool *pool, UA_Server *server,
+                             const UA_NodeId *fields, size_t fieldsSize,
+                             UA_Double samplingInterval, size_t *dataSet) {
+    if(pool->started || fieldsSize == 0 || fieldsSize > UA_UINT16_MAX ||
+       !(samplingInterval > 0.0))
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    DataSet **dataSets = (DataSet**)
+        UA_realloc(pool->dataSets, (pool->dataSetsSize + 1) * sizeof(DataSet*));
+    if(!dataSets)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    pool->dataSets = dataSets;
+
+    DataSet *ds = (DataSet*)UA_calloc(1, sizeof(DataSet));
+    if(!ds)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    ds->server = server;
+    ds->nodeIds = pool->nodeIds;
+    ds->nodestore = pool->config.nodestore;
+    ds->fieldsSize = fieldsSize;
+    ds->fields = (NodeIdHandle*)UA_calloc(fieldsSize, sizeof(NodeIdHandle));
+    ds->reads = (UA_Variant*)UA_calloc(fieldsSize, sizeof(UA_Variant));
+    ds->values = (UA_Variant*)UA_calloc(fieldsSize, sizeof(UA_Variant));
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    if(!ds->fields || !ds->reads || !ds->values)
+        retval = UA_STATUSCODE_BADOUTOFMEMORY;
+    /* Hashed once here. DataSets with common fields share the entries. */
+    for(size_t i = 0; i < fieldsSize && retval == UA_STATUSCODE_GOOD; i++)
+        retval = NodeIdIntern_intern(pool->nodeIds, &fields[i], &ds->fields[i]);
+    if(retval == UA_STATUSCODE_GOOD && pool->config.arenaSize > 0) {
+        ds->arena = PubSubArena_new(pool->config.arenaSize, pool->config.arenaMode,
+                                    ARENAWARMUP);
+        if(!ds->arena)
+            retval = UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    if(retval == UA_STATUSCODE_GOOD && pool->config.encoding != PUBSUBPUBLISHPOOL_UADP) {
+        ds->json = newJsonFields(server, fields, fieldsSize,
+                                 pool->config.encoding == PUBSUBPUBLISHPOOL_JSON);
+        if(!ds->json)
+            retval = UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    Worker *w = leastLoadedWorker(pool);
+    Cycle *c = NULL;
+    DataSet **cycleDataSets = NULL;
+    if(retval == UA_STATUSCODE_GOOD) {
+        c = getCycle(w, samplingInterval);
+        if(c)
+            cycleDataSets = (DataSet**)
+                UA_realloc(c->dataSets, (c->dataSetsSize + 1) * sizeof(DataSet*));
+        if(!cycleDataSets)
+            retval = UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    if(retval != UA_STATUSCODE_GOOD) {
+        if(ds->arena)
+            PubSubArena_delete(ds->arena);
+        if(ds->json)
+            PubSubJsonFields_delete(ds->json);
+        UA_free(ds->reads);
+        UA_free(ds->values);
+        UA_free(ds->fields);
+        UA_free(ds);
+        return retval;
+    }
+
+    c->dataSets = cycleDataSets;
+    c->dataSets[c->dataSetsSize++] = ds;
+    w->rate += 1000.0 / samplingInterval;
+
+    /* Take the first sample right away. The workers are not running and
+     * the caller is the server thread. */
+    sampleDataSet(ds, false);
+    if(dataSet)
+        *dataSet = pool->dataSetsSize;
+    pool->dataSets[pool->dataSetsSize++] = ds;
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+writeGroupHeader(Group *g, UA_UInt32 publisherId, UA_UInt16 writerGroupId,
+                 UA_UInt16 dataSetWriterId) {
+    UA_Byte *pos = g->header;
+    /* Version 1, PublisherId, GroupHeader, PayloadHeader, ExtendedFlags1 */
+    *pos++ = 0x01 | 0x10 | 0x20 | 0x40 | 0x80;
+    if(publisherId <= UA_UINT16_MAX) {
+        *pos++ = 0x01;
+        writeUInt16(&pos, (UA_UInt16)publisherId);
+    } else {
+        *pos++ = 0x02;
+        writeUInt16(&pos, (UA_UInt16)publisherId);
+        writeUInt16(&pos, (UA_UInt16)(publisherId >> 16));
+    }
+    *pos++ = 0x01; /* GroupFlags: WriterGroupId */
+    writeUInt16(&pos, writerGroupId);
+    *pos++ = 1;    /* PayloadHeader: one DataSetMessage */
+    writeUInt16(&pos, dataSetWriterId);
+    g->headerSize = (size_t)(pos - g->header);
+}
+
+UA_StatusCode
+PubSubPublishPool_addWriterGroup(PubSubPublishPool *pool, UA_UInt16 writerGroupId,
+                                 UA_UInt16 dataSetWriterId, size_t dataSet,
+                                 UA_Double publishingInterval) {
+    if(pool->started || dataSet >= pool->dataSetsSize || !(publishingInterval > 0.0))
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+
+    Worker *w = leastLoadedWorker(pool);
+    Cycle *c = getCycle(w, publishingInterval);
+    if(!c)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    Group *groups = (Group*)UA_realloc(c->groups, (c->groupsSize + 1) * sizeof(Group));
+    if(!groups)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    c->groups = groups;
+    Group *g = &c->groups[c->groupsSize++];
+    memset(g, 0, sizeof(Group));
+    g->dataSet = pool->dataSets[dataSet];
+    g->writerGroupId = writerGroupId;
+    if(g->dataSet->json) {
+        UA_Byte *pos = g->header;
+        PubSubJson_encodeHeader(pool->config.publisherId, dataSetWriterId, &pos,
+                                &g->header[PUBSUBJSON_MAXHEADERSIZE]);
+        g->headerSize = (size_t)(pos - g->header);
+    } else {
+        writeGroupHeader(g, pool->config.publisherId, writerGroupId, dataSetWriterId);
+    }
+    w->rate += 1000.0 / publishingInterval;
+    w->stats.groups++;
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+PubSubPublishPool_start(PubSubPublishPool *pool) {
+    if(pool->started)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    pool->started = true;
+
+    /* One channel per worker. Workers without cycles are not started. */
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    for(size_t i = 0; i < pool->config.workers; i++) {
+        Worker *w = &pool->workers[i];
+        if(w->cyclesSize == 0)
+            continue;
+        w->connectionConfig.name = UA_STRING("Publish Pool");
+        w->connectionConfig.enabled = true;
+        w->connectionConfig.transportProfileUri =
+            pool->config.transportLayer.transportProfileUri;
+        w->connectionConfig.publisherId.numeric = pool->config.publisherId;
+        UA_Variant_setScalar(&w->connectionConfig.address, &pool->address,
+                             &UA_TYPES[UA_TYPES_NETWORKADDRESSURLDATATYPE]);
+        w->channel = pool->config.transportLayer.createPubSubChannel(&w->connectionConfig);
+        if(!w->channel) {
+            UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                         "Publish pool: cannot create the channel of worker %lu",
+                         (unsigned long)i);
+            retval = UA_STATUSCODE_BADINTERNALERROR;
+            break;
+        }
+        UA_UInt64 now = taiNow();
+        for(size_t j = 0; j < w->cyclesSize; j++)
+            w->cycles[j].next = (now / w->cycles[j].interval + 1) * w->cycles[j].interval;
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    __atomic_store_n(&pool->running, true, __ATOMIC_RELEASE);
+    for(size_t i = 0; i < pool->config.workers; i++) {
+        Worker *w = &pool->workers[i];
+        if(!w->channel)
+            continue;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if(pool->config.cpusSize > 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(pool->cpus[i % pool->config.cpusSize], &cpus);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpus);
+        }
+        int res = pthread_create(&w->thread, &attr, workerThread, w);
+        pthread_attr_destroy(&attr);
+        if(res != 0) {
+            UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                         "Publish pool: cannot start worker %lu", (unsigned long)i);
+            return UA_STATUSCODE_BADINTERNALERROR;
+        }
+        w->threadStarted = true;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+PubSubPublishPool_getStats(const PubSubPublishPool *pool, size_t worker,
+                           PubSubPublishPoolStats *stats) {
+    if(worker >= pool->config.workers)
+        return UA_STATUSCODE_BADNOTFOUND;
+    const PubSubPublishPoolStats *s = &pool->workers[worker].stats;
+    stats->cpu = __atomic_load_n(&s->cpu, __ATOMIC_RELAXED);
+    stats->groups = s->groups;
+    stats->messages = __atomic_load_n(&s->messages, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&s->bytes, __ATOMIC_RELAXED);
+    stats->sendErrors = __atomic_load_n(&s->sendErrors, __ATOMIC_RELAXED);
+    stats->snapshotRetries = __atomic_load_n(&s->snapshotRetries, __ATOMIC_RELAXED);
+    stats->skipped = __atomic_load_n(&s->skipped, __ATOMIC_RELAXED);
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+PubSubPublishPool_getArenaStats(const PubSubPublishPool *pool, size_t dataSet,
+                                PubSubArenaStats *stats) {
+    if(dataSet >= pool->dataSetsSize || !pool->dataSets[dataSet]->arena)
+        return UA_STATUSCODE_BADNOTFOUND;
+    PubSubArena_getStats(pool->dataSets[dataSet]->arena, stats);
+    return UA_STATUSCODE_GOOD;
+}
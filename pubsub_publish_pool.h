@@ -0,0 +1,132 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_PUBLISH_POOL_H_
+#define PUBSUB_PUBLISH_POOL_H_
+
+#include <open62541/plugin/pubsub.h>
+#include <open62541/server.h>
+
+#include "pubsub_arena.h"
+
+/**
+ * Publish Worker Pool
+ * -------------------
+ * The WriterGroups of a server are published from one thread, the server
+ * thread or the timer wheel (pubsub_timer_wheel.h), so a publisher uses one
+ * core however many groups it has. The publish callbacks of the WriterGroups
+ * cannot be spread over threads: they share the channel of their
+ * PubSubConnection and the PubSub state of the server. The pool is a
+ * separate publisher instead. Its groups are not WriterGroups of the server.
+ * They are sharded over a number of worker threads, each with its own
+ * PubSubChannel (and socket) of the configured transport layer and its own
+ * message buffer. Worker ``i`` can be pinned to ``cpus[i % cpusSize]``.
+ *
+ * Sampling and encoding run on the workers as well. Every DataSet is
+ * sampled by one worker, in the cycle of its samplingInterval and before
+ * the groups of that cycle. The concurrent nodestore is read without a
+ * lock. Otherwise the worker reads through the server with the server lock
+ * of the timer wheel, so the server must run with
+ * ``PubSubTimerWheel_runServer``. The values are encoded once into a
+ * snapshot of the DataSetMessage payload that is protected by a sequence
+ * lock. The workers copy the snapshot into their messages without taking a
+ * lock and retry if it was written in the meantime. All groups of a DataSet
+ * publish the same sample, however many workers they are spread over. The
+ * NodeIds of the fields are interned (nodeid_intern.h) when the DataSet is
+ * added, so the sampling does not hash them again.
+ *
+ * The messages have the layout of ``tutorial_pubsub_publish.c``: UADP with
+ * PublisherId, WriterGroupId and one DataSetMessage per NetworkMessage,
+ * with sequence number and timestamp, fields in Variant encoding. Each group
+ * and each DataSet goes to the worker with the lowest rate of messages and
+ * samples. Groups with the same publishingInterval are published in the
+ * same cycle, aligned to multiples of the interval on CLOCK_TAI.
+ *
+ * With the JSON encodings, the messages are JSON NetworkMessages of one
+ * DataSetMessage (see pubsub_json.h) instead. The encoding is chosen for
+ * all groups of the pool. The keys of the fields are
+ * the BrowseNames of the nodes. The sample holds the formatted fields, and
+ * the header of every group is formatted when the group is added. The
+ * workers only format the trailer.
+ *
+ * DataSets and groups are added from the server thread before the pool is
+ * started.
+ *
+ * With ``arenaSize > 0`` the Variant copies of a sample are allocated from
+ * a cycle arena of the DataSet (see pubsub_arena.h), which is reset after
+ * the snapshot is written. PubSubArena_install must have been called. The
+ * reads themselves run outside the arena, as the server and the value
+ * callbacks may keep what they allocate. */
+
+#define PUBSUBPUBLISHPOOL_MAXWORKERS 64
+#define PUBSUBPUBLISHPOOL_MAXPAYLOAD 1400 /* Encoded fields of a DataSet */
+
+typedef enum {
+    PUBSUBPUBLISHPOOL_UADP = 0,
+    PUBSUBPUBLISHPOOL_JSON,              /* Reversible JSON */
+    PUBSUBPUBLISHPOOL_JSON_NONREVERSIBLE
+} PubSubPublishPoolEncoding;
+
+typedef struct {
+    size_t workers;
+    const UA_UInt16 *cpus; /* Affinity of the workers, NULL to not pin them */
+    size_t cpusSize;
+    UA_PubSubTransportLayer transportLayer;
+    UA_NetworkAddressUrlDataType address;
+    UA_UInt32 publisherId;
+    size_t arenaSize;           /* Initial size, 0 samples from the heap */
+    PubSubArenaMode arenaMode;
+    PubSubPublishPoolEncoding encoding;
+    /* The concurrent nodestore of the server (concurrent_nodestore.h), to
+     * sample without the server lock. NULL reads through the server. */
+    const UA_Nodestore *nodestore;
+} PubSubPublishPoolConfig;
+
+typedef struct {
+    UA_UInt16 cpu;          /* Where the worker last ran */
+    size_t groups;
+    UA_UInt64 messages;
+    UA_UInt64 bytes;
+    UA_UInt64 sendErrors;
+    UA_UInt64 snapshotRetries; /* Reads that raced with a sample */
+    UA_UInt64 skipped;      /* Cycles missed because the worker was late */
+} PubSubPublishPoolStats;
+
+typedef struct PubSubPublishPool PubSubPublishPool;
+
+/* The address in the config is copied */
+PubSubPublishPool *
+PubSubPublishPool_new(const PubSubPublishPoolConfig *config);
+
+/* Stops the workers */
+void
+PubSubPublishPool_delete(PubSubPublishPool *pool);
+
+/* Samples the value attribute of the nodes every samplingInterval ms on a
+ * worker. The first sample is taken right away. Returns the index of the
+ * DataSet. */
+UA_StatusCode
+PubSubPublishPool_addDataSet(PubSubPublishPool *pool, UA_Server *server,
+                             const UA_NodeId *fields, size_t fieldsSize,
+                             UA_Double samplingInterval, size_t *dataSet);
+
+UA_StatusCode
+PubSubPublishPool_addWriterGroup(PubSubPublishPool *pool, UA_UInt16 writerGroupId,
+                                 UA_UInt16 dataSetWriterId, size_t dataSet,
+                                 UA_Double publishingInterval);
+
+/* Creates the channels and starts the workers */
+UA_StatusCode
+PubSubPublishPool_start(PubSubPublishPool *pool);
+
+UA_StatusCode
+PubSubPublishPool_getStats(const PubSubPublishPool *pool, size_t worker,
+                           PubSubPublishPoolStats *stats);
+
+/* The statistics are read while the worker samples, the counters may be
+ * from different cycles. Returns BADNOTFOUND if the DataSet has no arena. */
+UA_StatusCode
+PubSubPublishPool_getArenaStats(const PubSubPublishPool *pool, size_t dataSet,
+                                PubSubArenaStats *stats);
+
+#endif /* PUBSUB_PUBLISH_POOL_H_ */
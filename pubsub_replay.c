@@ -0,0 +1,246 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+/**
+ * PubSub Replay
+ * -------------
+ * Sends the NetworkMessages of a capture (see pubsub_capture.h) again, as
+ * they were received, through the UDP, Ethernet or MQTT transport:
+ *
+ * - By default with the original pauses between the messages.
+ *   ``--speed=<factor>`` scales the pace, e.g. 2 for twice as fast.
+ * - ``--max`` sends as fast as the transport takes the messages.
+ * - ``--skip=<s>`` starts s seconds into the capture. ``--loop`` starts
+ *   over at the end.
+ *
+ * With ``--decode``, nothing is sent. The messages are decoded with
+ * ``UA_NetworkMessage_decodeBinary`` as in pubsub_subscribe_standalone.c,
+ * over and over for ``--duration`` seconds, and the run is reported as one
+ * JSON object::
+ *
+ *   {"records":12000,"passes":41,"nsPerMsg":812.4,"bytesPerMsg":57,
+ *    "decodeErrors":0}
+ *
+ * A capture is recorded with ``pubsub_subscribe_standalone --capture=<path>``.
+ * Run step of the application is as mentioned below:
+ *
+ * ./pubsub_replay /tmp/traffic opc.udp://224.0.0.22:4840/ --speed=10 */
+
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/plugin/pubsub_udp.h>
+
+#include <open62541/ua_pubsub_networkmessage.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pubsub_capture.h"
+#include "pubsub_mqtt.h"
+
+#ifdef UA_ENABLE_PUBSUB_ETH_UADP
+#include <open62541/plugin/pubsub_ethernet.h>
+#endif
+
+UA_Boolean running = true;
+static void stopHandler(int sign) {
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND, "received ctrl-c");
+    running = false;
+}
+
+static UA_Double speed = 1.0;   /* 0 for --max */
+static UA_Double skip = 0.0;    /* s */
+static UA_Double duration = 1.0;
+static UA_Boolean loop = false;
+
+static UA_UInt64
+nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UA_UInt64)ts.tv_sec * 1000000000 + (UA_UInt64)ts.tv_nsec;
+}
+
+static void
+sleepUntil(UA_UInt64 ns) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(ns / 1000000000);
+    ts.tv_nsec = (long)(ns % 1000000000);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static int
+decode(PubSubCaptureReader *reader) {
+    UA_DateTime start = PubSubCaptureReader_startTime(reader) +
+        (UA_DateTime)(skip * UA_DATETIME_SEC);
+    UA_UInt64 records = 0;
+    UA_UInt64 bytes = 0;
+    UA_UInt64 errors = 0;
+    UA_UInt64 passes = 0;
+    UA_UInt64 ns = 0;
+    UA_UInt64 begin = nowNs();
+    while(running && (passes == 0 || ns < (UA_UInt64)(duration * 1e9))) {
+        if(PubSubCaptureReader_seek(reader, start) != UA_STATUSCODE_GOOD)
+            break;
+        UA_DateTime receiveTime;
+        UA_ByteString message;
+        while(PubSubCaptureReader_next(reader, &receiveTime, &message)) {
+            UA_NetworkMessage networkMessage;
+            memset(&networkMessage, 0, sizeof(UA_NetworkMessage));
+            size_t offset = 0;
+            if(UA_NetworkMessage_decodeBinary(&message, &offset, &networkMessage) !=
+               UA_STATUSCODE_GOOD)
+                errors++;
+            UA_NetworkMessage_clear(&networkMessage);
+            records++;
+            bytes += message.length;
+        }
+        passes++;
+        ns = nowNs() - begin;
+    }
+    if(records == 0) {
+        printf("Error: no records to decode\n");
+        return EXIT_FAILURE;
+    }
+    printf("{\"records\":%lu,\"passes\":%lu,\"nsPerMsg\":%.1f,\"bytesPerMsg\":%lu,"
+           "\"decodeErrors\":%lu}\n", (unsigned long)(records / passes),
+           (unsigned long)passes, (UA_Double)ns / (UA_Double)records,
+           (unsigned long)(bytes / records), (unsigned long)(errors / passes));
+    return EXIT_SUCCESS;
+}
+
+static int
+replay(PubSubCaptureReader *reader, UA_PubSubChannel *channel) {
+    UA_DateTime start = PubSubCaptureReader_startTime(reader) +
+        (UA_DateTime)(skip * UA_DATETIME_SEC);
+    UA_UInt64 messages = 0;
+    UA_UInt64 bytes = 0;
+    UA_UInt64 errors = 0;
+    UA_UInt64 begin = nowNs();
+    do {
+        if(PubSubCaptureReader_seek(reader, start) != UA_STATUSCODE_GOOD)
+            break;
+        UA_UInt64 passBegin = nowNs();
+        UA_DateTime first = 0;
+        UA_DateTime receiveTime;
+        UA_ByteString message;
+        while(running && PubSubCaptureReader_next(reader, &receiveTime, &message)) {
+            if(first == 0)
+                first = receiveTime;
+            if(speed > 0 && receiveTime > first) {
+                UA_UInt64 due = passBegin +
+                    (UA_UInt64)((UA_Double)(receiveTime - first) * 100.0 / speed);
+                if(due > nowNs()) {
+                    /* Write what the transport buffered before the pause */
+                    if(channel->yield)
+                        channel->yield(channel, 0);
+                    sleepUntil(due);
+                }
+            }
+            if(channel->send(channel, NULL, &message) == UA_STATUSCODE_GOOD) {
+                messages++;
+                bytes += message.length;
+            } else {
+                errors++;
+            }
+        }
+    } while(running && loop);
+
+    UA_Double seconds = (UA_Double)(nowNs() - begin) / 1e9;
+
+    /* Flush, and wait up to a second for the acks of an MQTT channel */
+    if(channel->yield)
+        channel->yield(channel, 0);
+    PubSubMqttStats mqttStats;
+    for(int i = 0; i < 10 && PubSubMqtt_getStats(channel, &mqttStats) == UA_STATUSCODE_GOOD &&
+            mqttStats.inflight > 0; i++)
+        channel->yield(channel, 100);
+    printf("{\"messages\":%lu,\"bytes\":%lu,\"sendErrors\":%lu,\"seconds\":%.3f,"
+           "\"messagesPerSecond\":%.1f}\n", (unsigned long)messages,
+           (unsigned long)bytes, (unsigned long)errors, seconds,
+           seconds > 0 ? (UA_Double)messages / seconds : 0.0);
+    return EXIT_SUCCESS;
+}
+
+static void
+usage(char *progname) {
+    printf("usage: %s <capture> <uri> [device] [--speed=1] [--max] [--skip=<s>] [--loop]\n"
+           "       %s <capture> --decode [--skip=<s>] [--duration=1]\n",
+           progname, progname);
+}
+
+int main(int argc, char **argv) {
+    signal(SIGINT, stopHandler);
+    signal(SIGTERM, stopHandler);
+
+    UA_Boolean decodeOnly = false;
+    int args = 1;
+    for(int i = 1; i < argc; i++) {
+        if(strncmp(argv[i], "--speed=", 8) == 0)
+            speed = strtod(&argv[i][8], NULL);
+        else if(strcmp(argv[i], "--max") == 0)
+            speed = 0;
+        else if(strncmp(argv[i], "--skip=", 7) == 0)
+            skip = strtod(&argv[i][7], NULL);
+        else if(strcmp(argv[i], "--loop") == 0)
+            loop = true;
+        else if(strcmp(argv[i], "--decode") == 0)
+            decodeOnly = true;
+        else if(strncmp(argv[i], "--duration=", 11) == 0)
+            duration = strtod(&argv[i][11], NULL);
+        else
+            argv[args++] = argv[i];
+    }
+    argc = args;
+    if(argc < (decodeOnly ? 2 : 3) || strcmp(argv[1], "-h") == 0 ||
+       speed < 0 || skip < 0 || duration <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    PubSubCaptureReader *reader = PubSubCaptureReader_open(argv[1]);
+    if(!reader) {
+        printf("Error: cannot open the capture %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    if(decodeOnly) {
+        int result = decode(reader);
+        PubSubCaptureReader_close(reader);
+        return result;
+    }
+
+    UA_PubSubTransportLayer layer = UA_PubSubTransportLayerUDPMP();
+    UA_PubSubConnectionConfig connectionConfig;
+    memset(&connectionConfig, 0, sizeof(connectionConfig));
+    connectionConfig.name = UA_STRING("Replay Connection");
+    connectionConfig.enabled = UA_TRUE;
+    UA_NetworkAddressUrlDataType networkAddressUrl =
+        {UA_STRING_NULL, UA_STRING(argv[2])};
+    if(argc > 3)
+        networkAddressUrl.networkInterface = UA_STRING(argv[3]);
+    if(strncmp(argv[2], "opc.eth://", 10) == 0) {
+#ifdef UA_ENABLE_PUBSUB_ETH_UADP
+        layer = UA_PubSubTransportLayerEthernet();
+#else
+        printf("Error: UADP/ETH is not enabled\n");
+        PubSubCaptureReader_close(reader);
+        return EXIT_FAILURE;
+#endif
+    } else if(strncmp(argv[2], "opc.mqtt://", 11) == 0) {
+        layer = PubSubMqtt_transportLayer();
+    }
+    connectionConfig.transportProfileUri = layer.transportProfileUri;
+    UA_Variant_setScalar(&connectionConfig.address, &networkAddressUrl,
+                         &UA_TYPES[UA_TYPES_NETWORKADDRESSURLDATATYPE]);
+
+    UA_PubSubChannel *channel = layer.createPubSubChannel(&connectionConfig);
+    if(!channel) {
+        printf("Error: cannot open the PubSub channel\n");
+        PubSubCaptureReader_close(reader);
+        return EXIT_FAILURE;
+    }
+    int result = replay(reader, channel);
+    channel->close(channel);
+    PubSubCaptureReader_close(reader);
+    return result;
+}
@@ -0,0 +1,364 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_seq_tracker.h"
+
+#include "pubsub_transport_wrap.h"
+
+#include <string.h>
+
+typedef struct {
+    PubSubWriterKey key;
+    UA_UInt16 top;     /* Highest sequence number seen */
+    UA_UInt64 window;  /* Bit i: top - i was received */
+    UA_UInt32 behind;  /* Consecutive duplicates */
+    PubSubSeqStats stats;
+} SeqWriter;
+
+static SeqWriter *writers[PUBSUBSEQTRACKER_MAXWRITERS];
+static size_t writersSize = 0;
+
+/* Counters have a single writer and are read from other threads */
+static void
+add(UA_UInt64 *counter, UA_Int64 value) {
+    __atomic_store_n(counter, *counter + (UA_UInt64)value, __ATOMIC_RELAXED);
+}
+
+static SeqWriter *
+findWriter(const PubSubWriterKey *key, UA_UInt16 sequenceNumber) {
+    for(size_t i = 0; i < writersSize; i++) {
+        SeqWriter *w = writers[i];
+        if(w->key.publisherId == key->publisherId &&
+           w->key.writerGroupId == key->writerGroupId &&
+           w->key.dataSetWriterId == key->dataSetWriterId)
+            return w;
+    }
+    if(writersSize == PUBSUBSEQTRACKER_MAXWRITERS)
+        return NULL;
+    SeqWriter *w = (SeqWriter*)UA_calloc(1, sizeof(SeqWriter));
+    if(!w)
+        return NULL;
+    w->key = *key;
+    /* The first message is new, the window starts right before it */
+    w->top = (UA_UInt16)(sequenceNumber - 1);
+    w->window = ~(UA_UInt64)0;
+    __atomic_store_n(&writers[writersSize], w, __ATOMIC_RELEASE);
+    __atomic_store_n(&writersSize, writersSize + 1, __ATOMIC_RELEASE);
+    return w;
+}
+
+PubSubSeqResult
+PubSubSeqTracker_check(const PubSubWriterKey *key, UA_UInt16 sequenceNumber) {
+    SeqWriter *w = findWriter(key, sequenceNumber);
+    if(!w)
+        return PUBSUBSEQ_NEW;
+
+    /* Distance in the 16 bit sequence space, with wrap-around */
+    UA_Int16 d = (UA_Int16)(UA_UInt16)(sequenceNumber - w->top);
+    if(d > 0) {
+        add(&w->stats.lost, d - 1);
+        w->window = d < PUBSUBSEQTRACKER_WINDOW ? (w->window << d) | 1 : 1;
+        w->top = sequenceNumber;
+        w->behind = 0;
+        add(&w->stats.received, 1);
+        return PUBSUBSEQ_NEW;
+    }
+
+    /* Numbers behind the window are stale and dropped like duplicates */
+    UA_Int32 back = -(UA_Int32)d;
+    UA_Boolean stale = (back >= PUBSUBSEQTRACKER_WINDOW);
+    UA_UInt64 bit = stale ? 0 : (UA_UInt64)1 << back;
+    if(stale || (w->window & bit)) {
+        if(++w->behind >= PUBSUBSEQTRACKER_RESTART) {
+            w->behind = 0;
+            add(&w->stats.resets, 1);
+            w->window = ~(UA_UInt64)0;
+            w->top = sequenceNumber;
+            add(&w->stats.received, 1);
+            return PUBSUBSEQ_NEW;
+        }
+        add(&w->stats.duplicates, 1);
+        return PUBSUBSEQ_DUPLICATE;
+    }
+    w->window |= bit;
+    add(&w->stats.lost, -1);
+    add(&w->stats.reordered, 1);
+    add(&w->stats.received, 1);
+    return PUBSUBSEQ_REORDERED;
+}
+
+/**
+ * UADP Header Parsing
+ * ^^^^^^^^^^^^^^^^^^^
+ * Only what is needed to find the sequence numbers (Part 14, 7.2.2). */
+
+typedef struct {
+    const UA_Byte *pos;
+    const UA_Byte *end;
+} Reader;
+
+static UA_Boolean
+readByte(Reader *r, UA_Byte *out) {
+    if(r->pos >= r->end)
+        return false;
+    *out = *r->pos++;
+    return true;
+}
+
+static UA_Boolean
+readUInt16(Reader *r, UA_UInt16 *out) {
+    if(r->end - r->pos < 2)
+        return false;
+    *out = (UA_UInt16)(r->pos[0] | r->pos[1] << 8);
+    r->pos += 2;
+    return true;
+}
+
+static UA_Boolean
+readUInt(Reader *r, size_t size, UA_UInt64 *out) {
+    if((size_t)(r->end - r->pos) < size)
+        return false;
+    *out = 0;
+    for(size_t i = 0; i < size; i++)
+        *out |= (UA_UInt64)r->pos[i] << (8 * i);
+    r->pos += size;
+    return true;
+}
+
+static UA_Boolean
+skip(Reader *r, size_t size) {
+    if((size_t)(r->end - r->pos) < size)
+        return false;
+    r->pos += size;
+    return true;
+}
+
+#define UADP_MAXDSM 32
+
+UA_Boolean
+PubSubSeqTracker_checkMessage(const UA_ByteString *message) {
+    Reader r = {message->data, message->data + message->length};
+    UA_Byte flags, ext1 = 0, ext2 = 0;
+    if(!readByte(&r, &flags))
+        return false;
+    if((flags & 0x80) && !readByte(&r, &ext1))
+        return false;
+    if((ext1 & 0x80) && !readByte(&r, &ext2))
+        return false;
+    /* Only DataSetMessages, no chunks */
+    if((ext2 & 0x1d) != 0 || (ext1 & 0x10))
+        return false;
+
+    PubSubWriterKey key;
+    memset(&key, 0, sizeof(key));
+    if(flags & 0x10) {
+        static const size_t idSizes[4] = {1, 2, 4, 8};
+        UA_Byte idType = ext1 & 0x07;
+        if(idType < 4) {
+            if(!readUInt(&r, idSizes[idType], &key.publisherId))
+                return false;
+        } else {
+            /* String PublisherId, hashed with FNV-1a */
+            UA_UInt64 length;
+            if(!readUInt(&r, 4, &length) || length > (UA_UInt64)(r.end - r.pos))
+                return false;
+            key.publisherId = 14695981039346656037u;
+            for(size_t i = 0; i < length; i++)
+                key.publisherId = (key.publisherId ^ r.pos[i]) * 1099511628211u;
+            r.pos += length;
+        }
+    }
+    if((ext1 & 0x08) && !skip(&r, 16)) /* DataSetClassId */
+        return false;
+
+    UA_Boolean groupSeqEnabled = false;
+    UA_UInt16 groupSeq = 0;
+    if(flags & 0x20) {
+        UA_Byte groupFlags;
+        if(!readByte(&r, &groupFlags))
+            return false;
+        if((groupFlags & 0x01) && !readUInt16(&r, &key.writerGroupId))
+            return false;
+        if((groupFlags & 0x02) && !skip(&r, 4)) /* GroupVersion */
+            return false;
+        if((groupFlags & 0x04) && !skip(&r, 2)) /* NetworkMessageNumber */
+            return false;
+        if(groupFlags & 0x08) {
+            if(!readUInt16(&r, &groupSeq))
+                return false;
+            groupSeqEnabled = true;
+        }
+    }
+
+    UA_Byte count = 1;
+    UA_UInt16 writerIds[UADP_MAXDSM] = {0};
+    if(flags & 0x40) {
+        if(!readByte(&r, &count) || count == 0 || count > UADP_MAXDSM)
+            return false;
+        for(size_t i = 0; i < count; i++) {
+            if(!readUInt16(&r, &writerIds[i]))
+                return false;
+        }
+    }
+    if((ext1 & 0x20) && !skip(&r, 8)) /* Timestamp */
+        return false;
+    if((ext1 & 0x40) && !skip(&r, 2)) /* PicoSeconds */
+        return false;
+    if(ext2 & 0x02) { /* PromotedFields */
+        UA_UInt16 size;
+        if(!readUInt16(&r, &size) || !skip(&r, size))
+            return false;
+    }
+
+    UA_UInt16 sizes[UADP_MAXDSM] = {0};
+    if(count > 1) {
+        for(size_t i = 0; i < count; i++) {
+            if(!readUInt16(&r, &sizes[i]))
+                return false;
+        }
+    }
+
+    size_t duplicates = 0;
+    const UA_Byte *dsmStart = r.pos;
+    for(size_t i = 0; i < count && dsmStart < r.end; i++) {
+        Reader dsm = {dsmStart, r.end};
+        dsmStart += sizes[i];
+        UA_Byte dsmFlags1, dsmFlags2 = 0;
+        if(!readByte(&dsm, &dsmFlags1))
+            break;
+        if((dsmFlags1 & 0x80) && !readByte(&dsm, &dsmFlags2))
+            break;
+        UA_UInt16 seq = groupSeq;
+        if(dsmFlags1 & 0x08) {
+            if(!readUInt16(&dsm, &seq))
+                break;
+        } else if(!groupSeqEnabled) {
+            continue;
+        }
+        key.dataSetWriterId = writerIds[i];
+        if(PubSubSeqTracker_check(&key, seq) == PUBSUBSEQ_DUPLICATE)
+            duplicates++;
+    }
+    return duplicates == count;
+}
+
+/**
+ * Statistics
+ * ^^^^^^^^^^ */
+
+static void
+addStats(PubSubSeqStats *dst, const PubSubSeqStats *src) {
+    dst->received += __atomic_load_n(&src->received, __ATOMIC_RELAXED);
+    dst->lost += __atomic_load_n(&src->lost, __ATOMIC_RELAXED);
+    dst->reordered += __atomic_load_n(&src->reordered, __ATOMIC_RELAXED);
+    dst->duplicates += __atomic_load_n(&src->duplicates, __ATOMIC_RELAXED);
+    dst->resets += __atomic_load_n(&src->resets, __ATOMIC_RELAXED);
+}
+
+UA_StatusCode
+PubSubSeqTracker_getStats(const PubSubWriterKey *key, PubSubSeqStats *stats) {
+    memset(stats, 0, sizeof(PubSubSeqStats));
+    size_t size = __atomic_load_n(&writersSize, __ATOMIC_ACQUIRE);
+    for(size_t i = 0; i < size; i++) {
+        const SeqWriter *w = __atomic_load_n(&writers[i], __ATOMIC_ACQUIRE);
+        if(!key) {
+            addStats(stats, &w->stats);
+        } else if(w->key.publisherId == key->publisherId &&
+                  w->key.writerGroupId == key->writerGroupId &&
+                  w->key.dataSetWriterId == key->dataSetWriterId) {
+            addStats(stats, &w->stats);
+            return UA_STATUSCODE_GOOD;
+        }
+    }
+    return key ? UA_STATUSCODE_BADNOTFOUND : UA_STATUSCODE_GOOD;
+}
+
+void
+PubSubSeqTracker_dump(const UA_Logger *logger) {
+    size_t size = __atomic_load_n(&writersSize, __ATOMIC_ACQUIRE);
+    for(size_t i = 0; i < size; i++) {
+        const SeqWriter *w = __atomic_load_n(&writers[i], __ATOMIC_ACQUIRE);
+        PubSubSeqStats s;
+        memset(&s, 0, sizeof(s));
+        addStats(&s, &w->stats);
+        UA_LOG_INFO(logger, UA_LOGCATEGORY_USERLAND,
+                    "Writer %lu/%u/%u received %lu lost %lu reordered %lu "
+                    "duplicates %lu resets %lu",
+                    (unsigned long)w->key.publisherId, (unsigned)w->key.writerGroupId,
+                    (unsigned)w->key.dataSetWriterId, (unsigned long)s.received,
+                    (unsigned long)s.lost, (unsigned long)s.reordered,
+                    (unsigned long)s.duplicates, (unsigned long)s.resets);
+    }
+}
+
+static const char *seqCounterNames[] = {
+    "Received", "Lost", "Reordered", "Duplicates", "Resets"};
+#define SEQCOUNTERS 5
+
+static UA_StatusCode
+readSeqCounter(UA_Server *server, const UA_NodeId *sessionId,
+               void *sessionContext, const UA_NodeId *nodeId, void *nodeContext,
+               UA_Boolean sourceTimeStamp, const UA_NumericRange *range,
+               UA_DataValue *value) {
+    PubSubSeqStats stats;
+    PubSubSeqTracker_getStats(NULL, &stats);
+    const UA_UInt64 counters[SEQCOUNTERS] = {
+        stats.received, stats.lost, stats.reordered, stats.duplicates, stats.resets};
+    UA_UInt64 v = counters[(uintptr_t)nodeContext];
+    value->hasValue = true;
+    return UA_Variant_setScalarCopy(&value->value, &v, &UA_TYPES[UA_TYPES_UINT64]);
+}
+
+UA_StatusCode
+PubSubSeqTracker_addDiagnosticsNodes(UA_Server *server, const UA_NodeId parent) {
+    UA_NodeId objectId;
+    UA_ObjectAttributes oAttr = UA_ObjectAttributes_default;
+    oAttr.displayName = UA_LOCALIZEDTEXT("en-US", "PubSubSequence");
+    UA_StatusCode retval =
+        UA_Server_addObjectNode(server, UA_NODEID_NULL, parent,
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                UA_QUALIFIEDNAME(1, "PubSubSequence"),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                                oAttr, NULL, &objectId);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    UA_DataSource dataSource;
+    dataSource.read = readSeqCounter;
+    dataSource.write = NULL;
+    for(size_t i = 0; i < SEQCOUNTERS; i++) {
+        char *name = (char*)(uintptr_t)seqCounterNames[i];
+        UA_VariableAttributes vAttr = UA_VariableAttributes_default;
+        vAttr.displayName = UA_LOCALIZEDTEXT("en-US", name);
+        vAttr.dataType = UA_TYPES[UA_TYPES_UINT64].typeId;
+        vAttr.accessLevel = UA_ACCESSLEVELMASK_READ;
+        retval |= UA_Server_addDataSourceVariableNode(
+            server, UA_NODEID_NULL, objectId, UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+            UA_QUALIFIEDNAME(1, name), UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+            vAttr, dataSource, (void*)(uintptr_t)i, NULL);
+    }
+    return retval;
+}
+
+/**
+ * Transport Wrapper
+ * ^^^^^^^^^^^^^^^^^ */
+
+static UA_StatusCode
+seqReceive(PubSubChannelWrap *wrap, UA_ByteString *buf,
+           UA_ExtensionObject *transportSettings, UA_UInt32 timeout) {
+    UA_StatusCode retval = wrap->receive(wrap->channel, buf, transportSettings, timeout);
+    if(retval == UA_STATUSCODE_GOOD && buf->length > 0 &&
+       PubSubSeqTracker_checkMessage(buf))
+        buf->length = 0;
+    return retval;
+}
+
+static const PubSubTransportWrapper seqWrapper = {
+    "sequence", NULL, NULL, seqReceive, NULL
+};
+
+UA_PubSubTransportLayer
+PubSubSeqTracker_wrapTransportLayer(UA_PubSubTransportLayer inner) {
+    return PubSubTransportWrap_layer(inner, &seqWrapper, NULL);
+}
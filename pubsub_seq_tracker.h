@@ -0,0 +1,86 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_SEQ_TRACKER_H_
+#define PUBSUB_SEQ_TRACKER_H_
+
+#include <open62541/plugin/log.h>
+#include <open62541/plugin/pubsub.h>
+#include <open62541/server.h>
+
+#include "pubsub_net_latency.h" /* PubSubWriterKey */
+
+/**
+ * Sequence Number Tracking
+ * ------------------------
+ * Counts lost, reordered and duplicated DataSetMessages per writer
+ * (PublisherId, WriterGroupId, DataSetWriterId) and drops duplicates before
+ * they are decoded. With redundant publishers that send every message twice,
+ * only the first copy reaches the TargetVariables.
+ *
+ * Every writer has a sliding window over the last
+ * PUBSUBSEQTRACKER_WINDOW sequence numbers: the highest number seen plus a
+ * 64 bit bitmap of the numbers below it. A gap is counted as lost when it
+ * opens. A message that fills the gap later is counted as reordered and no
+ * longer as lost. A message behind the window is stale and dropped like a
+ * duplicate. PUBSUBSEQTRACKER_RESTART stale or duplicate messages in a row
+ * are taken as a restart of the publisher and reset the window. Redundant
+ * copies and single late messages never trigger this, since they alternate
+ * with new messages.
+ *
+ * The DataSetMessage sequence number is used. If the writer does not send
+ * it, the NetworkMessage sequence number of the group header is used. Other
+ * messages pass unchanged.
+ *
+ * ``PubSubSeqTracker_wrapTransportLayer`` parses the UADP headers of every
+ * received NetworkMessage, only up to the DataSetMessage sequence numbers.
+ * A message is dropped if all of its DataSetMessages are duplicates. Secured
+ * messages pass unchanged. The tracker has a single writer, the thread that
+ * receives. */
+
+#define PUBSUBSEQTRACKER_WINDOW 64
+#define PUBSUBSEQTRACKER_MAXWRITERS 64
+#define PUBSUBSEQTRACKER_RESTART 4
+
+typedef struct {
+    UA_UInt64 received;   /* Messages passed on */
+    UA_UInt64 lost;
+    UA_UInt64 reordered;
+    UA_UInt64 duplicates; /* Dropped, including stale messages */
+    UA_UInt64 resets;
+} PubSubSeqStats;
+
+typedef enum {
+    PUBSUBSEQ_NEW = 0,
+    PUBSUBSEQ_REORDERED, /* New, but older than the highest number seen */
+    PUBSUBSEQ_DUPLICATE
+} PubSubSeqResult;
+
+/* Tracks one sequence number. Writers beyond PUBSUBSEQTRACKER_MAXWRITERS are
+ * not tracked and always return PUBSUBSEQ_NEW. */
+PubSubSeqResult
+PubSubSeqTracker_check(const PubSubWriterKey *key, UA_UInt16 sequenceNumber);
+
+/* Tracks all DataSetMessages of an encoded NetworkMessage. Returns true if
+ * the message is to be dropped. */
+UA_Boolean
+PubSubSeqTracker_checkMessage(const UA_ByteString *message);
+
+/* Totals over all writers if key is NULL */
+UA_StatusCode
+PubSubSeqTracker_getStats(const PubSubWriterKey *key, PubSubSeqStats *stats);
+
+/* Logs one line per writer */
+void
+PubSubSeqTracker_dump(const UA_Logger *logger);
+
+/* Adds a "PubSubSequence" object below parent with the variables Received,
+ * Lost, Reordered, Duplicates and Resets (totals over all writers) */
+UA_StatusCode
+PubSubSeqTracker_addDiagnosticsNodes(UA_Server *server, const UA_NodeId parent);
+
+/* Tracks and deduplicates all received messages of the layer */
+UA_PubSubTransportLayer
+PubSubSeqTracker_wrapTransportLayer(UA_PubSubTransportLayer inner);
+
+#endif /* PUBSUB_SEQ_TRACKER_H_ */
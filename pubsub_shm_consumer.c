@@ -0,0 +1,122 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+/**
+ * Shared-Memory Consumer
+ * ----------------------
+ * Follows the DataSet ring that tutorial_pubsub_subscribe writes when it is
+ * started with ``--shm=<name>``. Values are read in place from the mapped
+ * ring. System calls only happen while the ring is idle.
+ *
+ * Run step of the application is as mentioned below:
+ *
+ * ./pubsub_shm_consumer /pubsub_dataset1 */
+
+#include <open62541/plugin/log_stdout.h>
+#include <open62541/types_generated.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pubsub_shm_ring.h"
+
+UA_Boolean running = true;
+static void stopHandler(int sign) {
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND, "received ctrl-c");
+    running = false;
+}
+
+/* Formats the slot in place. The slot may be overwritten meanwhile, so the
+ * indices and lengths are bounded. The line is only printed if the seqlock
+ * confirms it afterwards. */
+static void
+formatSlot(const PubSubShmRing *ring, const PubSubShmSlot *slot,
+           char *line, size_t size) {
+    UA_UInt16 fieldIndex = slot->fieldIndex;
+    UA_UInt32 length = slot->length;
+    if(fieldIndex >= PUBSUBSHMRING_MAX_FIELDS)
+        fieldIndex = 0;
+    if(length > PUBSUBSHMRING_DATA_SIZE)
+        length = PUBSUBSHMRING_DATA_SIZE;
+    const char *name = ring->header->fields[fieldIndex].name;
+    const void *d = slot->data;
+    UA_UInt16 typeIndex = slot->typeIndex;
+    switch(typeIndex) {
+    case UA_TYPES_BOOLEAN:
+        snprintf(line, size, "%s = %s\n", name, *(const UA_Boolean*)d ? "true" : "false");
+        break;
+    case UA_TYPES_BYTE:
+        snprintf(line, size, "%s = %u\n", name, *(const UA_Byte*)d);
+        break;
+    case UA_TYPES_INT32:
+        snprintf(line, size, "%s = %d\n", name, *(const UA_Int32*)d);
+        break;
+    case UA_TYPES_UINT32:
+        snprintf(line, size, "%s = %u\n", name, *(const UA_UInt32*)d);
+        break;
+    case UA_TYPES_INT64:
+        snprintf(line, size, "%s = %lld\n", name, (long long)*(const UA_Int64*)d);
+        break;
+    case UA_TYPES_DOUBLE:
+        snprintf(line, size, "%s = %f\n", name, *(const UA_Double*)d);
+        break;
+    case UA_TYPES_DATETIME: {
+        UA_DateTimeStruct dts = UA_DateTime_toStruct(*(const UA_DateTime*)d);
+        snprintf(line, size, "%s = %04u-%02u-%02u %02u:%02u:%02u.%03u\n",
+                 name, dts.year, dts.month, dts.day, dts.hour, dts.min, dts.sec,
+                 dts.milliSec);
+        break;
+    }
+    case UA_TYPES_STRING:
+        snprintf(line, size, "%s = %.*s\n", name, (int)length, (const char*)d);
+        break;
+    default:
+        snprintf(line, size, "%s = <%u bytes of type %u>\n", name, length, typeIndex);
+        break;
+    }
+}
+
+int main(int argc, char **argv) {
+    signal(SIGINT, stopHandler);
+    signal(SIGTERM, stopHandler);
+
+    const char *name = (argc > 1) ? argv[1] : "/pubsub_dataset1";
+    PubSubShmRing ring;
+    if(PubSubShmRing_open(&ring, name) != UA_STATUSCODE_GOOD) {
+        printf("Error: cannot open the shared-memory ring %s\n", name);
+        return EXIT_FAILURE;
+    }
+
+    UA_UInt64 position = PubSubShmRing_head(&ring);
+    UA_UInt64 lost = 0;
+    while(running) {
+        PubSubShmView view;
+        UA_UInt64 before = position;
+        UA_StatusCode retval = PubSubShmRing_beginRead(&ring, &position, &view);
+        if(retval == UA_STATUSCODE_BADNOTHINGTODO) {
+            struct timespec idle = {0, 100000}; /* 100us */
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        if(retval == UA_STATUSCODE_BADDATALOST) {
+            lost += position - before;
+            UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                           "Consumer too slow, %lu records lost", (unsigned long)lost);
+            continue;
+        }
+
+        /* Format the slot in place. Print the line only if the slot was
+         * stable. */
+        char line[PUBSUBSHMRING_NAME_SIZE + PUBSUBSHMRING_DATA_SIZE + 64];
+        formatSlot(&ring, view.slot, line, sizeof(line));
+        if(!PubSubShmRing_endRead(&view))
+            continue; /* Overwritten while reading, the next try reports the loss */
+        fputs(line, stdout);
+        position++;
+    }
+
+    PubSubShmRing_close(&ring);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_shm_ring.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t
+ringSize(UA_UInt32 slotCount) {
+    return sizeof(PubSubShmHeader) + (size_t)slotCount * sizeof(PubSubShmSlot);
+}
+
+static UA_UInt16
+typeIndexOf(const UA_DataType *type) {
+    if(!type || type < &UA_TYPES[0] || type >= &UA_TYPES[UA_TYPES_COUNT])
+        return UA_UINT16_MAX;
+    return (UA_UInt16)(type - UA_TYPES);
+}
+
+UA_StatusCode
+PubSubShmRing_create(PubSubShmRing *ring, const char *name, UA_UInt32 slotCount,
+                     size_t fieldCount, const UA_String *fieldNames,
+                     const UA_DataType **fieldTypes) {
+    memset(ring, 0, sizeof(PubSubShmRing));
+    if(fieldCount > PUBSUBSHMRING_MAX_FIELDS || slotCount == 0)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+
+    /* Round up to a power of two to map positions with a mask */
+    UA_UInt32 count = 1;
+    while(count < slotCount)
+        count <<= 1;
+
+    /* Consumers that still map a ring of a previous run keep the old object */
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+    size_t size = ringSize(count);
+    if(ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+    }
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED) {
+        shm_unlink(name);
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+    }
+
+    ring->name = strdup(name);
+    ring->header = (PubSubShmHeader*)mem;
+    ring->slots = (PubSubShmSlot*)((UA_Byte*)mem + sizeof(PubSubShmHeader));
+    ring->mappedSize = size;
+    ring->writer = true;
+
+    /* The new object is zero-filled. The magic is written last so that a
+     * consumer never sees a half-initialized header. */
+    PubSubShmHeader *h = ring->header;
+    h->version = PUBSUBSHMRING_VERSION;
+    h->slotCount = count;
+    h->fieldCount = (UA_UInt32)fieldCount;
+    for(size_t i = 0; i < fieldCount; i++) {
+        size_t len = fieldNames[i].length;
+        if(len >= PUBSUBSHMRING_NAME_SIZE)
+            len = PUBSUBSHMRING_NAME_SIZE - 1;
+        memcpy(h->fields[i].name, fieldNames[i].data, len);
+        h->fields[i].typeIndex = typeIndexOf(fieldTypes[i]);
+    }
+    __atomic_store_n(&h->magic, PUBSUBSHMRING_MAGIC, __ATOMIC_RELEASE);
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+PubSubShmRing_write(PubSubShmRing *ring, UA_UInt16 fieldIndex,
+                    const UA_DataValue *value) {
+    PubSubShmHeader *h = ring->header;
+    const UA_Variant *v = &value->value;
+    const void *src = NULL;
+    size_t len = 0;
+    if(fieldIndex >= h->fieldCount || !v->type || !UA_Variant_isScalar(v))
+        goto drop;
+    if(v->type->pointerFree) {
+        src = v->data;
+        len = v->type->memSize;
+        if(len > PUBSUBSHMRING_DATA_SIZE)
+            goto drop;
+    } else if(v->type == &UA_TYPES[UA_TYPES_STRING] ||
+              v->type == &UA_TYPES[UA_TYPES_BYTESTRING]) {
+        const UA_String *s = (const UA_String*)v->data;
+        src = s->data;
+        len = s->length;
+        if(len > PUBSUBSHMRING_DATA_SIZE)
+            len = PUBSUBSHMRING_DATA_SIZE;
+    } else {
+        goto drop;
+    }
+
+    UA_UInt64 pos = h->writePosition; /* Single writer */
+    PubSubShmSlot *slot = &ring->slots[pos & (h->slotCount - 1)];
+
+    /* Seqlock write section */
+    UA_UInt32 seq = slot->seq;
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->fieldIndex = fieldIndex;
+    slot->typeIndex = typeIndexOf(v->type);
+    slot->length = (UA_UInt32)len;
+    slot->position = pos;
+    slot->sourceTimestamp = value->hasSourceTimestamp ? value->sourceTimestamp : 0;
+    slot->writeTimestamp = UA_DateTime_now();
+    if(len > 0)
+        memcpy(slot->data, src, len);
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&h->writePosition, pos + 1, __ATOMIC_RELEASE);
+    return UA_STATUSCODE_GOOD;
+
+ drop:
+    __atomic_store_n(&h->dropped, h->dropped + 1, __ATOMIC_RELAXED);
+    return UA_STATUSCODE_BADNOTSUPPORTED;
+}
+
+UA_StatusCode
+PubSubShmRing_open(PubSubShmRing *ring, const char *name) {
+    memset(ring, 0, sizeof(PubSubShmRing));
+    int fd = shm_open(name, O_RDONLY, 0);
+    if(fd < 0)
+        return UA_STATUSCODE_BADNOTFOUND;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PubSubShmHeader)) {
+        close(fd);
+        return UA_STATUSCODE_BADNOTFOUND;
+    }
+    void *mem = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+
+    PubSubShmHeader *h = (PubSubShmHeader*)mem;
+    if(__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != PUBSUBSHMRING_MAGIC ||
+       h->version != PUBSUBSHMRING_VERSION ||
+       ringSize(h->slotCount) > (size_t)st.st_size) {
+        munmap(mem, (size_t)st.st_size);
+        return UA_STATUSCODE_BADNOTFOUND;
+    }
+    ring->header = h;
+    ring->slots = (PubSubShmSlot*)((UA_Byte*)mem + sizeof(PubSubShmHeader));
+    ring->mappedSize = (size_t)st.st_size;
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+PubSubShmRing_beginRead(const PubSubShmRing *ring, UA_UInt64 *position,
+                        PubSubShmView *view) {
+    const PubSubShmHeader *h = ring->header;
+    UA_UInt64 head = PubSubShmRing_head(ring);
+    if(*position >= head)
+        return UA_STATUSCODE_BADNOTHINGTODO;
+    if(head - *position > h->slotCount) {
+        *position = head - h->slotCount;
+        return UA_STATUSCODE_BADDATALOST;
+    }
+
+    const PubSubShmSlot *slot = &ring->slots[*position & (h->slotCount - 1)];
+    UA_UInt32 seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if((seq & 1) || slot->position != *position) {
+        /* The writer has lapped the consumer and is overwriting the slot */
+        *position = head + 1 > h->slotCount ? head + 1 - h->slotCount : 0;
+        return UA_STATUSCODE_BADDATALOST;
+    }
+    view->slot = slot;
+    view->seq = seq;
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_Boolean
+PubSubShmRing_endRead(const PubSubShmView *view) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&view->slot->seq, __ATOMIC_RELAXED) == view->seq;
+}
+
+void
+PubSubShmRing_close(PubSubShmRing *ring) {
+    if(ring->header)
+        munmap(ring->header, ring->mappedSize);
+    if(ring->writer && ring->name)
+        shm_unlink(ring->name);
+    free(ring->name);
+    memset(ring, 0, sizeof(PubSubShmRing));
+}
@@ -0,0 +1,116 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_SHM_RING_H_
+#define PUBSUB_SHM_RING_H_
+
+#include <open62541/types.h>
+
+/**
+ * Shared-Memory DataSet Ring
+ * --------------------------
+ * The subscriber publishes every received DataSet field into a POSIX
+ * shared-memory ring. Local consumers map the ring read-only and follow the
+ * write position. Reading does not copy the value and needs no system call.
+ *
+ * Every slot is protected by a sequence lock. The writer makes the sequence
+ * number odd, writes the slot and makes it even again. A reader notes the
+ * sequence number, accesses the slot in place and checks afterwards that the
+ * sequence number is unchanged. A consumer that falls behind by more than
+ * the ring size is told so and continues with the oldest retained record.
+ *
+ * There is exactly one writer per ring. Values of fixed-size builtin types
+ * are stored in their in-memory representation. Strings and ByteStrings are
+ * stored with their length and truncated to PUBSUBSHMRING_DATA_SIZE. */
+
+#define PUBSUBSHMRING_MAGIC 0x55415352 /* "UASR" */
+#define PUBSUBSHMRING_VERSION 1
+#define PUBSUBSHMRING_MAX_FIELDS 64
+#define PUBSUBSHMRING_NAME_SIZE 48
+#define PUBSUBSHMRING_DATA_SIZE 80
+
+typedef struct {
+    char name[PUBSUBSHMRING_NAME_SIZE];
+    UA_UInt16 typeIndex; /* Index in UA_TYPES */
+    UA_Byte reserved[14];
+} PubSubShmField;
+
+typedef struct {
+    UA_UInt32 seq;              /* Sequence lock, odd while written */
+    UA_UInt16 fieldIndex;
+    UA_UInt16 typeIndex;        /* Index in UA_TYPES */
+    UA_UInt32 length;           /* Valid bytes in data */
+    UA_UInt32 reserved;
+    UA_UInt64 position;         /* Ring position the slot was written for */
+    UA_DateTime sourceTimestamp;
+    UA_DateTime writeTimestamp;
+    UA_Byte data[PUBSUBSHMRING_DATA_SIZE];
+} __attribute__((aligned(64))) PubSubShmSlot;
+
+typedef struct {
+    UA_UInt32 magic;
+    UA_UInt32 version;
+    UA_UInt32 slotCount;        /* Power of two */
+    UA_UInt32 fieldCount;
+    PubSubShmField fields[PUBSUBSHMRING_MAX_FIELDS];
+    /* Number of records written so far. On its own cache line, it is the
+     * only location all consumers poll. */
+    UA_UInt64 writePosition __attribute__((aligned(64)));
+    UA_UInt64 dropped;          /* Values that could not be represented */
+} __attribute__((aligned(64))) PubSubShmHeader;
+
+typedef struct {
+    PubSubShmHeader *header;
+    PubSubShmSlot *slots;
+    size_t mappedSize;
+    UA_Boolean writer;
+    char *name;
+} PubSubShmRing;
+
+/* Writer API */
+
+/* Creates (or truncates) the shared-memory object name, e.g.
+ * "/pubsub_dataset1". slotCount is rounded up to a power of two. */
+UA_StatusCode
+PubSubShmRing_create(PubSubShmRing *ring, const char *name, UA_UInt32 slotCount,
+                     size_t fieldCount, const UA_String *fieldNames,
+                     const UA_DataType **fieldTypes);
+
+UA_StatusCode
+PubSubShmRing_write(PubSubShmRing *ring, UA_UInt16 fieldIndex,
+                    const UA_DataValue *value);
+
+/* Consumer API */
+
+UA_StatusCode
+PubSubShmRing_open(PubSubShmRing *ring, const char *name);
+
+/* The next position that will be written */
+static UA_INLINE UA_UInt64
+PubSubShmRing_head(const PubSubShmRing *ring) {
+    return __atomic_load_n(&ring->header->writePosition, __ATOMIC_ACQUIRE);
+}
+
+typedef struct {
+    const PubSubShmSlot *slot;
+    UA_UInt32 seq;
+} PubSubShmView;
+
+/* Starts a zero-copy read of the record at *position. Returns
+ * UA_STATUSCODE_BADNOTHINGTODO if the record was not yet written. If the
+ * record was already overwritten, *position is advanced to the oldest
+ * retained record and UA_STATUSCODE_BADDATALOST is returned. */
+UA_StatusCode
+PubSubShmRing_beginRead(const PubSubShmRing *ring, UA_UInt64 *position,
+                        PubSubShmView *view);
+
+/* Returns true if the slot was not modified since beginRead. Otherwise the
+ * content that was read must be discarded. */
+UA_Boolean
+PubSubShmRing_endRead(const PubSubShmView *view);
+
+/* Unmaps the ring. The writer also removes the shared-memory object. */
+void
+PubSubShmRing_close(PubSubShmRing *ring);
+
+#endif /* PUBSUB_SHM_RING_H_ */
@@ -21,32 +21,121 @@
 
 #include <signal.h>
 
+#include "log_ring.h"
+#include "pubsub_arena.h"
+#include "pubsub_array_codec.h"
+#include "pubsub_capture.h"
+#include "pubsub_ethernet_xdp.h"
+#include "pubsub_mqtt.h"
+#include "pubsub_net_latency.h"
+#include "pubsub_probe.h"
+#include "pubsub_seq_tracker.h"
+
 #ifdef UA_ENABLE_PUBSUB_ETH_UADP
 #include <open62541/plugin/pubsub_ethernet.h>
 #endif
 
 UA_Boolean running = true;
+
+/* Logging from the receive loop goes through a ring logger. Formatting and
+ * stdout writes happen in a background thread. */
+UA_Logger logger;
+
+/* Per-writer network latency from kernel receive timestamps */
+UA_Boolean latency = false;
+
+/* Per-writer loss and duplicate counters, duplicates are dropped */
+UA_Boolean seqTracking = false;
+
+/* The receive buffer and the decoded NetworkMessage come from a cycle arena
+ * that is reset after every message, see pubsub_arena.h */
+PubSubArena *decodeArena = NULL;
+
+/* Every received message is recorded for pubsub_replay, see
+ * pubsub_capture.h */
+PubSubCapture *capture = NULL;
+
+/* The RAW payload holds an array of this type after the DateTime. It is
+ * decoded with pubsub_array_codec.h, in the byte order of the publisher. */
+static const struct {
+    const char *name;
+    size_t type;
+} rawArrayTypes[] = {
+    {"SByte", UA_TYPES_SBYTE}, {"Byte", UA_TYPES_BYTE},
+    {"Int16", UA_TYPES_INT16}, {"UInt16", UA_TYPES_UINT16},
+    {"Int32", UA_TYPES_INT32}, {"UInt32", UA_TYPES_UINT32},
+    {"Int64", UA_TYPES_INT64}, {"UInt64", UA_TYPES_UINT64},
+    {"Float", UA_TYPES_FLOAT}, {"Double", UA_TYPES_DOUBLE},
+    {"DateTime", UA_TYPES_DATETIME}, {"StatusCode", UA_TYPES_STATUSCODE}
+};
+const char *rawArrayName = NULL;
+const UA_DataType *rawArrayType = NULL;
+PubSubArrayCodecByteOrder rawArrayOrder = PUBSUBARRAYCODEC_LITTLEENDIAN;
+
 static void stopHandler(int sign) {
     UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
                 "received ctrl-c");
     running = false;
 }
 
+/* The DataSetMessages carry the publisher timestamp if the writer has
+ * UA_UADPDATASETMESSAGECONTENTMASK_TIMESTAMP set. Otherwise the timestamp of
+ * the NetworkMessage is used. */
+static void
+recordLatency(const UA_NetworkMessage *nm) {
+    UA_DateTime received = PubSubNetLatency_lastReceiveTime(NULL);
+    if(received == 0)
+        return;
+    PubSubWriterKey key;
+    memset(&key, 0, sizeof(key));
+    if(nm->publisherIdEnabled) {
+        switch(nm->publisherIdType) {
+        case UA_PUBLISHERDATATYPE_BYTE: key.publisherId = nm->publisherId.publisherIdByte; break;
+        case UA_PUBLISHERDATATYPE_UINT16: key.publisherId = nm->publisherId.publisherIdUInt16; break;
+        case UA_PUBLISHERDATATYPE_UINT32: key.publisherId = nm->publisherId.publisherIdUInt32; break;
+        case UA_PUBLISHERDATATYPE_UINT64: key.publisherId = nm->publisherId.publisherIdUInt64; break;
+        default: break;
+        }
+    }
+    if(nm->groupHeaderEnabled && nm->groupHeader.writerGroupIdEnabled)
+        key.writerGroupId = nm->groupHeader.writerGroupId;
+
+    size_t count = nm->payloadHeaderEnabled ?
+        nm->payloadHeader.dataSetPayloadHeader.count : 1;
+    for(size_t j = 0; j < count; j++) {
+        const UA_DataSetMessage *dsm = &nm->payload.dataSetPayload.dataSetMessages[j];
+        UA_DateTime sent = dsm->header.timestampEnabled ? dsm->header.timestamp :
+            (nm->timestampEnabled ? nm->timestamp : 0);
+        if(sent == 0)
+            continue;
+        key.dataSetWriterId = nm->payloadHeaderEnabled ?
+            nm->payloadHeader.dataSetPayloadHeader.dataSetWriterIds[j] : 0;
+        PubSubNetLatency_record(&key, sent, received);
+    }
+}
+
 static UA_StatusCode
 subscriberListen(UA_PubSubChannel *psc) {
+    if(decodeArena)
+        PubSubArena_enter(decodeArena);
     UA_ByteString buffer;
     UA_StatusCode retval = UA_ByteString_allocBuffer(&buffer, 512);
     if(retval != UA_STATUSCODE_GOOD) {
-        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+        UA_LOG_ERROR(&logger, UA_LOGCATEGORY_SERVER,
                      "Message buffer allocation failed!");
+        if(decodeArena)
+            PubSubArena_reset(decodeArena);
         return retval;
     }
 
+    /* The transport wrappers keep per-writer state beyond the message. They
+     * allocate from the heap. */
+    if(decodeArena)
+        PubSubArena_leave();
 
-
-
-    /* Receive the message. Blocks for 100ms */
-    retval = psc->receive(psc, &buffer, NULL, 1000);
+    /* Receive the message. Blocks for 1ms. With --probe, the RECEIVE stage
+     * is timed once the message has arrived. */
+    retval = PubSubProbe_receive(psc, psc->receive, &buffer, NULL, 1000);
 
     if(retval != UA_STATUSCODE_GOOD || buffer.length == 0) {
         /* Workaround!! Reset buffer length. Receive can set the length to zero.
@@ -56,16 +145,30 @@ subscriberListen(UA_PubSubChannel *psc) {
          * length to zero. */
         buffer.length = 512;
         UA_ByteString_clear(&buffer);
+        if(decodeArena)
+            PubSubArena_reset(decodeArena);
         return UA_STATUSCODE_GOOD;
     }
 
     /* Decode the message */
-    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+    UA_LOG_INFO(&logger, UA_LOGCATEGORY_USERLAND,
                 "Message length: %lu", (unsigned long) buffer.length);
     UA_NetworkMessage networkMessage;
     memset(&networkMessage, 0, sizeof(UA_NetworkMessage));
     size_t currentPosition = 0;
-    UA_NetworkMessage_decodeBinary(&buffer, &currentPosition, &networkMessage);
+    PubSubProbeTime probeTime = PUBSUBPROBE_START();
+    if(decodeArena)
+        PubSubArena_enter(decodeArena);
+    UA_StatusCode decodeRetval =
+        UA_NetworkMessage_decodeBinary(&buffer, &currentPosition, &networkMessage);
+    if(decodeArena)
+        PubSubArena_leave();
+    PUBSUBPROBE_STOP(PUBSUBPROBE_DECODE, probeTime);
+    if(decodeRetval != UA_STATUSCODE_GOOD) {
+        UA_LOG_WARNING(&logger, UA_LOGCATEGORY_USERLAND,
+                       "Cannot decode the message: %s", UA_StatusCode_name(decodeRetval));
+        goto cleanup;
+    }
 
     /* Is this the correct message type? */
     if(networkMessage.networkMessageType != UA_NETWORKMESSAGE_DATASET)
@@ -76,45 +179,66 @@ subscriberListen(UA_PubSubChannel *psc) {
        networkMessage.payloadHeader.dataSetPayloadHeader.count < 1)
         goto cleanup;
 
+    if(latency)
+        recordLatency(&networkMessage);
+
     /* Is this a KeyFrame-DataSetMessage? */
+    probeTime = PUBSUBPROBE_START();
     for(size_t j = 0; j < networkMessage.payloadHeader.dataSetPayloadHeader.count; j++) {
         UA_DataSetMessage *dsm = &networkMessage.payload.dataSetPayload.dataSetMessages[j];
         if(dsm->header.dataSetMessageType != UA_DATASETMESSAGE_DATAKEYFRAME)
             continue;
         if(dsm->header.fieldEncoding == UA_FIELDENCODING_RAWDATA){
-        	printf("field count: %d\n", (int)j);//SW DEBUG POINT
+            UA_LOG_DEBUG(&logger, UA_LOGCATEGORY_USERLAND,
+                         "RAW DataSetMessage %u", (unsigned)j);
             //The RAW-Encoded payload contains no fieldCount information
             UA_DateTime dateTime;
             size_t offset = 0;
             UA_DateTime_decodeBinary(&dsm->data.keyFrameData.rawFields, &offset, &dateTime);
             //UA_DateTime value = *(UA_DateTime *)dsm->data.keyFrameData.rawFields->data;
             UA_DateTimeStruct receivedTime = UA_DateTime_toStruct(dateTime);
-            UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+            UA_LOG_INFO(&logger, UA_LOGCATEGORY_USERLAND,
                         "Message content: [DateTime] \t"
                         "Received date: %02i-%02i-%02i Received time: %02i:%02i:%02i",
                         receivedTime.year, receivedTime.month, receivedTime.day,
                         receivedTime.hour, receivedTime.min, receivedTime.sec);
+            if(rawArrayType) {
+                void *array = NULL;
+                size_t arrayLength = 0;
+                UA_StatusCode res =
+                    PubSubArrayCodec_decode(&dsm->data.keyFrameData.rawFields, &offset,
+                                            &array, &arrayLength, rawArrayType,
+                                            rawArrayOrder);
+                if(res == UA_STATUSCODE_GOOD)
+                    UA_LOG_INFO(&logger, UA_LOGCATEGORY_USERLAND,
+                                "Message content: [%s array] \tReceived %lu elements",
+                                rawArrayName, (unsigned long)arrayLength);
+                else
+                    UA_LOG_WARNING(&logger, UA_LOGCATEGORY_USERLAND,
+                                   "Cannot decode the %s array: %s", rawArrayName,
+                                   UA_StatusCode_name(res));
+                UA_Array_delete(array, arrayLength, rawArrayType);
+            }
         } else {
 
             /* Loop over the fields and print well-known content types */
             for(int i = 0; i < dsm->data.keyFrameData.fieldCount; i++) {
-                printf("loop count else: %d and field count: %d\n", i, dsm->data.keyFrameData.fieldCount);//SW DEBUG POINT
+                UA_LOG_DEBUG(&logger, UA_LOGCATEGORY_USERLAND,
+                             "Field %d of %d", i, (int)dsm->data.keyFrameData.fieldCount);
 
                 const UA_DataType *currentType = dsm->data.keyFrameData.dataSetFields[i].value.type;
                 if(currentType == &UA_TYPES[UA_TYPES_BYTE]) {
                     UA_Byte value = *(UA_Byte *)dsm->data.keyFrameData.dataSetFields[i].value.data;
-                    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                    UA_LOG_INFO(&logger, UA_LOGCATEGORY_USERLAND,
                                 "Message content: [Byte] \tReceived data: %i", value);
                 } else if (currentType == &UA_TYPES[UA_TYPES_UINT32]) {
-                    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
-                                "ELSE IF LOOP EXECUTED");
                     UA_UInt32 value = *(UA_UInt32 *)dsm->data.keyFrameData.dataSetFields[i].value.data;
-                    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                    UA_LOG_INFO(&logger, UA_LOGCATEGORY_USERLAND,
                                 "Message content: [UInt32] \tReceived data: %u", value);
                 } else if (currentType == &UA_TYPES[UA_TYPES_DATETIME]) {
                     UA_DateTime value = *(UA_DateTime *)dsm->data.keyFrameData.dataSetFields[i].value.data;
                     UA_DateTimeStruct receivedTime = UA_DateTime_toStruct(value);
-                    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                    UA_LOG_INFO(&logger, UA_LOGCATEGORY_USERLAND,
                                 "Message content: [DateTime] \t"
                                 "Received date else if: %02i-%02i-%02i Received time: %02i:%02i:%02i",
                                 receivedTime.year, receivedTime.month, receivedTime.day,
@@ -123,18 +247,119 @@ subscriberListen(UA_PubSubChannel *psc) {
             }
         }
     }
-    UA_ByteString_clear(&buffer);
+    PUBSUBPROBE_STOP(PUBSUBPROBE_DISPATCH, probeTime);
 
     cleanup:
+    UA_ByteString_clear(&buffer);
     UA_NetworkMessage_clear(&networkMessage);
+    if(decodeArena)
+        PubSubArena_reset(decodeArena);
     return retval;
 }
 
+static void
+dumpStatistics(void) {
+    if(pubsubProbeEnabled)
+        PubSubProbe_dump(&logger);
+    if(latency)
+        PubSubNetLatency_dump(&logger);
+    if(seqTracking)
+        PubSubSeqTracker_dump(&logger);
+    if(decodeArena) {
+        PubSubArenaStats stats;
+        PubSubArena_getStats(decodeArena, &stats);
+        UA_LOG_INFO(&logger, UA_LOGCATEGORY_USERLAND,
+                    "Decode arena: %lu bytes, high water %lu bytes, %lu allocations, "
+                    "%lu from the heap, %lu failed",
+                    (unsigned long)stats.capacity, (unsigned long)stats.highWater,
+                    (unsigned long)stats.allocations, (unsigned long)stats.heapAllocations,
+                    (unsigned long)stats.failed);
+    }
+    if(capture) {
+        PubSubCaptureStats stats;
+        PubSubCapture_getStats(capture, &stats);
+        UA_LOG_INFO(&logger, UA_LOGCATEGORY_USERLAND,
+                    "Capture: %lu records, %lu bytes in %lu segments, %lu dropped",
+                    (unsigned long)stats.records, (unsigned long)stats.bytes,
+                    (unsigned long)stats.segments, (unsigned long)stats.dropped);
+    }
+}
+
 int main(int argc, char **argv) {
     signal(SIGINT, stopHandler);
     signal(SIGTERM, stopHandler);
 
-    UA_PubSubTransportLayer udpLayer = UA_PubSubTransportLayerUDPMP();
+    /* With --probe the receive, decode and dispatch stages are timed and
+     * dumped every ten seconds. --log-rate limits the records per second of
+     * every log statement (0 for no limit). --xdp receives opc.eth addresses
+     * through AF_XDP, see pubsub_ethernet_xdp.h. --latency keeps latency and
+     * jitter per writer, see pubsub_net_latency.h. --seq drops duplicates and
+     * counts lost messages, see pubsub_seq_tracker.h. --arena[=strict]
+     * decodes into a cycle arena, see pubsub_arena.h. --capture records the
+     * received messages, see pubsub_capture.h. --raw-array=<type>[:be]
+     * decodes an array after the DateTime of RAW DataSetMessages. */
+    LogRingConfig logConfig = LOGRINGCONFIG_DEFAULT;
+    UA_Boolean xdp = false;
+    UA_Boolean arena = false;
+    PubSubArenaMode arenaMode = PUBSUBARENA_FALLBACK;
+    PubSubCaptureConfig captureConfig;
+    memset(&captureConfig, 0, sizeof(PubSubCaptureConfig));
+    int args = 1;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--probe") == 0)
+            PubSubProbe_setEnabled(true);
+        else if(strncmp(argv[i], "--log-rate=", 11) == 0)
+            logConfig.rateLimit = (UA_UInt32)strtoul(&argv[i][11], NULL, 10);
+        else if(strcmp(argv[i], "--xdp") == 0)
+            xdp = true;
+        else if(strcmp(argv[i], "--latency") == 0)
+            latency = true;
+        else if(strcmp(argv[i], "--seq") == 0)
+            seqTracking = true;
+        else if(strcmp(argv[i], "--arena") == 0)
+            arena = true;
+        else if(strcmp(argv[i], "--arena=strict") == 0) {
+            arena = true;
+            arenaMode = PUBSUBARENA_STRICT;
+        }
+        else if(strncmp(argv[i], "--capture=", 10) == 0)
+            captureConfig.path = &argv[i][10];
+        else if(strncmp(argv[i], "--raw-array=", 12) == 0) {
+            const char *name = &argv[i][12];
+            size_t nameLength = strcspn(name, ":");
+            if(strcmp(&name[nameLength], ":be") == 0)
+                rawArrayOrder = PUBSUBARRAYCODEC_BIGENDIAN;
+            for(size_t j = 0; j < sizeof(rawArrayTypes) / sizeof(rawArrayTypes[0]); j++) {
+                if(strlen(rawArrayTypes[j].name) == nameLength &&
+                   strncmp(rawArrayTypes[j].name, name, nameLength) == 0) {
+                    rawArrayName = rawArrayTypes[j].name;
+                    rawArrayType = &UA_TYPES[rawArrayTypes[j].type];
+                }
+            }
+            if(!rawArrayType) {
+                printf("Error: unknown --raw-array type %s\n", name);
+                return EXIT_FAILURE;
+            }
+        }
+        else
+            argv[args++] = argv[i];
+    }
+    argc = args;
+
+    /* Before the ring logger starts its thread */
+    if(arena) {
+        if(PubSubArena_install() != UA_STATUSCODE_GOOD) {
+            printf("Error: --arena needs open62541 with UA_ENABLE_MALLOC_SINGLETON\n");
+            return EXIT_FAILURE;
+        }
+        decodeArena = PubSubArena_new(4096, arenaMode, 100);
+        if(!decodeArena) {
+            printf("Error: cannot allocate the decode arena\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    UA_PubSubTransportLayer layer = UA_PubSubTransportLayerUDPMP();
 
     UA_PubSubConnectionConfig connectionConfig;
     memset(&connectionConfig, 0, sizeof(connectionConfig));
@@ -143,20 +368,91 @@ int main(int argc, char **argv) {
         UA_STRING("http://opcfoundation.org/UA-Profile/Transport/pubsub-udp-uadp");
     connectionConfig.enabled = UA_TRUE;
 
+    /* [uri] [device] as for tutorial_pubsub_subscribe */
     UA_NetworkAddressUrlDataType networkAddressUrl =
         {UA_STRING_NULL , UA_STRING("opc.udp://224.0.0.22:4840/")};
+    if(argc > 1) {
+        networkAddressUrl.url = UA_STRING(argv[1]);
+        if(argc > 2)
+            networkAddressUrl.networkInterface = UA_STRING(argv[2]);
+    }
+    if(strncmp((char*)networkAddressUrl.url.data, "opc.eth://", 10) == 0) {
+        if(xdp) {
+            layer = PubSubEthernetXdp_transportLayer();
+        } else {
+#ifdef UA_ENABLE_PUBSUB_ETH_UADP
+            layer = UA_PubSubTransportLayerEthernet();
+#else
+            printf("Error: UADP/ETH is not enabled, use --xdp\n");
+            return EXIT_FAILURE;
+#endif
+        }
+        connectionConfig.transportProfileUri = layer.transportProfileUri;
+    } else if(strncmp((char*)networkAddressUrl.url.data, "opc.mqtt://", 11) == 0) {
+        /* Subscribes to the default topic, see pubsub_mqtt.h */
+        layer = PubSubMqtt_transportLayer();
+        connectionConfig.transportProfileUri = layer.transportProfileUri;
+    }
     UA_Variant_setScalar(&connectionConfig.address, &networkAddressUrl,
                          &UA_TYPES[UA_TYPES_NETWORKADDRESSURLDATATYPE]);
+    if(latency)
+        layer = PubSubNetLatency_wrapTransportLayer(layer);
+    /* Above the latency wrapper, to record its receive timestamps */
+    if(captureConfig.path) {
+        capture = PubSubCapture_new(&captureConfig);
+        if(!capture) {
+            printf("Error: cannot create the capture %s\n", captureConfig.path);
+            return EXIT_FAILURE;
+        }
+        layer = PubSubCapture_wrapTransportLayer(layer, capture);
+    }
+    if(seqTracking)
+        layer = PubSubSeqTracker_wrapTransportLayer(layer);
 
     UA_PubSubChannel *psc =
-        udpLayer.createPubSubChannel(&connectionConfig);
-    psc->regist(psc, NULL, NULL);
+        layer.createPubSubChannel(&connectionConfig);
+    if(!psc || psc->regist(psc, NULL, NULL) != UA_STATUSCODE_GOOD) {
+        printf("Error: cannot open the PubSub channel\n");
+        if(psc)
+            psc->close(psc);
+        if(capture)
+            PubSubCapture_delete(capture);
+        return EXIT_FAILURE;
+    }
+
+    if(LogRing_init(&logger, &logConfig) != UA_STATUSCODE_GOOD) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "Cannot start the ring logger");
+        psc->close(psc);
+        if(capture)
+            PubSubCapture_delete(capture);
+        return EXIT_FAILURE;
+    }
 
     UA_StatusCode retval = UA_STATUSCODE_GOOD;
-    while(running && retval == UA_STATUSCODE_GOOD)
+    UA_DateTime nextDump = UA_DateTime_nowMonotonic() + 10 * UA_DATETIME_SEC;
+    while(running && retval == UA_STATUSCODE_GOOD) {
         retval = subscriberListen(psc);
+        if(UA_DateTime_nowMonotonic() > nextDump) {
+            dumpStatistics();
+            nextDump += 10 * UA_DATETIME_SEC;
+        }
+    }
 
+    dumpStatistics();
     psc->close(psc);
+
+    LogRingStats logStats;
+    LogRing_getStats(&logger, &logStats);
+    UA_LOG_INFO(&logger, UA_LOGCATEGORY_USERLAND,
+                "Log records written %lu, dropped %lu, suppressed %lu",
+                (unsigned long)logStats.written, (unsigned long)logStats.dropped,
+                (unsigned long)logStats.suppressed);
+    logger.clear(logger.context);
+    if(decodeArena)
+        PubSubArena_delete(decodeArena);
+    if(capture)
+        PubSubCapture_delete(capture);
         
     return 0;
 }
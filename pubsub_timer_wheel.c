@@ -0,0 +1,736 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_timer_wheel.h"
+#include "pubsub_probe.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef CLOCK_TAI
+#define CLOCK_TAI 11
+#endif
+
+#define LEVELBITS 6
+#define SLOTMASK (PUBSUBTIMERWHEEL_SLOTS - 1)
+#define WHEELRANGE (1ull << (LEVELBITS * PUBSUBTIMERWHEEL_LEVELS))
+#define NOEVENT UA_UINT64_MAX
+
+#define CHUNKSIZE 256
+#define MAXCHUNKS 1024 /* 256k timers */
+#define BUCKETHASH 64
+
+/* An entry in a slot of the wheel. Embedded at the start of a bucket of
+ * repeated timers or of a timeout. */
+typedef struct Entry {
+    struct Entry *next;
+    struct Entry **pprev; /* NULL if the entry is not in the wheel */
+    UA_UInt64 expire;     /* Tick */
+    UA_Byte level;
+    UA_Byte slot;
+    UA_Boolean bucket;
+} Entry;
+
+struct Bucket;
+
+typedef struct Timer {
+    Entry entry; /* Timeouts only */
+    UA_UInt32 index;
+    UA_UInt32 generation;
+    UA_Boolean used;
+    UA_Boolean repeated;
+    UA_ServerCallback callback;
+    UA_Server *server;
+    void *data;
+    UA_UInt64 ticks; /* Interval or timeout */
+    UA_UInt64 deadline; /* Timeouts: tick, moved without the lock */
+    UA_Boolean fired;   /* Timeouts: taken out of the wheel when expired */
+    struct Bucket *bucket;
+    struct Timer *next; /* In the bucket or the free list */
+    struct Timer *prev;
+} Timer;
+
+/* Repeated timers with the same interval */
+typedef struct Bucket {
+    Entry entry;
+    UA_UInt64 interval; /* Ticks */
+    Timer *first;
+    Timer *last;
+    struct Bucket *hashNext;
+} Bucket;
+
+static struct {
+    pthread_mutex_t lock; /* Recursive, released while a callback runs */
+    pthread_cond_t wakeup;
+    pthread_mutex_t serverLock; /* Held by the callbacks and the server loop */
+    pthread_cond_t done;        /* A callback has returned */
+    Timer *running;             /* Whose callback runs */
+    pthread_t thread;
+    UA_Boolean started;
+    UA_Boolean stopping;
+
+    UA_UInt64 tick;       /* ns */
+    UA_UInt64 current;    /* Last processed tick */
+    UA_UInt64 now;        /* Tick of the clock while processing */
+    UA_UInt64 sleepUntil; /* Tick the thread waits for */
+    Entry *slots[PUBSUBTIMERWHEEL_LEVELS][PUBSUBTIMERWHEEL_SLOTS];
+    UA_UInt64 occupied[PUBSUBTIMERWHEEL_LEVELS];
+
+    Timer *chunks[MAXCHUNKS];
+    size_t chunksSize;
+    Timer *freeTimers;
+    Bucket *buckets[BUCKETHASH];
+
+    /* The bucket whose callbacks run and the next timer to call */
+    Bucket *firingBucket;
+    Timer *nextMember;
+
+    PubSubTimerWheelStats stats;
+} wheel;
+
+static pthread_once_t wheelOnce = PTHREAD_ONCE_INIT;
+
+static void
+initWheel(void) {
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_settype(&mattr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&wheel.lock, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+    pthread_mutex_init(&wheel.serverLock, NULL);
+
+    /* The deadlines are on CLOCK_TAI, which has no condition variable
+     * support. Both clocks run at the same rate, so the remaining time is
+     * converted to a CLOCK_MONOTONIC deadline. */
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wheel.wakeup, &cattr);
+    pthread_condattr_destroy(&cattr);
+    pthread_cond_init(&wheel.done, NULL);
+
+    wheel.tick = PUBSUBTIMERWHEEL_TICK;
+}
+
+static UA_UInt64
+clockNs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (UA_UInt64)ts.tv_sec * 1000000000ull + (UA_UInt64)ts.tv_nsec;
+}
+
+/* The clock can step back (e.g. PTP), the wheel cannot */
+static UA_UInt64
+nowTick(void) {
+    UA_UInt64 now = clockNs(CLOCK_TAI) / wheel.tick;
+    return now > wheel.current ? now : wheel.current;
+}
+
+/*********/
+/* Wheel */
+/*********/
+
+static void
+insertEntry(Entry *e, UA_UInt64 expire) {
+    if(expire < wheel.current)
+        expire = wheel.current;
+    e->expire = expire;
+
+    /* Entries beyond the range of the wheel wait in the last slot that can
+     * be reached and are inserted again from there */
+    UA_UInt64 delta = expire - wheel.current;
+    UA_UInt64 pos = expire;
+    if(delta >= WHEELRANGE) {
+        delta = WHEELRANGE - 1;
+        pos = wheel.current + delta;
+    }
+    UA_Byte level = 0;
+    while(delta >= (1ull << (LEVELBITS * (level + 1))))
+        level++;
+    UA_Byte slot = (UA_Byte)((pos >> (LEVELBITS * level)) & SLOTMASK);
+
+    e->level = level;
+    e->slot = slot;
+    e->next = wheel.slots[level][slot];
+    if(e->next)
+        e->next->pprev = &e->next;
+    e->pprev = &wheel.slots[level][slot];
+    wheel.slots[level][slot] = e;
+    wheel.occupied[level] |= 1ull << slot;
+
+    if(expire < wheel.sleepUntil)
+        pthread_cond_signal(&wheel.wakeup);
+}
+
+static void
+unlinkEntry(Entry *e) {
+    if(!e->pprev)
+        return;
+    *e->pprev = e->next;
+    if(e->next)
+        e->next->pprev = e->pprev;
+    e->next = NULL;
+    e->pprev = NULL;
+    if(!wheel.slots[e->level][e->slot])
+        wheel.occupied[e->level] &= ~(1ull << e->slot);
+}
+
+/* First tick after the current one where a level-0 slot expires or a slot of
+ * a higher level is cascaded down */
+static UA_UInt64
+nextEvent(void) {
+    UA_UInt64 next = NOEVENT;
+    for(size_t level = 0; level < PUBSUBTIMERWHEEL_LEVELS; level++) {
+        UA_UInt64 bits = wheel.occupied[level];
+        if(!bits)
+            continue;
+        unsigned shift = (unsigned)(LEVELBITS * level);
+        UA_UInt64 index = wheel.current >> shift;
+        unsigned rot = (unsigned)((index + 1) & SLOTMASK);
+        if(rot)
+            bits = (bits >> rot) | (bits << (PUBSUBTIMERWHEEL_SLOTS - rot));
+        UA_UInt64 t = (index + 1 + (UA_UInt64)__builtin_ctzll(bits)) << shift;
+        if(t < next)
+            next = t;
+    }
+    return next;
+}
+
+static void
+cascade(size_t level, size_t slot) {
+    Entry *e = wheel.slots[level][slot];
+    wheel.slots[level][slot] = NULL;
+    wheel.occupied[level] &= ~(1ull << slot);
+    while(e) {
+        Entry *next = e->next;
+        e->pprev = NULL;
+        insertEntry(e, e->expire);
+        e = next;
+    }
+}
+
+/**************/
+/* Callbacks  */
+/**************/
+
+static void
+freeBucket(Bucket *b) {
+    unlinkEntry(&b->entry);
+    Bucket **bp = &wheel.buckets[b->interval % BUCKETHASH];
+    while(*bp != b)
+        bp = &(*bp)->hashNext;
+    *bp = b->hashNext;
+    wheel.stats.buckets--;
+    UA_free(b);
+}
+
+/* Called with the lock of the wheel. It is released during the callback, so
+ * the callback can use the wheel and the server thread is not blocked. */
+static void
+runCallback(Timer *t) {
+    UA_ServerCallback callback = t->callback;
+    UA_Server *server = t->server;
+    void *data = t->data;
+    wheel.running = t;
+    pthread_mutex_unlock(&wheel.lock);
+    callback(server, data);
+    pthread_mutex_lock(&wheel.lock);
+    wheel.running = NULL;
+    wheel.stats.callbacks++;
+    pthread_cond_broadcast(&wheel.done);
+}
+
+static void
+fireBucket(Bucket *b) {
+    /* Reschedule first to the next cycle after now. The callbacks may remove
+     * their timers. */
+    UA_UInt64 cycle = b->entry.expire / b->interval;
+    UA_UInt64 nextCycle = wheel.now / b->interval + 1;
+    wheel.stats.skipped += nextCycle - cycle - 1;
+    insertEntry(&b->entry, nextCycle * b->interval);
+
+    wheel.firingBucket = b;
+    Timer *t = b->first;
+    while(t) {
+        wheel.nextMember = t->next;
+        /* Start of the publish cycle for the ENCODE probe */
+        PubSubProbe_setMark();
+        runCallback(t);
+        t = wheel.nextMember;
+    }
+    wheel.firingBucket = NULL;
+    wheel.nextMember = NULL;
+    if(!b->first)
+        freeBucket(b);
+}
+
+static void
+processTick(UA_UInt64 t) {
+    for(size_t level = PUBSUBTIMERWHEEL_LEVELS - 1; level > 0; level--) {
+        unsigned shift = (unsigned)(LEVELBITS * level);
+        if(t & ((1ull << shift) - 1))
+            continue;
+        size_t slot = (size_t)((t >> shift) & SLOTMASK);
+        if(wheel.slots[level][slot])
+            cascade(level, slot);
+    }
+
+    size_t slot = (size_t)(t & SLOTMASK);
+    if(!wheel.slots[0][slot])
+        return;
+    UA_UInt64 lateness = clockNs(CLOCK_TAI) - t * wheel.tick;
+    if((UA_Int64)lateness > 0 && lateness > wheel.stats.maxLateness)
+        wheel.stats.maxLateness = lateness;
+
+    /* New entries never land in the slot of the current tick */
+    Entry *e;
+    while((e = wheel.slots[0][slot])) {
+        unlinkEntry(e);
+        if(e->bucket) {
+            fireBucket((Bucket*)e);
+        } else {
+            /* Move the timeout if it was reset since it was inserted. The
+             * flag is set before the deadline is read, see
+             * PubSubTimerWheel_resetTimeout. */
+            Timer *timeout = (Timer*)e;
+            __atomic_store_n(&timeout->fired, true, __ATOMIC_SEQ_CST);
+            UA_UInt64 deadline = __atomic_load_n(&timeout->deadline, __ATOMIC_SEQ_CST);
+            if(deadline > t) {
+                __atomic_store_n(&timeout->fired, false, __ATOMIC_RELAXED);
+                insertEntry(&timeout->entry, deadline);
+                continue;
+            }
+            runCallback(timeout);
+        }
+    }
+}
+
+static void
+advance(UA_UInt64 now) {
+    wheel.now = now;
+    while(wheel.current < now) {
+        UA_UInt64 t = nextEvent();
+        if(t > now) {
+            wheel.current = now;
+            break;
+        }
+        wheel.current = t;
+        processTick(t);
+    }
+}
+
+static void *
+wheelThread(void *arg) {
+    pthread_mutex_lock(&wheel.lock);
+    while(!wheel.stopping) {
+        /* The callbacks run with the server lock. It is taken before the
+         * lock of the wheel. */
+        pthread_mutex_unlock(&wheel.lock);
+        pthread_mutex_lock(&wheel.serverLock);
+        pthread_mutex_lock(&wheel.lock);
+        wheel.sleepUntil = 0;
+        advance(nowTick());
+        pthread_mutex_unlock(&wheel.serverLock);
+        wheel.sleepUntil = nextEvent();
+        if(wheel.sleepUntil == NOEVENT) {
+            pthread_cond_wait(&wheel.wakeup, &wheel.lock);
+        } else {
+            UA_UInt64 tai = clockNs(CLOCK_TAI);
+            UA_UInt64 target = wheel.sleepUntil * wheel.tick;
+            UA_UInt64 deadline = clockNs(CLOCK_MONOTONIC);
+            if(target > tai)
+                deadline += target - tai;
+            struct timespec ts;
+            ts.tv_sec = (time_t)(deadline / 1000000000ull);
+            ts.tv_nsec = (long)(deadline % 1000000000ull);
+            pthread_cond_timedwait(&wheel.wakeup, &wheel.lock, &ts);
+        }
+        wheel.stats.wakeups++;
+    }
+    pthread_mutex_unlock(&wheel.lock);
+    return NULL;
+}
+
+/**********/
+/* Timers */
+/**********/
+
+static UA_StatusCode
+toTicks(UA_Double ms, UA_UInt64 *ticks) {
+    if(!(ms > 0.0))
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    *ticks = (UA_UInt64)(ms * 1000000.0 / (UA_Double)wheel.tick + 0.5);
+    if(*ticks == 0)
+        *ticks = 1;
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+startThread(void) {
+    if(wheel.started)
+        return UA_STATUSCODE_GOOD;
+    wheel.current = clockNs(CLOCK_TAI) / wheel.tick;
+    wheel.sleepUntil = NOEVENT;
+    if(pthread_create(&wheel.thread, NULL, wheelThread, NULL) != 0)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    wheel.started = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+static Timer *
+allocTimer(void) {
+    if(!wheel.freeTimers) {
+        if(wheel.chunksSize == MAXCHUNKS)
+            return NULL;
+        Timer *chunk = (Timer*)UA_calloc(CHUNKSIZE, sizeof(Timer));
+        if(!chunk)
+            return NULL;
+        for(size_t i = CHUNKSIZE; i > 0; i--) {
+            chunk[i-1].index = (UA_UInt32)(wheel.chunksSize * CHUNKSIZE + i - 1);
+            chunk[i-1].next = wheel.freeTimers;
+            wheel.freeTimers = &chunk[i-1];
+        }
+        /* Published last, timers are looked up without the lock */
+        wheel.chunks[wheel.chunksSize] = chunk;
+        __atomic_store_n(&wheel.chunksSize, wheel.chunksSize + 1, __ATOMIC_RELEASE);
+    }
+    Timer *t = wheel.freeTimers;
+    wheel.freeTimers = t->next;
+    UA_UInt32 index = t->index;
+    UA_UInt32 generation = t->generation;
+    memset(t, 0, sizeof(Timer));
+    t->index = index;
+    t->generation = generation;
+    t->used = true;
+    wheel.stats.timers++;
+    return t;
+}
+
+static void
+freeTimer(Timer *t) {
+    t->used = false;
+    t->generation++;
+    t->next = wheel.freeTimers;
+    wheel.freeTimers = t;
+    wheel.stats.timers--;
+}
+
+static UA_UInt64
+timerId(const Timer *t) {
+    return ((UA_UInt64)t->generation << 32) | ((UA_UInt64)t->index + 1);
+}
+
+static Timer *
+findTimer(UA_UInt64 id) {
+    UA_UInt64 index = (id & 0xffffffffu) - 1;
+    if((id & 0xffffffffu) == 0 ||
+       index / CHUNKSIZE >= __atomic_load_n(&wheel.chunksSize, __ATOMIC_ACQUIRE))
+        return NULL;
+    Timer *t = &wheel.chunks[index / CHUNKSIZE][index % CHUNKSIZE];
+    if(!t->used || t->generation != (UA_UInt32)(id >> 32))
+        return NULL;
+    return t;
+}
+
+static Bucket *
+getBucket(UA_UInt64 interval) {
+    Bucket **head = &wheel.buckets[interval % BUCKETHASH];
+    for(Bucket *b = *head; b; b = b->hashNext) {
+        if(b->interval == interval)
+            return b;
+    }
+    Bucket *b = (Bucket*)UA_calloc(1, sizeof(Bucket));
+    if(!b)
+        return NULL;
+    b->entry.bucket = true;
+    b->interval = interval;
+    b->hashNext = *head;
+    *head = b;
+    wheel.stats.buckets++;
+
+    /* Cycles are aligned to multiples of the interval */
+    insertEntry(&b->entry, (nowTick() / interval + 1) * interval);
+    return b;
+}
+
+static void
+addToBucket(Timer *t, Bucket *b) {
+    t->bucket = b;
+    t->next = NULL;
+    t->prev = b->last;
+    if(b->last)
+        b->last->next = t;
+    else
+        b->first = t;
+    b->last = t;
+}
+
+static void
+removeFromBucket(Timer *t) {
+    Bucket *b = t->bucket;
+    if(wheel.nextMember == t)
+        wheel.nextMember = t->next;
+    if(t->prev)
+        t->prev->next = t->next;
+    else
+        b->first = t->next;
+    if(t->next)
+        t->next->prev = t->prev;
+    else
+        b->last = t->prev;
+    t->next = NULL;
+    t->prev = NULL;
+    t->bucket = NULL;
+    if(!b->first && b != wheel.firingBucket)
+        freeBucket(b);
+}
+
+static UA_StatusCode
+addTimer(UA_Server *server, UA_ServerCallback callback, void *data,
+         UA_Double ms, UA_Boolean repeated, UA_UInt64 *callbackId) {
+    if(!callback)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    pthread_once(&wheelOnce, initWheel);
+    pthread_mutex_lock(&wheel.lock);
+    UA_UInt64 ticks;
+    UA_StatusCode retval = toTicks(ms, &ticks);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = startThread();
+    if(retval != UA_STATUSCODE_GOOD) {
+        pthread_mutex_unlock(&wheel.lock);
+        return retval;
+    }
+
+    Timer *t = allocTimer();
+    Bucket *b = (t && repeated) ? getBucket(ticks) : NULL;
+    if(!t || (repeated && !b)) {
+        if(t)
+            freeTimer(t);
+        pthread_mutex_unlock(&wheel.lock);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    t->repeated = repeated;
+    t->callback = callback;
+    t->server = server;
+    t->data = data;
+    t->ticks = ticks;
+    if(repeated) {
+        addToBucket(t, b);
+    } else {
+        t->deadline = nowTick() + ticks;
+        insertEntry(&t->entry, t->deadline);
+    }
+    if(callbackId)
+        *callbackId = timerId(t);
+    pthread_mutex_unlock(&wheel.lock);
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+PubSubTimerWheel_setTick(UA_UInt64 tick) {
+    if(tick == 0)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    pthread_once(&wheelOnce, initWheel);
+    pthread_mutex_lock(&wheel.lock);
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    if(wheel.started)
+        retval = UA_STATUSCODE_BADINVALIDSTATE;
+    else
+        wheel.tick = tick;
+    pthread_mutex_unlock(&wheel.lock);
+    return retval;
+}
+
+UA_StatusCode
+PubSubTimerWheel_addRepeatedCallback(UA_Server *server, UA_ServerCallback callback,
+                                     void *data, UA_Double interval_ms,
+                                     UA_UInt64 *callbackId) {
+    return addTimer(server, callback, data, interval_ms, true, callbackId);
+}
+
+UA_StatusCode
+PubSubTimerWheel_changeRepeatedCallbackInterval(UA_UInt64 callbackId,
+                                                UA_Double interval_ms) {
+    pthread_once(&wheelOnce, initWheel);
+    pthread_mutex_lock(&wheel.lock);
+    UA_UInt64 ticks;
+    UA_StatusCode retval = toTicks(interval_ms, &ticks);
+    Timer *t = findTimer(callbackId);
+    if(retval == UA_STATUSCODE_GOOD && (!t || !t->repeated))
+        retval = UA_STATUSCODE_BADNOTFOUND;
+    if(retval != UA_STATUSCODE_GOOD || t->ticks == ticks) {
+        pthread_mutex_unlock(&wheel.lock);
+        return retval;
+    }
+
+    Bucket *b = getBucket(ticks);
+    if(!b) {
+        pthread_mutex_unlock(&wheel.lock);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    removeFromBucket(t);
+    addToBucket(t, b);
+    t->ticks = ticks;
+    pthread_mutex_unlock(&wheel.lock);
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+PubSubTimerWheel_addTimeout(UA_Server *server, UA_ServerCallback callback,
+                            void *data, UA_Double timeout_ms, UA_UInt64 *callbackId) {
+    return addTimer(server, callback, data, timeout_ms, false, callbackId);
+}
+
+/* Only the deadline is moved. The entry stays in its slot and is moved to
+ * the deadline when the slot expires. */
+UA_StatusCode
+PubSubTimerWheel_resetTimeout(UA_UInt64 callbackId) {
+    Timer *t = findTimer(callbackId);
+    if(!t || t->repeated)
+        return UA_STATUSCODE_BADNOTFOUND;
+    __atomic_store_n(&t->deadline, clockNs(CLOCK_TAI) / wheel.tick + t->ticks,
+                     __ATOMIC_SEQ_CST);
+    if(!__atomic_load_n(&t->fired, __ATOMIC_SEQ_CST))
+        return UA_STATUSCODE_GOOD;
+
+    /* Insert again after the timeout has fired */
+    pthread_mutex_lock(&wheel.lock);
+    if(findTimer(callbackId) == t && t->fired && !t->entry.pprev) {
+        t->fired = false;
+        insertEntry(&t->entry, t->deadline);
+    }
+    pthread_mutex_unlock(&wheel.lock);
+    return UA_STATUSCODE_GOOD;
+}
+
+void
+PubSubTimerWheel_removeCallback(UA_UInt64 callbackId) {
+    pthread_once(&wheelOnce, initWheel);
+    pthread_mutex_lock(&wheel.lock);
+    Timer *t = findTimer(callbackId);
+    /* Wait for the callback, unless it removes its own timer */
+    while(t && t == wheel.running && !pthread_equal(pthread_self(), wheel.thread)) {
+        pthread_cond_wait(&wheel.done, &wheel.lock);
+        t = findTimer(callbackId);
+    }
+    if(t) {
+        if(t->repeated)
+            removeFromBucket(t);
+        else
+            unlinkEntry(&t->entry);
+        freeTimer(t);
+    }
+    pthread_mutex_unlock(&wheel.lock);
+}
+
+void
+PubSubTimerWheel_getStats(PubSubTimerWheelStats *stats) {
+    pthread_once(&wheelOnce, initWheel);
+    pthread_mutex_lock(&wheel.lock);
+    *stats = wheel.stats;
+    pthread_mutex_unlock(&wheel.lock);
+}
+
+void
+PubSubTimerWheel_shutdown(void) {
+    pthread_once(&wheelOnce, initWheel);
+    pthread_mutex_lock(&wheel.lock);
+    if(!wheel.started) {
+        pthread_mutex_unlock(&wheel.lock);
+        return;
+    }
+    if(wheel.stats.timers > 0)
+        UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                       "Timer wheel stopped with %lu timers left",
+                       (unsigned long)wheel.stats.timers);
+    wheel.stopping = true;
+    pthread_cond_signal(&wheel.wakeup);
+    pthread_mutex_unlock(&wheel.lock);
+    pthread_join(wheel.thread, NULL);
+
+    for(size_t i = 0; i < BUCKETHASH; i++) {
+        while(wheel.buckets[i]) {
+            Bucket *b = wheel.buckets[i];
+            wheel.buckets[i] = b->hashNext;
+            UA_free(b);
+        }
+    }
+    for(size_t i = 0; i < wheel.chunksSize; i++)
+        UA_free(wheel.chunks[i]);
+    UA_UInt64 tick = wheel.tick;
+    pthread_mutex_t lock = wheel.lock;
+    pthread_cond_t wakeup = wheel.wakeup;
+    pthread_mutex_t serverLock = wheel.serverLock;
+    pthread_cond_t done = wheel.done;
+    memset(&wheel, 0, sizeof(wheel));
+    wheel.lock = lock;
+    wheel.wakeup = wakeup;
+    wheel.serverLock = serverLock;
+    wheel.done = done;
+    wheel.tick = tick;
+}
+
+void
+PubSubTimerWheel_lockServer(void) {
+    pthread_once(&wheelOnce, initWheel);
+    pthread_mutex_lock(&wheel.serverLock);
+}
+
+void
+PubSubTimerWheel_unlockServer(void) {
+    pthread_mutex_unlock(&wheel.serverLock);
+}
+
+UA_StatusCode
+PubSubTimerWheel_runServer(UA_Server *server, volatile UA_Boolean *running) {
+    pthread_once(&wheelOnce, initWheel);
+    UA_StatusCode retval = UA_Server_run_startup(server);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    while(*running) {
+        /* The network layer is polled without waiting. The lock is released
+         * while the thread sleeps. */
+        pthread_mutex_lock(&wheel.serverLock);
+        UA_UInt16 timeout = UA_Server_run_iterate(server, false);
+        pthread_mutex_unlock(&wheel.serverLock);
+        if(timeout > PUBSUBTIMERWHEEL_SERVERPOLL)
+            timeout = PUBSUBTIMERWHEEL_SERVERPOLL;
+        struct timespec ts = {0, (long)timeout * 1000000};
+        nanosleep(&ts, NULL);
+    }
+    pthread_mutex_lock(&wheel.serverLock);
+    retval = UA_Server_run_shutdown(server);
+    pthread_mutex_unlock(&wheel.serverLock);
+    return retval;
+}
+
+/*****************************/
+/* Custom publish scheduling */
+/*****************************/
+
+#ifdef UA_ENABLE_PUBSUB_CUSTOM_PUBLISH_HANDLING
+
+UA_StatusCode
+UA_PubSubManager_addRepeatedCallback(UA_Server *server, UA_ServerCallback callback,
+                                     void *data, UA_Double interval_ms,
+                                     UA_UInt64 *callbackId) {
+    return PubSubTimerWheel_addRepeatedCallback(server, callback, data,
+                                                interval_ms, callbackId);
+}
+
+UA_StatusCode
+UA_PubSubManager_changeRepeatedCallbackInterval(UA_Server *server, UA_UInt64 callbackId,
+                                                UA_Double interval_ms) {
+    return PubSubTimerWheel_changeRepeatedCallbackInterval(callbackId, interval_ms);
+}
+
+void
+UA_PubSubManager_removeRepeatedCallback(UA_Server *server, UA_UInt64 callbackId) {
+    PubSubTimerWheel_removeCallback(callbackId);
+}
+
+#endif
@@ -0,0 +1,113 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_TIMER_WHEEL_H_
+#define PUBSUB_TIMER_WHEEL_H_
+
+#include <open62541/server.h>
+
+/**
+ * PubSub Timer Wheel
+ * ------------------
+ * Every WriterGroup (and every ReaderGroup) is a repeated callback in the
+ * timer list of the server. With thousands of groups, inserting,
+ * rescheduling and scanning that list becomes visible in profiles. The timer
+ * wheel replaces it for the PubSub runtime.
+ *
+ * The wheel is hierarchical with four levels of 64 slots. A timer is put
+ * into the slot of its expiry tick on the level that covers the remaining
+ * time, so adding and cancelling a timer is O(1). When the lower level wraps
+ * around, the next slot of the level above is cascaded down. A bitmap per
+ * level lets the wheel thread sleep until the next occupied slot instead of
+ * waking up on every tick.
+ *
+ * Repeated timers with the same interval are coalesced. They share one entry
+ * in the wheel and fire in the same tick, one after the other in the order
+ * they were added. The cycles are multiples of the interval counted from the
+ * TAI epoch, the same phase as the launch times of pubsub_txtime.h. Cycles
+ * that passed while the callbacks were still busy are skipped and counted.
+ *
+ * One-shot timeouts, e.g. for the messageReceiveTimeout of a DataSetReader,
+ * are single entries. Resetting a timeout only stores the new deadline,
+ * without a lock, so it can be done for every received message. The entry is
+ * moved to the deadline when its old slot expires.
+ *
+ * The callbacks run in the thread of the wheel, started with the first
+ * timer. The lock of the wheel is released during a callback, so callbacks
+ * may add, change and remove timers themselves. Removing a timer from
+ * another thread waits until its callback has returned.
+ *
+ * The callbacks of the PubSub runtime use the server like its services do.
+ * They run with the server lock of the wheel held. ``PubSubTimerWheel_runServer``
+ * replaces ``UA_Server_run`` and holds the same lock during each iteration of
+ * the server, so callbacks and services never run at the same time.
+ *
+ * With ``UA_ENABLE_PUBSUB_CUSTOM_PUBLISH_HANDLING`` the open62541 PubSub
+ * runtime schedules its publish and subscribe callbacks through the
+ * ``UA_PubSubManager_*RepeatedCallback`` functions of the application. This
+ * module defines them on top of the wheel. */
+
+#define PUBSUBTIMERWHEEL_TICK 100000   /* Default tick in ns */
+#define PUBSUBTIMERWHEEL_LEVELS 4
+#define PUBSUBTIMERWHEEL_SLOTS 64
+#define PUBSUBTIMERWHEEL_SERVERPOLL 1 /* Max sleep of the server loop in ms */
+
+typedef struct {
+    UA_UInt64 timers;      /* Repeated timers and timeouts */
+    UA_UInt64 buckets;     /* Distinct intervals of the repeated timers */
+    UA_UInt64 wakeups;     /* Wakeups of the wheel thread */
+    UA_UInt64 callbacks;
+    UA_UInt64 skipped;     /* Cycles skipped because the thread was late */
+    UA_UInt64 maxLateness; /* ns between expiry and start of the callbacks */
+} PubSubTimerWheelStats;
+
+/* Tick of the wheel in ns. Must be set before the first timer is added.
+ * Intervals are rounded to whole ticks. */
+UA_StatusCode
+PubSubTimerWheel_setTick(UA_UInt64 tick);
+
+UA_StatusCode
+PubSubTimerWheel_addRepeatedCallback(UA_Server *server, UA_ServerCallback callback,
+                                     void *data, UA_Double interval_ms,
+                                     UA_UInt64 *callbackId);
+
+UA_StatusCode
+PubSubTimerWheel_changeRepeatedCallbackInterval(UA_UInt64 callbackId,
+                                                UA_Double interval_ms);
+
+/* The callback fires once, timeout_ms after it was added or last reset */
+UA_StatusCode
+PubSubTimerWheel_addTimeout(UA_Server *server, UA_ServerCallback callback,
+                            void *data, UA_Double timeout_ms, UA_UInt64 *callbackId);
+
+/* Restarts the timeout, also after it has fired. Without a lock until the
+ * timeout has fired. Must not run concurrently with removing the timeout. */
+UA_StatusCode
+PubSubTimerWheel_resetTimeout(UA_UInt64 callbackId);
+
+/* Removes repeated timers and timeouts */
+void
+PubSubTimerWheel_removeCallback(UA_UInt64 callbackId);
+
+void
+PubSubTimerWheel_getStats(PubSubTimerWheelStats *stats);
+
+/* For other threads that use the server, e.g. pubsub_publish_pool.h. Not
+ * from the callbacks of the wheel, they hold the lock already. */
+void
+PubSubTimerWheel_lockServer(void);
+
+void
+PubSubTimerWheel_unlockServer(void);
+
+/* Runs the server like UA_Server_run. Each iteration holds the server lock
+ * of the wheel. */
+UA_StatusCode
+PubSubTimerWheel_runServer(UA_Server *server, volatile UA_Boolean *running);
+
+/* Stops the thread. All timers must have been removed, i.e. the server
+ * must have been deleted. */
+void
+PubSubTimerWheel_shutdown(void);
+
+#endif /* PUBSUB_TIMER_WHEEL_H_ */
@@ -0,0 +1,237 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_transport_wrap.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#define PUBSUBTRANSPORTWRAP_MAXCHANNELS 64
+#define CHANNELTABLESIZE 128 /* Power of two, twice the channels */
+
+/* The transport layer interface has no context pointer. Every wrapped layer
+ * gets a slot with its own set of trampoline functions below. */
+typedef struct {
+    UA_PubSubTransportLayer inner;
+    const PubSubTransportWrapper *wrapper;
+    void *wrapperContext;
+} WrapSlot;
+
+typedef struct {
+    size_t slot;
+    PubSubChannelWrap wrap;
+} ChannelEntry;
+
+static WrapSlot slots[PUBSUBTRANSPORTWRAP_MAXLAYERS];
+static size_t slotsSize = 0;
+
+/* Open addressing over (slot, channel pointer). Channels are created and
+ * closed from the server thread. The operations may be called from other
+ * threads (publish workers) and look up their entry without a lock. Closed
+ * entries leave a tombstone, so the probe sequences of the others stay
+ * intact. */
+static ChannelEntry *channels[CHANNELTABLESIZE];
+static size_t channelsSize = 0;
+static ChannelEntry tombstone;
+
+static size_t
+channelHash(size_t slot, const UA_PubSubChannel *channel) {
+    UA_UInt64 h = ((UA_UInt64)(uintptr_t)channel >> 4) ^ ((UA_UInt64)slot << 56);
+    h *= 0x9e3779b97f4a7c15ull;
+    return (size_t)(h >> 32);
+}
+
+/* Returns the index of the entry, or CHANNELTABLESIZE */
+static size_t
+findEntry(size_t slot, const UA_PubSubChannel *channel, ChannelEntry **entry) {
+    size_t h = channelHash(slot, channel);
+    for(size_t i = 0; i < CHANNELTABLESIZE; i++) {
+        size_t index = (h + i) & (CHANNELTABLESIZE - 1);
+        ChannelEntry *e = __atomic_load_n(&channels[index], __ATOMIC_ACQUIRE);
+        if(!e)
+            break;
+        if(e != &tombstone && e->slot == slot && e->wrap.channel == channel) {
+            *entry = e;
+            return index;
+        }
+    }
+    return CHANNELTABLESIZE;
+}
+
+static PubSubChannelWrap *
+findWrap(size_t slot, const UA_PubSubChannel *channel) {
+    ChannelEntry *entry;
+    if(findEntry(slot, channel, &entry) == CHANNELTABLESIZE)
+        return NULL;
+    return &entry->wrap;
+}
+
+static UA_StatusCode
+wrapSend(size_t slot, UA_PubSubChannel *channel,
+         UA_ExtensionObject *transportSettings, const UA_ByteString *buf) {
+    PubSubChannelWrap *wrap = findWrap(slot, channel);
+    if(!wrap)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    if(wrap->wrapper->send)
+        return wrap->wrapper->send(wrap, transportSettings, buf);
+    return wrap->send(channel, transportSettings, buf);
+}
+
+static UA_StatusCode
+wrapReceive(size_t slot, UA_PubSubChannel *channel, UA_ByteString *buf,
+            UA_ExtensionObject *transportSettings, UA_UInt32 timeout) {
+    PubSubChannelWrap *wrap = findWrap(slot, channel);
+    if(!wrap)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    if(wrap->wrapper->receive)
+        return wrap->wrapper->receive(wrap, buf, transportSettings, timeout);
+    return wrap->receive(channel, buf, transportSettings, timeout);
+}
+
+static UA_StatusCode
+wrapClose(size_t slot, UA_PubSubChannel *channel) {
+    ChannelEntry *entry;
+    size_t index = findEntry(slot, channel, &entry);
+    if(index == CHANNELTABLESIZE)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    __atomic_store_n(&channels[index], &tombstone, __ATOMIC_RELEASE);
+    channelsSize--;
+
+    /* Restore the inner operations. The inner close frees the channel. */
+    PubSubChannelWrap *wrap = &entry->wrap;
+    if(wrap->wrapper->clear)
+        wrap->wrapper->clear(wrap);
+    channel->send = wrap->send;
+    channel->receive = wrap->receive;
+    channel->close = wrap->close;
+    UA_StatusCode retval = wrap->close(channel);
+    UA_free(entry);
+    return retval;
+}
+
+typedef struct {
+    UA_PubSubChannel *(*create)(UA_PubSubConnectionConfig *connectionConfig);
+    UA_StatusCode (*send)(UA_PubSubChannel *, UA_ExtensionObject *, const UA_ByteString *);
+    UA_StatusCode (*receive)(UA_PubSubChannel *, UA_ByteString *, UA_ExtensionObject *, UA_UInt32);
+    UA_StatusCode (*close)(UA_PubSubChannel *);
+} SlotOps;
+
+/* Defined below the trampolines */
+static const SlotOps slotOps[PUBSUBTRANSPORTWRAP_MAXLAYERS];
+
+static UA_PubSubChannel *
+wrapCreate(size_t slot, UA_PubSubConnectionConfig *connectionConfig) {
+    const WrapSlot *s = &slots[slot];
+    UA_PubSubChannel *channel = s->inner.createPubSubChannel(connectionConfig);
+    if(!channel)
+        return NULL;
+
+    /* The first free or closed entry on the probe sequence. The channel
+     * pointer is new, it is not in the table. */
+    size_t freeIndex = CHANNELTABLESIZE;
+    size_t h = channelHash(slot, channel);
+    for(size_t i = 0; i < CHANNELTABLESIZE &&
+            channelsSize < PUBSUBTRANSPORTWRAP_MAXCHANNELS; i++) {
+        size_t index = (h + i) & (CHANNELTABLESIZE - 1);
+        if(!channels[index] || channels[index] == &tombstone) {
+            freeIndex = index;
+            break;
+        }
+    }
+    ChannelEntry *entry = NULL;
+    if(freeIndex < CHANNELTABLESIZE)
+        entry = (ChannelEntry*)UA_calloc(1, sizeof(ChannelEntry));
+    if(!entry) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub transport wrapper %s: No space for another channel",
+                     s->wrapper->name);
+        channel->close(channel);
+        return NULL;
+    }
+
+    entry->slot = slot;
+    PubSubChannelWrap *wrap = &entry->wrap;
+    wrap->channel = channel;
+    wrap->wrapper = s->wrapper;
+    wrap->wrapperContext = s->wrapperContext;
+    wrap->send = channel->send;
+    wrap->receive = channel->receive;
+    wrap->close = channel->close;
+    if(s->wrapper->init) {
+        UA_StatusCode retval = s->wrapper->init(wrap, connectionConfig);
+        if(retval != UA_STATUSCODE_GOOD) {
+            UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                         "PubSub transport wrapper %s: Initialization failed with %s",
+                         s->wrapper->name, UA_StatusCode_name(retval));
+            channel->close(channel);
+            UA_free(entry);
+            return NULL;
+        }
+    }
+
+    channel->send = slotOps[slot].send;
+    channel->receive = slotOps[slot].receive;
+    channel->close = slotOps[slot].close;
+    __atomic_store_n(&channels[freeIndex], entry, __ATOMIC_RELEASE);
+    channelsSize++;
+    return channel;
+}
+
+#define WRAP_SLOT(N)                                                          \
+    static UA_PubSubChannel *                                                 \
+    wrapCreate##N(UA_PubSubConnectionConfig *c) { return wrapCreate(N, c); }  \
+    static UA_StatusCode                                                      \
+    wrapSend##N(UA_PubSubChannel *c, UA_ExtensionObject *t,                   \
+                const UA_ByteString *b) { return wrapSend(N, c, t, b); }      \
+    static UA_StatusCode                                                      \
+    wrapReceive##N(UA_PubSubChannel *c, UA_ByteString *b,                     \
+                   UA_ExtensionObject *t, UA_UInt32 to) {                     \
+        return wrapReceive(N, c, b, t, to);                                   \
+    }                                                                         \
+    static UA_StatusCode                                                      \
+    wrapClose##N(UA_PubSubChannel *c) { return wrapClose(N, c); }
+
+WRAP_SLOT(0)
+WRAP_SLOT(1)
+WRAP_SLOT(2)
+WRAP_SLOT(3)
+WRAP_SLOT(4)
+WRAP_SLOT(5)
+WRAP_SLOT(6)
+WRAP_SLOT(7)
+
+#define SLOT_OPS(N) {wrapCreate##N, wrapSend##N, wrapReceive##N, wrapClose##N}
+
+static const SlotOps slotOps[PUBSUBTRANSPORTWRAP_MAXLAYERS] = {
+    SLOT_OPS(0), SLOT_OPS(1), SLOT_OPS(2), SLOT_OPS(3),
+    SLOT_OPS(4), SLOT_OPS(5), SLOT_OPS(6), SLOT_OPS(7)
+};
+
+UA_PubSubTransportLayer
+PubSubTransportWrap_layer(UA_PubSubTransportLayer inner,
+                          const PubSubTransportWrapper *wrapper,
+                          void *wrapperContext) {
+    if(slotsSize >= PUBSUBTRANSPORTWRAP_MAXLAYERS) {
+        UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                       "PubSub transport wrapper %s: All %u slots in use, "
+                       "the transport layer is not wrapped", wrapper->name,
+                       PUBSUBTRANSPORTWRAP_MAXLAYERS);
+        return inner;
+    }
+    size_t slot = slotsSize++;
+    slots[slot].inner = inner;
+    slots[slot].wrapper = wrapper;
+    slots[slot].wrapperContext = wrapperContext;
+
+    UA_PubSubTransportLayer layer = inner;
+    layer.createPubSubChannel = slotOps[slot].create;
+    return layer;
+}
+
+UA_Boolean
+PubSubTransportWrap_isInnermost(const PubSubChannelWrap *wrap) {
+    for(size_t i = 0; i < PUBSUBTRANSPORTWRAP_MAXLAYERS; i++) {
+        if(wrap->receive == slotOps[i].receive)
+            return false;
+    }
+    return true;
+}
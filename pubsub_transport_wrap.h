@@ -0,0 +1,71 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_TRANSPORT_WRAP_H_
+#define PUBSUB_TRANSPORT_WRAP_H_
+
+#include <open62541/plugin/pubsub.h>
+
+/**
+ * Transport Layer Wrapping
+ * ------------------------
+ * Adds behavior to an existing PubSub transport layer without modifying it.
+ * The wrapped layer keeps the transportProfileUri of the inner layer and is
+ * registered in its place with ``UA_ServerConfig_addPubSubTransportLayer``.
+ * Every channel is created by the inner layer. Afterwards its send, receive
+ * and close operations are replaced by the operations of the wrapper, which
+ * get the original operations in the PubSubChannelWrap.
+ *
+ * Wrappers can be stacked, e.g. latency probes around a sequence-number
+ * filter around the UDP layer. */
+
+typedef struct PubSubChannelWrap PubSubChannelWrap;
+
+typedef struct {
+    const char *name;
+
+    /* Called after the inner channel was created. A failure closes the
+     * channel again. May be NULL. */
+    UA_StatusCode (*init)(PubSubChannelWrap *wrap,
+                          UA_PubSubConnectionConfig *connectionConfig);
+
+    /* Replacement operations. NULL passes the call through. */
+    UA_StatusCode (*send)(PubSubChannelWrap *wrap, UA_ExtensionObject *transportSettings,
+                          const UA_ByteString *buf);
+    UA_StatusCode (*receive)(PubSubChannelWrap *wrap, UA_ByteString *buf,
+                             UA_ExtensionObject *transportSettings, UA_UInt32 timeout);
+
+    /* Called before the inner channel is closed. May be NULL. */
+    void (*clear)(PubSubChannelWrap *wrap);
+} PubSubTransportWrapper;
+
+struct PubSubChannelWrap {
+    UA_PubSubChannel *channel;
+    const PubSubTransportWrapper *wrapper;
+    void *wrapperContext;  /* As given to PubSubTransportWrap_layer */
+    void *context;         /* Per-channel state of the wrapper */
+
+    /* The operations of the inner channel */
+    UA_StatusCode (*send)(UA_PubSubChannel *channel, UA_ExtensionObject *transportSettings,
+                          const UA_ByteString *buf);
+    UA_StatusCode (*receive)(UA_PubSubChannel *channel, UA_ByteString *buf,
+                             UA_ExtensionObject *transportSettings, UA_UInt32 timeout);
+    UA_StatusCode (*close)(UA_PubSubChannel *channel);
+};
+
+/* The number of wrapped layers per process */
+#define PUBSUBTRANSPORTWRAP_MAXLAYERS 8
+
+/* Returns a transport layer whose channels are wrapped. If all slots are in
+ * use, a warning is logged and the inner layer is returned unchanged. */
+UA_PubSubTransportLayer
+PubSubTransportWrap_layer(UA_PubSubTransportLayer inner,
+                          const PubSubTransportWrapper *wrapper,
+                          void *wrapperContext);
+
+/* True if the inner operations of the wrap are those of the transport layer
+ * itself, i.e. no other wrapper is stacked below. */
+UA_Boolean
+PubSubTransportWrap_isInnermost(const PubSubChannelWrap *wrap);
+
+#endif /* PUBSUB_TRANSPORT_WRAP_H_ */
@@ -0,0 +1,419 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "pubsub_txtime.h"
+
+#include <open62541/plugin/log_stdout.h>
+
+#include "pubsub_ethernet_frame.h"
+#include "pubsub_transport_wrap.h"
+
+#include <errno.h>
+#include <linux/errqueue.h>
+#include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#define SCM_TXTIME SO_TXTIME
+#endif
+
+#ifndef CLOCK_TAI
+#define CLOCK_TAI 11
+#endif
+
+/* The cycle of one sender. The transmit times of a WriterGroup follow its
+ * own publishingInterval. */
+typedef struct {
+    UA_UInt64 interval; /* ns */
+    UA_UInt64 offset;
+    UA_UInt64 lastTxTime;
+} TxTimeCycle;
+
+/* A WriterGroup is recognized by the WriterGroupId in the group header of
+ * its NetworkMessages */
+typedef struct TxTimeGroup {
+    struct TxTimeGroup *next;
+    UA_UInt16 writerGroupId;
+    TxTimeCycle cycle;
+} TxTimeGroup;
+
+typedef struct TxTimeChannel {
+    struct TxTimeChannel *next; /* In the list of all channels */
+    UA_PubSubChannel *channel;
+    UA_UInt64 minLead;
+    TxTimeCycle cycle;  /* For senders that are not registered WriterGroups */
+    PubSubTxTimeStats stats;
+    struct sockaddr_storage dest;
+    socklen_t destLength;
+    UA_Byte header[PUBSUBETHERNET_MAXHEADERSIZE]; /* Ethernet only */
+    size_t headerSize;
+} TxTimeChannel;
+
+/* All channels, for PubSubTxTime_getStats, and the registered WriterGroups */
+static pthread_mutex_t txTimeLock = PTHREAD_MUTEX_INITIALIZER;
+static TxTimeChannel *channels = NULL;
+static TxTimeGroup *groups = NULL;
+
+static void
+countStat(UA_UInt64 *counter) {
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+static UA_StatusCode
+resolveUdp(TxTimeChannel *tc, int sockfd, const UA_String *url) {
+    /* opc.udp://<host>:<port>[/] */
+    char buf[256];
+    if(url->length <= 10 || url->length >= sizeof(buf))
+        return UA_STATUSCODE_BADINTERNALERROR;
+    memcpy(buf, &url->data[10], url->length - 10);
+    buf[url->length - 10] = 0;
+    char *slash = strchr(buf, '/');
+    if(slash)
+        *slash = 0;
+    char *host = buf;
+    char *port = strrchr(buf, ':');
+    if(!port)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    *port++ = 0;
+    if(host[0] == '[') { /* IPv6 literal */
+        host++;
+        host[strlen(host) - 1] = 0;
+    }
+
+    int domain = 0;
+    socklen_t len = sizeof(domain);
+    getsockopt(sockfd, SOL_SOCKET, SO_DOMAIN, &domain, &len);
+
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = domain ? domain : AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    if(getaddrinfo(host, port, &hints, &res) != 0 || !res)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    memcpy(&tc->dest, res->ai_addr, res->ai_addrlen);
+    tc->destLength = res->ai_addrlen;
+    freeaddrinfo(res);
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+resolveEthernet(TxTimeChannel *tc, const UA_NetworkAddressUrlDataType *address) {
+    UA_Byte target[ETH_ALEN], source[ETH_ALEN];
+    UA_UInt16 vid;
+    UA_Byte pcp;
+    char ifName[IF_NAMESIZE];
+    if(PubSubEthernet_parseAddress(&address->url, target, &vid, &pcp) !=
+       UA_STATUSCODE_GOOD || address->networkInterface.length >= IF_NAMESIZE)
+        return UA_STATUSCODE_BADINTERNALERROR;
+    memcpy(ifName, address->networkInterface.data, address->networkInterface.length);
+    ifName[address->networkInterface.length] = 0;
+    int ifindex = (int)if_nametoindex(ifName);
+    if(ifindex == 0 || PubSubEthernet_interfaceAddress(ifName, source) != UA_STATUSCODE_GOOD)
+        return UA_STATUSCODE_BADINTERNALERROR;
+
+    tc->headerSize = PubSubEthernet_writeHeader(tc->header, target, source, vid, pcp);
+    struct sockaddr_ll *sll = (struct sockaddr_ll*)&tc->dest;
+    sll->sll_family = AF_PACKET;
+    sll->sll_ifindex = ifindex;
+    sll->sll_halen = ETH_ALEN;
+    memcpy(sll->sll_addr, target, ETH_ALEN);
+    tc->destLength = sizeof(struct sockaddr_ll);
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode
+txTimeInit(PubSubChannelWrap *wrap, UA_PubSubConnectionConfig *connectionConfig) {
+    const PubSubTxTimeConfig *config = (const PubSubTxTimeConfig*)wrap->wrapperContext;
+    if(config->publishingInterval <= 0.0 ||
+       !UA_Variant_hasScalarType(&connectionConfig->address,
+                                 &UA_TYPES[UA_TYPES_NETWORKADDRESSURLDATATYPE]))
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    const UA_NetworkAddressUrlDataType *address =
+        (const UA_NetworkAddressUrlDataType*)connectionConfig->address.data;
+
+    TxTimeChannel *tc = (TxTimeChannel*)UA_calloc(1, sizeof(TxTimeChannel));
+    if(!tc)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    tc->channel = wrap->channel;
+    tc->cycle.interval = (UA_UInt64)(config->publishingInterval * 1000000.0);
+    tc->cycle.offset = (UA_UInt64)config->offset % tc->cycle.interval;
+    tc->minLead = (UA_UInt64)config->minLead;
+
+    int sockfd = wrap->channel->sockfd;
+    UA_StatusCode retval = UA_STATUSCODE_BADINTERNALERROR;
+    if(address->url.length > 10 && strncmp((const char*)address->url.data, "opc.udp://", 10) == 0)
+        retval = resolveUdp(tc, sockfd, &address->url);
+    else if(address->url.length > 10 && strncmp((const char*)address->url.data, "opc.eth://", 10) == 0)
+        retval = resolveEthernet(tc, address);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub SO_TXTIME: Cannot resolve %.*s",
+                     (int)address->url.length, address->url.data);
+        UA_free(tc);
+        return retval;
+    }
+
+    struct sock_txtime txtime;
+    txtime.clockid = CLOCK_TAI;
+    txtime.flags = SOF_TXTIME_REPORT_ERRORS;
+    if(config->deadlineMode)
+        txtime.flags |= SOF_TXTIME_DEADLINE_MODE;
+    if(setsockopt(sockfd, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)) < 0) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                     "PubSub SO_TXTIME: Cannot enable launch times. %s",
+                     strerror(errno));
+        UA_free(tc);
+        return UA_STATUSCODE_BADNOTSUPPORTED;
+    }
+    if(config->priority >= 0 &&
+       setsockopt(sockfd, SOL_SOCKET, SO_PRIORITY, &config->priority,
+                  sizeof(config->priority)) < 0)
+        UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                       "PubSub SO_TXTIME: Cannot set the socket priority. %s",
+                       strerror(errno));
+
+    pthread_mutex_lock(&txTimeLock);
+    tc->next = channels;
+    channels = tc;
+    pthread_mutex_unlock(&txTimeLock);
+    wrap->context = tc;
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+txTimeClear(PubSubChannelWrap *wrap) {
+    TxTimeChannel *tc = (TxTimeChannel*)wrap->context;
+    pthread_mutex_lock(&txTimeLock);
+    for(TxTimeChannel **p = &channels; *p; p = &(*p)->next) {
+        if(*p == tc) {
+            *p = tc->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&txTimeLock);
+    UA_free(tc);
+    wrap->context = NULL;
+}
+
+static UA_UInt64
+nowTai(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_TAI, &ts);
+    return (UA_UInt64)ts.tv_sec * 1000000000u + (UA_UInt64)ts.tv_nsec;
+}
+
+/* Count what the kernel reports for earlier packets */
+static void
+readErrorQueue(TxTimeChannel *tc, int sockfd) {
+    UA_Byte control[256];
+    for(;;) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if(recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            return;
+        for(struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            /* The extended error of the IP, IPv6 or packet socket */
+            if(!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                 (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR) ||
+                 (cm->cmsg_level == SOL_PACKET && cm->cmsg_type == PACKET_TX_TIMESTAMP)) ||
+               cm->cmsg_len < CMSG_LEN(sizeof(struct sock_extended_err)))
+                continue;
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if(err.ee_origin != SO_EE_ORIGIN_TXTIME)
+                continue;
+            if(err.ee_code == SO_EE_CODE_TXTIME_MISSED)
+                countStat(&tc->stats.late);
+            else
+                countStat(&tc->stats.dropped);
+        }
+    }
+}
+
+/* The WriterGroupId in the group header of a UADP NetworkMessage */
+static UA_Boolean
+readWriterGroupId(const UA_ByteString *buf, UA_UInt16 *writerGroupId) {
+    const UA_Byte *b = buf->data;
+    size_t pos = 0;
+    if(buf->length < 1 || (b[0] & 0x0f) != 1) /* UADP version 1 */
+        return false;
+    UA_Byte flags = b[pos++];
+    UA_Byte ext1 = 0;
+    if(flags & 0x80) {
+        if(pos >= buf->length)
+            return false;
+        ext1 = b[pos++];
+        if(ext1 & 0x80)
+            pos++; /* ExtendedFlags2 */
+    }
+    if(flags & 0x10) { /* PublisherId */
+        static const size_t idSizes[4] = {1, 2, 4, 8};
+        UA_Byte idType = ext1 & 0x07;
+        if(idType < 4) {
+            pos += idSizes[idType];
+        } else {
+            if(pos + 4 > buf->length)
+                return false;
+            pos += 4 + (size_t)(b[pos] | b[pos+1] << 8 | b[pos+2] << 16 |
+                                (UA_UInt32)b[pos+3] << 24);
+        }
+    }
+    if(ext1 & 0x08)
+        pos += 16; /* DataSetClassId */
+    if(!(flags & 0x20) || pos + 3 > buf->length || !(b[pos] & 0x01))
+        return false; /* No WriterGroupId in the group header */
+    *writerGroupId = (UA_UInt16)(b[pos+1] | b[pos+2] << 8);
+    return true;
+}
+
+static UA_StatusCode
+txTimeSend(PubSubChannelWrap *wrap, UA_ExtensionObject *transportSettings,
+           const UA_ByteString *buf) {
+    TxTimeChannel *tc = (TxTimeChannel*)wrap->context;
+    int sockfd = wrap->channel->sockfd;
+    readErrorQueue(tc, sockfd);
+
+    /* The cycle of the sending WriterGroup. A WriterGroup sends on one
+     * channel only, so its cycle is not shared between threads. */
+    TxTimeCycle *cycle = &tc->cycle;
+    UA_UInt16 writerGroupId;
+    if(__atomic_load_n(&groups, __ATOMIC_RELAXED) &&
+       readWriterGroupId(buf, &writerGroupId)) {
+        pthread_mutex_lock(&txTimeLock);
+        for(TxTimeGroup *g = groups; g; g = g->next) {
+            if(g->writerGroupId == writerGroupId) {
+                cycle = &g->cycle;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&txTimeLock);
+    }
+
+    /* The next slot that is far enough in the future */
+    UA_UInt64 earliest = nowTai() + tc->minLead;
+    UA_UInt64 txtime = earliest - (earliest % cycle->interval) + cycle->offset;
+    if(txtime < earliest)
+        txtime += cycle->interval;
+    if(cycle->lastTxTime > 0 && txtime > cycle->lastTxTime + cycle->interval)
+        __atomic_fetch_add(&tc->stats.skipped,
+                           (txtime - cycle->lastTxTime) / cycle->interval - 1,
+                           __ATOMIC_RELAXED);
+    cycle->lastTxTime = txtime;
+
+    struct iovec iov[2];
+    size_t iovSize = 0;
+    if(tc->headerSize > 0) {
+        iov[iovSize].iov_base = tc->header;
+        iov[iovSize++].iov_len = tc->headerSize;
+    }
+    iov[iovSize].iov_base = buf->data;
+    iov[iovSize++].iov_len = buf->length;
+
+    union {
+        UA_Byte buf[CMSG_SPACE(sizeof(UA_UInt64))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &tc->dest;
+    msg.msg_namelen = tc->destLength;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovSize;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_TXTIME;
+    cm->cmsg_len = CMSG_LEN(sizeof(UA_UInt64));
+    memcpy(CMSG_DATA(cm), &txtime, sizeof(txtime));
+
+    if(sendmsg(sockfd, &msg, 0) < 0) {
+        countStat(&tc->stats.dropped);
+        UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_SERVER,
+                       "PubSub SO_TXTIME: Sending failed. %s", strerror(errno));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    countStat(&tc->stats.sent);
+    return UA_STATUSCODE_GOOD;
+}
+
+static const PubSubTransportWrapper txTimeWrapper = {
+    "txtime", txTimeInit, txTimeSend, NULL, txTimeClear
+};
+
+UA_PubSubTransportLayer
+PubSubTxTime_wrapTransportLayer(UA_PubSubTransportLayer inner,
+                                const PubSubTxTimeConfig *config) {
+    return PubSubTransportWrap_layer(inner, &txTimeWrapper, (void*)(uintptr_t)config);
+}
+
+UA_StatusCode
+PubSubTxTime_addWriterGroup(const UA_WriterGroupConfig *config, UA_Int64 offset) {
+    if(!(config->publishingInterval > 0.0))
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    PubSubTxTime_removeWriterGroup(&config->writerGroupId);
+
+    TxTimeGroup *g = (TxTimeGroup*)UA_calloc(1, sizeof(TxTimeGroup));
+    if(!g)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    g->writerGroupId = config->writerGroupId;
+    g->cycle.interval = (UA_UInt64)(config->publishingInterval * 1000000.0);
+    g->cycle.offset = (UA_UInt64)offset % g->cycle.interval;
+    pthread_mutex_lock(&txTimeLock);
+    g->next = groups;
+    groups = g;
+    pthread_mutex_unlock(&txTimeLock);
+    return UA_STATUSCODE_GOOD;
+}
+
+void
+PubSubTxTime_removeWriterGroup(const UA_UInt16 *writerGroupId) {
+    pthread_mutex_lock(&txTimeLock);
+    TxTimeGroup **p = &groups;
+    while(*p) {
+        TxTimeGroup *g = *p;
+        if(writerGroupId && g->writerGroupId != *writerGroupId) {
+            p = &g->next;
+            continue;
+        }
+        *p = g->next;
+        UA_free(g);
+    }
+    pthread_mutex_unlock(&txTimeLock);
+}
+
+static void
+loadStats(const TxTimeChannel *tc, PubSubTxTimeStats *s) {
+    s->sent += __atomic_load_n(&tc->stats.sent, __ATOMIC_RELAXED);
+    s->skipped += __atomic_load_n(&tc->stats.skipped, __ATOMIC_RELAXED);
+    s->late += __atomic_load_n(&tc->stats.late, __ATOMIC_RELAXED);
+    s->dropped += __atomic_load_n(&tc->stats.dropped, __ATOMIC_RELAXED);
+}
+
+UA_StatusCode
+PubSubTxTime_getStats(UA_PubSubChannel *channel, PubSubTxTimeStats *stats) {
+    memset(stats, 0, sizeof(PubSubTxTimeStats));
+    UA_StatusCode retval = channel ? UA_STATUSCODE_BADINVALIDARGUMENT : UA_STATUSCODE_GOOD;
+    pthread_mutex_lock(&txTimeLock);
+    for(TxTimeChannel *tc = channels; tc; tc = tc->next) {
+        if(channel && tc->channel != channel)
+            continue;
+        loadStats(tc, stats);
+        retval = UA_STATUSCODE_GOOD;
+    }
+    pthread_mutex_unlock(&txTimeLock);
+    return retval;
+}
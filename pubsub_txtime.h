@@ -0,0 +1,96 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef PUBSUB_TXTIME_H_
+#define PUBSUB_TXTIME_H_
+
+#include <open62541/plugin/pubsub.h>
+#include <open62541/server.h>
+
+/**
+ * Launch-Time Transmission
+ * ------------------------
+ * Without help from the network stack a NetworkMessage leaves the host when
+ * the publish callback happens to run, so the jitter on the wire is the
+ * scheduling jitter of the callback. This wrapper hands every message to the
+ * kernel with a transmit time (SO_TXTIME, CLOCK_TAI). The ETF qdisc holds the
+ * packet back until that time and sends it, in software or offloaded to the
+ * NIC.
+ *
+ * The transmit time is the first cycle boundary plus ``offset`` that is at
+ * least ``minLead`` in the future. The cycles are multiples of the
+ * publishingInterval of the sending WriterGroup counted from the TAI epoch, so
+ * publishers on hosts with synchronized clocks send in the same phase. As
+ * long as the scheduling jitter of the publish callback stays below one
+ * cycle minus minLead, every message gets the slot of its cycle. A callback
+ * that runs too late pushes its message into the slot after; the cycle left
+ * without a message is counted as skipped.
+ *
+ * Wraps ``UA_PubSubTransportLayerUDPMP()`` and
+ * ``UA_PubSubTransportLayerEthernet()``. The wrapper sends through the socket
+ * of the inner channel with sendmsg, so it cannot be used with the ring based
+ * transports (pubsub_ethernet_mmap.h, pubsub_ethernet_xdp.h).
+ *
+ * The channel only sees the encoded message. A WriterGroup is made known
+ * with ``PubSubTxTime_addWriterGroup`` and the configuration the application
+ * created it with. Its messages are recognized by the WriterGroupId in the
+ * UADP group header. Messages without a known WriterGroupId, e.g. JSON,
+ * use the publishingInterval of the PubSubTxTimeConfig.
+ *
+ * The kernel reports packets that missed their transmit time or had an
+ * invalid one on the error queue of the socket. The queue is read after
+ * every send.
+ *
+ * Software ETF on a plain Linux box, here on a veth pair with several TX
+ * queues. Priority 3 is mapped to the ETF queue::
+ *
+ *   ip link add veth0 numtxqueues 4 type veth peer name veth1
+ *   tc qdisc replace dev veth0 parent root handle 100 mqprio num_tc 2 \
+ *       map 1 1 1 0 1 1 1 1 1 1 1 1 1 1 1 1 queues 1@0 1@1 hw 0
+ *   tc qdisc add dev veth0 parent 100:1 etf clockid CLOCK_TAI delta 500000
+ *   ./tutorial_pubsub_publish opc.eth://01-00-5E-7F-00-01 veth0 --txtime=200
+ *
+ * ``delta`` is the time the qdisc needs to dequeue the packet before its
+ * transmit time. minLead should be larger. With NIC support add ``offload``
+ * to the ETF qdisc. */
+
+typedef struct {
+    UA_Double publishingInterval; /* ms, for unregistered senders */
+    UA_Int64 offset;              /* ns after the start of the cycle */
+    UA_Int64 minLead;             /* ns, earliest transmit time after now */
+    UA_Int32 priority;            /* SO_PRIORITY of the socket, -1 to keep it */
+    UA_Boolean deadlineMode;      /* Send as soon as possible, before the time */
+} PubSubTxTimeConfig;
+
+#define PUBSUBTXTIMECONFIG_DEFAULT {1000.0, 0, 500000, 3, false}
+
+typedef struct {
+    UA_UInt64 sent;
+    UA_UInt64 skipped;  /* Cycles without a message between two sends */
+    UA_UInt64 late;     /* Reported by the kernel: transmit time missed */
+    UA_UInt64 dropped;  /* Reported by the kernel or rejected by sendmsg */
+} PubSubTxTimeStats;
+
+/* The config must stay valid while channels are created. Returns the inner
+ * layer if no wrapper slot is left. */
+UA_PubSubTransportLayer
+PubSubTxTime_wrapTransportLayer(UA_PubSubTransportLayer inner,
+                                const PubSubTxTimeConfig *config);
+
+/* Sends the messages with the writerGroupId of the config in the cycles of
+ * its publishingInterval, ``offset`` ns after their start. The
+ * networkMessageContentMask must contain the WriterGroupId. Call again after
+ * the configuration of the group changed. */
+UA_StatusCode
+PubSubTxTime_addWriterGroup(const UA_WriterGroupConfig *config, UA_Int64 offset);
+
+/* NULL removes all WriterGroups */
+void
+PubSubTxTime_removeWriterGroup(const UA_UInt16 *writerGroupId);
+
+/* Statistics of the channel, or totals over all channels with NULL. Returns
+ * BADINVALIDARGUMENT for a channel that is not wrapped for SO_TXTIME. */
+UA_StatusCode
+PubSubTxTime_getStats(UA_PubSubChannel *channel, PubSubTxTimeStats *stats);
+
+#endif /* PUBSUB_TXTIME_H_ */
@@ -0,0 +1,135 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "sampling_cache.h"
+
+#include <string.h>
+
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+
+/* Open addressing with linear probing, at most half full */
+#define TABLESIZE (2 * SAMPLINGCACHE_MAXVARIABLES)
+
+typedef struct {
+    UA_Boolean used;
+    UA_NodeId nodeId;
+    UA_ValueCallback callback;
+    UA_DateTime maxAge;
+    UA_DateTime sampledAt;
+    UA_Boolean valid;    /* sampledAt is set */
+    UA_Boolean sampling; /* Within the onRead callback */
+    UA_UInt64 hits;
+    UA_UInt64 misses;
+} CacheEntry;
+
+static CacheEntry table[TABLESIZE];
+static size_t variables;
+
+static CacheEntry *
+findEntry(const UA_NodeId *nodeId, UA_Boolean insert) {
+    size_t i = UA_NodeId_hash(nodeId) & (TABLESIZE - 1);
+    for(; table[i].used; i = (i + 1) & (TABLESIZE - 1)) {
+        if(UA_NodeId_equal(&table[i].nodeId, nodeId))
+            return &table[i];
+    }
+    if(!insert || variables >= SAMPLINGCACHE_MAXVARIABLES)
+        return NULL;
+    if(UA_NodeId_copy(nodeId, &table[i].nodeId) != UA_STATUSCODE_GOOD)
+        return NULL;
+    table[i].used = true;
+    STORE(&variables, variables + 1);
+    return &table[i];
+}
+
+static void
+cachedRead(UA_Server *server, const UA_NodeId *sessionId, void *sessionContext,
+           const UA_NodeId *nodeId, void *nodeContext, const UA_NumericRange *range,
+           const UA_DataValue *value) {
+    CacheEntry *e = findEntry(nodeId, false);
+    if(!e || !e->callback.onRead)
+        return;
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    if(e->valid && now - e->sampledAt < e->maxAge) {
+        STORE(&e->hits, e->hits + 1);
+        return;
+    }
+    STORE(&e->misses, e->misses + 1);
+    e->sampledAt = now;
+    e->valid = true;
+    /* The callback writes the sample into the variable. That write does not
+     * end the window. */
+    e->sampling = true;
+    e->callback.onRead(server, sessionId, sessionContext, nodeId, nodeContext,
+                       range, value);
+    e->sampling = false;
+}
+
+static void
+cachedWrite(UA_Server *server, const UA_NodeId *sessionId, void *sessionContext,
+            const UA_NodeId *nodeId, void *nodeContext, const UA_NumericRange *range,
+            const UA_DataValue *data) {
+    CacheEntry *e = findEntry(nodeId, false);
+    if(!e)
+        return;
+    if(!e->sampling)
+        e->valid = false;
+    if(e->callback.onWrite)
+        e->callback.onWrite(server, sessionId, sessionContext, nodeId, nodeContext,
+                            range, data);
+}
+
+UA_StatusCode
+SamplingCache_setValueCallback(UA_Server *server, const UA_NodeId nodeId,
+                               UA_ValueCallback callback, UA_Double maxAge) {
+    if(maxAge < 0)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    CacheEntry *e = findEntry(&nodeId, true);
+    if(!e)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+    e->callback = callback;
+    e->maxAge = (UA_DateTime)(maxAge * UA_DATETIME_MSEC);
+    e->valid = false;
+
+    UA_ValueCallback cached;
+    cached.onRead = cachedRead;
+    cached.onWrite = cachedWrite;
+    return UA_Server_setVariableNode_valueCallback(server, nodeId, cached);
+}
+
+void
+SamplingCache_invalidate(const UA_NodeId *nodeId) {
+    CacheEntry *e = findEntry(nodeId, false);
+    if(e)
+        e->valid = false;
+}
+
+UA_StatusCode
+SamplingCache_getStats(const UA_NodeId *nodeId, SamplingCacheStats *stats) {
+    memset(stats, 0, sizeof(SamplingCacheStats));
+    if(nodeId) {
+        CacheEntry *e = findEntry(nodeId, false);
+        if(!e)
+            return UA_STATUSCODE_BADNOTFOUND;
+        stats->variables = 1;
+        stats->hits = LOAD(&e->hits);
+        stats->misses = LOAD(&e->misses);
+        return UA_STATUSCODE_GOOD;
+    }
+    stats->variables = LOAD(&variables);
+    for(size_t i = 0; i < TABLESIZE; i++) {
+        stats->hits += LOAD(&table[i].hits);
+        stats->misses += LOAD(&table[i].misses);
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+void
+SamplingCache_clear(void) {
+    for(size_t i = 0; i < TABLESIZE; i++) {
+        if(table[i].used)
+            UA_NodeId_clear(&table[i].nodeId);
+    }
+    memset(table, 0, sizeof(table));
+    STORE(&variables, 0);
+}
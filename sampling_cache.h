@@ -0,0 +1,55 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef SAMPLING_CACHE_H_
+#define SAMPLING_CACHE_H_
+
+#include <open62541/server.h>
+
+/**
+ * Sampling Cache
+ * --------------
+ * The onRead callback of a variable runs on every read of its value: for
+ * every publishing cycle of every WriterGroup that publishes the variable,
+ * and for every client read. The callback usually samples a device and
+ * writes the result into the variable.
+ *
+ * The sampling cache calls the onRead callback at most once per maxAge. All
+ * reads within that window skip the callback and get the value written by
+ * the last sample, whether they come from PubSub or from a client. A write
+ * from outside the callback (e.g. by a client) starts a new window with the
+ * next read. With maxAge 0, every read samples.
+ *
+ * ``SamplingCache_setValueCallback`` is used in place of
+ * ``UA_Server_setVariableNode_valueCallback``. The node context is passed
+ * through unchanged. Up to SAMPLINGCACHE_MAXVARIABLES variables are cached
+ * in one table for all servers of the process. The table is changed from the
+ * server thread only, the counters can be read from any thread. */
+
+#define SAMPLINGCACHE_MAXVARIABLES 1024
+
+typedef struct {
+    size_t variables;
+    UA_UInt64 hits;   /* Reads served from the last sample */
+    UA_UInt64 misses; /* Reads that called the onRead callback */
+} SamplingCacheStats;
+
+/* maxAge in ms. Setting the callback again replaces it and its maxAge. */
+UA_StatusCode
+SamplingCache_setValueCallback(UA_Server *server, const UA_NodeId nodeId,
+                               UA_ValueCallback callback, UA_Double maxAge);
+
+/* The next read of the variable calls the onRead callback */
+void
+SamplingCache_invalidate(const UA_NodeId *nodeId);
+
+/* Sums over all variables if nodeId is NULL. Returns BADNOTFOUND if the
+ * variable is not cached. */
+UA_StatusCode
+SamplingCache_getStats(const UA_NodeId *nodeId, SamplingCacheStats *stats);
+
+/* Forgets all variables. Call after the servers are deleted. */
+void
+SamplingCache_clear(void);
+
+#endif /* SAMPLING_CACHE_H_ */
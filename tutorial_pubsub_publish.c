@@ -32,8 +32,59 @@
 
 #include <signal.h>
 
+#include "concurrent_nodestore.h"
+#include "pubsub_ethernet_mmap.h"
+#include "pubsub_ethernet_xdp.h"
+#include "pubsub_probe.h"
+#include "pubsub_frozen_config.h"
+#include "pubsub_mqtt.h"
+#include "pubsub_publish_pool.h"
+#include "pubsub_timer_wheel.h"
+#include "pubsub_txtime.h"
+#include "sampling_cache.h"
+
 UA_NodeId connectionIdent, publishedDataSetIdent, writerGroupIdent;
 
+UA_Duration publishingInterval = 1000;
+
+/* Number of WriterGroups, each with one DataSetWriter for the same
+ * PublishedDataSet. Many groups show the cost of the publish timers. */
+UA_UInt16 writerGroups = 1;
+
+/* Publish the WriterGroups from a pool of worker threads instead of the
+ * server thread, see pubsub_publish_pool.h */
+size_t publishWorkers = 0;
+UA_UInt16 workerCpus[PUBSUBPUBLISHPOOL_MAXWORKERS];
+size_t workerCpusSize = 0;
+
+/* Sample the DataSet of the pool into a cycle arena, see pubsub_arena.h */
+size_t arenaSize = 0;
+PubSubArenaMode arenaMode = PUBSUBARENA_FALLBACK;
+
+/* Send JSON NetworkMessages from the pool, see pubsub_json.h. Only the
+ * groups of the pool use this encoder, so it needs --workers. */
+PubSubPublishPoolEncoding poolEncoding = PUBSUBPUBLISHPOOL_UADP;
+
+/* Build the PubSub configuration as one frozen block, see
+ * pubsub_frozen_config.h. The block can be saved to a file and loaded from
+ * it at the next start. */
+UA_Boolean frozen = false;
+PubSubFrozenConfig *frozenConfig = NULL;
+const char *saveConfigPath = NULL;
+const char *loadConfigPath = NULL;
+
+/* Sample the answer in an onRead callback, at most once per max. age in
+ * ms, see sampling_cache.h. Negative for a plain variable. */
+UA_Double sampleMaxAge = -1;
+
+/* Keep the information model in a nodestore that worker threads can read
+ * without the server lock, see concurrent_nodestore.h */
+UA_Boolean concurrentNodestore = false;
+
+/* Launch times for the sent messages, see pubsub_txtime.h */
+UA_Boolean txTime = false;
+PubSubTxTimeConfig txTimeConfig = PUBSUBTXTIMECONFIG_DEFAULT;
+
 static void
 addPubSubConnection(UA_Server *server, UA_String *transportProfile,
                     UA_NetworkAddressUrlDataType *networkAddressUrl){
@@ -139,15 +190,15 @@ addVariableDataSetField(UA_Server *server, int nsIndex, char* qualifier){
  * The WriterGroup (WG) is part of the connection and contains the primary
  * configuration parameters for the message creation. */
 static void
-addWriterGroup(UA_Server *server) {
+addWriterGroup(UA_Server *server, UA_UInt16 writerGroupId) {
     /* Now we create a new WriterGroupConfig and add the group to the existing
      * PubSubConnection. */
     UA_WriterGroupConfig writerGroupConfig;
     memset(&writerGroupConfig, 0, sizeof(UA_WriterGroupConfig));
     writerGroupConfig.name = UA_STRING("Demo WriterGroup");
-    writerGroupConfig.publishingInterval = 1000;
+    writerGroupConfig.publishingInterval = publishingInterval;
     writerGroupConfig.enabled = UA_FALSE;
-    writerGroupConfig.writerGroupId = 100;
+    writerGroupConfig.writerGroupId = writerGroupId;
     writerGroupConfig.encodingMimeType = UA_PUBSUB_ENCODING_UADP;
     writerGroupConfig.messageSettings.encoding             = UA_EXTENSIONOBJECT_DECODED;
     writerGroupConfig.messageSettings.content.decoded.type = &UA_TYPES[UA_TYPES_UADPWRITERGROUPMESSAGEDATATYPE];
@@ -165,6 +216,9 @@ addWriterGroup(UA_Server *server) {
                                                               (UA_UadpNetworkMessageContentMask)UA_UADPNETWORKMESSAGECONTENTMASK_PAYLOADHEADER);
     writerGroupConfig.messageSettings.content.decoded.data = writerGroupMessage;
     UA_Server_addWriterGroup(server, connectionIdent, &writerGroupConfig, &writerGroupIdent);
+    /* Launch times in the cycles of this group's publishingInterval */
+    if(txTime)
+        PubSubTxTime_addWriterGroup(&writerGroupConfig, txTimeConfig.offset);
     UA_Server_setWriterGroupOperational(server, writerGroupIdent);
     UA_UadpWriterGroupMessageDataType_delete(writerGroupMessage);
 }
@@ -185,9 +239,106 @@ addDataSetWriter(UA_Server *server) {
     dataSetWriterConfig.name = UA_STRING("Demo DataSetWriter");
     dataSetWriterConfig.dataSetWriterId = 62541;
     dataSetWriterConfig.keyFrameCount = 10;
+    /* Timestamp and sequence number in every DataSetMessage, for the
+     * latency and loss statistics of the subscriber */
+    UA_UadpDataSetWriterMessageDataType *writerMessage =
+        UA_UadpDataSetWriterMessageDataType_new();
+    writerMessage->dataSetMessageContentMask = (UA_UadpDataSetMessageContentMask)
+        (UA_UADPDATASETMESSAGECONTENTMASK_TIMESTAMP |
+         UA_UADPDATASETMESSAGECONTENTMASK_SEQUENCENUMBER);
+    dataSetWriterConfig.messageSettings.encoding = UA_EXTENSIONOBJECT_DECODED;
+    dataSetWriterConfig.messageSettings.content.decoded.type =
+        &UA_TYPES[UA_TYPES_UADPDATASETWRITERMESSAGEDATATYPE];
+    dataSetWriterConfig.messageSettings.content.decoded.data = writerMessage;
     UA_Server_addDataSetWriter(server, writerGroupIdent, publishedDataSetIdent,
                                &dataSetWriterConfig, &dataSetWriterIdent);
+    UA_UadpDataSetWriterMessageDataType_delete(writerMessage);
+
+}
 
+/**
+ * **Frozen configuration**
+ *
+ * With ``--frozen``, the connection, PDS, fields, WriterGroups and
+ * DataSetWriters from above are described in a frozen configuration. It is
+ * laid out in one read-only block and applied to the server at once. The
+ * WriterGroups are frozen afterwards, so the server rejects changes to them.
+ * See pubsub_frozen_config.h.
+ *
+ * ``--save-config=<file>`` writes the block to a file.
+ * ``--load-config=<file>`` maps it at the next start instead of building it
+ * call by call. */
+static UA_StatusCode
+buildFrozenConfiguration(UA_String *transportProfile,
+                         UA_NetworkAddressUrlDataType *networkAddressUrl) {
+    PubSubFrozenConfigBuilder *builder = PubSubFrozenConfigBuilder_new();
+    if(!builder)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    UA_String connectionName = UA_STRING("UADP Connection 1");
+    UA_String pdsName = UA_STRING("Demo PDS");
+    UA_String timeName = UA_STRING("Server localtime");
+    UA_String answerName = UA_STRING("temperature");
+    UA_String groupName = UA_STRING("Demo WriterGroup");
+    UA_String writerName = UA_STRING("Demo DataSetWriter");
+    UA_NodeId timeNode = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_SERVERSTATUS_CURRENTTIME);
+    UA_NodeId answerNode = UA_NODEID_STRING(1, "the.answer");
+    UA_UInt32 networkMessageContentMask =
+        UA_UADPNETWORKMESSAGECONTENTMASK_PUBLISHERID |
+        UA_UADPNETWORKMESSAGECONTENTMASK_GROUPHEADER |
+        UA_UADPNETWORKMESSAGECONTENTMASK_WRITERGROUPID |
+        UA_UADPNETWORKMESSAGECONTENTMASK_PAYLOADHEADER;
+    UA_UInt32 dataSetMessageContentMask =
+        UA_UADPDATASETMESSAGECONTENTMASK_TIMESTAMP |
+        UA_UADPDATASETMESSAGECONTENTMASK_SEQUENCENUMBER;
+
+    UA_UInt32 connection, pds;
+    UA_StatusCode retval =
+        PubSubFrozenConfigBuilder_addConnection(builder, &connectionName, transportProfile,
+                                                networkAddressUrl, 2234, &connection);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = PubSubFrozenConfigBuilder_addPublishedDataSet(builder, &pdsName, &pds);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = PubSubFrozenConfigBuilder_addPublishedField(builder, pds, &timeName,
+                                                             &timeNode);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = PubSubFrozenConfigBuilder_addPublishedField(builder, pds, &answerName,
+                                                             &answerNode);
+    for(UA_UInt16 i = 0; i < writerGroups && retval == UA_STATUSCODE_GOOD; i++) {
+        UA_UInt32 writerGroup;
+        retval = PubSubFrozenConfigBuilder_addWriterGroup(builder, connection, &groupName,
+                                                          (UA_UInt16)(100 + i),
+                                                          publishingInterval,
+                                                          networkMessageContentMask,
+                                                          &writerGroup);
+        if(retval == UA_STATUSCODE_GOOD)
+            retval = PubSubFrozenConfigBuilder_addDataSetWriter(builder, writerGroup, pds,
+                                                                &writerName, 62541, 10,
+                                                                dataSetMessageContentMask);
+    }
+    if(retval == UA_STATUSCODE_GOOD) {
+        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                    "Freezing the PubSub configuration into %lu bytes",
+                    (unsigned long)PubSubFrozenConfigBuilder_footprint(builder));
+        retval = PubSubFrozenConfig_freeze(builder, 0, &frozenConfig);
+    }
+    PubSubFrozenConfigBuilder_delete(builder);
+    return retval;
+}
+
+static UA_StatusCode
+addFrozenConfiguration(UA_Server *server, UA_String *transportProfile,
+                       UA_NetworkAddressUrlDataType *networkAddressUrl) {
+    UA_StatusCode retval;
+    if(loadConfigPath)
+        retval = PubSubFrozenConfig_load(loadConfigPath, &frozenConfig);
+    else
+        retval = buildFrozenConfiguration(transportProfile, networkAddressUrl);
+    if(retval == UA_STATUSCODE_GOOD && saveConfigPath)
+        retval = PubSubFrozenConfig_save(frozenConfig, saveConfigPath);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = PubSubFrozenConfig_apply(frozenConfig, server);
+    return retval;
 }
 
 /**
@@ -206,28 +357,217 @@ addDataSetWriter(UA_Server *server) {
  *
  * It follows the main server code, making use of the above definitions. */
 UA_Boolean running = true;
+UA_Boolean probe = false;
+UA_Boolean ethMmap = false; /* See pubsub_ethernet_mmap.h */
+UA_Boolean xdp = false; /* See pubsub_ethernet_xdp.h */
 static void stopHandler(int sign) {
     UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_SERVER, "received ctrl-c");
     running = false;
 }
 
+static void
+txTimeReport(UA_Server *server, void *data) {
+    PubSubTxTimeStats stats;
+    PubSubTxTime_getStats(NULL, &stats);
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                "SO_TXTIME: %lu sent, %lu cycles skipped, %lu late, %lu dropped",
+                (unsigned long)stats.sent, (unsigned long)stats.skipped,
+                (unsigned long)stats.late, (unsigned long)stats.dropped);
+}
+
+/* Stands in for reading the answer from a device. Writes the value again,
+ * with the time of the sample as the source timestamp. */
+static void
+sampleAnswer(UA_Server *server, const UA_NodeId *sessionId, void *sessionContext,
+             const UA_NodeId *nodeId, void *nodeContext, const UA_NumericRange *range,
+             const UA_DataValue *value) {
+    UA_Int32 answer = 42;
+    UA_DataValue sample;
+    UA_DataValue_init(&sample);
+    UA_Variant_setScalar(&sample.value, &answer, &UA_TYPES[UA_TYPES_INT32]);
+    sample.hasValue = true;
+    sample.sourceTimestamp = UA_DateTime_now();
+    sample.hasSourceTimestamp = true;
+    UA_Server_writeDataValue(server, *nodeId, sample);
+}
+
+static void
+samplingCacheReport(UA_Server *server, void *data) {
+    SamplingCacheStats stats;
+    SamplingCache_getStats(NULL, &stats);
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                "Sampling cache: %lu variables, %lu hits, %lu misses",
+                (unsigned long)stats.variables, (unsigned long)stats.hits,
+                (unsigned long)stats.misses);
+}
+
+static void
+nodestoreReport(UA_Server *server, void *data) {
+    ConcurrentNodestoreStats stats;
+    ConcurrentNodestore_getStats(&UA_Server_getConfig(server)->nodestore, &stats);
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                "Nodestore: %lu nodes, %lu replaced, %lu conflicts, "
+                "%lu retired, %lu reclaimed", (unsigned long)stats.nodes,
+                (unsigned long)stats.replaced, (unsigned long)stats.conflicts,
+                (unsigned long)stats.retired, (unsigned long)stats.reclaimed);
+}
+
+#ifdef UA_ENABLE_PUBSUB_CUSTOM_PUBLISH_HANDLING
+/* The publish callbacks of the WriterGroups are scheduled by the timer wheel,
+ * see pubsub_timer_wheel.h */
+static void
+timerWheelReport(UA_Server *server, void *data) {
+    PubSubTimerWheelStats stats;
+    PubSubTimerWheel_getStats(&stats);
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                "Timer wheel: %lu timers in %lu buckets, %lu callbacks, "
+                "%lu cycles skipped, max. lateness %lu us",
+                (unsigned long)stats.timers, (unsigned long)stats.buckets,
+                (unsigned long)stats.callbacks, (unsigned long)stats.skipped,
+                (unsigned long)(stats.maxLateness / 1000));
+}
+#endif
+
+/* The MQTT channels buffer the messages. The yield callback writes the
+ * messages of all WriterGroups of an interval at once, see pubsub_mqtt.h. */
+static void
+mqttYield(UA_Server *server, void *data) {
+    PubSubMqtt_yieldAll(0);
+}
+
+static void
+mqttReport(UA_Server *server, void *data) {
+    PubSubMqttStats stats;
+    PubSubMqtt_getStats(NULL, &stats);
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                "MQTT: %lu published in %lu writes, %lu acked, %lu in flight, "
+                "%lu dropped", (unsigned long)stats.published,
+                (unsigned long)stats.writes, (unsigned long)stats.acked,
+                (unsigned long)stats.inflight, (unsigned long)stats.dropped);
+}
+
+static void
+publishPoolReport(UA_Server *server, void *data) {
+    PubSubPublishPool *pool = (PubSubPublishPool*)data;
+    for(size_t i = 0; i < publishWorkers; i++) {
+        PubSubPublishPoolStats stats;
+        PubSubPublishPool_getStats(pool, i, &stats);
+        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                    "Publish worker %lu on CPU %u: %lu groups, %lu messages, "
+                    "%lu send errors, %lu cycles skipped, %lu snapshot retries",
+                    (unsigned long)i, (unsigned)stats.cpu, (unsigned long)stats.groups,
+                    (unsigned long)stats.messages, (unsigned long)stats.sendErrors,
+                    (unsigned long)stats.skipped, (unsigned long)stats.snapshotRetries);
+    }
+    PubSubArenaStats arenaStats;
+    if(PubSubPublishPool_getArenaStats(pool, 0, &arenaStats) == UA_STATUSCODE_GOOD)
+        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                    "Sampling arena: %lu bytes, high water %lu bytes, %lu allocations, "
+                    "%lu from the heap, %lu failed",
+                    (unsigned long)arenaStats.capacity, (unsigned long)arenaStats.highWater,
+                    (unsigned long)arenaStats.allocations,
+                    (unsigned long)arenaStats.heapAllocations,
+                    (unsigned long)arenaStats.failed);
+}
+
+/* The pool samples the fields of the PublishedDataSet and publishes the
+ * groups from its workers */
+static PubSubPublishPool *
+startPublishPool(UA_Server *server, UA_PubSubTransportLayer *transportLayer,
+                 UA_NetworkAddressUrlDataType *networkAddressUrl) {
+    PubSubPublishPoolConfig poolConfig;
+    memset(&poolConfig, 0, sizeof(PubSubPublishPoolConfig));
+    poolConfig.workers = publishWorkers;
+    poolConfig.cpus = workerCpus;
+    poolConfig.cpusSize = workerCpusSize;
+    poolConfig.transportLayer = *transportLayer;
+    poolConfig.address = *networkAddressUrl;
+    poolConfig.publisherId = 2234;
+    poolConfig.arenaSize = arenaSize;
+    poolConfig.arenaMode = arenaMode;
+    poolConfig.encoding = poolEncoding;
+    if(concurrentNodestore)
+        poolConfig.nodestore = &UA_Server_getConfig(server)->nodestore;
+    PubSubPublishPool *pool = PubSubPublishPool_new(&poolConfig);
+    if(!pool)
+        return NULL;
+
+    UA_NodeId fields[2] = {UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_SERVERSTATUS_CURRENTTIME),
+                           UA_NODEID_STRING(1, "the.answer")};
+    size_t dataSet;
+    UA_StatusCode retval = PubSubPublishPool_addDataSet(pool, server, fields, 2,
+                                                        publishingInterval, &dataSet);
+    for(UA_UInt16 i = 0; i < writerGroups && retval == UA_STATUSCODE_GOOD; i++)
+        retval = PubSubPublishPool_addWriterGroup(pool, (UA_UInt16)(100 + i), 62541,
+                                                  dataSet, publishingInterval);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = PubSubPublishPool_start(pool);
+    if(retval != UA_STATUSCODE_GOOD) {
+        PubSubPublishPool_delete(pool);
+        return NULL;
+    }
+    UA_Server_addRepeatedCallback(server, publishPoolReport, pool, 10000, NULL);
+    return pool;
+}
+
 static int run(UA_String *transportProfile,
                UA_NetworkAddressUrlDataType *networkAddressUrl) {
     signal(SIGINT, stopHandler);
     signal(SIGTERM, stopHandler);
 
-    UA_Server *server = UA_Server_new();
+    UA_Server *server;
+    if(concurrentNodestore) {
+        /* The nodestore is set up before the server fills it with namespace 0 */
+        UA_ServerConfig serverConfig;
+        memset(&serverConfig, 0, sizeof(UA_ServerConfig));
+        UA_ServerConfig_setMinimal(&serverConfig, 4840, NULL);
+        /* Replace the default nodestore only once the new one exists, so
+         * that the config can be cleaned on failure */
+        UA_Nodestore nodestore;
+        if(ConcurrentNodestore_init(&nodestore, 0) != UA_STATUSCODE_GOOD) {
+            UA_ServerConfig_clean(&serverConfig);
+            return EXIT_FAILURE;
+        }
+        serverConfig.nodestore.clear(serverConfig.nodestore.context);
+        serverConfig.nodestore = nodestore;
+        server = UA_Server_newWithConfig(&serverConfig);
+    } else {
+        server = UA_Server_new();
+        if(server)
+            UA_ServerConfig_setMinimal(UA_Server_getConfig(server), 4840, NULL);
+    }
+    if(!server)
+        return EXIT_FAILURE;
     UA_ServerConfig *config = UA_Server_getConfig(server);
-    UA_ServerConfig_setMinimal(config, 4840, NULL);
 
 
 
     /* Details about the connection configuration and handling are located in
      * the pubsub connection tutorial */
-    UA_ServerConfig_addPubSubTransportLayer(config, UA_PubSubTransportLayerUDPMP());
+    UA_PubSubTransportLayer udpLayer = UA_PubSubTransportLayerUDPMP();
+    if(txTime)
+        udpLayer = PubSubTxTime_wrapTransportLayer(udpLayer, &txTimeConfig);
+    if(probe)
+        udpLayer = PubSubProbe_wrapTransportLayer(udpLayer);
+    UA_ServerConfig_addPubSubTransportLayer(config, udpLayer);
 #ifdef UA_ENABLE_PUBSUB_ETH_UADP
-    UA_ServerConfig_addPubSubTransportLayer(config, UA_PubSubTransportLayerEthernet());
+    UA_PubSubTransportLayer ethLayer = ethMmap ?
+        PubSubEthernetMmap_transportLayer() : UA_PubSubTransportLayerEthernet();
+    if(txTime)
+        ethLayer = PubSubTxTime_wrapTransportLayer(ethLayer, &txTimeConfig);
+    if(probe)
+        ethLayer = PubSubProbe_wrapTransportLayer(ethLayer);
+    UA_ServerConfig_addPubSubTransportLayer(config, ethLayer);
 #endif
+    UA_PubSubTransportLayer xdpLayer = PubSubEthernetXdp_transportLayer();
+    if(probe)
+        xdpLayer = PubSubProbe_wrapTransportLayer(xdpLayer);
+    UA_ServerConfig_addPubSubTransportLayer(config, xdpLayer);
+    UA_PubSubTransportLayer mqttLayer = PubSubMqtt_transportLayer();
+    if(probe)
+        mqttLayer = PubSubProbe_wrapTransportLayer(mqttLayer);
+    UA_ServerConfig_addPubSubTransportLayer(config, mqttLayer);
+    UA_Boolean mqtt = UA_String_equal(transportProfile, &mqttLayer.transportProfileUri);
 
 
 
@@ -248,27 +588,107 @@ static int run(UA_String *transportProfile,
     UA_Server_addVariableNode(server, myIntegerNodeId, parentNodeId,
     parentReferenceNodeId, myIntegerName,
     UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE), attr, NULL, NULL);
+    if(sampleMaxAge >= 0) {
+        UA_ValueCallback callback;
+        memset(&callback, 0, sizeof(UA_ValueCallback));
+        callback.onRead = sampleAnswer;
+        SamplingCache_setValueCallback(server, myIntegerNodeId, callback, sampleMaxAge);
+        UA_Server_addRepeatedCallback(server, samplingCacheReport, NULL, 10000, NULL);
+    }
 
 
 
 
 
-    addPubSubConnection(server, transportProfile, networkAddressUrl);
-    addPublishedDataSet(server);
-    addDataSetField(server);
-    addVariableDataSetField(server, 1, "the.answer");
-    addWriterGroup(server);
-    addDataSetWriter(server);
+    PubSubPublishPool *pool = NULL;
+    if(frozen) {
+        if(addFrozenConfiguration(server, transportProfile,
+                                  networkAddressUrl) != UA_STATUSCODE_GOOD) {
+            UA_Server_delete(server);
+            return EXIT_FAILURE;
+        }
+    } else {
+        addPubSubConnection(server, transportProfile, networkAddressUrl);
+        addPublishedDataSet(server);
+        addDataSetField(server);
+        addVariableDataSetField(server, 1, "the.answer");
+    }
+    if(publishWorkers > 0) {
+        UA_PubSubTransportLayer *poolLayer = mqtt ? &mqttLayer : &udpLayer;
+#ifdef UA_ENABLE_PUBSUB_ETH_UADP
+        if(UA_String_equal(transportProfile, &ethLayer.transportProfileUri))
+            poolLayer = &ethLayer;
+#endif
+        pool = startPublishPool(server, poolLayer, networkAddressUrl);
+        if(!pool) {
+            UA_Server_delete(server);
+            return EXIT_FAILURE;
+        }
+    } else if(!frozen) {
+        for(UA_UInt16 i = 0; i < writerGroups; i++) {
+            addWriterGroup(server, (UA_UInt16)(100 + i));
+            addDataSetWriter(server);
+        }
+    }
 
-    UA_StatusCode retval = UA_Server_run(server, &running);
+    /* The workers of the pool yield their channels themselves */
+    UA_UInt64 mqttYieldId = 0;
+    if(mqtt && publishWorkers == 0) {
+#ifdef UA_ENABLE_PUBSUB_CUSTOM_PUBLISH_HANDLING
+        /* Added after the WriterGroups, so it fires in the same tick after them */
+        PubSubTimerWheel_addRepeatedCallback(server, mqttYield, NULL,
+                                             publishingInterval, &mqttYieldId);
+#else
+        UA_Server_addRepeatedCallback(server, mqttYield, NULL,
+                                      publishingInterval, &mqttYieldId);
+#endif
+    }
+    if(mqtt)
+        UA_Server_addRepeatedCallback(server, mqttReport, NULL, 10000, NULL);
+
+    /* Expose the latency probes below the Server object */
+    if(probe) {
+        PubSubProbe_setEnabled(true);
+        PubSubProbe_addDiagnosticsNodes(server, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER));
+        PubSubProbe_addPeriodicDump(server, 10000, NULL);
+    }
+    if(txTime)
+        UA_Server_addRepeatedCallback(server, txTimeReport, NULL, 10000, NULL);
+    if(concurrentNodestore)
+        UA_Server_addRepeatedCallback(server, nodestoreReport, NULL, 10000, NULL);
+#ifdef UA_ENABLE_PUBSUB_CUSTOM_PUBLISH_HANDLING
+    UA_Server_addRepeatedCallback(server, timerWheelReport, NULL, 10000, NULL);
+#endif
 
+    UA_StatusCode retval = PubSubTimerWheel_runServer(server, &running);
+
+#ifdef UA_ENABLE_PUBSUB_CUSTOM_PUBLISH_HANDLING
+    if(mqttYieldId != 0)
+        PubSubTimerWheel_removeCallback(mqttYieldId);
+#endif
+
+    if(pool)
+        PubSubPublishPool_delete(pool);
+    if(txTime)
+        PubSubTxTime_removeWriterGroup(NULL);
     UA_Server_delete(server);
+    if(frozenConfig)
+        PubSubFrozenConfig_delete(frozenConfig);
+    SamplingCache_clear();
+#ifdef UA_ENABLE_PUBSUB_CUSTOM_PUBLISH_HANDLING
+    PubSubTimerWheel_shutdown();
+#endif
     return retval == UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 static void
 usage(char *progname) {
-    printf("usage: %s <uri> [device]\n", progname);
+    printf("usage: %s <uri> [device] [--probe] [--eth-mmap] [--xdp]\n"
+           "       [--txtime=<offset us>] [--groups=<n>] [--workers=<n>]\n"
+           "       [--cpus=<cpu>,<cpu>,...] [--arena[=strict]] [--frozen]\n"
+           "       [--save-config=<file>] [--load-config=<file>]\n"
+           "       [--sample-max-age=<ms>] [--concurrent-nodestore]\n"
+           "       [--json[=nonreversible]]\n", progname);
 }
 
 int main(int argc, char **argv) {
@@ -277,14 +697,120 @@ int main(int argc, char **argv) {
     UA_NetworkAddressUrlDataType networkAddressUrl =
         {UA_STRING_NULL , UA_STRING("opc.udp://224.0.0.22:4840/")};
 
+    /* Strip the options, the remaining arguments are positional */
+    int args = 1;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--probe") == 0)
+            probe = true;
+        else if(strcmp(argv[i], "--eth-mmap") == 0)
+            ethMmap = true;
+        else if(strcmp(argv[i], "--xdp") == 0)
+            xdp = true;
+        else if(strncmp(argv[i], "--txtime=", 9) == 0) {
+            txTime = true;
+            txTimeConfig.offset = strtol(&argv[i][9], NULL, 10) * 1000;
+        }
+        else if(strncmp(argv[i], "--groups=", 9) == 0) {
+            long groups = strtol(&argv[i][9], NULL, 10);
+            if(groups < 1 || groups > 60000) {
+                printf("Error: --groups must be between 1 and 60000\n");
+                return EXIT_FAILURE;
+            }
+            writerGroups = (UA_UInt16)groups;
+        }
+        else if(strncmp(argv[i], "--workers=", 10) == 0) {
+            long workers = strtol(&argv[i][10], NULL, 10);
+            if(workers < 1 || workers > PUBSUBPUBLISHPOOL_MAXWORKERS) {
+                printf("Error: --workers must be between 1 and %d\n",
+                       PUBSUBPUBLISHPOOL_MAXWORKERS);
+                return EXIT_FAILURE;
+            }
+            publishWorkers = (size_t)workers;
+        }
+        else if(strncmp(argv[i], "--cpus=", 7) == 0) {
+            char *pos = &argv[i][7];
+            while(*pos && workerCpusSize < PUBSUBPUBLISHPOOL_MAXWORKERS) {
+                workerCpus[workerCpusSize++] = (UA_UInt16)strtoul(pos, &pos, 10);
+                if(*pos == ',')
+                    pos++;
+                else
+                    break;
+            }
+        }
+        else if(strcmp(argv[i], "--frozen") == 0)
+            frozen = true;
+        else if(strncmp(argv[i], "--save-config=", 14) == 0) {
+            frozen = true;
+            saveConfigPath = &argv[i][14];
+        }
+        else if(strncmp(argv[i], "--load-config=", 14) == 0) {
+            frozen = true;
+            loadConfigPath = &argv[i][14];
+        }
+        else if(strncmp(argv[i], "--sample-max-age=", 17) == 0) {
+            sampleMaxAge = strtod(&argv[i][17], NULL);
+            if(sampleMaxAge < 0) {
+                printf("Error: --sample-max-age must not be negative\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if(strcmp(argv[i], "--concurrent-nodestore") == 0)
+            concurrentNodestore = true;
+        else if(strcmp(argv[i], "--arena") == 0)
+            arenaSize = 4096;
+        else if(strcmp(argv[i], "--arena=strict") == 0) {
+            arenaSize = 4096;
+            arenaMode = PUBSUBARENA_STRICT;
+        }
+        else if(strcmp(argv[i], "--json") == 0)
+            poolEncoding = PUBSUBPUBLISHPOOL_JSON;
+        else if(strcmp(argv[i], "--json=nonreversible") == 0)
+            poolEncoding = PUBSUBPUBLISHPOOL_JSON_NONREVERSIBLE;
+        else
+            argv[args++] = argv[i];
+    }
+    argc = args;
+    /* For the publish pool and the frozen configuration. The WriterGroups
+     * added below are registered with their own interval. */
+    txTimeConfig.publishingInterval = publishingInterval;
+    if(publishWorkers > 0 && xdp) {
+        printf("Error: --workers needs one socket per worker, not AF_XDP\n");
+        return EXIT_FAILURE;
+    }
+    if(frozen && publishWorkers > 0) {
+        printf("Error: the groups of the publish pool are not WriterGroups, "
+               "they cannot be frozen\n");
+        return EXIT_FAILURE;
+    }
+    if(arenaSize > 0 && publishWorkers == 0) {
+        printf("Error: --arena samples for the publish pool, use it with --workers\n");
+        return EXIT_FAILURE;
+    }
+    if(poolEncoding != PUBSUBPUBLISHPOOL_UADP && publishWorkers == 0) {
+        printf("Error: --json selects the encoder of the publish pool, "
+               "use it with --workers\n");
+        return EXIT_FAILURE;
+    }
+    if(arenaSize > 0 && PubSubArena_install() != UA_STATUSCODE_GOOD) {
+        printf("Error: --arena needs open62541 with UA_ENABLE_MALLOC_SINGLETON\n");
+        return EXIT_FAILURE;
+    }
+    if(txTime && (ethMmap || xdp)) {
+        printf("Error: --txtime needs the UDP or the Ethernet layer of open62541\n");
+        return EXIT_FAILURE;
+    }
+
     if (argc > 1) {
         if (strcmp(argv[1], "-h") == 0) {
             usage(argv[0]);
             return EXIT_SUCCESS;
         } else if (strncmp(argv[1], "opc.udp://", 10) == 0) {
             networkAddressUrl.url = UA_STRING(argv[1]);
+        } else if (strncmp(argv[1], "opc.mqtt://", 11) == 0) {
+            transportProfile = UA_STRING(PUBSUBMQTT_PROFILE);
+            networkAddressUrl.url = UA_STRING(argv[1]);
         } else if (strncmp(argv[1], "opc.eth://", 10) == 0) {
-            transportProfile =
+            transportProfile = xdp ? UA_STRING(PUBSUBETHERNETXDP_PROFILE) :
                 UA_STRING("http://opcfoundation.org/UA-Profile/Transport/pubsub-eth-uadp");
             if (argc < 3) {
                 printf("Error: UADP/ETH needs an interface name\n");
@@ -48,14 +48,65 @@
 
 #include <stdio.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#include "concurrent_nodestore.h"
+#include "pubsub_aggregator.h"
+#include "pubsub_ethernet_mmap.h"
+#include "pubsub_ethernet_xdp.h"
+#include "pubsub_frozen_config.h"
+#include "pubsub_probe.h"
+#include "pubsub_seq_tracker.h"
+#include "pubsub_timer_wheel.h"
+#include "pubsub_shm_ring.h"
+
 UA_NodeId connectionIdentifier;
 UA_NodeId readerGroupIdentifier;
 UA_NodeId readerIdentifier;
 
 UA_DataSetReaderConfig readerConfig;
 
+/* Optional local fan-out of the received fields, see pubsub_shm_ring.h */
+const char *shmName = NULL;
+PubSubShmRing shmRing;
+
+/* Optional latency probes, see pubsub_probe.h */
+UA_Boolean probe = false;
+
+/* Drop duplicates and count lost messages, see pubsub_seq_tracker.h */
+UA_Boolean seqTracking = false;
+
+/* messageReceiveTimeout of the DataSetReader in ms, 0 disables. The
+ * timeout is taken from the configuration of the DataSetReader and runs on
+ * the timer wheel, see pubsub_timer_wheel.h */
+UA_Double receiveTimeout = 0;
+UA_UInt64 receiveTimeoutId;
+
+/* Use the PACKET_MMAP Ethernet layer, see pubsub_ethernet_mmap.h */
+UA_Boolean ethMmap = false;
+
+/* Use the AF_XDP layer for opc.eth addresses, see pubsub_ethernet_xdp.h */
+UA_Boolean xdp = false;
+
+/* Build the PubSub configuration as one frozen block, see
+ * pubsub_frozen_config.h. The block can be saved to a file and loaded from
+ * it at the next start. */
+UA_Boolean frozen = false;
+PubSubFrozenConfig *frozenConfig = NULL;
+const char *saveConfigPath = NULL;
+const char *loadConfigPath = NULL;
+
+/* Keep the information model, with the TargetVariables, in a nodestore that
+ * worker threads can write without the server lock, see
+ * concurrent_nodestore.h */
+UA_Boolean concurrentNodestore = false;
+
+/* Aggregate the fields per window of ms into aggregate nodes, see
+ * pubsub_aggregator.h. Sliding windows if the hop is shorter. */
+PubSubAggregatorConfig aggregatorConfig = {0, 0};
+PubSubAggregator *aggregator = NULL;
+
 static void fillTestDataSetMetaData(UA_DataSetMetaDataType *pMetaData);
 
 /* Add new connection to the server */
@@ -139,6 +190,7 @@ addDataSetReader(UA_Server *server) {
     readerConfig.publisherId.data = &publisherIdentifier;
     readerConfig.writerGroupId    = 100;
     readerConfig.dataSetWriterId  = 62541;
+    readerConfig.messageReceiveTimeout = receiveTimeout;
 
 
     /* Setting up Meta data configuration in DataSetReader */
@@ -149,6 +201,106 @@ addDataSetReader(UA_Server *server) {
     return retval;
 }
 
+/**
+ * **TargetVariable callbacks**
+ *
+ * Local consumers read the received fields from a shared-memory ring instead
+ * of connecting back over opc.tcp. The DataSetReader writes every field into
+ * its TargetVariable. The onWrite callback of the TargetVariable appends the
+ * value to the ring. The index of the field is stored in the node context.
+ *
+ * The same callback records the DECODE, DISPATCH and receive-to-TargetVariable
+ * latency probes and restarts the messageReceiveTimeout with the last field of the message. */
+static void
+receiveTimeoutExpired(UA_Server *server, void *data) {
+    UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                   "No DataSetMessage received for %.0f ms",
+                   readerConfig.messageReceiveTimeout);
+}
+
+static void
+targetVariableWritten(UA_Server *server, const UA_NodeId *sessionId,
+                      void *sessionContext, const UA_NodeId *nodeId,
+                      void *nodeContext, const UA_NumericRange *range,
+                      const UA_DataValue *data) {
+    /* The fields are written in order. The message is decoded before the
+     * first write, and the last write ends the message. */
+    size_t field = (size_t)(uintptr_t)nodeContext;
+    if(field == 0)
+        PubSubProbe_recordSplit(PUBSUBPROBE_DECODE);
+    if(field + 1 == readerConfig.dataSetMetaData.fieldsSize) {
+        PubSubProbe_recordSplit(PUBSUBPROBE_DISPATCH);
+        PubSubProbe_recordSinceMark(PUBSUBPROBE_TARGETWRITE);
+        if(readerConfig.messageReceiveTimeout > 0)
+            PubSubTimerWheel_resetTimeout(receiveTimeoutId);
+    }
+    if(shmName)
+        PubSubShmRing_write(&shmRing, (UA_UInt16)field, data);
+    if(aggregator && data->hasValue)
+        PubSubAggregator_addSample(aggregator, field, &data->value);
+}
+
+static void
+nodestoreReport(UA_Server *server, void *data) {
+    ConcurrentNodestoreStats stats;
+    ConcurrentNodestore_getStats(&UA_Server_getConfig(server)->nodestore, &stats);
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                "Nodestore: %lu nodes, %lu replaced, %lu conflicts, "
+                "%lu retired, %lu reclaimed", (unsigned long)stats.nodes,
+                (unsigned long)stats.replaced, (unsigned long)stats.conflicts,
+                (unsigned long)stats.retired, (unsigned long)stats.reclaimed);
+}
+
+static UA_StatusCode
+watchTargetVariable(UA_Server *server, const UA_NodeId targetVariable) {
+    if(!shmName && !probe && readerConfig.messageReceiveTimeout <= 0 && !aggregator)
+        return UA_STATUSCODE_GOOD;
+    UA_ValueCallback callback;
+    memset(&callback, 0, sizeof(UA_ValueCallback));
+    callback.onWrite = targetVariableWritten;
+    return UA_Server_setVariableNode_valueCallback(server, targetVariable, callback);
+}
+
+static UA_StatusCode
+addSharedMemoryFanOut(UA_Server *server) {
+    size_t fieldsSize = readerConfig.dataSetMetaData.fieldsSize;
+    UA_String *names = (UA_String*)UA_calloc(fieldsSize, sizeof(UA_String));
+    const UA_DataType **types = (const UA_DataType**)
+        UA_calloc(fieldsSize, sizeof(UA_DataType*));
+    if(!names || !types) {
+        UA_free(names);
+        UA_free(types);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    for(size_t i = 0; i < fieldsSize; i++) {
+        names[i] = readerConfig.dataSetMetaData.fields[i].name;
+        types[i] = UA_findDataType(&readerConfig.dataSetMetaData.fields[i].dataType);
+    }
+    UA_StatusCode retval =
+        PubSubShmRing_create(&shmRing, shmName, 1024, fieldsSize, names, types);
+    UA_free(names);
+    UA_free(types);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_LOG_ERROR(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                     "Cannot create the shared-memory ring %s", shmName);
+        return retval;
+    }
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                "Received fields are published to the shared-memory ring %s", shmName);
+    return retval;
+}
+
+/* The nodeContext of the TargetVariables is the field index */
+static UA_StatusCode
+addAggregator(UA_Server *server, const UA_NodeId parent, size_t fieldsSize,
+              const UA_String *names) {
+    if(aggregatorConfig.windowMs <= 0)
+        return UA_STATUSCODE_GOOD;
+    aggregator = PubSubAggregator_new(server, &aggregatorConfig, parent,
+                                      fieldsSize, names);
+    return aggregator ? UA_STATUSCODE_GOOD : UA_STATUSCODE_BADINTERNALERROR;
+}
+
 /**
  * **SubscribedDataSet**
  *
@@ -206,7 +358,7 @@ addSubscribedVariables (UA_Server *server, UA_NodeId dataSetReaderId) {
                                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
                                            UA_QUALIFIEDNAME(1, (char *)readerConfig.dataSetMetaData.fields[i].name.data),
                                            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-                                           vAttr, NULL, &newNode);
+                                           vAttr, (void*)(uintptr_t)i, &newNode);
 
         /* For creating Targetvariables */
         UA_FieldTargetDataType_init(&targetVars[i].targetVariable);
@@ -216,6 +368,19 @@ addSubscribedVariables (UA_Server *server, UA_NodeId dataSetReaderId) {
 
     retval = UA_Server_DataSetReader_createTargetVariables(server, dataSetReaderId,
                                                            readerConfig.dataSetMetaData.fieldsSize, targetVars);
+    if(retval == UA_STATUSCODE_GOOD && shmName)
+        retval = addSharedMemoryFanOut(server);
+    if(retval == UA_STATUSCODE_GOOD && aggregatorConfig.windowMs > 0) {
+        size_t fieldsSize = readerConfig.dataSetMetaData.fieldsSize;
+        UA_String *names = (UA_String*)UA_calloc(fieldsSize, sizeof(UA_String));
+        for(size_t i = 0; names && i < fieldsSize; i++)
+            names[i] = readerConfig.dataSetMetaData.fields[i].name;
+        retval = names ? addAggregator(server, folderId, fieldsSize, names) :
+            UA_STATUSCODE_BADOUTOFMEMORY;
+        UA_free(names);
+    }
+    for(size_t i = 0; i < readerConfig.dataSetMetaData.fieldsSize; i++)
+        retval |= watchTargetVariable(server, targetVars[i].targetVariable.targetNodeId);
     for(size_t i = 0; i < readerConfig.dataSetMetaData.fieldsSize; i++)
         UA_FieldTargetDataType_clear(&targetVars[i].targetVariable);
 
@@ -282,6 +447,102 @@ static void fillTestDataSetMetaData(UA_DataSetMetaDataType *pMetaData) {
     pMetaData->fields[3].valueRank = -1; /* scalar */
 }
 
+/**
+ * **Frozen configuration**
+ *
+ * With ``--frozen``, the connection, ReaderGroup, DataSetReader and
+ * TargetVariables from above are described in a frozen configuration. It is
+ * laid out in one read-only block and applied to the server at once. The
+ * ReaderGroup is frozen afterwards, so the server rejects changes to it.
+ * See pubsub_frozen_config.h.
+ *
+ * ``--save-config=<file>`` writes the block to a file.
+ * ``--load-config=<file>`` maps it at the next start instead of building it
+ * call by call. */
+static UA_StatusCode
+buildFrozenConfiguration(const UA_DataSetMetaDataType *metaData,
+                         UA_String *transportProfile,
+                         UA_NetworkAddressUrlDataType *networkAddressUrl) {
+    PubSubFrozenConfigBuilder *builder = PubSubFrozenConfigBuilder_new();
+    if(!builder)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    UA_String connectionName = UA_STRING("UDPMC Connection 1");
+    UA_String groupName = UA_STRING("ReaderGroup1");
+    UA_String readerName = UA_STRING("DataSet Reader 1");
+    UA_UInt32 connection, readerGroup, reader;
+    UA_StatusCode retval =
+        PubSubFrozenConfigBuilder_addConnection(builder, &connectionName, transportProfile,
+                                                networkAddressUrl, UA_UInt32_random(),
+                                                &connection);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = PubSubFrozenConfigBuilder_addReaderGroup(builder, connection, &groupName,
+                                                          &readerGroup);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = PubSubFrozenConfigBuilder_addDataSetReader(builder, readerGroup,
+                                                            &readerName, 2234, 100, 62541,
+                                                            receiveTimeout,
+                                                            &metaData->name, &reader);
+    for(size_t i = 0; i < metaData->fieldsSize && retval == UA_STATUSCODE_GOOD; i++) {
+        UA_NodeId targetVariable = UA_NODEID_NUMERIC(1, (UA_UInt32)i + 50000);
+        retval = PubSubFrozenConfigBuilder_addReaderField(builder, reader,
+                                                          &metaData->fields[i].name,
+                                                          &metaData->fields[i].dataType,
+                                                          &targetVariable);
+    }
+    if(retval == UA_STATUSCODE_GOOD) {
+        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_USERLAND,
+                    "Freezing the PubSub configuration into %lu bytes",
+                    (unsigned long)PubSubFrozenConfigBuilder_footprint(builder));
+        retval = PubSubFrozenConfig_freeze(builder, 0, &frozenConfig);
+    }
+    PubSubFrozenConfigBuilder_delete(builder);
+    return retval;
+}
+
+static UA_StatusCode
+addFrozenConfiguration(UA_Server *server, UA_String *transportProfile,
+                       UA_NetworkAddressUrlDataType *networkAddressUrl) {
+    fillTestDataSetMetaData(&readerConfig.dataSetMetaData);
+    UA_DataSetMetaDataType *metaData = &readerConfig.dataSetMetaData;
+    UA_StatusCode retval;
+    if(loadConfigPath)
+        retval = PubSubFrozenConfig_load(loadConfigPath, &frozenConfig);
+    else
+        retval = buildFrozenConfiguration(metaData, transportProfile, networkAddressUrl);
+    if(retval == UA_STATUSCODE_GOOD && saveConfigPath)
+        retval = PubSubFrozenConfig_save(frozenConfig, saveConfigPath);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = PubSubFrozenConfig_apply(frozenConfig, server);
+
+    /* The TargetVariables are listed in the block */
+    if(retval == UA_STATUSCODE_GOOD && shmName)
+        retval = addSharedMemoryFanOut(server);
+    if(retval == UA_STATUSCODE_GOOD && aggregatorConfig.windowMs > 0) {
+        PubSubFrozenView view;
+        PubSubFrozenConfig_getView(frozenConfig, &view);
+        UA_String *names = (UA_String*)UA_calloc(view.readerFieldsSize, sizeof(UA_String));
+        for(size_t i = 0; names && i < view.readerFieldsSize; i++)
+            names[i] = PubSubFrozenConfig_getString(frozenConfig, view.readerFields[i].name);
+        retval = names ? addAggregator(server, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                       view.readerFieldsSize, names) :
+            UA_STATUSCODE_BADOUTOFMEMORY;
+        UA_free(names);
+    }
+    if(retval == UA_STATUSCODE_GOOD) {
+        PubSubFrozenView view;
+        PubSubFrozenConfig_getView(frozenConfig, &view);
+        if(view.dataSetReadersSize > 0)
+            readerConfig.messageReceiveTimeout = view.dataSetReaders[0].messageReceiveTimeout;
+        for(size_t i = 0; i < view.readerFieldsSize; i++)
+            retval |= watchTargetVariable(server,
+                          PubSubFrozenConfig_getNodeId(frozenConfig,
+                                                       &view.readerFields[i].targetVariable));
+    }
+    UA_free(metaData->fields);
+    return retval;
+}
+
 /**
  * Followed by the main server code, making use of the above definitions */
 UA_Boolean running = true;
@@ -290,24 +551,60 @@ static void stopHandler(int sign) {
     running = false;
 }
 
+/* Duplicates are dropped before the probes see them */
+static UA_PubSubTransportLayer
+wrapLayer(UA_PubSubTransportLayer layer) {
+    if(seqTracking)
+        layer = PubSubSeqTracker_wrapTransportLayer(layer);
+    if(probe)
+        layer = PubSubProbe_wrapTransportLayer(layer);
+    return layer;
+}
+
 static int
 run(UA_String *transportProfile, UA_NetworkAddressUrlDataType *networkAddressUrl) {
     signal(SIGINT, stopHandler);
     signal(SIGTERM, stopHandler);
     /* Return value initialized to Status Good */
     UA_StatusCode retval = UA_STATUSCODE_GOOD;
-    UA_Server *server = UA_Server_new();
+    UA_Server *server;
+    if(concurrentNodestore) {
+        /* The nodestore is set up before the server fills it with namespace 0 */
+        UA_ServerConfig serverConfig;
+        memset(&serverConfig, 0, sizeof(UA_ServerConfig));
+        UA_ServerConfig_setMinimal(&serverConfig, 4801, NULL);
+        /* Replace the default nodestore only once the new one exists, so
+         * that the config can be cleaned on failure */
+        UA_Nodestore nodestore;
+        if(ConcurrentNodestore_init(&nodestore, 0) != UA_STATUSCODE_GOOD) {
+            UA_ServerConfig_clean(&serverConfig);
+            return EXIT_FAILURE;
+        }
+        serverConfig.nodestore.clear(serverConfig.nodestore.context);
+        serverConfig.nodestore = nodestore;
+        server = UA_Server_newWithConfig(&serverConfig);
+    } else {
+        server = UA_Server_new();
+        if(server)
+            UA_ServerConfig_setMinimal(UA_Server_getConfig(server), 4801, NULL);
+    }
+    if(!server)
+        return EXIT_FAILURE;
     UA_ServerConfig *config = UA_Server_getConfig(server);
-    UA_ServerConfig_setMinimal(config, 4801, NULL);
 
     /* Add the PubSub network layer implementation to the server config.
      * The TransportLayer is acting as factory to create new connections
      * on runtime. Details about the PubSubTransportLayer can be found inside the
      * tutorial_pubsub_connection */
-    UA_ServerConfig_addPubSubTransportLayer(config, UA_PubSubTransportLayerUDPMP());
+    UA_ServerConfig_addPubSubTransportLayer(config,
+                                            wrapLayer(UA_PubSubTransportLayerUDPMP()));
 #ifdef UA_ENABLE_PUBSUB_ETH_UADP
-    UA_ServerConfig_addPubSubTransportLayer(config, UA_PubSubTransportLayerEthernet());
+    UA_PubSubTransportLayer ethLayer = ethMmap ?
+        PubSubEthernetMmap_transportLayer() : UA_PubSubTransportLayerEthernet();
+    UA_ServerConfig_addPubSubTransportLayer(config, wrapLayer(ethLayer));
 #endif
+    UA_ServerConfig_addPubSubTransportLayer(config,
+                                            wrapLayer(PubSubEthernetXdp_transportLayer()));
 
 
 
@@ -319,44 +616,116 @@ run(UA_String *transportProfile, UA_NetworkAddressUrlDataType *networkAddressUrl
 
 
 
-    /* API calls */
-    /* Add PubSubConnection */
-    retval |= addPubSubConnection(server, transportProfile, networkAddressUrl);
-    if (retval != UA_STATUSCODE_GOOD)
-        return EXIT_FAILURE;
+    if(frozen) {
+        retval = addFrozenConfiguration(server, transportProfile, networkAddressUrl);
+        if(retval != UA_STATUSCODE_GOOD)
+            return EXIT_FAILURE;
+    } else {
+        /* API calls */
+        /* Add PubSubConnection */
+        retval |= addPubSubConnection(server, transportProfile, networkAddressUrl);
+        if (retval != UA_STATUSCODE_GOOD)
+            return EXIT_FAILURE;
 
-    /* Add ReaderGroup to the created PubSubConnection */
-    retval |= addReaderGroup(server);
-    if (retval != UA_STATUSCODE_GOOD)
-        return EXIT_FAILURE;
+        /* Add ReaderGroup to the created PubSubConnection */
+        retval |= addReaderGroup(server);
+        if (retval != UA_STATUSCODE_GOOD)
+            return EXIT_FAILURE;
 
-    /* Add DataSetReader to the created ReaderGroup */
-    retval |= addDataSetReader(server);
-    if (retval != UA_STATUSCODE_GOOD)
-        return EXIT_FAILURE;
+        /* Add DataSetReader to the created ReaderGroup */
+        retval |= addDataSetReader(server);
+        if (retval != UA_STATUSCODE_GOOD)
+            return EXIT_FAILURE;
 
-    /* Add SubscribedVariables to the created DataSetReader */
-    retval |= addSubscribedVariables(server, readerIdentifier);
-    if (retval != UA_STATUSCODE_GOOD)
-        return EXIT_FAILURE;
+        /* Add SubscribedVariables to the created DataSetReader */
+        retval |= addSubscribedVariables(server, readerIdentifier);
+        if (retval != UA_STATUSCODE_GOOD)
+            return EXIT_FAILURE;
+    }
+
+    /* Expose the latency probes below the Server object */
+    if(probe) {
+        PubSubProbe_setEnabled(true);
+        PubSubProbe_addDiagnosticsNodes(server, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER));
+        PubSubProbe_addPeriodicDump(server, 10000, NULL);
+    }
+    if(seqTracking)
+        PubSubSeqTracker_addDiagnosticsNodes(server, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER));
+    if(readerConfig.messageReceiveTimeout > 0) {
+        retval = PubSubTimerWheel_addTimeout(server, receiveTimeoutExpired, NULL,
+                                             readerConfig.messageReceiveTimeout,
+                                             &receiveTimeoutId);
+        if(retval != UA_STATUSCODE_GOOD)
+            return EXIT_FAILURE;
+    }
+    if(concurrentNodestore)
+        UA_Server_addRepeatedCallback(server, nodestoreReport, NULL, 10000, NULL);
 
 
 
 
-    retval = UA_Server_run(server, &running);
+    retval = PubSubTimerWheel_runServer(server, &running);
+    if(readerConfig.messageReceiveTimeout > 0)
+        PubSubTimerWheel_removeCallback(receiveTimeoutId);
+    PubSubAggregator_delete(aggregator);
     UA_Server_delete(server);
+    PubSubTimerWheel_shutdown();
+    if(frozenConfig)
+        PubSubFrozenConfig_delete(frozenConfig);
+    if(shmName)
+        PubSubShmRing_close(&shmRing);
     return retval == UA_STATUSCODE_GOOD ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 static void
 usage(char *progname) {
-    printf("usage: %s <uri> [device]\n", progname);
+    printf("usage: %s <uri> [device] [--shm=<name>] [--probe] [--eth-mmap] [--xdp]\n"
+           "       [--seq] [--timeout=<ms>] [--frozen] [--save-config=<file>]\n"
+           "       [--load-config=<file>] [--concurrent-nodestore]\n"
+           "       [--aggregate=<window ms>] [--aggregate-hop=<ms>]\n", progname);
 }
 
 
 int main(int argc, char **argv) {
     UA_String transportProfile = UA_STRING("http://opcfoundation.org/UA-Profile/Transport/pubsub-udp-uadp");
     UA_NetworkAddressUrlDataType networkAddressUrl = {UA_STRING_NULL , UA_STRING("opc.udp://224.0.0.22:4840/")};
+
+    /* Strip the options, the remaining arguments are positional */
+    int args = 1;
+    for(int i = 1; i < argc; i++) {
+        if(strncmp(argv[i], "--shm=", 6) == 0)
+            shmName = &argv[i][6];
+        else if(strcmp(argv[i], "--probe") == 0)
+            probe = true;
+        else if(strcmp(argv[i], "--seq") == 0)
+            seqTracking = true;
+        else if(strncmp(argv[i], "--timeout=", 10) == 0)
+            receiveTimeout = strtod(&argv[i][10], NULL);
+        else if(strcmp(argv[i], "--eth-mmap") == 0)
+            ethMmap = true;
+        else if(strcmp(argv[i], "--xdp") == 0)
+            xdp = true;
+        else if(strcmp(argv[i], "--concurrent-nodestore") == 0)
+            concurrentNodestore = true;
+        else if(strncmp(argv[i], "--aggregate=", 12) == 0)
+            aggregatorConfig.windowMs = strtod(&argv[i][12], NULL);
+        else if(strncmp(argv[i], "--aggregate-hop=", 16) == 0)
+            aggregatorConfig.hopMs = strtod(&argv[i][16], NULL);
+        else if(strcmp(argv[i], "--frozen") == 0)
+            frozen = true;
+        else if(strncmp(argv[i], "--save-config=", 14) == 0) {
+            frozen = true;
+            saveConfigPath = &argv[i][14];
+        }
+        else if(strncmp(argv[i], "--load-config=", 14) == 0) {
+            frozen = true;
+            loadConfigPath = &argv[i][14];
+        }
+        else
+            argv[args++] = argv[i];
+    }
+    argc = args;
+
     if(argc > 1) {
         if(strcmp(argv[1], "-h") == 0) {
             usage(argv[0]);
@@ -364,7 +733,7 @@ int main(int argc, char **argv) {
         } else if(strncmp(argv[1], "opc.udp://", 10) == 0) {
             networkAddressUrl.url = UA_STRING(argv[1]);
         } else if(strncmp(argv[1], "opc.eth://", 10) == 0) {
-            transportProfile =
+            transportProfile = xdp ? UA_STRING(PUBSUBETHERNETXDP_PROFILE) :
                 UA_STRING("http://opcfoundation.org/UA-Profile/Transport/pubsub-eth-uadp");
             if(argc < 3) {
                 printf("Error: UADP/ETH needs an interface name\n");